@@ -0,0 +1,7 @@
+find_path(LZ4_INCLUDE_DIR NAMES lz4frame.h)
+find_library(LZ4_LIBRARIES NAMES lz4)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4 DEFAULT_MSG LZ4_LIBRARIES LZ4_INCLUDE_DIR)
+
+mark_as_advanced(LZ4_INCLUDE_DIR LZ4_LIBRARIES)
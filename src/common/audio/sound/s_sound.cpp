@@ -49,6 +49,7 @@
 #include "s_loader.h"
 #include "g_levellocals.h"
 #include "i_time.h"
+#include "filesystem.h"
 
 CVARD(Bool, snd_enabled, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG, "enables/disables sound effects")
 CVAR(Bool, i_soundinbackground, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
@@ -150,6 +151,24 @@ void SoundEngine::CacheMarkedSounds()
 		MarkUsed(chan->SoundID);
 	}
 
+	// @Cockatrice - Read all sound lumps that are about to be loaded in one parallel batch
+	if (GSnd && !GSnd->IsNull())
+	{
+		TArray<int> lumps;
+		for (unsigned i = 1; i < S_sfx.Size(); ++i)
+		{
+			if (!S_sfx[i].bUsed || S_sfx[i].bTentative) continue;
+
+			sfxinfo_t* sfx = &S_sfx[i];
+			while (!sfx->bRandomHeader && isValidSoundId(sfx->link))
+			{
+				sfx = &S_sfx[sfx->link.index()];
+			}
+			if (!sfx->bRandomHeader && !sfx->data.isValid() && sfx->lumpnum >= 0) lumps.Push(sfx->lumpnum);
+		}
+		fileSystem.PrefetchLumps(lumps.Data(), lumps.Size());
+	}
+
 	for (unsigned i = 1; i < S_sfx.Size(); ++i)
 	{
 		if (S_sfx[i].bUsed)
@@ -37,7 +37,6 @@
 #define RAPIDJSON_HAS_CXX11_RANGE_FOR 1
 #define RAPIDJSON_PARSE_DEFAULT_FLAGS kParseFullPrecisionFlag
 
-#include <miniz.h>
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/prettywriter.h"
@@ -60,6 +59,8 @@
 
 using namespace FileSys;
 
+FCompressedBuffer CompressZipEntry(const char *filename, const void *data, size_t size, int method, int level);
+
 extern DObject *WP_NOCHANGE;
 bool save_full = false;	// for testing. Should be removed afterward.
 
@@ -118,18 +119,266 @@ const char *UnicodeToString(const char *cc)
 	return &out[0];
 }
 
+//==========================================================================
+//
+// Feeds a binary document to rapidjson's SAX handler interface.
+// Numbers are reported with the same handler the text parser would pick
+// for them so that the resulting values have identical type flags.
+//
+//==========================================================================
+
+struct FBinaryGenerator
+{
+	struct FLevel
+	{
+		bool isObject;
+		bool haveKey;
+		unsigned count;
+	};
+
+	const uint8_t *p, *end;
+	TArray<FString> keys;
+	TArray<FLevel> levels;
+
+	bool ReadVarint(uint64_t &v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 64 && p < end; shift += 7)
+		{
+			uint8_t b = *p++;
+			v |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) return true;
+		}
+		return false;
+	}
+
+	bool ReadBytes(const char *&data, unsigned &length)
+	{
+		uint64_t len;
+		if (!ReadVarint(len) || len > uint64_t(end - p)) return false;
+		data = (const char *)p;
+		length = (unsigned)len;
+		p += len;
+		return true;
+	}
+
+	uint64_t ReadRaw(int size)
+	{
+		uint64_t v = 0;
+		for (int i = 0; i < size; i++) v |= uint64_t(p[i]) << (i * 8);
+		p += size;
+		return v;
+	}
+
+	template<class Handler> bool Integer(Handler &h, uint64_t v)
+	{
+		return v <= UINT_MAX ? h.Uint((unsigned)v) : h.Uint64(v);
+	}
+
+	template<class Handler> bool Negative(Handler &h, int64_t v)
+	{
+		return v >= INT_MIN ? h.Int((int)v) : h.Int64(v);
+	}
+
+	// Checks that a value may appear here and counts it.
+	bool Value(unsigned num = 1)
+	{
+		if (levels.Size() == 0) return false;
+		auto &level = levels.Last();
+		if (level.isObject)
+		{
+			if (!level.haveKey || num != 1) return false;
+			level.haveKey = false;
+		}
+		level.count += num;
+		return true;
+	}
+
+	template<class Handler> bool NumberBlock(Handler &h)
+	{
+		uint64_t count;
+		if (p >= end) return false;
+		int kind = *p >> 4, size = *p & 15;
+		p++;
+		if (size != 1 && size != 2 && size != 4 && size != 8) return false;
+		if (kind == BK_Float && size != 4 && size != 8) return false;
+		if (!ReadVarint(count) || count > uint64_t(end - p) / size || !Value((unsigned)count)) return false;
+
+		for (uint64_t i = 0; i < count; i++)
+		{
+			uint64_t v = ReadRaw(size);
+			switch (kind)
+			{
+			case BK_Unsigned:
+				Integer(h, v);
+				break;
+
+			case BK_Signed:
+			{
+				int64_t sv = int64_t(v << (64 - size * 8)) >> (64 - size * 8);
+				if (sv >= 0) Integer(h, sv);
+				else Negative(h, sv);
+				break;
+			}
+
+			case BK_Float:
+				if (size == 4)
+				{
+					uint32_t bits = (uint32_t)v;
+					float f;
+					memcpy(&f, &bits, 4);
+					h.Double(f);
+				}
+				else
+				{
+					double d;
+					memcpy(&d, &v, 8);
+					h.Double(d);
+				}
+				break;
+
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<class Handler> bool operator()(Handler &h)
+	{
+		bool done = false;
+		while (p < end && !done)
+		{
+			uint64_t v;
+			const char *str;
+			unsigned len;
+
+			switch (*p++)
+			{
+			case BT_Null:
+				if (!Value()) return false;
+				h.Null();
+				break;
+
+			case BT_False:
+			case BT_True:
+				if (!Value()) return false;
+				h.Bool(p[-1] == BT_True);
+				break;
+
+			case BT_Uint:
+				if (!Value() || !ReadVarint(v)) return false;
+				Integer(h, v);
+				break;
+
+			case BT_Negative:
+				if (!Value() || !ReadVarint(v)) return false;
+				Negative(h, (int64_t)~v);
+				break;
+
+			case BT_Float:
+			{
+				if (!Value() || end - p < 4) return false;
+				uint32_t bits = (uint32_t)ReadRaw(4);
+				float f;
+				memcpy(&f, &bits, 4);
+				h.Double(f);
+				break;
+			}
+
+			case BT_Double:
+			{
+				if (!Value() || end - p < 8) return false;
+				uint64_t bits = ReadRaw(8);
+				double d;
+				memcpy(&d, &bits, 8);
+				h.Double(d);
+				break;
+			}
+
+			case BT_String:
+				if (!Value() || !ReadBytes(str, len)) return false;
+				h.String(str, len, true);
+				break;
+
+			case BT_StartObject:
+			case BT_StartArray:
+			{
+				// The root has to be an object or array.
+				if (levels.Size() > 0 && !Value()) return false;
+				bool isObject = p[-1] == BT_StartObject;
+				if (isObject) h.StartObject();
+				else h.StartArray();
+				levels.Push({ isObject, false, 0 });
+				break;
+			}
+
+			case BT_EndObject:
+			case BT_EndArray:
+			{
+				if (levels.Size() == 0) return false;
+				auto level = levels.Last();
+				if (level.isObject != (p[-1] == BT_EndObject) || level.haveKey) return false;
+				levels.Pop();
+				if (level.isObject) h.EndObject(level.count);
+				else h.EndArray(level.count);
+				done = levels.Size() == 0;
+				break;
+			}
+
+			case BT_NewKey:
+			case BT_Key:
+			{
+				if (levels.Size() == 0 || !levels.Last().isObject || levels.Last().haveKey) return false;
+				if (p[-1] == BT_NewKey)
+				{
+					if (!ReadBytes(str, len)) return false;
+					keys.Push(FString(str, len));
+				}
+				else
+				{
+					if (!ReadVarint(v) || v >= keys.Size()) return false;
+					str = keys[(unsigned)v].GetChars();
+					len = (unsigned)keys[(unsigned)v].Len();
+				}
+				levels.Last().haveKey = true;
+				h.Key(str, len, true);
+				break;
+			}
+
+			case BT_NumberBlock:
+				if (!NumberBlock(h)) return false;
+				break;
+
+			default:
+				return false;
+			}
+		}
+		return done;
+	}
+};
+
+bool ReadBinaryDocument(rapidjson::Document &doc, const char *buffer, size_t length)
+{
+	FBinaryGenerator gen;
+	gen.p = (const uint8_t *)buffer;
+	gen.end = gen.p + length;
+	doc.Populate(gen);
+	return !doc.IsNull();
+}
+
 //==========================================================================
 //
 //
 //
 //==========================================================================
 
-bool FSerializer::OpenWriter(bool pretty)
+bool FSerializer::OpenWriter(bool pretty, bool binary)
 {
 	if (w != nullptr || r != nullptr) return false;
 
 	mErrors = 0;
-	w = new FWriter(pretty);
+	w = new FWriter(pretty, binary);
 	BeginObject(nullptr);
 	return true;
 }
@@ -449,7 +698,7 @@ FSerializer &FSerializer::ScriptNum(const char *key, int &num)
 			}
 			else if (val->IsString())
 			{
-				num = -FName(UnicodeToString(val->GetString())).GetIndex();
+				num = -FName(r->GetString(*val)).GetIndex();
 			}
 			else
 			{
@@ -522,7 +771,7 @@ FSerializer &FSerializer::StringPtr(const char *key, const char *&charptr)
 		{
 			if (val->IsString())
 			{
-				charptr = UnicodeToString(val->GetString());
+				charptr = r->GetString(*val);
 			}
 			else
 			{
@@ -766,58 +1015,100 @@ const char *FSerializer::GetOutput(unsigned *len)
 //==========================================================================
 
 FCompressedBuffer FSerializer::GetCompressedOutput()
+{
+	if (isReading()) return{ 0,0,0,0,0,nullptr };
+	WriteObjects();
+	EndObject();
+	return CompressZipEntry(nullptr, w->mOutString.GetString(), w->mOutString.GetSize(), METHOD_DEFLATE, 8);
+}
+
+//==========================================================================
+//
+// Leaves the compression and the CRC to whoever writes the buffer, so
+// that work can be moved off the calling thread.
+//
+//==========================================================================
+
+FCompressedBuffer FSerializer::GetUncompressedOutput()
 {
 	if (isReading()) return{ 0,0,0,0,0,nullptr };
 	FCompressedBuffer buff;
 	WriteObjects();
 	EndObject();
 	buff.filename = nullptr;
-	buff.mSize = (unsigned)w->mOutString.GetSize();
-	buff.mCRC32 = crc32(0, (const Bytef*)w->mOutString.GetString(), buff.mSize);
+	buff.mSize = buff.mCompressedSize = (unsigned)w->mOutString.GetSize();
+	buff.mCRC32 = 0;
+	buff.mMethod = METHOD_STORED;
+	buff.mBuffer = new char[buff.mSize + 1];
+	memcpy(buff.mBuffer, w->mOutString.GetString(), buff.mSize + 1);
+	return buff;
+}
+
+//==========================================================================
+//
+// Stores an array of plain numbers as a single raw block if the
+// writer supports it. Returns false if the elements need to be
+// written individually.
+//
+//==========================================================================
 
-	uint8_t *compressbuf = new uint8_t[buff.mSize+1];
+bool FSerializer::WriteNumberBlock(const void *data, unsigned count, int size, int kind)
+{
+	if (!isWriting() || !w->isBinary() || w->inObject()) return false;
+	w->mWriter3->NumberBlock(data, count, size, kind);
+	return true;
+}
 
-	z_stream stream;
-	int err;
+//==========================================================================
+//
+// Rewinding only works on complete values at the current nesting level.
+//
+//==========================================================================
 
-	stream.next_in = (Bytef *)w->mOutString.GetString();
-	stream.avail_in = (unsigned)buff.mSize;
-	stream.next_out = (Bytef*)compressbuf;
-	stream.avail_out = (unsigned)buff.mSize;
-	stream.zalloc = (alloc_func)0;
-	stream.zfree = (free_func)0;
-	stream.opaque = (voidpf)0;
+bool FSerializer::CanRewind() const
+{
+	return w != nullptr && w->isBinary();
+}
 
-	// create output in zip-compatible form as required by FCompressedBuffer
-	err = deflateInit2(&stream, 8, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY);
-	if (err != Z_OK)
-	{
-		goto error;
-	}
+size_t FSerializer::WritePosition() const
+{
+	return w->mOutString.GetSize();
+}
 
-	err = deflate(&stream, Z_FINISH);
-	if (err != Z_STREAM_END) 
-	{
-		deflateEnd(&stream);
-		goto error;
-	}
-	buff.mCompressedSize = stream.total_out;
+void FSerializer::Rewind(size_t position)
+{
+	assert(CanRewind() && position <= WritePosition());
+	w->mOutString.Pop(WritePosition() - position);
+}
 
-	err = deflateEnd(&stream);
-	if (err == Z_OK)
+bool FSerializer::WroteEmptyObject(size_t position) const
+{
+	if (!CanRewind() || WritePosition() != position + 2) return false;
+	auto data = w->mOutString.GetString() + position;
+	return data[0] == BT_StartObject && data[1] == BT_EndObject;
+}
+
+//==========================================================================
+//
+// Makes the next element read come from an empty object, so that it gets
+// the same treatment as if it had been saved as '{}'.
+//
+//==========================================================================
+
+void FSerializer::BeginEmptyElement()
+{
+	if (!isReading()) return;
+	if (!r->mEmptyElement.IsArray())
 	{
-		buff.mBuffer = new char[buff.mCompressedSize];
-		buff.mMethod = METHOD_DEFLATE;
-		memcpy(buff.mBuffer, compressbuf, buff.mCompressedSize);
-		delete[] compressbuf;
-		return buff;
+		r->mEmptyElement.SetArray();
+		r->mEmptyElement.PushBack(rapidjson::Value(rapidjson::kObjectType), r->mDoc.GetAllocator());
 	}
+	r->mObjects.Push(FJSONObject(&r->mEmptyElement));
+}
 
-error:
-	memcpy(compressbuf, w->mOutString.GetString(), buff.mSize + 1);
-	buff.mCompressedSize = buff.mSize;
-	buff.mMethod = METHOD_STORED;
-	return buff;
+void FSerializer::EndEmptyElement()
+{
+	if (isReading()) r->mObjects.Pop();
 }
 
 //==========================================================================
@@ -830,9 +1121,23 @@ FSerializer &FSerializer::SerializeMemory(const char *key, void* mem, size_t len
 {
 	if (isWriting())
 	{
+		if (w->isBinary())
+		{
+			WriteKey(key);
+			w->mWriter3->Blob(mem, length);
+			return *this;
+		}
 		auto array = base64_encode((const uint8_t*)mem, length);
 		AddString(key, (const char*)array.Data());
 	}
+	else if (r->mBinary)
+	{
+		auto val = r->FindKey(key);
+		if (val != nullptr && val->IsString())
+		{
+			memcpy(mem, val->GetString(), std::min<size_t>(length, val->GetStringLength()));
+		}
+	}
 	else
 	{
 		auto cp = GetString(key);
@@ -1187,7 +1492,7 @@ FSerializer &Serialize(FSerializer &arc, const char *key, FTextureID &value, FTe
 				assert(nameval.IsString() && typeval.IsInt());
 				if (nameval.IsString() && typeval.IsInt())
 				{
-					value = TexMan.GetTextureID(UnicodeToString(nameval.GetString()), static_cast<ETextureType>(typeval.GetInt()));
+					value = TexMan.GetTextureID(arc.r->GetString(nameval), static_cast<ETextureType>(typeval.GetInt()));
 				}
 				else
 				{
@@ -1355,7 +1660,7 @@ FSerializer &Serialize(FSerializer &arc, const char *key, FName &value, FName *d
 			assert(val->IsString());
 			if (val->IsString())
 			{
-				value = UnicodeToString(val->GetString());
+				value = arc.r->GetString(*val);
 			}
 			else
 			{
@@ -1401,7 +1706,7 @@ FSerializer &Serialize(FSerializer &arc, const char *key, FSoundID &sid, FSoundI
 			assert(val->IsString() || val->IsNull());
 			if (val->IsString())
 			{
-				sid = S_FindSound(UnicodeToString(val->GetString()));
+				sid = S_FindSound(arc.r->GetString(*val));
 			}
 			else if (val->IsNull())
 			{
@@ -1449,7 +1754,7 @@ template<> FSerializer &Serialize(FSerializer &arc, const char *key, PClass *&cl
 		{
 			if (val->IsString())
 			{
-				clst = PClass::FindClass(UnicodeToString(val->GetString()));
+				clst = PClass::FindClass(arc.r->GetString(*val));
 			}
 			else if (val->IsNull())
 			{
@@ -1495,7 +1800,7 @@ FSerializer &Serialize(FSerializer &arc, const char *key, FString &pstr, FString
 			}
 			else if (val->IsString())
 			{
-				pstr = UnicodeToString(val->GetString());
+				pstr = arc.r->GetString(*val);
 			}
 			else
 			{
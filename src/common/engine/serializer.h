@@ -73,6 +73,27 @@ public:
 	unsigned ArraySize();
 	void WriteKey(const char *key);
 	void WriteObjects();
+	bool WriteNumberBlock(const void *data, unsigned count, int size, int kind);
+
+	// Arrays of plain numbers get written as one block by the binary writer.
+	template<class T>
+	bool WriteNumbers(const T *obj, unsigned count)
+	{
+		if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value)
+		{
+			return WriteNumberBlock(obj, count, sizeof(T), std::is_floating_point<T>::value ? 2 : std::is_signed<T>::value ? 1 : 0);
+		}
+		return false;
+	}
+
+	// The binary writer can take back the values it has just written. Together with
+	// reading a skipped element as an empty object this allows storing sparse arrays.
+	bool CanRewind() const;
+	size_t WritePosition() const;
+	void Rewind(size_t position);
+	bool WroteEmptyObject(size_t position) const;
+	void BeginEmptyElement();
+	void EndEmptyElement();
 
 private:
 	virtual void CloseReaderCustom() {}
@@ -84,7 +105,7 @@ public:
 		Close();
 	}
 	void SetUniqueSoundNames() { soundNamesAreUnique = true; }
-	bool OpenWriter(bool pretty = true);
+	bool OpenWriter(bool pretty = true, bool binary = false);
 	bool OpenReader(const char *buffer, size_t length);
 	bool OpenReader(FileSys::FCompressedBuffer *input);
 	void Close();
@@ -99,6 +120,7 @@ public:
 	const char *GetKey();
 	const char *GetOutput(unsigned *len = nullptr);
 	FileSys::FCompressedBuffer GetCompressedOutput();
+	FileSys::FCompressedBuffer GetUncompressedOutput();	// stored, without CRC, for compressing it elsewhere
 	// The sprite serializer is a special case because it is needed by the VM to handle its 'spriteid' type.
 	virtual FSerializer &Sprite(const char *key, int32_t &spritenum, int32_t *def);
 	// This is only needed by the type system.
@@ -158,6 +180,10 @@ public:
 				int max = ArraySize();
 				if (max < count) count = max;
 			}
+			else if (WriteNumbers(obj, count))
+			{
+				count = 0;
+			}
 			for (int i = 0; i < count; i++)
 			{
 				Serialize(*this, nullptr, obj[i], (T*)nullptr);
@@ -181,6 +207,10 @@ public:
 				int max = ArraySize();
 				if (max < count) count = max;
 			}
+			else if (WriteNumbers(obj, count))
+			{
+				count = 0;
+			}
 			for (int i = 0; i < count; i++)
 			{
 				Serialize(*this, nullptr, obj[i], def ? &def[i] : nullptr);
@@ -289,6 +319,11 @@ FSerializer &Serialize(FSerializer &arc, const char *key, TArray<T, TT> &value,
 		}
 		value.Resize(arc.ArraySize());
 	}
+	else if (arc.WriteNumbers(value.Data(), value.Size()))
+	{
+		arc.EndArray();
+		return arc;
+	}
 	for (unsigned i = 0; i < value.Size(); i++)
 	{
 		Serialize(arc, nullptr, value[i], def? &(*def)[i] : nullptr);
@@ -25,6 +25,182 @@ struct FJSONObject
 	}
 };
 
+//==========================================================================
+//
+// Compact binary encoding of the same document a JSON writer would produce.
+//
+// Every value starts with a tag byte. Integers are stored as varints, keys
+// are written out once and afterward referenced by their index, and arrays
+// of plain numbers can be stored as a single raw little endian block.
+// The reader turns this back into the exact rapidjson DOM the text parser
+// would have built, so nothing past FReader needs to know the difference.
+//
+//==========================================================================
+
+static const char BinaryMagic[4] = { 'F', 'S', 'B', '1' };
+
+enum EBinaryTag : uint8_t
+{
+	BT_Null,
+	BT_False,
+	BT_True,
+	BT_Uint,		// varint
+	BT_Negative,	// varint of ~value
+	BT_Float,		// a double that is exactly representable as a float
+	BT_Double,
+	BT_String,		// varint length + bytes
+	BT_StartObject,
+	BT_EndObject,
+	BT_StartArray,
+	BT_EndArray,
+	BT_NewKey,		// varint length + bytes, gets the next key index
+	BT_Key,			// varint key index
+	BT_NumberBlock,	// kind << 4 | element size, varint count, raw data
+};
+
+enum EBlockKind
+{
+	BK_Unsigned,
+	BK_Signed,
+	BK_Float,
+};
+
+struct FBinaryWriter
+{
+	rapidjson::StringBuffer &mOut;
+	TArray<FString> mKeyNames;
+	TMap<FString, unsigned> mKeyIndex;
+	TMap<const char *, unsigned> mKeyCache;	// keys are mostly literals so their address is a good first guess.
+
+	FBinaryWriter(rapidjson::StringBuffer &out) : mOut(out)
+	{
+		memcpy(mOut.Push(4), BinaryMagic, 4);
+	}
+
+	void Tag(EBinaryTag tag)
+	{
+		mOut.Put((char)tag);
+	}
+
+	void Varint(uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			mOut.Put(char(v | 0x80));
+			v >>= 7;
+		}
+		mOut.Put(char(v));
+	}
+
+	void Bytes(const void *data, size_t length)
+	{
+		Varint(length);
+		if (length > 0) memcpy(mOut.Push(length), data, length);
+	}
+
+	void Key(const char *k)
+	{
+		auto cached = mKeyCache.CheckKey(k);
+		if (cached != nullptr && mKeyNames[*cached].Compare(k) == 0)
+		{
+			Tag(BT_Key);
+			Varint(*cached);
+			return;
+		}
+		FString name = k;
+		auto index = mKeyIndex.CheckKey(name);
+		if (index != nullptr)
+		{
+			Tag(BT_Key);
+			Varint(*index);
+			mKeyCache[k] = *index;
+			return;
+		}
+		unsigned newindex = mKeyNames.Push(name);
+		mKeyIndex[name] = newindex;
+		mKeyCache[k] = newindex;
+		Tag(BT_NewKey);
+		Bytes(k, name.Len());
+	}
+
+	void String(const char *k)
+	{
+		Tag(BT_String);
+		Bytes(k, strlen(k));
+	}
+
+	void Blob(const void *data, size_t length)
+	{
+		Tag(BT_String);
+		Bytes(data, length);
+	}
+
+	void Bool(bool k)
+	{
+		Tag(k ? BT_True : BT_False);
+	}
+
+	void Int64(int64_t k)
+	{
+		if (k >= 0)
+		{
+			Tag(BT_Uint);
+			Varint((uint64_t)k);
+		}
+		else
+		{
+			Tag(BT_Negative);
+			Varint(~(uint64_t)k);
+		}
+	}
+
+	void Uint64(uint64_t k)
+	{
+		Tag(BT_Uint);
+		Varint(k);
+	}
+
+	void Double(double k)
+	{
+		float f = (float)k;
+		if ((double)f == k)
+		{
+			Tag(BT_Float);
+			Raw(&f, 4);
+		}
+		else
+		{
+			Tag(BT_Double);
+			Raw(&k, 8);
+		}
+	}
+
+	void NumberBlock(const void *data, unsigned count, int size, int kind)
+	{
+		Tag(BT_NumberBlock);
+		mOut.Put(char(kind << 4 | size));
+		Varint(count);
+		auto src = (const uint8_t *)data;
+#ifdef __BIG_ENDIAN__
+		for (unsigned i = 0; i < count; i++, src += size) Raw(src, size);
+#else
+		memcpy(mOut.Push(count * size), src, count * size);
+#endif
+	}
+
+	void Raw(const void *data, int size)
+	{
+		auto dest = mOut.Push(size);
+#ifdef __BIG_ENDIAN__
+		for (int i = 0; i < size; i++) dest[i] = ((const char *)data)[size - 1 - i];
+#else
+		memcpy(dest, data, size);
+#endif
+	}
+};
+
+bool ReadBinaryDocument(rapidjson::Document &doc, const char *buffer, size_t length);
+
 //==========================================================================
 //
 // some wrapper stuff to keep the RapidJSON dependencies out of the global headers.
@@ -37,23 +213,26 @@ struct FWriter
 	typedef rapidjson::Writer<rapidjson::StringBuffer, rapidjson::UTF8<> > Writer;
 	typedef rapidjson::PrettyWriter<rapidjson::StringBuffer, rapidjson::UTF8<> > PrettyWriter;
 
-	Writer *mWriter1;
-	PrettyWriter *mWriter2;
+	Writer *mWriter1 = nullptr;
+	PrettyWriter *mWriter2 = nullptr;
+	FBinaryWriter *mWriter3 = nullptr;
 	TArray<bool> mInObject;
 	rapidjson::StringBuffer mOutString;
 	TArray<DObject *> mDObjects;
 	TMap<DObject *, int> mObjectMap;
 
-	FWriter(bool pretty)
+	FWriter(bool pretty, bool binary = false)
 	{
-		if (!pretty)
+		if (binary)
+		{
+			mWriter3 = new FBinaryWriter(mOutString);
+		}
+		else if (!pretty)
 		{
 			mWriter1 = new Writer(mOutString);
-			mWriter2 = nullptr;
 		}
 		else
 		{
-			mWriter1 = nullptr;
 			mWriter2 = new PrettyWriter(mOutString);
 		}
 	}
@@ -62,9 +241,15 @@ struct FWriter
 	{
 		if (mWriter1) delete mWriter1;
 		if (mWriter2) delete mWriter2;
+		if (mWriter3) delete mWriter3;
 	}
 
 
+	bool isBinary() const
+	{
+		return mWriter3 != nullptr;
+	}
+
 	bool inObject() const
 	{
 		return mInObject.Size() > 0 && mInObject.Last();
@@ -74,87 +259,102 @@ struct FWriter
 	{
 		if (mWriter1) mWriter1->StartObject();
 		else if (mWriter2) mWriter2->StartObject();
+		else if (mWriter3) mWriter3->Tag(BT_StartObject);
 	}
 
 	void EndObject()
 	{
 		if (mWriter1) mWriter1->EndObject();
 		else if (mWriter2) mWriter2->EndObject();
+		else if (mWriter3) mWriter3->Tag(BT_EndObject);
 	}
 
 	void StartArray()
 	{
 		if (mWriter1) mWriter1->StartArray();
 		else if (mWriter2) mWriter2->StartArray();
+		else if (mWriter3) mWriter3->Tag(BT_StartArray);
 	}
 
 	void EndArray()
 	{
 		if (mWriter1) mWriter1->EndArray();
 		else if (mWriter2) mWriter2->EndArray();
+		else if (mWriter3) mWriter3->Tag(BT_EndArray);
 	}
 
 	void Key(const char *k)
 	{
 		if (mWriter1) mWriter1->Key(k);
 		else if (mWriter2) mWriter2->Key(k);
+		else if (mWriter3) mWriter3->Key(k);
 	}
 
 	void Null()
 	{
 		if (mWriter1) mWriter1->Null();
 		else if (mWriter2) mWriter2->Null();
+		else if (mWriter3) mWriter3->Tag(BT_Null);
 	}
 
+	// The binary format stores strings as they are, only JSON needs them converted to UTF-8.
 	void StringU(const char *k, bool encode)
 	{
-		if (encode) k = StringToUnicode(k);
+		if (encode && !mWriter3) k = StringToUnicode(k);
 		if (mWriter1) mWriter1->String(k);
 		else if (mWriter2) mWriter2->String(k);
+		else if (mWriter3) mWriter3->String(k);
 	}
 
 	void String(const char *k)
 	{
-		k = StringToUnicode(k);
+		if (!mWriter3) k = StringToUnicode(k);
 		if (mWriter1) mWriter1->String(k);
 		else if (mWriter2) mWriter2->String(k);
+		else if (mWriter3) mWriter3->String(k);
 	}
 
 	void String(const char *k, int size)
 	{
-		k = StringToUnicode(k, size);
+		if (!mWriter3) k = StringToUnicode(k, size);
 		if (mWriter1) mWriter1->String(k);
 		else if (mWriter2) mWriter2->String(k);
+		else if (mWriter3) mWriter3->String(k);
 	}
 
 	void Bool(bool k)
 	{
 		if (mWriter1) mWriter1->Bool(k);
 		else if (mWriter2) mWriter2->Bool(k);
+		else if (mWriter3) mWriter3->Bool(k);
 	}
 
 	void Int(int32_t k)
 	{
 		if (mWriter1) mWriter1->Int(k);
 		else if (mWriter2) mWriter2->Int(k);
+		else if (mWriter3) mWriter3->Int64(k);
 	}
 
 	void Int64(int64_t k)
 	{
 		if (mWriter1) mWriter1->Int64(k);
 		else if (mWriter2) mWriter2->Int64(k);
+		else if (mWriter3) mWriter3->Int64(k);
 	}
 
 	void Uint(uint32_t k)
 	{
 		if (mWriter1) mWriter1->Uint(k);
 		else if (mWriter2) mWriter2->Uint(k);
+		else if (mWriter3) mWriter3->Uint64(k);
 	}
 
 	void Uint64(int64_t k)
 	{
 		if (mWriter1) mWriter1->Uint64(k);
 		else if (mWriter2) mWriter2->Uint64(k);
+		else if (mWriter3) mWriter3->Uint64(k);
 	}
 
 	void Double(double k)
@@ -167,6 +367,10 @@ struct FWriter
 		{
 			mWriter2->Double(k);
 		}
+		else if (mWriter3)
+		{
+			mWriter3->Double(k);
+		}
 	}
 
 };
@@ -183,14 +387,30 @@ struct FReader
 	rapidjson::Document mDoc;
 	TArray<DObject *> mDObjects;
 	rapidjson::Value *mKeyValue = nullptr;
+	rapidjson::Value mEmptyElement;		// [ {} ], see FSerializer::BeginEmptyElement
 	bool mObjectsRead = false;
+	bool mBinary = false;
 
 	FReader(const char *buffer, size_t length)
 	{
-		mDoc.Parse(buffer, length);
+		if (length >= 4 && !memcmp(buffer, BinaryMagic, 4))
+		{
+			mBinary = true;
+			ReadBinaryDocument(mDoc, buffer + 4, length - 4);
+		}
+		else
+		{
+			mDoc.Parse(buffer, length);
+		}
 		mObjects.Push(FJSONObject(&mDoc));
 	}
 
+	// Strings read back from JSON need to be converted from UTF-8, see FWriter::String.
+	const char *GetString(const rapidjson::Value &val)
+	{
+		return mBinary ? val.GetString() : UnicodeToString(val.GetString());
+	}
+
 	rapidjson::Value *FindKey(const char *key)
 	{
 		FJSONObject &obj = mObjects.Last();
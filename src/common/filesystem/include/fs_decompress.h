@@ -12,8 +12,10 @@ enum ECompressionMethod
 	METHOD_DEFLATE = 8,
 	METHOD_BZIP2 = 12,
 	METHOD_LZMA = 14,
+	METHOD_ZSTD = 93,
 	METHOD_XZ = 95,
 	METHOD_PPMD = 98,
+	METHOD_LZ4 = 200,			// LZ4 frame format. Not part of the Zip spec, the id is our own and outside the range the spec assigns.
 	METHOD_LZSS = 1337,			// not used in Zips - this is for Console Doom compression
 	METHOD_ZLIB = 1338,			// Zlib stream with header, used by compressed nodes.
 	METHOD_RFFCRYPT = 1339,		// not actual compression but can be put in here to make handling easier.
@@ -8,6 +8,8 @@
 
 
 
+#include <memory>
+#include <functional>
 #include "fs_files.h"
 #include "resourcefile.h"
 
@@ -28,6 +30,16 @@ struct FolderEntry
 	unsigned lumpnum;
 };
 
+struct FPrefetchStats
+{
+	size_t bytesRead;		// everything PrefetchLumps ever loaded
+	size_t bytesCached;		// currently waiting to be consumed
+	unsigned lumpsRead;
+	unsigned lumpsCached;
+	unsigned hits;			// reads that were served from the cache
+	unsigned evicted;		// prefetched lumps that were dropped without ever being read
+};
+
 class FileSystem
 {
 public:
@@ -134,6 +146,9 @@ public:
 	bool CheckFileName (int lump, const char *name) const;	// [RH] Returns true if the names match
 	unsigned GetFilesInFolder(const char *path, std::vector<FolderEntry> &result, bool atomic) const;
 
+	// All name lookups only read the tables InitHashChains builds, so once that is done
+	// they can be used from any number of threads at the same time.
+
 	int GetNumEntries() const
 	{
 		return NumEntries;
@@ -150,6 +165,18 @@ public:
 		return Files[wadnum]->GetFileName();
 	}
 
+	// Loads and decompresses a batch of lumps ahead of use, spread over ParallelFor if set.
+	// The next ReadFile or OpenFileReader call for each of them takes its data out of the cache.
+	// Stored lumps of mapped or memory backed archives are skipped since reading them is free.
+	void PrefetchLumps(const int* lumps, size_t count);
+	void ClearPrefetch();
+	void SetPrefetchLimit(size_t bytes);
+	FPrefetchStats GetPrefetchStats() const;
+
+	// Runs work(0) ... work(count - 1), possibly in parallel, and returns once all of them are done.
+	// Without it prefetching runs on the calling thread.
+	std::function<void(int count, const std::function<void(int)>& work)> ParallelFor;
+
 	int AddFromBuffer(const char* name, char* data, int size, int id, int flags);
 	FileReader* GetFileReader(int wadnum);	// Gets a FileReader object to the entire WAD
 	void InitHashChains();
@@ -174,6 +201,8 @@ protected:
 	uint32_t* FirstLumpIndex_ResId = nullptr;	// The same information for fully qualified paths from .zips
 	uint32_t* NextLumpIndex_ResId = nullptr;
 
+	std::vector<uint32_t> SortedPaths;			// lumps with a full path ordered by name, so every folder is one contiguous range
+
 	uint32_t NumEntries = 0;					// Not necessarily the same as FileInfo.Size()
 	uint32_t NumWads = 0;
 
@@ -182,6 +211,10 @@ protected:
 
 	StringPool* stringpool = nullptr;
 
+	struct PrefetchCache;
+	std::unique_ptr<PrefetchCache> prefetch;
+	bool TakePrefetched(int lump, FileData& data);
+
 private:
 	void DeleteAll();
 	void MoveLumpsInFolder(const char *);
@@ -6,12 +6,14 @@
 #include <limits.h>
 #include <vector>
 #include <string>
+#include <memory>
 #include "fs_files.h"
 #include "fs_decompress.h"
 
 namespace FileSys {
 	
 class StringPool;
+class FileMapping;
 std::string ExtractBaseName(const char* path, bool include_extension = false);
 void strReplace(std::string& str, const char* from, const char* to);
 
@@ -108,6 +110,10 @@ struct FResourceEntry
 };
 
 void SetMainThread();
+// Archives opened from here on get mapped into memory instead of read through file handles where the platform allows it.
+void SetMemoryMapping(bool on);
+// Directory for cached archive indices. Pass an empty string to disable the cache.
+void SetIndexCacheDirectory(const char* path);
 
 class FResourceFile
 {
@@ -125,6 +131,7 @@ protected:
 	uint32_t NumLumps;
 	char Hash[48];
 	StringPool* stringpool;
+	std::shared_ptr<FileMapping> Mapping;	// set if the whole container file is mapped
 
 	// for archives that can contain directories
 	virtual void SetEntryAddress(uint32_t entry)
@@ -134,6 +141,10 @@ protected:
 	bool IsFileInFolder(const char* const resPath);
 	void CheckEmbedded(uint32_t entry, LumpFilterInfo* lfi);
 
+	// Persistent copy of the processed directory, see fs_indexcache.cpp
+	bool LoadIndex(LumpFilterInfo* filter);
+	void StoreIndex(LumpFilterInfo* filter);
+
 private:
 	uint32_t FirstLump;
 
@@ -155,6 +166,10 @@ public:
 	void SetFirstLump(uint32_t f) { FirstLump = f; }
 	const char* GetHash() const { return Hash; }
 
+	// Maps the container file so uncompressed entries can be handed out without copying.
+	bool MapFile();
+	bool IsMapped() const { return Mapping != nullptr; }
+
 	int EntryCount() const { return NumLumps; }
 	int FindEntry(const char* name);
 
@@ -173,6 +188,19 @@ public:
 	// default is the safest reader type.
 	virtual FileReader GetEntryReader(uint32_t entry, int readertype = READER_NEW, int flags = READERFLAG_SEEKABLE);
 
+	// Resolves where the entry's data starts, so other threads can read it without touching shared state.
+	// Must be called from the main thread.
+	void PrepareEntry(uint32_t entry)
+	{
+		if (entry < NumLumps && (Entries[entry].Flags & RESFF_NEEDFILESTART)) SetEntryAddress(entry);
+	}
+
+	// True if reading the entry needs neither decompression nor a copy
+	bool IsDirectlyAccessible(uint32_t entry)
+	{
+		return entry < NumLumps && !(Entries[entry].Flags & RESFF_COMPRESSED) && (Mapping != nullptr || (Reader.isOpen() && Reader.GetBuffer() != nullptr));
+	}
+
 	int GetEntryFlags(uint32_t entry)
 	{
 		return (entry < NumLumps) ? Entries[entry].Flags : 0;
@@ -131,6 +131,8 @@ FZipFile::FZipFile(const char * filename, FileReader &file, StringPool* sp)
 
 bool FZipFile::Open(LumpFilterInfo* filter, FileSystemMessageFunc Printf)
 {
+	if (LoadIndex(filter)) return true;
+
 	bool zip64 = false;
 	uint32_t centraldir = Zip_FindCentralDir(Reader, &zip64);
 	int skipped = 0;
@@ -249,6 +251,12 @@ bool FZipFile::Open(LumpFilterInfo* filter, FileSystemMessageFunc Printf)
 			zip_fh->Method != METHOD_BZIP2 &&
 			zip_fh->Method != METHOD_IMPLODE &&
 			zip_fh->Method != METHOD_SHRINK &&
+#ifdef HAVE_ZSTD
+			zip_fh->Method != METHOD_ZSTD &&
+#endif
+#ifdef HAVE_LZ4
+			zip_fh->Method != METHOD_LZ4 &&
+#endif
 			zip_fh->Method != METHOD_XZ)
 		{
 			Printf(FSMessageLevel::Error, "%s: '%s' uses an unsupported compression algorithm (#%d).\n", FileName, name.c_str(), zip_fh->Method);
@@ -320,6 +328,7 @@ bool FZipFile::Open(LumpFilterInfo* filter, FileSystemMessageFunc Printf)
 
 	GenerateHash();
 	PostProcessArchive(filter);
+	StoreIndex(filter);
 	return true;
 }
 
@@ -41,6 +41,13 @@
 #include "zstring.h"
 #include "files_internal.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace FileSys {
 	
 #ifdef _WIN32
@@ -385,6 +392,62 @@ char* BufferingReader::Gets(char* strbuf, ptrdiff_t len)
 	return MemoryReader::Gets(strbuf, len);
 }
 
+//==========================================================================
+//
+// FileMapping
+//
+//==========================================================================
+
+std::shared_ptr<FileMapping> FileMapping::Map(const char* filename)
+{
+#if !defined(_WIN32) && INTPTR_MAX > INT32_MAX	// 32 bit address space is too small for large archives
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return nullptr;
+
+	struct stat info;
+	void* mem = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		mem = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);	// the mapping stays valid without the descriptor
+	if (mem == MAP_FAILED) return nullptr;
+
+	std::shared_ptr<FileMapping> map(new FileMapping);
+	map->data = (const uint8_t*)mem;
+	map->size = (size_t)info.st_size;
+
+	// Lumps are accessed all over the place, so don't let the kernel read ahead of each fault.
+	map->Advise(0, map->size, MAPADV_Random);
+	return map;
+#else
+	return nullptr;
+#endif
+}
+
+FileMapping::~FileMapping()
+{
+#ifndef _WIN32
+	if (data) munmap((void*)data, size);
+#endif
+}
+
+void FileMapping::Advise(size_t offset, size_t length, EMapAdvice advice) const
+{
+#ifndef _WIN32
+	if (offset >= size || length == 0) return;
+	length = std::min(length, size - offset);
+
+	// madvise needs a page aligned start
+	static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = offset & ~(pageSize - 1);
+	length += offset - start;
+
+	int adv = advice == MAPADV_Random ? MADV_RANDOM : advice == MAPADV_Sequential ? MADV_SEQUENTIAL : advice == MAPADV_WillNeed ? MADV_WILLNEED : MADV_NORMAL;
+	madvise((void*)(data + start), length, adv);
+#endif
+}
+
 //==========================================================================
 //
 // FileReader
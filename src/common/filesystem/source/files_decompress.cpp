@@ -41,6 +41,12 @@
 #include "7zCrc.h"
 #include <miniz.h>
 #include <bzlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
 #include <algorithm>
 #include <stdexcept>
 
@@ -850,6 +856,192 @@ public:
 };
 
 
+#ifdef HAVE_ZSTD
+//==========================================================================
+//
+// DecompressorZstd
+//
+// reads data from a Zstandard compressed stream
+//
+//==========================================================================
+
+class DecompressorZstd : public DecompressorBase
+{
+	enum { BUFF_SIZE = 65536 };
+
+	bool SawEOF = false;
+	ZSTD_DStream *Stream = nullptr;
+	ZSTD_inBuffer In = {};
+	uint8_t InBuff[BUFF_SIZE];
+
+public:
+	bool Open(FileReader *file)
+	{
+		if (File != nullptr)
+		{
+			DecompressionError("File already open");
+			return false;
+		}
+
+		File = file;
+		Stream = ZSTD_createDStream();
+		if (Stream == nullptr || ZSTD_isError(ZSTD_initDStream(Stream)))
+		{
+			DecompressionError("DecompressorZstd: ZSTD_initDStream failed\n");
+			return false;
+		}
+		FillBuffer();
+		return true;
+	}
+
+	~DecompressorZstd()
+	{
+		if (Stream) ZSTD_freeDStream(Stream);
+	}
+
+	ptrdiff_t Read(void *buffer, ptrdiff_t len) override
+	{
+		if (File == nullptr)
+		{
+			DecompressionError("File not open");
+			return 0;
+		}
+
+		ZSTD_outBuffer out = { buffer, (size_t)len, 0 };
+		while (out.pos < out.size)
+		{
+			if (In.pos == In.size && !SawEOF)
+			{
+				FillBuffer();
+			}
+			size_t inpos = In.pos, outpos = out.pos;
+			size_t err = ZSTD_decompressStream(Stream, &out, &In);
+			if (ZSTD_isError(err))
+			{
+				DecompressionError("Corrupt zstd stream: %s", ZSTD_getErrorName(err));
+				return 0;
+			}
+			// Nothing left to feed and nothing buffered inside the decoder either.
+			if (In.pos == inpos && out.pos == outpos && SawEOF && In.pos == In.size) break;
+		}
+
+		if (out.pos < out.size)
+		{
+			DecompressionError("Ran out of data in zstd stream");
+			return 0;
+		}
+		return (ptrdiff_t)out.pos;
+	}
+
+	void FillBuffer()
+	{
+		auto numread = File->Read(InBuff, BUFF_SIZE);
+
+		if (numread < BUFF_SIZE)
+		{
+			SawEOF = true;
+		}
+		In.src = InBuff;
+		In.size = (size_t)std::max<ptrdiff_t>(numread, 0);
+		In.pos = 0;
+	}
+};
+#endif
+
+#ifdef HAVE_LZ4
+//==========================================================================
+//
+// DecompressorLZ4
+//
+// reads data from a LZ4 frame
+//
+//==========================================================================
+
+class DecompressorLZ4 : public DecompressorBase
+{
+	enum { BUFF_SIZE = 65536 };
+
+	bool SawEOF = false;
+	LZ4F_dctx *Stream = nullptr;
+	size_t InPos = 0, InSize = 0;
+	uint8_t InBuff[BUFF_SIZE];
+
+public:
+	bool Open(FileReader *file)
+	{
+		if (File != nullptr)
+		{
+			DecompressionError("File already open");
+			return false;
+		}
+
+		File = file;
+		if (LZ4F_isError(LZ4F_createDecompressionContext(&Stream, LZ4F_VERSION)))
+		{
+			Stream = nullptr;
+			DecompressionError("DecompressorLZ4: LZ4F_createDecompressionContext failed\n");
+			return false;
+		}
+		FillBuffer();
+		return true;
+	}
+
+	~DecompressorLZ4()
+	{
+		if (Stream) LZ4F_freeDecompressionContext(Stream);
+	}
+
+	ptrdiff_t Read(void *buffer, ptrdiff_t len) override
+	{
+		if (File == nullptr)
+		{
+			DecompressionError("File not open");
+			return 0;
+		}
+
+		uint8_t *out = (uint8_t *)buffer;
+		size_t done = 0;
+		while (done < (size_t)len)
+		{
+			if (InPos == InSize && !SawEOF)
+			{
+				FillBuffer();
+			}
+			size_t outsize = len - done;
+			size_t insize = InSize - InPos;
+			size_t err = LZ4F_decompress(Stream, out + done, &outsize, InBuff + InPos, &insize, nullptr);
+			if (LZ4F_isError(err))
+			{
+				DecompressionError("Corrupt LZ4 stream: %s", LZ4F_getErrorName(err));
+				return 0;
+			}
+			InPos += insize;
+			done += outsize;
+			if (insize == 0 && outsize == 0 && SawEOF && InPos == InSize) break;
+		}
+
+		if (done < (size_t)len)
+		{
+			DecompressionError("Ran out of data in LZ4 stream");
+			return 0;
+		}
+		return (ptrdiff_t)done;
+	}
+
+	void FillBuffer()
+	{
+		auto numread = File->Read(InBuff, BUFF_SIZE);
+
+		if (numread < BUFF_SIZE)
+		{
+			SawEOF = true;
+		}
+		InPos = 0;
+		InSize = (size_t)std::max<ptrdiff_t>(numread, 0);
+	}
+};
+#endif
+
 bool OpenDecompressor(FileReader& self, FileReader &parent, FileReader::Size length, int method, int flags)
 {
 	FileReaderInterface* fr = nullptr;
@@ -910,6 +1102,34 @@ bool OpenDecompressor(FileReader& self, FileReader &parent, FileReader::Size len
 			}
 			break;
 		}
+#ifdef HAVE_ZSTD
+		case METHOD_ZSTD:
+		{
+			auto idec = new DecompressorZstd;
+			fr = dec = idec;
+			idec->EnableExceptions(exceptions);
+			if (!idec->Open(p))
+			{
+				delete idec;
+				return false;
+			}
+			break;
+		}
+#endif
+#ifdef HAVE_LZ4
+		case METHOD_LZ4:
+		{
+			auto idec = new DecompressorLZ4;
+			fr = dec = idec;
+			idec->EnableExceptions(exceptions);
+			if (!idec->Open(p))
+			{
+				delete idec;
+				return false;
+			}
+			break;
+		}
+#endif
 		case METHOD_LZSS:
 		{
 			auto idec = new DecompressorLZSS;
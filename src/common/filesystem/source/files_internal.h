@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <algorithm>
 #include "fs_files.h"
 
 namespace FileSys {
@@ -90,4 +91,68 @@ public:
 	}
 };
 
+//==========================================================================
+//
+// FileMapping
+//
+// A read-only mapping of an entire archive. Readers handed out for its
+// lumps keep a reference so the mapping outlives the resource file if needed.
+// Only implemented for POSIX systems, Map returns nullptr everywhere else.
+//
+//==========================================================================
+
+enum EMapAdvice
+{
+	MAPADV_Normal,
+	MAPADV_Random,			// scattered small reads, don't read ahead
+	MAPADV_Sequential,		// read once front to back
+	MAPADV_WillNeed,		// about to read the whole range
+};
+
+class FileMapping
+{
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+	FileMapping() = default;
+
+public:
+	~FileMapping();
+	static std::shared_ptr<FileMapping> Map(const char* filename);
+
+	const uint8_t* Data() const { return data; }
+	size_t Size() const { return size; }
+	void Advise(size_t offset, size_t length, EMapAdvice advice) const;
+};
+
+//==========================================================================
+//
+// MappedReader
+//
+// reads a lump straight out of a mapped archive
+//
+//==========================================================================
+
+class MappedReader : public MemoryReader
+{
+	std::shared_ptr<FileMapping> mapping;
+	ptrdiff_t dataLength;
+
+public:
+	// headerSlack extends the view so a header in front of the data can be read and skipped with ShiftStart.
+	MappedReader(std::shared_ptr<FileMapping> map, size_t start, size_t length, size_t headerSlack = 0)
+		: MemoryReader((const char*)map->Data() + start, (ptrdiff_t)std::min(length + headerSlack, map->Size() - start)), mapping(std::move(map))
+	{
+		dataLength = (ptrdiff_t)length;
+	}
+
+	void ShiftStart(ptrdiff_t offset) override
+	{
+		auto end = (const char*)mapping->Data() + mapping->Size();
+		bufptr += offset;
+		Length = std::min<ptrdiff_t>(dataLength, end - bufptr);
+		FilePos = 0;
+	}
+};
+
 }
@@ -41,6 +41,12 @@
 #include <ctype.h>
 #include <string.h>
 #include <inttypes.h>
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
 
 #include "resourcefile.h"
 #include "fs_filesystem.h"
@@ -199,6 +205,7 @@ static void PrintLastError (FileSystemMessageFunc Printf);
 
 FileSystem::FileSystem()
 {
+	prefetch = std::make_unique<PrefetchCache>();
 }
 
 FileSystem::~FileSystem ()
@@ -208,7 +215,9 @@ FileSystem::~FileSystem ()
 
 void FileSystem::DeleteAll ()
 {
+	ClearPrefetch();
 	Hashes.clear();
+	SortedPaths.clear();
 	NumEntries = 0;
 
 	FileInfo.clear();
@@ -378,6 +387,9 @@ void FileSystem::AddFile (const char *filename, FileReader *filer, LumpFilterInf
 
 		uint32_t lumpstart = (uint32_t)FileInfo.size();
 
+		// Embedded files are already in memory, only map what comes straight from disk.
+		if (filer == nullptr) resfile->MapFile();
+
 		resfile->SetFirstLump(lumpstart);
 		Files.push_back(resfile);
 		for (int i = 0; i < resfile->EntryCount(); i++)
@@ -855,6 +867,18 @@ void FileSystem::InitHashChains (void)
 
 		}
 	}
+
+	// Duplicates keep their load order so the last one of a run is the one that overrides the others.
+	SortedPaths.clear();
+	for (i = 0; i < (unsigned)NumEntries; i++)
+	{
+		if (FileInfo[i].LongName[0] != 0) SortedPaths.push_back(i);
+	}
+	std::stable_sort(SortedPaths.begin(), SortedPaths.end(), [&](uint32_t a, uint32_t b)
+	{
+		return strcmp(FileInfo[a].LongName, FileInfo[b].LongName) < 0;
+	});
+	SortedPaths.shrink_to_fit();
 	FileInfo.shrink_to_fit();
 	Files.shrink_to_fit();
 }
@@ -1013,44 +1037,46 @@ int FileSystem::FindLumpFullName(const char* name, int* lastlump, bool noext)
 {
 	assert(lastlump != NULL && *lastlump >= 0);
 
-	const LumpRecord * last = FileInfo.data() + FileInfo.size();
-
-	LumpRecord * lump_p = FileInfo.data() + *lastlump;
+	// The hash chains list duplicates newest first, so the next match in load order
+	// is the lowest matching index that is not below lastlump.
+	uint32_t start = *lastlump;
+	uint32_t found = NULL_INDEX;
+	auto len = strlen(name);
 
-	if (!noext)
+	if (NumEntries > 0 && *name != 0)
 	{
-		while (lump_p < last)
+		uint32_t hash = MakeHash(name) % NumEntries;
+		for (uint32_t i = FirstLumpIndex_FullName[hash]; i != NULL_INDEX; i = NextLumpIndex_FullName[i])
 		{
-			if (!stricmp(name, lump_p->LongName))
+			if (i >= start && i < found && !stricmp(name, FileInfo[i].LongName)) found = i;
+		}
+		if (noext)
+		{
+			// Lumps with an extension are in the chain for their name without it.
+			for (uint32_t i = FirstLumpIndex_NoExt[hash]; i != NULL_INDEX; i = NextLumpIndex_NoExt[i])
 			{
-				int lump = int(lump_p - FileInfo.data());
-				*lastlump = lump + 1;
-				return lump;
+				if (i < start || i >= found || strnicmp(name, FileInfo[i].LongName, len)) continue;
+				auto p = FileInfo[i].LongName + len;
+				if (*p == '.' && strpbrk(p + 1, "./") == 0) found = i;
 			}
-			lump_p++;
 		}
 	}
-	else
+
+	// Lumps added after the chains were built are not in them.
+	for (uint32_t i = std::max(start, NumEntries); i < FileInfo.size() && i < found; i++)
 	{
-		auto len = strlen(name);
-		while (lump_p <= &FileInfo.back())
+		auto p = FileInfo[i].LongName + len;
+		if (!strnicmp(name, FileInfo[i].LongName, len) && (*p == 0 || (noext && *p == '.' && strpbrk(p + 1, "./") == 0)))
 		{
-			auto res = strnicmp(name, lump_p->LongName, len);
-			if (res == 0)
-			{
-				auto p = lump_p->LongName + len;
-				if (*p == 0 || (*p == '.' && strpbrk(p + 1, "./") == 0))
-				{
-					int lump = int(lump_p - FileInfo.data());
-					*lastlump = lump + 1;
-					return lump;
-				}
-			}
-			lump_p++;
+			found = i;
 		}
 	}
 
-
+	if (found != NULL_INDEX)
+	{
+		*lastlump = found + 1;
+		return found;
+	}
 	*lastlump = NumEntries;
 	return -1;
 }
@@ -1204,19 +1230,6 @@ int FileSystem::GetFileContainer (int lump) const
 //
 //==========================================================================
 
-static int folderentrycmp(const void *a, const void *b)
-{
-	auto A = (FolderEntry*)a;
-	auto B = (FolderEntry*)b;
-	return strcmp(A->name, B->name);
-}
-
-//==========================================================================
-//
-// 
-//
-//==========================================================================
-
 unsigned FileSystem::GetFilesInFolder(const char *inpath, std::vector<FolderEntry> &result, bool atomic) const
 {
 	std::string path = inpath;
@@ -1224,36 +1237,36 @@ unsigned FileSystem::GetFilesInFolder(const char *inpath, std::vector<FolderEntr
 	for (auto& c : path) c = tolower(c);
 	if (path.back() != '/') path += '/';
 	result.clear();
-	for (size_t i = 0; i < FileInfo.size(); i++)
+
+	// Everything starting with the path sorts right after it. Walking in name order also means the result needs no sorting.
+	auto it = std::lower_bound(SortedPaths.begin(), SortedPaths.end(), path, [&](uint32_t lump, const std::string& p)
+	{
+		return strcmp(FileInfo[lump].LongName, p.c_str()) < 0;
+	});
+	for (; it != SortedPaths.end() && strncmp(FileInfo[*it].LongName, path.c_str(), path.length()) == 0; ++it)
 	{
-		if (strncmp(FileInfo[i].LongName, path.c_str(), path.length()) == 0)
+		uint32_t i = *it;
+		// Only if it hasn't been replaced.
+		if ((unsigned)CheckNumForFullName(FileInfo[i].LongName) == i)
 		{
-			// Only if it hasn't been replaced.
-			if ((unsigned)CheckNumForFullName(FileInfo[i].LongName) == i)
-			{
-				FolderEntry fe{ FileInfo[i].LongName, (uint32_t)i };
-				result.push_back(fe);
-			}
+			FolderEntry fe{ FileInfo[i].LongName, i };
+			result.push_back(fe);
 		}
 	}
-	if (result.size())
+	if (result.size() && atomic)
 	{
+		// Find the highest resource file having content in the given folder.
 		int maxfile = -1;
-		if (atomic)
+		for (auto & entry : result)
 		{
-			// Find the highest resource file having content in the given folder.
-			for (auto & entry : result)
-			{
-				int thisfile = GetFileContainer(entry.lumpnum);
-				if (thisfile > maxfile) maxfile = thisfile;
-			}
-			// Delete everything from older files.
-			for (int i = (int)result.size() - 1; i >= 0; i--)
-			{
-				if (GetFileContainer(result[i].lumpnum) != maxfile) result.erase(result.begin() + i);
-			}
+			int thisfile = GetFileContainer(entry.lumpnum);
+			if (thisfile > maxfile) maxfile = thisfile;
 		}
-		qsort(result.data(), result.size(), sizeof(FolderEntry), folderentrycmp);
+		// Delete everything from older files.
+		result.erase(std::remove_if(result.begin(), result.end(), [&](const FolderEntry& entry)
+		{
+			return GetFileContainer(entry.lumpnum) != maxfile;
+		}), result.end());
 	}
 	return (unsigned)result.size();
 }
@@ -1294,6 +1307,8 @@ FileData FileSystem::ReadFile (int lump)
 	{
 		throw FileSystemException("ReadFile: %u >= NumEntries", lump);
 	}
+	FileData data;
+	if (TakePrefetched(lump, data)) return data;
 	return FileInfo[lump].resfile->Read(FileInfo[lump].resindex);
 }
 
@@ -1313,10 +1328,169 @@ FileReader FileSystem::OpenFileReader(int lump, int readertype, int readerflags)
 		throw FileSystemException("OpenFileReader: %u >= NumEntries", lump);
 	}
 
+	FileData data;
+	if (TakePrefetched(lump, data))
+	{
+		FileReader fr;
+		fr.OpenMemoryArray(data);
+		if (fr.isOpen()) return fr;
+	}
+
 	auto file = FileInfo[lump].resfile;
 	return file->GetEntryReader(FileInfo[lump].resindex, readertype, readerflags);
 }
 
+//==========================================================================
+//
+// Prefetching
+//
+// Lumps stay in the cache until they are read once, or get dropped oldest
+// batch first when a newer batch needs the room. A batch never pushes out
+// its own lumps, whatever doesn't fit is simply not prefetched.
+//
+//==========================================================================
+
+struct FileSystem::PrefetchCache
+{
+	struct Entry
+	{
+		FileData data;
+		unsigned batch;
+	};
+
+	mutable std::mutex lock;
+	std::unordered_map<int, Entry> lumps;
+	std::deque<int> order;			// oldest first, may contain lumps that were consumed already
+	std::atomic<unsigned> count{ 0 };	// lets reads skip the lock while the cache is empty
+	size_t bytes = 0;
+	size_t limit = 256 * 1024 * 1024;
+	unsigned batch = 0;
+	FPrefetchStats stats = {};
+
+	FileData Remove(std::unordered_map<int, Entry>::iterator it)
+	{
+		FileData data = std::move(it->second.data);
+		bytes -= data.size();
+		lumps.erase(it);
+		count.store((unsigned)lumps.size());
+		return data;
+	}
+};
+
+bool FileSystem::TakePrefetched(int lump, FileData& data)
+{
+	if (prefetch->count.load(std::memory_order_relaxed) == 0) return false;
+
+	std::lock_guard<std::mutex> lock(prefetch->lock);
+	auto it = prefetch->lumps.find(lump);
+	if (it == prefetch->lumps.end()) return false;
+
+	data = prefetch->Remove(it);
+	prefetch->stats.hits++;
+	return true;
+}
+
+void FileSystem::PrefetchLumps(const int* lumplist, size_t numlumps)
+{
+	struct FPending
+	{
+		int lump;
+		FileData data;
+	};
+	std::vector<FPending> pending;
+	std::unordered_set<int> seen;
+	size_t planned = 0;
+	unsigned batch;
+
+	{
+		std::lock_guard<std::mutex> lock(prefetch->lock);
+		batch = ++prefetch->batch;
+
+		for (size_t i = 0; i < numlumps; i++)
+		{
+			int lump = lumplist[i];
+			if ((unsigned)lump >= (unsigned)FileInfo.size() || prefetch->lumps.count(lump) || !seen.insert(lump).second) continue;
+
+			auto& info = FileInfo[lump];
+			size_t size = info.resfile->Length(info.resindex);
+			if (size == 0 || info.resfile->IsDirectlyAccessible(info.resindex)) continue;
+
+			// Make room by dropping what is left of older batches.
+			while (prefetch->bytes + planned + size > prefetch->limit && !prefetch->order.empty())
+			{
+				auto it = prefetch->lumps.find(prefetch->order.front());
+				if (it != prefetch->lumps.end())
+				{
+					if (it->second.batch == batch) break;
+					prefetch->stats.evicted++;
+					prefetch->Remove(it);
+				}
+				prefetch->order.pop_front();
+			}
+			if (prefetch->bytes + planned + size > prefetch->limit) break;
+
+			info.resfile->PrepareEntry(info.resindex);
+			pending.push_back({ lump, FileData() });
+			planned += size;
+		}
+	}
+	if (pending.empty()) return;
+
+	auto work = [&](int i)
+	{
+		auto& info = FileInfo[pending[i].lump];
+		try
+		{
+			auto fr = info.resfile->GetEntryReader(info.resindex, READER_NEW, 0);
+			if (fr.isOpen()) pending[i].data = fr.Read(info.resfile->Length(info.resindex));
+		}
+		catch (const FileSystemException&)
+		{
+			// Leave it to the regular read to report the error.
+		}
+	};
+
+	if (ParallelFor) ParallelFor((int)pending.size(), work);
+	else for (int i = 0; i < (int)pending.size(); i++) work(i);
+
+	std::lock_guard<std::mutex> lock(prefetch->lock);
+	for (auto& p : pending)
+	{
+		if (p.data.size() == 0) continue;
+		prefetch->bytes += p.data.size();
+		prefetch->stats.bytesRead += p.data.size();
+		prefetch->stats.lumpsRead++;
+		prefetch->order.push_back(p.lump);
+		prefetch->lumps[p.lump] = { std::move(p.data), batch };
+	}
+	prefetch->count.store((unsigned)prefetch->lumps.size());
+}
+
+void FileSystem::ClearPrefetch()
+{
+	std::lock_guard<std::mutex> lock(prefetch->lock);
+	prefetch->stats.evicted += (unsigned)prefetch->lumps.size();
+	prefetch->lumps.clear();
+	prefetch->order.clear();
+	prefetch->bytes = 0;
+	prefetch->count.store(0);
+}
+
+void FileSystem::SetPrefetchLimit(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(prefetch->lock);
+	prefetch->limit = bytes;
+}
+
+FPrefetchStats FileSystem::GetPrefetchStats() const
+{
+	std::lock_guard<std::mutex> lock(prefetch->lock);
+	FPrefetchStats stats = prefetch->stats;
+	stats.bytesCached = prefetch->bytes;
+	stats.lumpsCached = (unsigned)prefetch->lumps.size();
+	return stats;
+}
+
 FileReader FileSystem::OpenFileReader(const char* name)
 {
 	FileReader fr;
@@ -33,6 +33,7 @@
 */
 
 #include "fs_findfile.h"
+#include <stdio.h>
 #include <string.h>
 #include <vector>
 #include <sys/stat.h>
@@ -45,6 +46,7 @@
 #include <sys/time.h>
 #endif
 #include <unistd.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <dirent.h>
 
@@ -424,4 +426,73 @@ bool FS_DirEntryExists(const char* pathname, bool* isdir)
 	return res;
 }
 
+//==========================================================================
+//
+// FS_GetFileStamp
+//
+// Size and modification time of a file, to tell if it changed since it was last seen.
+//
+//==========================================================================
+
+bool FS_GetFileStamp(const char* pathname, uint64_t* size, uint64_t* mtime)
+{
+	if (pathname == NULL || *pathname == 0)
+		return false;
+
+#ifndef _WIN32
+	struct stat info;
+	bool res = stat(pathname, &info) == 0;
+#else
+	auto wstr = toWide(pathname);
+	struct _stat64 info;
+	bool res = _wstat64(wstr.c_str(), &info) == 0;
+#endif
+	if (!res || (info.st_mode & S_IFDIR)) return false;
+	*size = (uint64_t)info.st_size;
+	*mtime = (uint64_t)info.st_mtime;
+	return true;
+}
+
+//==========================================================================
+//
+// FS_SyncFile
+//
+// Makes sure a file's contents have reached the disk.
+//
+//==========================================================================
+
+bool FS_SyncFile(const char* pathname)
+{
+#ifndef _WIN32
+	int fd = open(pathname, O_WRONLY);
+	if (fd < 0) return false;
+	bool res = fsync(fd) == 0;
+	return close(fd) == 0 && res;
+#else
+	auto wstr = toWide(pathname);
+	HANDLE handle = CreateFileW(wstr.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	bool res = FlushFileBuffers(handle) != 0;
+	return CloseHandle(handle) != 0 && res;
+#endif
+}
+
+//==========================================================================
+//
+// FS_RenameReplacing
+//
+// Renames a file, replacing the destination in a single step if it exists.
+// At no point is there neither the old nor the new destination file.
+//
+//==========================================================================
+
+bool FS_RenameReplacing(const char* from, const char* to)
+{
+#ifndef _WIN32
+	return rename(from, to) == 0;
+#else
+	return MoveFileExW(toWide(from).c_str(), toWide(to).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#endif
+}
+
 }
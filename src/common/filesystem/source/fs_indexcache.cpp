@@ -0,0 +1,278 @@
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+//--------------------------------------------------------------------------
+//
+/*
+** fs_indexcache.cpp
+** Persistent cache of processed archive directories
+**
+** Reading a large archive's directory means parsing every central directory
+** record, normalizing every name, sorting and running the lump filters.
+** The result only depends on the archive itself and the filter, so it gets
+** stored after the first scan and reused as long as the archive's size and
+** modification time are unchanged.
+**
+** An index file is a fixed header, fixed size entry records and a block
+** of zero terminated names the records point into by offset.
+**
+*/
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include "resourcefile.h"
+#include "fs_findfile.h"
+#include "fs_stringpool.h"
+#include "md5.hpp"
+
+namespace FileSys {
+
+static std::string indexDirectory;
+
+void SetIndexCacheDirectory(const char* path)
+{
+	indexDirectory = path ? path : "";
+	if (!indexDirectory.empty() && indexDirectory.back() != '/') indexDirectory += '/';
+}
+
+enum
+{
+	INDEX_VERSION = 1,		// bump whenever the archive processing changes what ends up in Entries
+};
+
+struct FIndexHeader
+{
+	char Magic[4];
+	uint32_t Version;
+	uint64_t FileSize;
+	uint64_t FileTime;
+	uint8_t FilterDigest[16];
+	char Hash[48];
+	uint32_t NumEntries;
+	uint32_t PathLength;		// the archive's path follows the entries, to rule out name hash collisions
+	uint32_t NamesSize;
+	uint32_t EntrySize;
+};
+
+struct FIndexEntry
+{
+	uint64_t Length;
+	uint64_t CompressedSize;
+	uint64_t Position;
+	uint32_t NameOffset;
+	int32_t ResourceID;
+	uint32_t CRC32;
+	uint16_t Flags;
+	uint16_t Method;
+	int16_t Namespace;
+	uint16_t Padding;
+};
+
+static const char IndexMagic[4] = { 'F', 'S', 'I', 'X' };
+
+//==========================================================================
+//
+// Everything in the filter that affects how the directory gets processed
+//
+//==========================================================================
+
+static void HashFilter(LumpFilterInfo* filter, uint8_t digest[16])
+{
+	using namespace FileSys::md5;
+	md5_state_t state;
+	md5_init(&state);
+
+	auto add = [&](const std::vector<std::string>& list)
+	{
+		for (auto& str : list) md5_append(&state, (const uint8_t*)str.c_str(), str.length() + 1);
+		md5_append(&state, (const uint8_t*)"\n", 1);
+	};
+
+	if (filter)
+	{
+		add(filter->gameTypeFilter);
+		add(filter->reservedFolders);
+		add(filter->requiredPrefixes);
+		add(filter->embeddings);
+		add(filter->blockednames);
+	}
+
+	// Entries with compression methods the build does not support are dropped during processing.
+	static const char methods[] = "methods"
+#ifdef HAVE_ZSTD
+		" zstd"
+#endif
+#ifdef HAVE_LZ4
+		" lz4"
+#endif
+		;
+	md5_append(&state, (const uint8_t*)methods, sizeof(methods));
+	md5_finish(&state, digest);
+}
+
+static std::string IndexFileName(const char* filename)
+{
+	using namespace FileSys::md5;
+	md5_state_t state;
+	uint8_t digest[16];
+	md5_init(&state);
+	md5_append(&state, (const uint8_t*)filename, strlen(filename));
+	md5_finish(&state, digest);
+
+	std::string name = indexDirectory;
+	char hex[3];
+	for (auto c : digest)
+	{
+		snprintf(hex, 3, "%02x", c);
+		name += hex;
+	}
+	name += ".fsi";
+	return name;
+}
+
+//==========================================================================
+//
+// FResourceFile :: LoadIndex
+//
+// Fills Entries from the cache. Returns false if there is no usable index,
+// in which case nothing has been changed.
+//
+//==========================================================================
+
+bool FResourceFile::LoadIndex(LumpFilterInfo* filter)
+{
+	uint64_t size, mtime;
+	if (indexDirectory.empty() || !FS_GetFileStamp(FileName, &size, &mtime)) return false;
+
+	FileReader fr;
+	if (!fr.OpenFile(IndexFileName(FileName).c_str())) return false;
+	auto data = fr.Read();
+	fr.Close();
+
+	FIndexHeader header;
+	uint8_t digest[16];
+	size_t pathLength = strlen(FileName);
+	if (data.size() < sizeof(header)) return false;
+	memcpy(&header, data.data(), sizeof(header));
+	HashFilter(filter, digest);
+
+	if (memcmp(header.Magic, IndexMagic, 4) || header.Version != INDEX_VERSION || header.EntrySize != sizeof(FIndexEntry) ||
+		header.FileSize != size || header.FileTime != mtime || memcmp(header.FilterDigest, digest, 16) || header.PathLength != pathLength)
+	{
+		return false;
+	}
+
+	size_t entriesSize = (size_t)header.NumEntries * sizeof(FIndexEntry);
+	if (data.size() != sizeof(header) + entriesSize + pathLength + header.NamesSize || header.NamesSize == 0) return false;
+
+	auto records = (const FIndexEntry*)(data.bytes() + sizeof(header));
+	auto path = (const char*)records + entriesSize;
+	auto names = path + pathLength;
+	if (memcmp(path, FileName, pathLength) || names[header.NamesSize - 1] != 0) return false;
+
+	for (uint32_t i = 0; i < header.NumEntries; i++)
+	{
+		if (records[i].NameOffset >= header.NamesSize) return false;
+	}
+
+	AllocateEntries(header.NumEntries);
+	for (uint32_t i = 0; i < NumLumps; i++)
+	{
+		auto& rec = records[i];
+		auto& entry = Entries[i];
+		entry.FileName = stringpool->Strdup(names + rec.NameOffset);
+		entry.Length = (size_t)rec.Length;
+		entry.CompressedSize = (size_t)rec.CompressedSize;
+		entry.Position = (size_t)rec.Position;
+		entry.ResourceID = rec.ResourceID;
+		entry.CRC32 = rec.CRC32;
+		entry.Flags = rec.Flags;
+		entry.Method = rec.Method;
+		entry.Namespace = rec.Namespace;
+	}
+	memcpy(Hash, header.Hash, sizeof(Hash));
+	return true;
+}
+
+//==========================================================================
+//
+// FResourceFile :: StoreIndex
+//
+// Must be called right after the directory has been processed, before
+// anything resolves entry positions.
+//
+//==========================================================================
+
+void FResourceFile::StoreIndex(LumpFilterInfo* filter)
+{
+	uint64_t size, mtime;
+	if (indexDirectory.empty() || !FS_GetFileStamp(FileName, &size, &mtime)) return;
+
+	FIndexHeader header = {};
+	memcpy(header.Magic, IndexMagic, 4);
+	header.Version = INDEX_VERSION;
+	header.FileSize = size;
+	header.FileTime = mtime;
+	HashFilter(filter, header.FilterDigest);
+	memcpy(header.Hash, Hash, sizeof(Hash));
+	header.NumEntries = NumLumps;
+	header.PathLength = (uint32_t)strlen(FileName);
+	header.EntrySize = sizeof(FIndexEntry);
+
+	std::vector<FIndexEntry> records(NumLumps);
+	std::string names;
+	for (uint32_t i = 0; i < NumLumps; i++)
+	{
+		auto& entry = Entries[i];
+		auto& rec = records[i];
+		rec = {};
+		rec.NameOffset = (uint32_t)names.length();
+		rec.Length = entry.Length;
+		rec.CompressedSize = entry.CompressedSize;
+		rec.Position = entry.Position;
+		rec.ResourceID = entry.ResourceID;
+		rec.CRC32 = entry.CRC32;
+		rec.Flags = entry.Flags;
+		rec.Method = entry.Method;
+		rec.Namespace = entry.Namespace;
+		names += entry.FileName ? entry.FileName : "";
+		names += '\0';
+	}
+	if (names.empty()) names += '\0';
+	header.NamesSize = (uint32_t)names.length();
+
+	// Write to a temporary file first so that an interrupted write never leaves a valid looking index behind.
+	auto filename = IndexFileName(FileName);
+	auto tempname = filename + ".tmp";
+	auto fw = FileWriter::Open(tempname.c_str());
+	if (fw == nullptr) return;
+
+	bool ok = fw->Write(&header, sizeof(header)) == sizeof(header);
+	if (ok && NumLumps > 0) ok = fw->Write(records.data(), records.size() * sizeof(FIndexEntry)) == records.size() * sizeof(FIndexEntry);
+	if (ok) ok = fw->Write(FileName, header.PathLength) == header.PathLength;
+	if (ok) ok = fw->Write(names.data(), names.length()) == names.length();
+	delete fw;
+
+	if (ok)
+	{
+		remove(filename.c_str());
+		ok = rename(tempname.c_str(), filename.c_str()) == 0;
+	}
+	if (!ok) remove(tempname.c_str());
+}
+
+}
@@ -59,6 +59,12 @@ void SetMainThread()
 	}
 }
 
+static bool useMapping = true;
+void SetMemoryMapping(bool on)
+{
+	useMapping = on;
+}
+
 std::string ExtractBaseName(const char* path, bool include_extension)
 {
 	const char* src, * dot;
@@ -671,7 +677,31 @@ FileReader FResourceFile::GetEntryReader(uint32_t entry, int readertype, int rea
 			if(mainThread) 
 				SetEntryAddress(entry);
 		}
-		if (!(Entries[entry].Flags & RESFF_COMPRESSED))
+		if (Mapping && Entries[entry].Position < Mapping->Size())
+		{
+			// Mapped readers need no file handle and no lock, so they work the same on every thread.
+			bool compressed = Entries[entry].Flags & RESFF_COMPRESSED;
+			bool needStart = Entries[entry].Flags & RESFF_NEEDFILESTART;
+			size_t size = compressed ? Entries[entry].CompressedSize : Entries[entry].Length;
+			// a local header is at most 64 bytes plus two 16 bit length fields worth of name and extra data
+			FileReader fri(new MappedReader(Mapping, Entries[entry].Position, size, needStart ? 2 * 65536 + 64 : 0));
+			if (needStart)
+			{
+				SkipHeader(fri);
+			}
+			if (compressed || readertype == READER_NEW)
+			{
+				Mapping->Advise(fri.GetBuffer() - (const char*)Mapping->Data(), fri.GetLength(), MAPADV_Sequential);
+			}
+
+			if (!compressed) return fri;
+
+			int flags = DCF_TRANSFEROWNER | DCF_EXCEPTIONS;
+			if (readertype == READER_CACHED) flags |= DCF_CACHED;
+			else if (readerflags & READERFLAG_SEEKABLE) flags |= DCF_SEEKABLE;
+			OpenDecompressor(fr, fri, Entries[entry].Length, Entries[entry].Method, flags);
+		}
+		else if (!(Entries[entry].Flags & RESFF_COMPRESSED))
 		{
 			auto buf = Reader.GetBuffer();
 			// if this is backed by a memory buffer, create a new reader directly referencing it.
@@ -728,6 +758,21 @@ void FResourceFile::SkipHeader(FileReader& fr) {
 }
 
 
+//==========================================================================
+//
+// Maps the container file. Only files opened directly from disk qualify,
+// anything embedded is already held in memory.
+//
+//==========================================================================
+
+bool FResourceFile::MapFile()
+{
+	if (!useMapping || Mapping || !Reader.isOpen() || Reader.GetBuffer() != nullptr) return Mapping != nullptr;
+	Mapping = FileMapping::Map(FileName);
+	return Mapping != nullptr;
+}
+
+
 FileData FResourceFile::Read(uint32_t entry)
 {
 	if (!(Entries[entry].Flags & RESFF_COMPRESSED) && Reader.isOpen())
@@ -740,6 +785,17 @@ FileData FResourceFile::Read(uint32_t entry)
 		}
 	}
 
+	// Same for mapped files, the view stays valid as long as this file is open.
+	if (Mapping && entry < NumLumps && !(Entries[entry].Flags & RESFF_COMPRESSED))
+	{
+		auto fr = GetEntryReader(entry, READER_SHARED, 0);
+		if (fr.GetBuffer() != nullptr && fr.GetLength() == (ptrdiff_t)Entries[entry].Length)
+		{
+			Mapping->Advise(fr.GetBuffer() - (const char*)Mapping->Data(), Entries[entry].Length, MAPADV_WillNeed);
+			return FileData(fr.GetBuffer(), Entries[entry].Length, false);
+		}
+	}
+
 	auto fr = GetEntryReader(entry, READER_SHARED, 0);
 	return fr.Read(entry < NumLumps ? Entries[entry].Length : 0);
 }
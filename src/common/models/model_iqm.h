@@ -120,11 +120,12 @@ public:
 	void BuildVertexBuffer(FModelRenderer* renderer) override;
 	void AddSkins(uint8_t* hitlist, const FTextureID* surfaceskinids) override;
 	const TArray<TRS>* AttachAnimationData() override;
-	const TArray<VSMatrix> CalculateBones(int frame1, int frame2, float inter, int frame1_prev, float inter1_prev, int frame2_prev, float inter2_prev, const TArray<TRS>* animationData, DBoneComponents* bones, int index) override;
+	const TArray<VSMatrix>& CalculateBones(int frame1, int frame2, float inter, int frame1_prev, float inter1_prev, int frame2_prev, float inter2_prev, const TArray<TRS>* animationData, DBoneComponents* bones, int index) override;
 
 private:
 	void LoadGeometry();
 	void UnloadGeometry();
+	void EvaluatePose(TArray<VSMatrix> &bones, const TArray<TRS> &animationFrames, int frame1, int frame2, float inter, int frame1_prev, float inter1_prev, int frame2_prev, float inter2_prev) const;
 
 	void LoadPosition(IQMFileReader& reader, const IQMVertexArray& vertexArray);
 	void LoadTexcoord(IQMFileReader& reader, const IQMVertexArray& vertexArray);
@@ -150,6 +151,8 @@ private:
 
 	TArray<VSMatrix> baseframe;
 	TArray<VSMatrix> inversebaseframe;
+	TArray<VSMatrix> bonePre;	// swapYZ * parent's baseframe
+	TArray<VSMatrix> bonePost;	// inversebaseframe * swapYZ
 	TArray<TRS> TRSData;
 };
 
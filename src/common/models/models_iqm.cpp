@@ -7,9 +7,18 @@
 #include "engineerrors.h"
 #include "dobject.h"
 #include "bonecomponents.h"
+#include "stats.h"
+#include <atomic>
+
+#ifndef NO_SSE
+#include <xmmintrin.h>
+#endif
 
 IMPLEMENT_CLASS(DBoneComponents, false, false);
 
+// Bumped whenever a model is loaded or goes away so that no pose cache entry can match a recycled model or animation pointer.
+static std::atomic<unsigned> PoseCacheGeneration = { 1 };
+
 
 IQMModel::IQMModel()
 {
@@ -17,10 +26,12 @@ IQMModel::IQMModel()
 
 IQMModel::~IQMModel()
 {
+	PoseCacheGeneration++;
 }
 
 bool IQMModel::Load(const char* path, int lumpnum, const char* buffer, int length)
 {
+	PoseCacheGeneration++;
 	mLumpNum = lumpnum;
 
 	try
@@ -176,6 +187,23 @@ bool IQMModel::Load(const char* path, int lumpnum, const char* buffer, int lengt
 			}			
 		}
 
+		// The constant parts of each bone's transform, see EvaluatePose.
+		float swapYZ[16] = { 0.0f };
+		swapYZ[0 + 0 * 4] = 1.0f;
+		swapYZ[1 + 2 * 4] = 1.0f;
+		swapYZ[2 + 1 * 4] = 1.0f;
+		swapYZ[3 + 3 * 4] = 1.0f;
+
+		bonePre.Resize(num_joints);
+		bonePost.Resize(num_joints);
+		for (uint32_t i = 0; i < num_joints; i++)
+		{
+			bonePre[i].loadMatrix(swapYZ);
+			if (Joints[i].Parent >= 0) bonePre[i].multMatrix(baseframe[Joints[i].Parent]);
+			bonePost[i] = inversebaseframe[i];
+			bonePost[i].multMatrix(swapYZ);
+		}
+
 		TRSData.Resize(num_frames * num_poses);
 		reader.SeekTo(ofs_frames);
 		for (uint32_t i = 0; i < num_frames; i++)
@@ -541,11 +569,168 @@ const TArray<TRS>* IQMModel::AttachAnimationData()
 	return &TRSData;
 }
 
+//==========================================================================
+//
+// Pose cache
+//
+// Actors that show the same frames of the same animation share one
+// computed matrix palette. The interpolation factors are quantized so
+// that nearly identical poses match. Each thread has its own cache, and
+// entries are recycled in least recently used order so their storage is
+// only allocated once.
+//
+//==========================================================================
+
+enum
+{
+	POSE_CACHE_SETS = 64,
+	POSE_CACHE_WAYS = 4,
+	POSE_INTER_STEPS = 1024,
+};
+
+struct FPoseKey
+{
+	const IQMModel *model;
+	const TArray<TRS> *animation;
+	int frame1, frame2, frame1_prev, frame2_prev;
+	int inter, inter1_prev, inter2_prev;
+
+	bool operator==(const FPoseKey &other) const
+	{
+		return model == other.model && animation == other.animation && frame1 == other.frame1 && frame2 == other.frame2 &&
+			frame1_prev == other.frame1_prev && frame2_prev == other.frame2_prev && inter == other.inter &&
+			inter1_prev == other.inter1_prev && inter2_prev == other.inter2_prev;
+	}
+
+	unsigned Hash() const
+	{
+		uint64_t h = (uint64_t(uintptr_t(model)) ^ (uint64_t(uintptr_t(animation)) << 7)) * 0x9E3779B97F4A7C15ull;
+		h ^= unsigned(frame1) * 0x85EBCA6Bu + unsigned(frame2) * 0xC2B2AE35u + unsigned(inter) * 0x27D4EB2Fu;
+		h ^= unsigned(frame1_prev) * 0x165667B1u + unsigned(frame2_prev) * 0xD3A2646Cu + unsigned(inter1_prev ^ (inter2_prev << 11)) * 0xFD7046C5u;
+		return unsigned(h ^ (h >> 32));
+	}
+};
+
+struct FPoseCacheEntry
+{
+	FPoseKey key;
+	unsigned generation = 0;
+	uint64_t lastUse = 0;
+	TArray<VSMatrix> bones;
+};
+
+struct FPoseCache
+{
+	FPoseCacheEntry entries[POSE_CACHE_SETS * POSE_CACHE_WAYS];
+	uint64_t counter = 0;
+	int hits = 0, misses = 0;
+};
+
+static thread_local FPoseCache PoseCache;
+
+static int QuantizeInter(float inter)
+{
+	if (inter < 0) return -1;
+	if (inter == 0) return 0;
+	// Never round a positive factor down to 0 because that selects a different frame.
+	return clamp(int(inter * POSE_INTER_STEPS + 0.5f), 1, (int)POSE_INTER_STEPS);
+}
+
+static float DequantizeInter(int inter)
+{
+	return inter < 0 ? -1.f : inter * (1.f / POSE_INTER_STEPS);
+}
+
+ADD_STAT(posecache)
+{
+	FString out;
+	auto &cache = PoseCache;
+	int total = cache.hits + cache.misses;
+	out.Format("Pose cache hits: %d, misses: %d (%2.1f%%)", cache.hits, cache.misses, total > 0 ? cache.hits * 100.0 / total : 0.0);
+	return out;
+}
+
+//==========================================================================
+//
+// Bone math
+//
+//==========================================================================
+
+// out = a * b for column major matrices. out may be the same as a or b.
+static void MultBoneMatrix(FLOATTYPE *out, const FLOATTYPE *a, const FLOATTYPE *b)
+{
+#if !defined(NO_SSE) && !defined(USE_DOUBLE)
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	for (int j = 0; j < 4; j++)
+	{
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[j * 4 + 0]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[j * 4 + 1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[j * 4 + 2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[j * 4 + 3])));
+		_mm_storeu_ps(out + j * 4, r);
+	}
+#else
+	FLOATTYPE res[16];
+	for (int j = 0; j < 4; j++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			res[j * 4 + i] = a[i] * b[j * 4] + a[4 + i] * b[j * 4 + 1] + a[8 + i] * b[j * 4 + 2] + a[12 + i] * b[j * 4 + 3];
+		}
+	}
+	memcpy(out, res, sizeof(res));
+#endif
+}
+
+// Same as loadIdentity, translate, multQuaternion and scale on a VSMatrix, without the matrix multiplications.
+static void MakeBoneMatrix(FLOATTYPE *m, const TRS &bone)
+{
+	const FVector4 &q = bone.rotation;
+	const FVector3 &s = bone.scaling;
+	m[0] = (1.f - 2.f * q.Y * q.Y - 2.f * q.Z * q.Z) * s.X;
+	m[1] = (2.f * q.X * q.Y + 2.f * q.W * q.Z) * s.X;
+	m[2] = (2.f * q.X * q.Z - 2.f * q.W * q.Y) * s.X;
+	m[3] = 0;
+	m[4] = (2.f * q.X * q.Y - 2.f * q.W * q.Z) * s.Y;
+	m[5] = (1.f - 2.f * q.X * q.X - 2.f * q.Z * q.Z) * s.Y;
+	m[6] = (2.f * q.Y * q.Z + 2.f * q.W * q.X) * s.Y;
+	m[7] = 0;
+	m[8] = (2.f * q.X * q.Z + 2.f * q.W * q.Y) * s.Z;
+	m[9] = (2.f * q.Y * q.Z - 2.f * q.W * q.X) * s.Z;
+	m[10] = (1.f - 2.f * q.X * q.X - 2.f * q.Y * q.Y) * s.Z;
+	m[11] = 0;
+	m[12] = bone.translation.X;
+	m[13] = bone.translation.Y;
+	m[14] = bone.translation.Z;
+	m[15] = 1.f;
+}
+
 static TRS InterpolateBone(const TRS &from, const TRS &to, float t, float invt)
 {
 	TRS bone;
 
 	bone.translation = from.translation * invt + to.translation * t;
+#ifndef NO_SSE
+	__m128 a = _mm_mul_ps(_mm_loadu_ps(&from.rotation.X), _mm_set1_ps(invt));
+	__m128 b = _mm_mul_ps(_mm_loadu_ps(&to.rotation.X), _mm_set1_ps(t));
+
+	// take the shorter way around
+	__m128 dot = _mm_mul_ps(a, b);
+	dot = _mm_add_ps(dot, _mm_movehl_ps(dot, dot));
+	dot = _mm_add_ss(dot, _mm_shuffle_ps(dot, dot, 1));
+	if (_mm_cvtss_f32(dot) < 0) a = _mm_xor_ps(a, _mm_set1_ps(-0.f));
+
+	__m128 q = _mm_add_ps(a, b);
+	__m128 len = _mm_mul_ps(q, q);
+	len = _mm_add_ps(len, _mm_movehl_ps(len, len));
+	len = _mm_add_ss(len, _mm_shuffle_ps(len, len, 1));
+	len = _mm_sqrt_ss(len);
+	if (_mm_cvtss_f32(len) != 0) q = _mm_div_ps(q, _mm_shuffle_ps(len, len, 0));
+	_mm_storeu_ps(&bone.rotation.X, q);
+#else
 	bone.rotation = from.rotation * invt;
 
 	if ((bone.rotation | to.rotation * t) < 0)
@@ -555,111 +740,126 @@ static TRS InterpolateBone(const TRS &from, const TRS &to, float t, float invt)
 
 	bone.rotation += to.rotation * t;
 	bone.rotation.MakeUnit();
+#endif
 	bone.scaling = from.scaling * invt + to.scaling * t;
 
 	return bone;
 }
 
-const TArray<VSMatrix> IQMModel::CalculateBones(int frame1, int frame2, float inter, int frame1_prev, float inter1_prev, int frame2_prev, float inter2_prev, const TArray<TRS>* animationData, DBoneComponents* boneComponentData, int index)
+//==========================================================================
+//
+// Returns the matrix palette for the given frames, either from the pose
+// cache or freshly evaluated. The returned array stays valid until a few
+// more poses of other models have been calculated on the same thread.
+//
+//==========================================================================
+
+const TArray<VSMatrix>& IQMModel::CalculateBones(int frame1, int frame2, float inter, int frame1_prev, float inter1_prev, int frame2_prev, float inter2_prev, const TArray<TRS>* animationData, DBoneComponents* boneComponentData, int index)
 {
+	static const TArray<VSMatrix> noBones;
 	const TArray<TRS>& animationFrames = animationData ? *animationData : TRSData;
-	if (Joints.Size() > 0)
+	if (Joints.Size() == 0)
 	{
-		int numbones = Joints.SSize();
+		return noBones;
+	}
 
-		if (boneComponentData->trscomponents[index].SSize() != numbones)
-			boneComponentData->trscomponents[index].Resize(numbones);
-		if (boneComponentData->trsmatrix[index].SSize() != numbones)
-			boneComponentData->trsmatrix[index].Resize(numbones);
+	int numbones = Joints.SSize();
+
+	FPoseKey key;
+	key.model = this;
+	key.animation = &animationFrames;
+	key.frame1 = clamp(frame1, 0, (animationFrames.SSize() - 1) / numbones);
+	key.frame2 = clamp(frame2, 0, (animationFrames.SSize() - 1) / numbones);
+	key.frame1_prev = frame1_prev;
+	key.frame2_prev = frame2_prev;
+	key.inter = QuantizeInter(inter);
+	key.inter1_prev = QuantizeInter(inter1_prev);
+	key.inter2_prev = QuantizeInter(inter2_prev);
+
+	auto &cache = PoseCache;
+	unsigned generation = PoseCacheGeneration.load(std::memory_order_relaxed);
+	FPoseCacheEntry *set = &cache.entries[(key.Hash() % POSE_CACHE_SETS) * POSE_CACHE_WAYS];
+	FPoseCacheEntry *victim = nullptr;
+	uint64_t victimAge = UINT64_MAX;
+
+	cache.counter++;
+	for (int w = 0; w < POSE_CACHE_WAYS; w++)
+	{
+		auto &entry = set[w];
+		bool current = entry.generation == generation;
+		if (current && entry.key == key)
+		{
+			entry.lastUse = cache.counter;
+			cache.hits++;
+			return entry.bones;
+		}
+		uint64_t age = current ? entry.lastUse : 0;
+		if (age < victimAge)
+		{
+			victim = &entry;
+			victimAge = age;
+		}
+	}
 
-		frame1 = clamp(frame1, 0, (animationFrames.SSize() - 1) / numbones);
-		frame2 = clamp(frame2, 0, (animationFrames.SSize() - 1) / numbones);
+	cache.misses++;
+	victim->key = key;
+	victim->generation = generation;
+	victim->lastUse = cache.counter;
+	EvaluatePose(victim->bones, animationFrames, key.frame1, key.frame2, DequantizeInter(key.inter), frame1_prev, DequantizeInter(key.inter1_prev), frame2_prev, DequantizeInter(key.inter2_prev));
+	return victim->bones;
+}
 
-		int offset1 = frame1 * numbones;
-		int offset2 = frame2 * numbones;
+void IQMModel::EvaluatePose(TArray<VSMatrix> &bones, const TArray<TRS> &animationFrames, int frame1, int frame2, float inter, int frame1_prev, float inter1_prev, int frame2_prev, float inter2_prev) const
+{
+	int numbones = Joints.SSize();
 
-		int offset1_1 = frame1_prev * numbones;
-		int offset2_1 = frame2_prev * numbones;
+	int offset1 = frame1 * numbones;
+	int offset2 = frame2 * numbones;
 
-		float invt = 1.0f - inter;
-		float invt1 = 1.0f - inter1_prev;
-		float invt2 = 1.0f - inter2_prev;
+	int offset1_1 = frame1_prev * numbones;
+	int offset2_1 = frame2_prev * numbones;
 
-		float swapYZ[16] = { 0.0f };
-		swapYZ[0 + 0 * 4] = 1.0f;
-		swapYZ[1 + 2 * 4] = 1.0f;
-		swapYZ[2 + 1 * 4] = 1.0f;
-		swapYZ[3 + 3 * 4] = 1.0f;
-
-		TArray<VSMatrix> bones(numbones, true);
-		TArray<bool> modifiedBone(numbones, true);
-		for (int i = 0; i < numbones; i++)
-		{
-			TRS prev;
-
-			if(frame1 >= 0 && (frame1_prev >= 0 || inter1_prev < 0))
-			{
-				prev = inter1_prev <= 0 ? animationFrames[offset1 + i] : InterpolateBone(animationFrames[offset1_1 + i], animationFrames[offset1 + i], inter1_prev, invt1);
-			}
+	float invt = 1.0f - inter;
+	float invt1 = 1.0f - inter1_prev;
+	float invt2 = 1.0f - inter2_prev;
 
-			TRS next;
+	bones.Resize(numbones);
+	for (int i = 0; i < numbones; i++)
+	{
+		TRS prev;
 
-			if(frame2 >= 0 && (frame2_prev >= 0 || inter2_prev < 0))
-			{
-				next = inter2_prev <= 0 ? animationFrames[offset2 + i] : InterpolateBone(animationFrames[offset2_1 + i], animationFrames[offset2 + i], inter2_prev, invt2);
-			}
+		if(frame1 >= 0 && (frame1_prev >= 0 || inter1_prev < 0))
+		{
+			prev = inter1_prev <= 0 ? animationFrames[offset1 + i] : InterpolateBone(animationFrames[offset1_1 + i], animationFrames[offset1 + i], inter1_prev, invt1);
+		}
 
-			TRS bone;
+		TRS next;
 
-			if(frame1 >= 0 || inter < 0)
-			{
-				bone = inter < 0 ? animationFrames[offset1 + i] : InterpolateBone(prev, next , inter, invt);
-			}
-
-			if (Joints[i].Parent >= 0 && modifiedBone[Joints[i].Parent])
-			{
-				boneComponentData->trscomponents[index][i] = bone;
-				modifiedBone[i] = true;
-			}
-			else if (boneComponentData->trscomponents[index][i].Equals(bone))
-			{
-				bones[i] = boneComponentData->trsmatrix[index][i];
-				modifiedBone[i] = false;
-				continue;
-			}
-			else
-			{
-				boneComponentData->trscomponents[index][i] = bone;
-				modifiedBone[i] = true;
-			}
+		if(frame2 >= 0 && (frame2_prev >= 0 || inter2_prev < 0))
+		{
+			next = inter2_prev <= 0 ? animationFrames[offset2 + i] : InterpolateBone(animationFrames[offset2_1 + i], animationFrames[offset2 + i], inter2_prev, invt2);
+		}
 
-			VSMatrix m;
-			m.loadIdentity();
-			m.translate(bone.translation.X, bone.translation.Y, bone.translation.Z);
-			m.multQuaternion(bone.rotation);
-			m.scale(bone.scaling.X, bone.scaling.Y, bone.scaling.Z);
+		TRS bone;
 
-			VSMatrix& result = bones[i];
-			if (Joints[i].Parent >= 0)
-			{
-				result = bones[Joints[i].Parent];
-				result.multMatrix(swapYZ);
-				result.multMatrix(baseframe[Joints[i].Parent]);
-				result.multMatrix(m);
-				result.multMatrix(inversebaseframe[i]);
-			}
-			else
-			{
-				result.loadMatrix(swapYZ);
-				result.multMatrix(m);
-				result.multMatrix(inversebaseframe[i]);
-			}
-			result.multMatrix(swapYZ);
+		if(frame1 >= 0 || inter < 0)
+		{
+			bone = inter < 0 ? animationFrames[offset1 + i] : InterpolateBone(prev, next , inter, invt);
 		}
 
-		boneComponentData->trsmatrix[index] = bones;
-
-		return bones;
+		// parent * swapYZ * baseframe[parent] * bone * inversebaseframe[i] * swapYZ, with the constant parts premultiplied at load time.
+		FLOATTYPE m[16], result[16];
+		MakeBoneMatrix(m, bone);
+		if (Joints[i].Parent >= 0)
+		{
+			MultBoneMatrix(result, bones[Joints[i].Parent].get(), bonePre[i].get());
+			MultBoneMatrix(result, result, m);
+		}
+		else
+		{
+			MultBoneMatrix(result, bonePre[i].get(), m);
+		}
+		MultBoneMatrix(result, result, bonePost[i].get());
+		bones[i].loadMatrix(result);
 	}
-	return {};
 }
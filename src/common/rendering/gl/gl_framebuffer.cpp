@@ -68,6 +68,7 @@
 
 #include "filesystem.h"
 #include "c_dispatch.h"
+#include "texturediskcache.h"
 
 EXTERN_CVAR (Bool, vid_vsync)
 EXTERN_CVAR(Int, gl_tonemap)
@@ -149,11 +150,28 @@ void GlTexLoadThread::bgproc() {
 	if (auxContext >= 0) gl_setNULLContext();
 }
 
-void GlTexLoadThread::prepareLoad() {
-	//gl_setAUXContext(auxContext);
+
+// Uploads pixels decoded by a job. Only created when the thread has a context to upload with.
+bool GlTexLoadThread::loadResource(GlTexLoadOut & input, GlTexLoadOut & output) {
+	output = input;
+
+	if (input.imgSource->IsGPUOnly()) {
+		output.tex->BackgroundCreateCompressedTexture(input.pixels, (uint32_t)input.pixelsSize, (uint32_t)input.totalDataSize, input.pixelW, input.pixelH, input.texUnit, input.mipLevels, "GlTexLoadThread::loadResource(Compressed)", !input.flags.AllowMips, input.flags.AllowQualityReduction);
+	}
+	else {
+		output.tex->BackgroundCreateTexture(input.pixels, input.pixelW, input.pixelH, input.texUnit, input.flags.CreateMips, false, "GlTexLoadThread::loadResource()", !input.flags.AllowMips);
+	}
+
+	free(input.pixels);
+	output.pixels = nullptr;
+
+	return true;
 }
 
-bool GlTexLoadThread::loadResource(GlTexLoadIn & input, GlTexLoadOut & output) {
+
+// Reads and decodes the image for a load request. This is pure CPU work and runs as a job,
+// the pixels are always returned in output and uploaded by whoever consumes it.
+static void DecodeTexture(const GlTexLoadIn & input, GlTexLoadOut & output) {
 	FImageLoadParams* params = input.params;
 
 	output.conversion = params->conversion;
@@ -170,9 +188,7 @@ bool GlTexLoadThread::loadResource(GlTexLoadIn & input, GlTexLoadOut & output) {
 
 	// Load pixels directly with the reader we copied on the main thread
 	auto* src = input.imgSource;
-	FBitmap pixels;
 
-	const bool uploadPossible = auxContext >= 0;
 	const bool allowMips = input.flags.AllowMips;
 	const bool indexed = false;	// TODO: Determine this properly
 	bool mipmap = !indexed && allowMips;
@@ -185,8 +201,26 @@ bool GlTexLoadThread::loadResource(GlTexLoadIn & input, GlTexLoadOut & output) {
 	unsigned char* pixelData = nullptr;
 	size_t pixelDataSize = 0;
 	
+	// @Cockatrice - Decoded images can come from the disk cache, sprite info is always stored with them
+	FTexCacheKey cacheKey;
+	const bool cacheable = !gpu && TextureDiskCache.MakeKey(src, params, input.spi.shouldExpand, input.spi.notrimming, cacheKey);
+	const bool makeSpi = input.spi.generateSpi || cacheable;
+	bool cacheHit = false;
+
+	if (cacheable) {
+		bool translucent = false;
+		cacheHit = TextureDiskCache.Load(cacheKey, buffWidth, buffHeight, pixelData, translucent, output.spi.info);
+		if (cacheHit) {
+			pixelDataSize = 4u * (size_t)buffWidth * (size_t)buffHeight;
+			output.flags.OutputIsTranslucent = translucent;
+			output.totalDataSize = pixelDataSize;
+		}
+	}
 
-	if (exx && !gpu) {
+	if (cacheHit) {
+		// Nothing left to decode
+	}
+	else if (exx && !gpu) {
 		pixelDataSize = 4u * (size_t)buffWidth * (size_t)buffHeight;
 		pixelData = (unsigned char*)malloc(pixelDataSize);
 		memset(pixelData, 0, pixelDataSize);
@@ -201,8 +235,8 @@ bool GlTexLoadThread::loadResource(GlTexLoadIn & input, GlTexLoadOut & output) {
 		pixels.Blit(exx, exx, srcBitmap);
 
 		// If we need sprite positioning info, generate it here and assign it in the main thread later
-		if (input.spi.generateSpi) {
-			FGameTexture::GenerateInitialSpriteData(output.spi.info, &srcBitmap, input.spi.shouldExpand, input.spi.notrimming);
+		if (makeSpi) {
+			FGameTexture::GenerateInitialSpriteData(output.spi.info, &srcBitmap, input.spi.shouldExpand, input.spi.notrimming, SpriteTrimCache.LumpFor(params));
 		}
 
 		output.totalDataSize = pixelDataSize;
@@ -215,10 +249,6 @@ bool GlTexLoadThread::loadResource(GlTexLoadIn & input, GlTexLoadOut & output) {
 			output.mipLevels = numMipLevels;
 			reader.Close();
 
-			if (uploadPossible) {
-				output.tex->BackgroundCreateCompressedTexture(pixelData, (uint32_t)pixelDataSize, (uint32_t)output.totalDataSize, buffWidth, buffHeight, input.texUnit, numMipLevels, "GlTexLoadThread::loadResource(Compressed)", !allowMips, input.flags.AllowQualityReduction);
-			}
-
 			if (input.spi.generateSpi) {
 				FGameTexture::GenerateEmptySpriteData(output.spi.info, buffWidth, buffHeight);
 			}
@@ -233,80 +263,43 @@ bool GlTexLoadThread::loadResource(GlTexLoadIn & input, GlTexLoadOut & output) {
 			output.flags.OutputIsTranslucent = src->ReadPixels(params, &pixels);
 			output.totalDataSize = pixelDataSize;
 
-			if (input.spi.generateSpi) {
-				FGameTexture::GenerateInitialSpriteData(output.spi.info, &pixels, input.spi.shouldExpand, input.spi.notrimming);
+			if (makeSpi) {
+				FGameTexture::GenerateInitialSpriteData(output.spi.info, &pixels, input.spi.shouldExpand, input.spi.notrimming, SpriteTrimCache.LumpFor(params));
 			}
 		}
 	}
 
+	if (cacheable && !cacheHit && pixelData) {
+		TextureDiskCache.Store(cacheKey, buffWidth, buffHeight, pixelData, output.flags.OutputIsTranslucent, output.spi.info);
+	}
+
 	delete input.params;
 
 	output.pixelsSize = pixelDataSize;
 	output.pixelW = buffWidth;
 	output.pixelH = buffHeight;
-	output.flags.CreateMips = mipmap && allowMips;
-
-	if (!uploadPossible) {
-		output.flags.CreateMips = mipmap;
-		output.pixels = pixelData;
-	}
-	else {
-		output.flags.CreateMips = mipmap;
-		output.pixels = nullptr;
-
-		if (!gpu)
-			output.tex->BackgroundCreateTexture(pixelData, buffWidth, buffHeight, input.texUnit, mipmap, indexed, "GlTexLoadThread::loadResource()", !allowMips);
+	output.flags.CreateMips = mipmap;
+	output.pixels = pixelData;
 
-		free(pixelData);
-	}
-
-	
 	// TODO: Mark failed images as unloadable so they don't keep coming back to the queue
-	return true;
 }
 
 
-bool GLModelLoadThread::loadResource(GLModelLoadIn& input, GLModelLoadOut& output) {
-	FileReader reader = fileSystem.OpenFileReader(input.lump, FileSys::EReaderType::READER_NEW, 0);
-	output.data = reader.Read();
-	reader.Close();
-
-	output.lump = input.lump;
-	output.model = input.model;
-
-	return true;
-}
-
-
-
 // @Cockatrice - Background loader management =======================================
 // ==================================================================================
 void OpenGLFrameBuffer::GetBGQueueSize(int& current, int &secCurrent, int& collisions, int& max, int& maxSec, int& total, int &outSize, int &models) {
-	max = maxSec = total = 0;
-	current = primaryTexQueue.size();
-	secCurrent = secondaryTexQueue.size();
+	current = texJobs.Queued(JOBPRI_Now);
+	secCurrent = texJobs.Queued(JOBPRI_Precache) + texJobs.Queued(JOBPRI_Speculative);
 	max = statMaxQueued;
 	maxSec = statMaxQueuedSecondary;
 	collisions = statCollisions;
-	outSize = outputTexQueue.size();
+	outSize = outputTexQueue.size() + decodedTexQueue.size();
 	models = statModelsLoaded;
-
-	for (auto& tfr : bgTransferThreads) {
-		total += tfr->statTotalLoaded();
-	}
+	total = texJobs.Completed();
 }
 
 void OpenGLFrameBuffer::GetBGStats(double& min, double& max, double& avg) {
-	min = 99999998;
-	max = avg = 0;
-
-	for (auto& tfr : bgTransferThreads) {
-		min = std::min(tfr->statMinLoadTime(), min);
-		max = std::max(tfr->statMaxLoadTime(), max);
-		avg += tfr->statAvgLoadTime();
-	}
-
-	avg /= (double)bgTransferThreads.size();
+	texJobs.GetTimes(min, max, avg);
 }
 
 void OpenGLFrameBuffer::GetBGStats2(double& min, double& max, double& avg) {
@@ -320,6 +313,7 @@ void OpenGLFrameBuffer::GetBGStats2(double& min, double& max, double& avg) {
 
 void OpenGLFrameBuffer::ResetBGStats() {
 	statMaxQueued = statMaxQueuedSecondary = 0;
+	texJobs.ResetStats();
 	for (auto& tfr : bgTransferThreads) tfr->resetStats();
 	statCollisions = 0;
 	fgTotalTime = fgTotalCount = fgMin = fgMax = 0;
@@ -340,15 +334,49 @@ bool OpenGLFrameBuffer::BackgroundLoadModel(FModel* model) {
 
 	model->SetLoadState(FModel::LOADING);
 
-	GLModelLoadIn modelLoad;
-	modelLoad.model = model;
-	modelLoad.lump = model->GetLumpNum();
-	modelInQueue.queue(modelLoad);
+	const int lump = model->GetLumpNum();
+	BackgroundJobs.Submit(JOBPRI_Now, &modelJobs, [this, model, lump]() {
+		GLModelLoadOut modelOut;
+		FileReader reader = fileSystem.OpenFileReader(lump, FileSys::EReaderType::READER_NEW, 0);
+		modelOut.data = reader.Read();
+		reader.Close();
+
+		modelOut.lump = lump;
+		modelOut.model = model;
+		modelOutQueue.queue(modelOut);
+	}, [model]() {
+		model->SetLoadState(FModel::NONE);
+	}, model);
 
 	return true;
 }
 
 
+// Queue the decode of one texture layer. Decoded pixels go to the upload threads if there are any,
+// otherwise straight to the main thread. A cancelled load puts the texture back to where it was
+// before it was requested, so it gets requested again the next time it is needed.
+void OpenGLFrameBuffer::SubmitTextureLoad(const GlTexLoadIn& in, bool secondary) {
+	BackgroundJobs.Submit(secondary ? JOBPRI_Precache : JOBPRI_Now, &texJobs, [this, in]() {
+		GlTexLoadOut out;
+		DecodeTexture(in, out);
+
+		if (bgTransferThreads.size() > 0) {
+			decodedTexQueue.queue(out);
+			for (auto& tfr : bgTransferThreads) tfr->wake();
+		}
+		else {
+			outputTexQueue.queue(out);
+		}
+	}, [in]() {
+		delete in.params;
+		in.tex->SetHardwareState(IHardwareTexture::HardwareState::NONE, in.texUnit);
+	}, in.tex);
+
+	if (secondary) statMaxQueuedSecondary = max(statMaxQueuedSecondary, texJobs.Queued(JOBPRI_Precache));
+	else statMaxQueued = max(statMaxQueued, texJobs.Queued(JOBPRI_Now));
+}
+
+
 // @Cockatrice - Cache a texture material, intended for use outside of the main thread
 bool OpenGLFrameBuffer::BackgroundCacheTextureMaterial(FGameTexture* tex, FTranslationID translation, int scaleFlags, bool makeSPI) {
 	if (!tex || !tex->isValid() || tex->GetID().GetIndex() == 0) return false;
@@ -386,14 +414,10 @@ bool OpenGLFrameBuffer::BackgroundCacheMaterial(FMaterial* mat, FTranslationID t
 	flags.AllowMips = !mat->sourcetex->GetNoMipmaps();;
 	flags.AllowQualityReduction = (layer->scaleFlags & CTF_ReduceQuality);
 
-	// If the texture is already submitted to the cache, find it and move it to the normal queue to reprioritize it
+	// If the texture is already submitted to the cache, move its job up to reprioritize it
 	if (lumpExists && !secondary && systex->GetState(0) == IHardwareTexture::HardwareState::CACHING) {
-		GlTexLoadIn in;
-		if (secondaryTexQueue.dequeueSearch(in, systex,
-			[](void* a, GlTexLoadIn& b)
-		{ return (FHardwareTexture*)a == b.tex; })) {
+		if (BackgroundJobs.Promote(systex, JOBPRI_Now)) {
 			systex->SetHardwareState(IHardwareTexture::HardwareState::LOADING, 0);
-			primaryTexQueue.queue(in);
 			return true;
 		}
 	}
@@ -424,8 +448,7 @@ bool OpenGLFrameBuffer::BackgroundCacheMaterial(FMaterial* mat, FTranslationID t
 				flags
 			};
 
-			if (secondary) secondaryTexQueue.queue(in);
-			else primaryTexQueue.queue(in);
+			SubmitTextureLoad(in, secondary);
 		}
 		else {
 			systex->SetHardwareState(IHardwareTexture::HardwareState::READY, 0); // TODO: Set state to a special "unloadable" state
@@ -445,12 +468,8 @@ bool OpenGLFrameBuffer::BackgroundCacheMaterial(FMaterial* mat, FTranslationID t
 		bool lumpExists = fileSystem.FileLength(lump) >= 0;
 
 		if (lumpExists && !secondary && syslayer->GetState(i) == IHardwareTexture::HardwareState::CACHING) {
-			GlTexLoadIn in;
-			if (secondaryTexQueue.dequeueSearch(in, syslayer,
-				[](void* a, GlTexLoadIn& b)
-			{ return (FHardwareTexture*)a == b.tex; })) {
+			if (BackgroundJobs.Promote(syslayer, JOBPRI_Now)) {
 				syslayer->SetHardwareState(IHardwareTexture::HardwareState::LOADING, i);
-				primaryTexQueue.queue(in);
 				return true;
 			}
 		}
@@ -479,8 +498,7 @@ bool OpenGLFrameBuffer::BackgroundCacheMaterial(FMaterial* mat, FTranslationID t
 					flags
 				};
 
-				if (secondary) secondaryTexQueue.queue(in);
-				else primaryTexQueue.queue(in);
+				SubmitTextureLoad(in, secondary);
 			}
 			else {
 				syslayer->SetHardwareState(IHardwareTexture::HardwareState::READY, i); // TODO: Set state to a special "unloadable" state
@@ -488,58 +506,61 @@ bool OpenGLFrameBuffer::BackgroundCacheMaterial(FMaterial* mat, FTranslationID t
 		}
 	}
 
-	statMaxQueued = max(statMaxQueued, primaryTexQueue.size());
-	statMaxQueuedSecondary = max(statMaxQueuedSecondary, secondaryTexQueue.size());
-
 	return true;
 }
 
 
-void OpenGLFrameBuffer::StopBackgroundCache() {
-	primaryTexQueue.clear();
-	secondaryTexQueue.clear();
+void OpenGLFrameBuffer::CancelBackgroundCache() {
 	patchQueue.clear();
-	modelInQueue.clear();
+
+	int textures = BackgroundJobs.Cancel(&texJobs);
+	int models = BackgroundJobs.Cancel(&modelJobs);
+
+	if (textures > 0 || models > 0) {
+		Printf(TEXTCOLOR_GREEN"OpenGLFrameBuffer: Cancelled %d texture and %d model loads\n", textures, models);
+	}
+}
+
+
+void OpenGLFrameBuffer::StopBackgroundCache() {
+	CancelBackgroundCache();
+	texJobs.Wait();
+	modelJobs.Wait();
 
 	for (auto& tfr : bgTransferThreads) {
 		tfr->stop();
 	}
 
-	modelThread->stop();
+	decodedTexQueue.clear();
 	modelOutQueue.clear();
 	outputTexQueue.clear();
 }
 
 
 void OpenGLFrameBuffer::FlushBackground() {
-	int nq = primaryTexQueue.size() + secondaryTexQueue.size();
-	bool active = nq;
+	int nq = texJobs.Pending();
 
-	if (!active)
-		for (auto& tfr : bgTransferThreads) active = active || tfr->isActive();
-
-	Printf(TEXTCOLOR_GREEN"OpenGLFrameBuffer[%s]: Flushing [%d + %d] = %d texture load ops\n", active ? "active" : "inactive", nq, patchQueue.size(), nq + patchQueue.size());
-	Printf(TEXTCOLOR_GREEN"\tFlushing %d - %d Model Reads\n", modelInQueue.size(), modelOutQueue.size());
-
-	// Make sure active is marked if we have patches waiting
-	active = active || patchQueue.size() > 0;
+	Printf(TEXTCOLOR_GREEN"OpenGLFrameBuffer: Flushing [%d + %d] = %d texture load ops\n", nq, patchQueue.size(), nq + patchQueue.size());
+	Printf(TEXTCOLOR_GREEN"\tFlushing %d - %d Model Reads\n", modelJobs.Pending(), modelOutQueue.size());
 
 	// Finish anything queued, and send anything that needs to be loaded from the patch queue
 	UpdateBackgroundCache(true);
 
-	// Wait for everything to load, kinda cheating here but this shouldn't be called in the game loop only at teardown
 	cycle_t check = cycle_t();
 	check.Clock();
 
-	while (active) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
-
-		UpdateBackgroundCache(true);
+	// Decoding does not depend on the main thread, so the jobs can simply be waited on
+	texJobs.Wait();
+	modelJobs.Wait();
 
-		active = false;
+	// Then give the upload threads time to drain what was decoded
+	bool active = true;
+	while (active) {
+		active = decodedTexQueue.size() > 0;
 		for (auto& tfr : bgTransferThreads)
 			active = active || tfr->isActive();
-		active = active || modelThread->isActive();
+
+		if (active) std::this_thread::sleep_for(std::chrono::milliseconds(2));
 	}
 
 	// Finish anything that was loaded
@@ -666,6 +687,12 @@ OpenGLFrameBuffer::~OpenGLFrameBuffer()
 {
 	PPResource::ResetAll();
 
+	// Jobs still reference this framebuffer's queues
+	BackgroundJobs.Cancel(&texJobs);
+	BackgroundJobs.Cancel(&modelJobs);
+	texJobs.Wait();
+	modelJobs.Wait();
+
 	bgTransferThreads.clear();
 
 	if (mVertexData != nullptr) delete mVertexData;
@@ -750,22 +777,25 @@ void OpenGLFrameBuffer::InitializeState()
 	mDebug->Update();
 
 	bgTransferThreads.clear();
+	bgTransferEnabled = false;
 	if (gl_texture_thread) {
-		int numThreads = 1;
+		int numThreads = 0;
 		bool canUpload = gl_texture_thread_upload && gl_numAUXContexts() > 0;
 
+		// Without an AUX context to upload with, decoded textures are uploaded on the main thread
 		if(canUpload)
 			numThreads = min(4, min((int)gl_max_transfer_threads, gl_numAUXContexts()));
 		
 		for (int x = 0; x < numThreads; x++) {
-			std::unique_ptr<GlTexLoadThread> ptr(new GlTexLoadThread(this, canUpload ? x : -1, &primaryTexQueue, &secondaryTexQueue, &outputTexQueue));
+			std::unique_ptr<GlTexLoadThread> ptr(new GlTexLoadThread(this, x, &decodedTexQueue, &outputTexQueue));
 			ptr->start();
 			bgTransferThreads.push_back(std::move(ptr));
 		}
+
+		bgTransferEnabled = !canUpload || numThreads > 0;
 	}
 
-	modelThread.reset(new GLModelLoadThread(&modelInQueue, &modelOutQueue));
-	modelThread->start();
+	BackgroundJobs.Start();
 }
 
 //==========================================================================
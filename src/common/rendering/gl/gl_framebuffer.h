@@ -4,6 +4,7 @@
 #include "gl_sysfb.h"
 #include "m_png.h"
 #include "TSQueue.h"
+#include "jobsystem.h"
 #include "image.h"
 
 #include <memory>
@@ -17,7 +18,7 @@ class FHardwareTexture;
 class FGLDebug;
 
 
-/* Background loader classes: TODO: Split GPU and File loading. */
+/* Background loader classes. Decoding runs as jobs in BackgroundJobs, the threads below only upload. */
 struct GlTexLoadSpiFull {
 	bool generateSpi, shouldExpand, notrimming;
 	SpritePositioningInfo info[2];
@@ -81,11 +82,6 @@ struct GlTexLoadOut {
 	GLTexLoadField flags;
 };
 
-struct GLModelLoadIn {
-	int lump = -1;
-	FModel* model = nullptr;
-};
-
 struct GLModelLoadOut {
 	int lump = -1;
 	FileSys::FileData data;
@@ -97,48 +93,27 @@ struct GLModelLoadOut {
 
 class OpenGLFrameBuffer;
 
-// @Cockatrice - Background loader thread to handle transfer of texture data
-class GlTexLoadThread : public ResourceLoader2<GlTexLoadIn, GlTexLoadOut> {
+// @Cockatrice - Background thread that uploads decoded texture data on its own AUX context
+class GlTexLoadThread : public ResourceLoader2<GlTexLoadOut, GlTexLoadOut, TSRingQueue<GlTexLoadOut>> {
 public:
-	GlTexLoadThread(OpenGLFrameBuffer *buffer, int contextIndex, TSQueue<GlTexLoadIn> *inQueue, TSQueue<GlTexLoadIn>* secondaryQueue, TSQueue<GlTexLoadOut>* outQueue) : ResourceLoader2(inQueue, secondaryQueue, outQueue) {
+	GlTexLoadThread(OpenGLFrameBuffer *buffer, int contextIndex, TSRingQueue<GlTexLoadOut> *inQueue, TSQueue<GlTexLoadOut>* outQueue) : ResourceLoader2(inQueue, nullptr, outQueue) {
 		auxContext = contextIndex;
-		submits = 0;
 		cmd = buffer;
 	}
 
 	~GlTexLoadThread() override {};
 
-	bool uploadPossible() const { return auxContext >= 0; }
-
 protected:
 	OpenGLFrameBuffer* cmd;
 
-	int submits, auxContext;
-
-	std::atomic<int> maxQueue;
+	int auxContext;
 
-	bool loadResource(GlTexLoadIn& input, GlTexLoadOut& output) override;
-	void cancelLoad() override {  }		// TODO: Actually finish this
-	void completeLoad() override {  }	// TODO: Same
-	void prepareLoad() override;
+	bool loadResource(GlTexLoadOut& input, GlTexLoadOut& output) override;
 
 	void bgproc() override;
 };
 
 
-class GLModelLoadThread : public ResourceLoader2<GLModelLoadIn, GLModelLoadOut> {
-public:
-	GLModelLoadThread(TSQueue<GLModelLoadIn>* inQueue, TSQueue<GLModelLoadOut>* outQueue) : ResourceLoader2(inQueue, nullptr, outQueue) {
-
-	}
-
-protected:
-	std::atomic<int> maxQueue;
-
-	bool loadResource(GLModelLoadIn& input, GLModelLoadOut& output) override;
-};
-
-
 
 class OpenGLFrameBuffer : public SystemGLFrameBuffer
 {
@@ -175,9 +150,10 @@ public:
 	bool BackgroundLoadModel(FModel* model) override;
 	bool BackgroundCacheMaterial(FMaterial* mat, FTranslationID translation, bool makeSPI = false, bool secondary = false) override;
 	bool BackgroundCacheTextureMaterial(FGameTexture* tex, FTranslationID translation, int scaleFlags, bool makeSPI = false) override;
-	bool CachingActive() override { return secondaryTexQueue.size() > 0; }
-	bool SupportsBackgroundCache() override { return bgTransferThreads.size() > 0; }
+	bool CachingActive() override { return texJobs.Queued(JOBPRI_Precache) > 0; }
+	bool SupportsBackgroundCache() override { return bgTransferEnabled; }
 	void StopBackgroundCache() override;
+	void CancelBackgroundCache() override;
 	void FlushBackground() override;
 	float CacheProgress() override { return 0.5; }	// TODO: Report actual progress, there is no way to measure this yet and this function is not used yet
 	void UpdateBackgroundCache(bool flush = false) override;
@@ -215,7 +191,7 @@ public:
 	void GetBGQueueSize(int& current, int& currentSec, int& collisions, int& max, int& maxSec, int& total, int &outSize, int &models);
 	void GetBGStats(double& min, double& max, double& avg);
 	void GetBGStats2(double& min, double& max, double& avg);
-	int GetNumThreads() { return (int)bgTransferThreads.size(); }
+	int GetNumThreads() { return BackgroundJobs.NumWorkers(); }
 	void ResetBGStats();
 
 	int camtexcount = 0;
@@ -228,14 +204,16 @@ private:
 		bool generateSPI;
 	};
 
+	void SubmitTextureLoad(const GlTexLoadIn& in, bool secondary);
+
 	int statMaxQueued = 0, statMaxQueuedSecondary = 0, statCollisions = 0, statModelsLoaded = 0;
-	TSQueue<GlTexLoadIn> primaryTexQueue, secondaryTexQueue;
+	FJobGroup texJobs, modelJobs;										// Decode and model read jobs, so they can be waited on and cancelled
+	TSRingQueue<GlTexLoadOut> decodedTexQueue{ 64 };					// Decoded images waiting for an upload thread, bounded to limit the pixel memory in flight
 	TSQueue<GlTexLoadOut> outputTexQueue;
-	TSQueue<GLModelLoadIn> modelInQueue;
 	TSQueue<GLModelLoadOut> modelOutQueue;
 	TSQueue<QueuedPatch> patchQueue;									// @Cockatrice - Thread safe queue of textures to create materials for and submit to the bg thread
-	std::vector<std::unique_ptr<GlTexLoadThread>> bgTransferThreads;	// @Cockatrice - Threads that handle the background transfers
-	std::unique_ptr<GLModelLoadThread> modelThread;						// Loads models, always 1 thread
+	std::vector<std::unique_ptr<GlTexLoadThread>> bgTransferThreads;	// @Cockatrice - Threads that handle the background uploads
+	bool bgTransferEnabled = false;
 
 	double fgTotalTime = 0, fgTotalCount = 0, fgMin = 0, fgMax = 0;		// Foreground integration time stats
 };
@@ -51,6 +51,8 @@ glcycle_t Dirty;
 glcycle_t drawcalls;
 glcycle_t twoD, Flush3D;
 glcycle_t MTWait, WTTotal;
+glcycle_t WTWorkerTotal[MAX_RENDER_WORKERS], WTWorkerBusy[MAX_RENDER_WORKERS];
+int WTWorkerCount;
 int vertexcount, flatvertices, flatprimitives;
 
 int rendered_lines,rendered_flats,rendered_sprites,render_vertexsplit,render_texsplit,rendered_decals, rendered_portals, rendered_commandbuffers;
@@ -75,6 +77,11 @@ void ResetProfilingData()
 	drawcalls.Reset();
 	MTWait.Reset();
 	WTTotal.Reset();
+	for (int i = 0; i < MAX_RENDER_WORKERS; i++)
+	{
+		WTWorkerTotal[i].Reset();
+		WTWorkerBusy[i].Reset();
+	}
 
 	flatvertices=flatprimitives=vertexcount=0;
 	render_texsplit=render_vertexsplit=rendered_lines=rendered_flats=rendered_sprites=rendered_decals=rendered_portals = 0;
@@ -109,6 +116,10 @@ static void AppendRenderTimes(FString &str)
 		All.TimeMS() + Finish.TimeMS(), RenderAll.TimeMS(), ProcessAll.TimeMS(), PortalAll.TimeMS(), drawcalls.TimeMS(), PostProcess.TimeMS(), Finish.TimeMS(),
 		GPUWait.TimeMS(), FPSWait.TimeMS()
 	);
+	for (int i = 0; i < WTWorkerCount; i++)
+	{
+		str.AppendFormat("\nWorker %d: total=%2.3f, waiting=%2.3f", i, WTWorkerTotal[i].TimeMS(), WTWorkerTotal[i].TimeMS() - WTWorkerBusy[i].TimeMS());
+	}
 }
 
 static void AppendRenderStats(FString &out)
@@ -14,6 +14,11 @@ extern glcycle_t Dirty;
 extern glcycle_t drawcalls, twoD, Flush3D;
 extern glcycle_t MTWait, WTTotal;
 
+// The BSP walk can feed up to this many render worker threads (walls and sprites, flats, particles).
+enum { MAX_RENDER_WORKERS = 3 };
+extern glcycle_t WTWorkerTotal[MAX_RENDER_WORKERS], WTWorkerBusy[MAX_RENDER_WORKERS];
+extern int WTWorkerCount;
+
 extern int iter_dlightf, iter_dlight, draw_dlight, draw_dlightf;
 extern int rendered_lines,rendered_flats,rendered_sprites,rendered_decals,render_vertexsplit,render_texsplit;
 extern int rendered_portals;
@@ -235,6 +235,8 @@ public:
 	virtual bool SupportsBackgroundCache() { return false; }
 	virtual void UpdateBackgroundCache(bool flush = false) { }
 	virtual void StopBackgroundCache() { }
+	// Drop background loads that have not started yet, i.e. everything requested for a level that is going away
+	virtual void CancelBackgroundCache() { }
 	// Wait for all background loads to finish, then update background cache
 	virtual void FlushBackground() { }	
 	
@@ -65,6 +65,7 @@
 #include "vulkan/system/vk_buffer.h"
 #include "engineerrors.h"
 #include "c_dispatch.h"
+#include "texturediskcache.h"
 #include "image.h"
 #include "model.h"
 #include "vm.h"
@@ -204,33 +205,20 @@ CCMD(vk_rstbgstats) {
 
 
 void VulkanRenderDevice::GetBGQueueSize(int& current, int& secCurrent, int& collisions, int& max, int& maxSec, int& total, int& outSize, int& models) {
-	max = maxSec = total = 0;
-	current = primaryTexQueue.size();
-	secCurrent = secondaryTexQueue.size();
+	current = texJobs.Queued(JOBPRI_Now);
+	secCurrent = texJobs.Queued(JOBPRI_Precache) + texJobs.Queued(JOBPRI_Speculative);
 	max = statMaxQueued;
 	maxSec = statMaxQueuedSecondary;
 	collisions = statCollisions;
-	outSize = outputTexQueue.size() + bgtUploads.size();
+	outSize = outputTexQueue.size() + decodedTexQueue.size() + bgtUploads.size();
 	models = statModelsLoaded;
-
-	for (auto& tfr : bgTransferThreads) {
-		total += tfr->statTotalLoaded();
-	}
+	total = texJobs.Completed();
 }
 
 
 
 void VulkanRenderDevice::GetBGStats(double &min, double &max, double &avg) {
-	min = 99999998;
-	max = avg = 0;
-
-	for (auto& tfr : bgTransferThreads) {
-		min = std::min(tfr->statMinLoadTime(), min);
-		max = std::max(tfr->statMaxLoadTime(), max);
-		avg += tfr->statAvgLoadTime();
-	}
-
-	avg /= (double)bgTransferThreads.size();
+	texJobs.GetTimes(min, max, avg);
 }
 
 
@@ -247,6 +235,7 @@ void VulkanRenderDevice::GetBGStats2(double& min, double& max, double& avg) {
 
 void VulkanRenderDevice::ResetBGStats() {
 	statMaxQueued = statMaxQueuedSecondary = 0;
+	texJobs.ResetStats();
 	for (auto& tfr : bgTransferThreads) tfr->resetStats();
 	statCollisions = 0;
 	fgTotalTime = fgTotalCount = fgMin = fgMax = fgCurTime = 0;
@@ -254,14 +243,14 @@ void VulkanRenderDevice::ResetBGStats() {
 }
 
 bool VulkanRenderDevice::CachingActive() {
-	return secondaryTexQueue.size() > 0;
+	return texJobs.Queued(JOBPRI_Precache) > 0;
 }
 
 // TODO: Change this to report the actual progress once we have a way to mark the total number of objects to load
 float VulkanRenderDevice::CacheProgress() {
 	float total = 0;
 
-	return (float)secondaryTexQueue.size();
+	return (float)texJobs.Queued(JOBPRI_Precache);
 }
 
 
@@ -318,10 +307,9 @@ static void TempUploadTexture(VkCommandBufferManager *cmd, VkHardwareTexture *te
 	}
 }
 
-// @Cockatrice - TODO: Separate 
-bool VkTexLoadThread::loadResource(VkTexLoadIn &input, VkTexLoadOut &output) {
-	currentImageID.store(input.imgSource->GetId());
-
+// Reads and decodes the image for a load request. This is pure CPU work and runs as a job,
+// the pixels are always returned in output and uploaded by whoever consumes it.
+static void DecodeTexture(const VkTexLoadIn &input, VkTexLoadOut &output) {
 	FImageLoadParams *params = input.params;
 
 	output.conversion = params->conversion;
@@ -345,13 +333,28 @@ bool VkTexLoadThread::loadResource(VkTexLoadIn &input, VkTexLoadOut &output) {
 	bool indexed = false;	// TODO: Determine this properly
 	bool allowMips = (input.flags & TEXLOAD_ALLOWMIPS);
 	bool mipmap = !indexed && allowMips;
-	VkFormat fmt = indexed ? VK_FORMAT_R8_UNORM : VK_FORMAT_B8G8R8A8_UNORM;
-	VulkanDevice* device = cmd != nullptr ? cmd->GetRenderDevice()->device.get() : nullptr;
 
 	unsigned char* pixelData = nullptr;
 	size_t pixelDataSize = 0;
 
-	if (exx && !gpu) {
+	// @Cockatrice - Decoded images can come from the disk cache, sprite info is always stored with them
+	FTexCacheKey cacheKey;
+	const bool cacheable = !gpu && TextureDiskCache.MakeKey(src, params, input.spi.shouldExpand, input.spi.notrimming, cacheKey);
+	const bool makeSpi = input.spi.generateSpi || cacheable;
+	bool cacheHit = false;
+
+	if (cacheable) {
+		cacheHit = TextureDiskCache.Load(cacheKey, buffWidth, buffHeight, pixelData, output.isTranslucent, output.spi.info);
+		if (cacheHit) {
+			pixelDataSize = 4u * (size_t)buffWidth * (size_t)buffHeight;
+			output.totalDataSize = pixelDataSize;
+		}
+	}
+
+	if (cacheHit) {
+		// Nothing left to decode
+	}
+	else if (exx && !gpu) {
 		pixelDataSize = 4u * (size_t)buffWidth * (size_t)buffHeight;
 		pixelData = (unsigned char*)malloc(pixelDataSize);
 		memset(pixelData, 0, pixelDataSize);
@@ -366,8 +369,8 @@ bool VkTexLoadThread::loadResource(VkTexLoadIn &input, VkTexLoadOut &output) {
 		pixels.Blit(exx, exx, srcBitmap);
 
 		// If we need sprite positioning info, generate it here and assign it in the main thread later
-		if (input.spi.generateSpi) {
-			FGameTexture::GenerateInitialSpriteData(output.spi.info, &srcBitmap, input.spi.shouldExpand, input.spi.notrimming);
+		if (makeSpi) {
+			FGameTexture::GenerateInitialSpriteData(output.spi.info, &srcBitmap, input.spi.shouldExpand, input.spi.notrimming, SpriteTrimCache.LumpFor(params));
 		}
 
 		output.totalDataSize = pixelDataSize;
@@ -382,21 +385,12 @@ bool VkTexLoadThread::loadResource(VkTexLoadIn &input, VkTexLoadOut &output) {
 			FileReader reader = fileSystem.OpenFileReader(params->lump, FileSys::EReaderType::READER_NEW, 0);
 			output.isTranslucent = src->ReadCompressedPixels(&reader, &pixelData, totalSize, pixelDataSize, numMipLevels);
 			reader.Close();
-			mipmap = false;
-			fmt = VK_FORMAT_BC7_UNORM_BLOCK;
 
 			output.totalDataSize = totalSize;
 
+			// Upload mipmaps if the science is correct
 			uint32_t expectedMipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(buffWidth, buffHeight)))) + 1;
-
-			// Only perform upload if we have a command buffer
-			if (cmd) {
-				mipmap = false;	// Don't generate mipmaps past this point
-				TempUploadTexture(cmd, output.tex, fmt, buffWidth, buffHeight, pixelData, pixelDataSize, totalSize, allowMips && numMipLevels == (int)expectedMipLevels && numMipLevels > 0, true, indexed, input.flags & TEXLOAD_ALLOWQUALITY);
-			}
-			else {
-				mipmap = allowMips && numMipLevels == (int)expectedMipLevels && numMipLevels > 0;	// Upload mipmaps if the science is correct
-			}
+			mipmap = allowMips && numMipLevels == (int)expectedMipLevels && numMipLevels > 0;
 
 			if (input.spi.generateSpi) {
 				// Generate sprite data without pixel data, since no trimming should occur
@@ -413,125 +407,118 @@ bool VkTexLoadThread::loadResource(VkTexLoadIn &input, VkTexLoadOut &output) {
 			output.isTranslucent = src->ReadPixels(params, &pixels);
 			output.totalDataSize = pixelDataSize;
 
-			if (input.spi.generateSpi) {
-				FGameTexture::GenerateInitialSpriteData(output.spi.info, &pixels, input.spi.shouldExpand, input.spi.notrimming);
+			if (makeSpi) {
+				FGameTexture::GenerateInitialSpriteData(output.spi.info, &pixels, input.spi.shouldExpand, input.spi.notrimming, SpriteTrimCache.LumpFor(params));
 			}
 		}
 	}
 
+	if (cacheable && !cacheHit && pixelData) {
+		TextureDiskCache.Store(cacheKey, buffWidth, buffHeight, pixelData, output.isTranslucent, output.spi.info);
+	}
+
 	delete input.params;
 
 	output.pixelsSize = pixelDataSize;
 	output.pixelW = buffWidth;
 	output.pixelH = buffHeight;
+	output.createMipmaps = mipmap;
+	output.pixels = pixelData;
 
-	// If there is no command buffer we have to do the upload in the main thread
-	// Transfer data if necessary
-	if (!cmd) {
-		output.createMipmaps = mipmap;
-		output.pixels = pixelData;
-	}
-	else {
-		output.createMipmaps = mipmap && !uploadQueue.familySupportsGraphics;
-		output.pixels = nullptr;
+	// TODO: Mark failed images as unloadable so they don't keep coming back to the queue
+}
 
-		// Upload non-gpu only textures
-		if (!gpu) {
-			output.tex->BackgroundCreateTexture(cmd, buffWidth, buffHeight, indexed ? 1 : 4, fmt, pixelData, mipmap ? -1 : 0, mipmap, (int)pixelDataSize);
-		}
 
-		// Wait for operations to finish, since we can't maintain a regular loop of clearing the buffer
-		if (cmd && cmd->TransferDeleteList->TotalSize > 1) {
-			cmd->WaitForCommands(false, true);
-		}
+// Uploads pixels decoded by a job. Only created for devices with upload queues.
+bool VkTexLoadThread::loadResource(VkTexLoadOut &input, VkTexLoadOut &output) {
+	currentImageID.store(input.imgSource->GetId());
 
-		if (pixelData) {
-			free(pixelData);
-		}
+	output = input;
 
-		// If we created the texture on a different family than the graphics family, we need to release access 
-		// to the image on this queue
-		if (device && device->GraphicsFamily != uploadQueue.queueFamily) {
-			auto cmds = cmd->CreateUnmanagedCommands();
-			cmds->SetDebugName("BGThread::QueueMoveCMDS");
-			output.releaseSemaphore = new VulkanSemaphore(device);
-			output.tex->ReleaseLoadedFromQueue(cmds.get(), uploadQueue.queueFamily, device->GraphicsFamily);
-			cmds->end();
+	bool gpu = input.imgSource->IsGPUOnly();
+	bool indexed = false;	// TODO: Determine this properly
+	bool mipmap = input.createMipmaps;
+	VulkanDevice* device = cmd->GetRenderDevice()->device.get();
 
-			QueueSubmit submit;
-			submit.AddCommandBuffer(cmds.get());
-			submit.AddSignal(output.releaseSemaphore);
-
-			deleteList.push_back(std::move(cmds));
-
-			//if(++submits == 8) {
-				// TODO: We have to wait for each submit right now, because for some reason we can't rely on sempaphores
-				// being used by the time we get back to the main thread and move resources to the main graphics queue.
-				// I believe this is incorrect, we should be able to move on here without having to wait.
-			submits = 1;
-			submit.Execute(device, uploadQueue.queue, submitFences[submits - 1].get());
-			vkWaitForFences(device->device, submits, submitWaitFences, VK_TRUE, std::numeric_limits<uint64_t>::max());
-			vkResetFences(device->device, submits, submitWaitFences);
-			deleteList.clear();
-			submits = 0;
-			//} else {
-			//	submit.Execute(device, device->uploadQueue, submitFences[submits - 1].get());
-			//}
-		}
+	if (gpu) {
+		TempUploadTexture(cmd, output.tex, VK_FORMAT_BC7_UNORM_BLOCK, input.pixelW, input.pixelH, input.pixels, input.pixelsSize, input.totalDataSize, mipmap, true, indexed, input.flags & TEXLOAD_ALLOWQUALITY);
+		mipmap = false;	// Don't generate mipmaps past this point
+	}
+	else {
+		output.tex->BackgroundCreateTexture(cmd, input.pixelW, input.pixelH, indexed ? 1 : 4, indexed ? VK_FORMAT_R8_UNORM : VK_FORMAT_B8G8R8A8_UNORM, input.pixels, mipmap ? -1 : 0, mipmap, (int)input.pixelsSize);
 	}
 
-	// Always return true, because failed images need to be marked as unloadable
-	// TODO: Mark failed images as unloadable so they don't keep coming back to the queue
-	return true;
-}
-
-void VkTexLoadThread::cancelLoad() { currentImageID.store(0); }
-void VkTexLoadThread::completeLoad() { currentImageID.store(0); }
+	output.createMipmaps = mipmap && !uploadQueue.familySupportsGraphics;
+	output.pixels = nullptr;
 
+	// Wait for operations to finish, since we can't maintain a regular loop of clearing the buffer
+	if (cmd->TransferDeleteList->TotalSize > 1) {
+		cmd->WaitForCommands(false, true);
+	}
 
-bool VkModelLoadThread::loadResource(VkModelLoadIn& input, VkModelLoadOut& output) {
-	FileReader reader = fileSystem.OpenFileReader(input.lump, FileSys::EReaderType::READER_NEW, 0);
-	output.data = reader.Read();
-	reader.Close();
+	if (input.pixels) {
+		free(input.pixels);
+	}
 
-	output.lump = input.lump;
-	output.model = input.model;
+	// If we created the texture on a different family than the graphics family, we need to release access 
+	// to the image on this queue
+	if (device && device->GraphicsFamily != uploadQueue.queueFamily) {
+		auto cmds = cmd->CreateUnmanagedCommands();
+		cmds->SetDebugName("BGThread::QueueMoveCMDS");
+		output.releaseSemaphore = new VulkanSemaphore(device);
+		output.tex->ReleaseLoadedFromQueue(cmds.get(), uploadQueue.queueFamily, device->GraphicsFamily);
+		cmds->end();
+
+		QueueSubmit submit;
+		submit.AddCommandBuffer(cmds.get());
+		submit.AddSignal(output.releaseSemaphore);
+
+		deleteList.push_back(std::move(cmds));
+
+		// TODO: We have to wait for each submit right now, because for some reason we can't rely on sempaphores
+		// being used by the time we get back to the main thread and move resources to the main graphics queue.
+		// I believe this is incorrect, we should be able to move on here without having to wait.
+		submits = 1;
+		submit.Execute(device, uploadQueue.queue, submitFences[submits - 1].get());
+		vkWaitForFences(device->device, submits, submitWaitFences, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		vkResetFences(device->device, submits, submitWaitFences);
+		deleteList.clear();
+		submits = 0;
+	}
 
 	return true;
 }
 
+void VkTexLoadThread::cancelLoad() { currentImageID.store(0); }
+void VkTexLoadThread::completeLoad() { currentImageID.store(0); }
+
 
 // END Background Loader Stuff =====================================================
 
 void VulkanRenderDevice::FlushBackground() {
-	int nq = primaryTexQueue.size() + secondaryTexQueue.size();
-	bool active = nq;
-
-	if(!active)
-		for (auto& tfr : bgTransferThreads) active = active || tfr->isActive();
+	int nq = texJobs.Pending();
 
-	Printf(TEXTCOLOR_GREEN"VulkanFrameBuffer[%s]: Flushing [%d + %d + %d] texture load ops\n", active ? "active" : "inactive", nq, patchQueue.size(), nq + patchQueue.size());
-	Printf(TEXTCOLOR_GREEN"\tFlushing %d - %d Model Reads\n", modelInQueue.size(), modelOutQueue.size());
-
-	// Make sure active is marked if we have patches waiting
-	active = active || patchQueue.size() > 0;
+	Printf(TEXTCOLOR_GREEN"VulkanFrameBuffer: Flushing [%d + %d] = %d texture load ops\n", nq, patchQueue.size(), nq + patchQueue.size());
+	Printf(TEXTCOLOR_GREEN"\tFlushing %d - %d Model Reads\n", modelJobs.Pending(), modelOutQueue.size());
 
 	// Finish anything queued, and send anything that needs to be loaded from the patch queue
 	UpdateBackgroundCache(true);
 		
-	// Wait for everything to load, kinda cheating here but this shouldn't be called in the game loop only at teardown
 	cycle_t check = cycle_t();
 	check.Clock();
-	
-	while (active) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
-		UpdateBackgroundCache(true);
+	// Decoding does not depend on the main thread, so the jobs can simply be waited on
+	texJobs.Wait();
+	modelJobs.Wait();
 
-		active = false;
+	// Then give the upload threads time to drain what was decoded
+	bool active = true;
+	while (active) {
+		active = decodedTexQueue.size() > 0;
 		for (auto& tfr : bgTransferThreads) 
 			active = active || tfr->isActive();
-		active = active || modelThread->isActive();
+
+		if (active) std::this_thread::sleep_for(std::chrono::milliseconds(2));
 	}
 
 	// Finish anything that was loaded
@@ -566,15 +553,11 @@ void VulkanRenderDevice::UpdateBackgroundCache(bool flush) {
 	if(outputTexQueue.size()) {
 		// Do transfers need to be made?
 		bool transferOwnership = false;
-		bool uploadOnMainThread = false;
+		bool uploadOnMainThread = !bgUploadEnabled;
 		for (int bgIndex = (int)bgTransferThreads.size() - 1; bgIndex >= 0; bgIndex--) {
-			if (bgTransferThreads[bgIndex]->getUploadQueue().queueFamily != device->GraphicsFamily && bgTransferThreads[bgIndex]->getUploadQueue().queueIndex >= 0) {
+			if (bgTransferThreads[bgIndex]->getUploadQueue().queueFamily != device->GraphicsFamily) {
 				transferOwnership = true;
 			}
-
-			if (bgTransferThreads[bgIndex]->getUploadQueue().queueIndex < 0) {
-				uploadOnMainThread = true;
-			}
 		}
 
 		if (transferOwnership && uploadOnMainThread) {
@@ -843,18 +826,26 @@ VulkanRenderDevice::~VulkanRenderDevice()
 }
 
 
+void VulkanRenderDevice::CancelBackgroundCache() {
+	patchQueue.clear();
+
+	int textures = BackgroundJobs.Cancel(&texJobs);
+	int models = BackgroundJobs.Cancel(&modelJobs);
+
+	if (textures > 0 || models > 0) {
+		Printf(TEXTCOLOR_GREEN"VulkanFrameBuffer: Cancelled %d texture and %d model loads\n", textures, models);
+	}
+}
+
 void VulkanRenderDevice::StopBackgroundCache() {
+	CancelBackgroundCache();
 	FlushBackground();
-	primaryTexQueue.clear();
-	secondaryTexQueue.clear();
-	modelInQueue.clear();
 
 	for (auto& tfr : bgTransferThreads) {
 		tfr->stop();
 	}
 
-	modelThread->stop();
-
+	decodedTexQueue.clear();
 	modelOutQueue.clear();
 	outputTexQueue.clear();
 }
@@ -927,21 +918,18 @@ void VulkanRenderDevice::InitializeState()
 
 			for (int q = 0; q < numThreads; q++) {
 				std::unique_ptr<VkCommandBufferManager> cmds(new VkCommandBufferManager(this, &device->uploadQueues[q].queue, device->uploadQueues[q].queueFamily, true));
-				std::unique_ptr<VkTexLoadThread> ptr(new VkTexLoadThread(cmds.get(), device.get(), q, &primaryTexQueue, &secondaryTexQueue, &outputTexQueue));
+				std::unique_ptr<VkTexLoadThread> ptr(new VkTexLoadThread(cmds.get(), device.get(), q, &decodedTexQueue, &outputTexQueue));
 				ptr->start();
 				mBGTransferCommands.push_back(std::move(cmds));
 				bgTransferThreads.push_back(std::move(ptr));
 			}
+
+			// With no upload threads the decoded images still have to reach the main thread
+			bgUploadEnabled = numThreads > 0;
 		}
 		else {
-			// Init queues but only load from disk, upload will have to happen on the main thread
+			// Only decode in the background, upload will have to happen on the main thread
 			bgUploadEnabled = false;
-
-			for (int x = 0; x < numThreads; x++) {
-				std::unique_ptr<VkTexLoadThread> ptr(new VkTexLoadThread(nullptr, device.get(), -1, &primaryTexQueue, &secondaryTexQueue, &outputTexQueue));
-				ptr->start();
-				bgTransferThreads.push_back(std::move(ptr));
-			}
 		}
 	}
 	else {
@@ -949,8 +937,7 @@ void VulkanRenderDevice::InitializeState()
 		bgTransferEnabled = false;
 	}
 
-	modelThread.reset(new VkModelLoadThread(&modelInQueue, &modelOutQueue));
-	modelThread->start();
+	BackgroundJobs.Start();
 }
 
 void VulkanRenderDevice::Update()
@@ -1062,15 +1049,49 @@ bool VulkanRenderDevice::BackgroundLoadModel(FModel* model) {
 
 	model->SetLoadState(FModel::LOADING);
 
-	VkModelLoadIn modelLoad;
-	modelLoad.model = model;
-	modelLoad.lump = model->GetLumpNum();
-	modelInQueue.queue(modelLoad);
+	const int lump = model->GetLumpNum();
+	BackgroundJobs.Submit(JOBPRI_Now, &modelJobs, [this, model, lump]() {
+		VkModelLoadOut modelOut;
+		FileReader reader = fileSystem.OpenFileReader(lump, FileSys::EReaderType::READER_NEW, 0);
+		modelOut.data = reader.Read();
+		reader.Close();
+
+		modelOut.lump = lump;
+		modelOut.model = model;
+		modelOutQueue.queue(modelOut);
+	}, [model]() {
+		model->SetLoadState(FModel::NONE);
+	}, model);
 
 	return true;
 }
 
 
+// Queue the decode of one texture. Decoded pixels go to the upload threads if the device has upload
+// queues, otherwise straight to the main thread. A cancelled load puts the texture back to where it
+// was before it was requested, so it gets requested again the next time it is needed.
+void VulkanRenderDevice::SubmitTextureLoad(const VkTexLoadIn& in, bool secondary) {
+	BackgroundJobs.Submit(secondary ? JOBPRI_Precache : JOBPRI_Now, &texJobs, [this, in]() {
+		VkTexLoadOut out;
+		DecodeTexture(in, out);
+
+		if (bgUploadEnabled) {
+			decodedTexQueue.queue(out);
+			for (auto& tfr : bgTransferThreads) tfr->wake();
+		}
+		else {
+			outputTexQueue.queue(out);
+		}
+	}, [in]() {
+		delete in.params;
+		in.tex->SetHardwareState(IHardwareTexture::HardwareState::NONE);
+	}, in.tex);
+
+	if (secondary) statMaxQueuedSecondary = max(statMaxQueuedSecondary, texJobs.Queued(JOBPRI_Precache));
+	else statMaxQueued = max(statMaxQueued, texJobs.Queued(JOBPRI_Now));
+}
+
+
 // @Cockatrice - Cache a texture material, intended for use outside of the main thread
 bool VulkanRenderDevice::BackgroundCacheTextureMaterial(FGameTexture *tex, FTranslationID translation, int scaleFlags, bool makeSPI) {
 	if (!tex || !tex->isValid() || tex->GetID().GetIndex() == 0) {
@@ -1116,15 +1137,10 @@ bool VulkanRenderDevice::BackgroundCacheMaterial(FMaterial *mat, FTranslationID
 	if (layer->scaleFlags & CTF_ReduceQuality) 
 		flags |= TEXLOAD_ALLOWQUALITY;
 
-	// If the texture is already submitted to the cache, find it and move it to the normal queue to reprioritize it
+	// If the texture is already submitted to the cache, move its job up to reprioritize it
 	if (lumpExists && !secondary && systex->GetState() == IHardwareTexture::HardwareState::CACHING) {
-		// Move from secondary queue to primary
-		VkTexLoadIn in;
-		if (secondaryTexQueue.dequeueSearch(in, systex,
-			[](void* a, VkTexLoadIn& b)
-		{ return (VkHardwareTexture*)a == b.tex; })) {
+		if (BackgroundJobs.Promote(systex, JOBPRI_Now)) {
 			systex->SetHardwareState(IHardwareTexture::HardwareState::LOADING, 0);
-			primaryTexQueue.queue(in);
 			return true;
 		}
 	} else if (lumpExists && systex->GetState() == IHardwareTexture::HardwareState::NONE) {
@@ -1152,8 +1168,7 @@ bool VulkanRenderDevice::BackgroundCacheMaterial(FMaterial *mat, FTranslationID
 				flags
 			};
 
-			if (secondary) secondaryTexQueue.queue(in);
-			else primaryTexQueue.queue(in);
+			SubmitTextureLoad(in, secondary);
 		}
 		else {
 			systex->SetHardwareState(IHardwareTexture::HardwareState::READY); // TODO: Set state to a special "unloadable" state
@@ -1173,13 +1188,8 @@ bool VulkanRenderDevice::BackgroundCacheMaterial(FMaterial *mat, FTranslationID
 		if (lump == 0) 
 			continue;
 		if (lumpExists && syslayer->GetState() == IHardwareTexture::HardwareState::CACHING) {
-			// Move from secondary queue to primary
-			VkTexLoadIn in;
-			if (secondaryTexQueue.dequeueSearch(in, syslayer,
-				[](void* a, VkTexLoadIn& b)
-			{ return (VkHardwareTexture*)a == b.tex; })) {
+			if (BackgroundJobs.Promote(syslayer, JOBPRI_Now)) {
 				syslayer->SetHardwareState(IHardwareTexture::HardwareState::LOADING, 0);
-				primaryTexQueue.queue(in);
 				return true;
 			}
 		} else if (lumpExists && syslayer->GetState() == IHardwareTexture::HardwareState::NONE) {
@@ -1204,8 +1214,7 @@ bool VulkanRenderDevice::BackgroundCacheMaterial(FMaterial *mat, FTranslationID
 					flags
 				};
 
-				if (secondary) secondaryTexQueue.queue(in);
-				else primaryTexQueue.queue(in);
+				SubmitTextureLoad(in, secondary);
 			}
 			else {
 				syslayer->SetHardwareState(IHardwareTexture::HardwareState::READY); // TODO: Set state to a special "unloadable" state
@@ -1214,9 +1223,6 @@ bool VulkanRenderDevice::BackgroundCacheMaterial(FMaterial *mat, FTranslationID
 		}
 	}
 
-	statMaxQueued = max(statMaxQueued, primaryTexQueue.size());
-	statMaxQueuedSecondary = max(statMaxQueuedSecondary, secondaryTexQueue.size());
-
 	return true;
 }
 
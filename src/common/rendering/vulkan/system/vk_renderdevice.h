@@ -5,6 +5,7 @@
 #include <zvulkan/vulkandevice.h>
 #include <zvulkan/vulkanobjects.h>
 #include "TSQueue.h"
+#include "jobsystem.h"
 #include "bitmap.h"
 #include "printf.h"
 #include "image.h"
@@ -66,11 +67,6 @@ struct VkTexLoadOut {
 	int8_t flags;
 };
 
-struct VkModelLoadIn {
-	int lump = -1;
-	FModel* model = nullptr;
-};
-
 struct VkModelLoadOut {
 	int lump = -1;
 	FileSys::FileData data;
@@ -78,11 +74,11 @@ struct VkModelLoadOut {
 };
 
 
-// @Cockatrice - Background loader thread to handle transfer of texture data
-// TODO: Move the queue outside of the object and have each thread pull from a central queue
-class VkTexLoadThread : public ResourceLoader2<VkTexLoadIn, VkTexLoadOut> {
+// @Cockatrice - Background thread that uploads decoded texture data on its own upload queue
+// Decoding runs as jobs in BackgroundJobs, which feed all upload threads from one queue
+class VkTexLoadThread : public ResourceLoader2<VkTexLoadOut, VkTexLoadOut, TSRingQueue<VkTexLoadOut>> {
 public:
-	VkTexLoadThread(VkCommandBufferManager* bgCmd, VulkanDevice* device, int uploadQueueIndex, TSQueue<VkTexLoadIn>* inQueue, TSQueue<VkTexLoadIn>* secondaryQueue, TSQueue<VkTexLoadOut>* outQueue) : ResourceLoader2(inQueue, secondaryQueue, outQueue) {
+	VkTexLoadThread(VkCommandBufferManager* bgCmd, VulkanDevice* device, int uploadQueueIndex, TSRingQueue<VkTexLoadOut>* inQueue, TSQueue<VkTexLoadOut>* outQueue) : ResourceLoader2(inQueue, nullptr, outQueue) {
 		cmd = bgCmd;
 		submits = 0;
 		if (uploadQueueIndex >= 0) uploadQueue = device->uploadQueues[uploadQueueIndex];
@@ -118,25 +114,12 @@ protected:
 	std::atomic<int> currentImageID;
 	std::atomic<int> maxQueue;
 
-	bool loadResource(VkTexLoadIn &input, VkTexLoadOut &output) override;
+	bool loadResource(VkTexLoadOut &input, VkTexLoadOut &output) override;
 	void cancelLoad() override;
 	void completeLoad() override;
 };
 
 
-class VkModelLoadThread : public ResourceLoader2<VkModelLoadIn, VkModelLoadOut> {
-public:
-	VkModelLoadThread(TSQueue<VkModelLoadIn>* inQueue, TSQueue<VkModelLoadOut>* outQueue) : ResourceLoader2(inQueue, nullptr, outQueue) {
-		
-	}
-
-protected:
-	std::atomic<int> maxQueue;
-
-	bool loadResource(VkModelLoadIn& input, VkModelLoadOut& output) override;
-};
-
-
 
 class VulkanRenderDevice : public SystemBaseFrameBuffer
 {
@@ -179,6 +162,7 @@ public:
 	bool CachingActive() override;
 	bool SupportsBackgroundCache() override { return bgTransferEnabled; }
 	void StopBackgroundCache() override;
+	void CancelBackgroundCache() override;
 	void FlushBackground() override;
 	float CacheProgress() override;
 	void UpdateBackgroundCache(bool flush = false) override;
@@ -226,7 +210,7 @@ public:
 	void GetBGStats(double& min, double& max, double& avg);
 	void GetBGStats2(double& min, double& max, double& avg);
 	void ResetBGStats();
-	int GetNumThreads() { return (int)bgTransferThreads.size(); }
+	int GetNumThreads() { return BackgroundJobs.NumWorkers(); }
 
 private:
 	void RenderTextureView(FCanvasTexture* tex, std::function<void(IntRect &)> renderFunc) override;
@@ -239,19 +223,17 @@ private:
 		bool generateSPI;
 	};
 
-	//inline int findLeastFullSecondaryQueue();
-	//inline int findLeastFullPrimaryQueue();
+	void SubmitTextureLoad(const VkTexLoadIn& in, bool secondary);
 
 	// BG Thread management
 	// TODO: Move these into their own manager object
 	int statMaxQueued = 0, statMaxQueuedSecondary = 0, statCollisions = 0, statModelsLoaded = 0;
-	TSQueue<VkTexLoadIn> primaryTexQueue, secondaryTexQueue;
+	FJobGroup texJobs, modelJobs;										// Decode and model read jobs, so they can be waited on and cancelled
+	TSRingQueue<VkTexLoadOut> decodedTexQueue{ 64 };					// Decoded images waiting for an upload thread, bounded to limit the pixel memory in flight
 	TSQueue<VkTexLoadOut> outputTexQueue;
 	TSQueue<QueuedPatch> patchQueue;									// @Cockatrice - Queue of textures to create materials for and submit to the bg thread
-	TSQueue<VkModelLoadIn> modelInQueue;
 	TSQueue<VkModelLoadOut> modelOutQueue;
-	std::unique_ptr<VkModelLoadThread> modelThread;						// Loads models, always 1 thread
-	std::vector<std::unique_ptr<VkTexLoadThread>> bgTransferThreads;	// @Cockatrice - Threads that handle the background transfers
+	std::vector<std::unique_ptr<VkTexLoadThread>> bgTransferThreads;	// @Cockatrice - Threads that handle the background uploads
 	std::unique_ptr<VulkanFence> bgtFence;								// @Cockatrice - Used to block for tranferring resources between queues
 	std::vector<std::unique_ptr<VulkanSemaphore>> bgtSm4List;			// Semaphores to release after queue resource transfers
 	std::unique_ptr<VulkanCommandBuffer> bgtCmds;
@@ -34,6 +34,7 @@
 **
 */
 
+#include <filesystem>
 #include "files.h"
 
 #include "m_png.h"
@@ -44,6 +45,11 @@
 #include "texturemanager.h"
 #include "filesystem.h"
 #include "m_swap.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "i_time.h"
+
+EXTERN_CVAR(Bool, png_simd)
 
 //==========================================================================
 //
@@ -1309,4 +1315,100 @@ FBitmap FPNGFileTexture::GetBgraBitmap(const PalEntry *remap, int *trans)
 		bmp.CopyPixelDataRGB(0, 0, Pixels.Data(), Width, Height, 3, pixwidth, 0, CF_RGB);
 	}
 	return bmp;
-} 
\ No newline at end of file
+} 
+
+//==========================================================================
+//
+// pngbench <directory> [iterations]
+//
+// Decodes every PNG in a directory from memory, once with the plain C
+// unfilter and once with the SIMD one, and reports the time for each.
+//
+//==========================================================================
+
+CCMD(pngbench)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: pngbench <directory> [iterations]\n");
+		return;
+	}
+	int iterations = argv.argc() > 2 ? max(1, (int)strtol(argv[2], nullptr, 10)) : 5;
+
+	struct FBenchImage
+	{
+		FileSys::FileData data;
+		int width, height;
+		uint8_t bitdepth, colortype, interlace;
+	};
+	std::vector<FBenchImage> images;
+	size_t pixelBytes = 0;
+
+	std::error_code err;
+	for (auto &entry : std::filesystem::directory_iterator(argv[1], err))
+	{
+		if (!entry.is_regular_file(err) || entry.path().extension() != ".png") continue;
+
+		FileReader fr;
+		if (!fr.OpenFile(entry.path().string().c_str())) continue;
+		FBenchImage image;
+		image.data = fr.Read();
+
+		FileReader mr;
+		mr.OpenMemory(image.data.data(), image.data.size());
+		PNGHandle *png = M_VerifyPNG(mr);
+		if (png == nullptr) continue;
+
+		uint8_t ihdr[13];
+		png->File.Seek(16, FileReader::SeekSet);
+		png->File.Read(ihdr, 13);
+		delete png;
+		image.width = (ihdr[0] << 24) | (ihdr[1] << 16) | (ihdr[2] << 8) | ihdr[3];
+		image.height = (ihdr[4] << 24) | (ihdr[5] << 16) | (ihdr[6] << 8) | ihdr[7];
+		image.bitdepth = ihdr[8];
+		image.colortype = ihdr[9];
+		image.interlace = ihdr[12];
+		if (image.width <= 0 || image.height <= 0 || image.width > 16384 || image.height > 16384 || image.bitdepth > 8) continue;
+
+		pixelBytes += size_t(image.width) * image.height * 4;
+		images.push_back(std::move(image));
+	}
+
+	if (images.empty())
+	{
+		Printf("No PNG images found in %s\n", argv[1]);
+		return;
+	}
+
+	auto decodeAll = [&]()
+	{
+		TArray<uint8_t> pixels;
+		for (auto &image : images)
+		{
+			static const int bytesPerPixel[] = { 1, 0, 3, 1, 2, 0, 4 };
+			int bpp = image.colortype <= 6 ? max(1, bytesPerPixel[image.colortype]) : 1;
+			pixels.Resize(image.width * image.height * bpp);
+
+			FileReader mr;
+			mr.OpenMemory(image.data.data(), image.data.size());
+			PNGHandle *png = M_VerifyPNG(mr);
+			if (png == nullptr) continue;
+			unsigned len = M_FindPNGChunk(png, MAKE_ID('I','D','A','T'));
+			if (len > 0) M_ReadIDAT(png->File, pixels.Data(), image.width, image.height, image.width * bpp, image.bitdepth, image.colortype, image.interlace, len);
+			delete png;
+		}
+	};
+
+	bool saved = png_simd;
+	Printf("%d images, %.1f MB decoded per pass\n", (int)images.size(), pixelBytes / (1024. * 1024.));
+	for (int simd = 0; simd < 2; simd++)
+	{
+		png_simd = !!simd;
+		decodeAll();	// warm up
+		auto start = I_msTimeF();
+		for (int i = 0; i < iterations; i++) decodeAll();
+		auto time = (I_msTimeF() - start) / iterations;
+		Printf("%-6s %10.2f ms %10.1f MB/s\n", simd ? "simd" : "scalar", time, pixelBytes / (1024. * 1024.) / (time / 1000.));
+	}
+	png_simd = saved;
+}
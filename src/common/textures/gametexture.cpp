@@ -50,6 +50,7 @@
 #include "c_cvars.h"
 #include "hw_material.h"
 #include "cmdlib.h"
+#include "texturediskcache.h"
 
 FTexture *CreateBrightmapTexture(FImageSource*);
 
@@ -358,7 +359,8 @@ void FGameTexture::SetupSpriteData()
 
 // @Cockatrice - This version may be used in a thread which also has it's own copy of the bitmap data
 // The SPI data will be moved into the associated texture later in the main thread
-void FGameTexture::GenerateInitialSpriteData(SpritePositioningInfo *info, FBitmap *bmp, bool expandSprite, bool noTrimming) {
+// cacheLump is the lump the bitmap was read from if the trim bounds may go through the trim cache, -1 otherwise
+void FGameTexture::GenerateInitialSpriteData(SpritePositioningInfo *info, FBitmap *bmp, bool expandSprite, bool noTrimming, int cacheLump) {
 	for (int i = 0; i < 2; i++)
 	{
 		auto& spi = info[i];
@@ -369,7 +371,13 @@ void FGameTexture::GenerateInitialSpriteData(SpritePositioningInfo *info, FBitma
 
 		if (i == 1 && expandSprite)
 		{
-			spi.mTrimResult = FTexture::TrimBorders(spi.trim, bmp->GetPixels(), spi.spriteWidth, spi.spriteHeight) && !noTrimming;
+			bool trimmed;
+			if (cacheLump < 0 || !SpriteTrimCache.Load(cacheLump, spi.spriteWidth, spi.spriteHeight, spi.trim, trimmed))
+			{
+				trimmed = FTexture::TrimBorders(spi.trim, bmp->GetPixels(), spi.spriteWidth, spi.spriteHeight);
+				if (cacheLump >= 0) SpriteTrimCache.Store(cacheLump, spi.spriteWidth, spi.spriteHeight, spi.trim, trimmed);
+			}
+			spi.mTrimResult = trimmed && !noTrimming;
 			spi.spriteWidth += 2;
 			spi.spriteHeight += 2;
 		}
@@ -49,6 +49,22 @@
 #endif
 #include "m_png.h"
 #include "basics.h"
+#include "x86.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+#define PNG_USE_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+// AVX2 code is compiled per function so the rest of the file still runs on any x86 CPU.
+#if defined(__GNUC__) || defined(__clang__)
+#define PNG_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PNG_TARGET_AVX2
+#endif
+#endif
 
 
 // MACROS ------------------------------------------------------------------
@@ -99,6 +115,7 @@ static inline void MakeChunk (void *where, uint32_t type, size_t len);
 static inline void StuffPalette (const PalEntry *from, uint8_t *to);
 static bool WriteIDAT (FileWriter *file, const uint8_t *data, int len);
 static void UnfilterRow (int width, uint8_t *dest, uint8_t *stream, uint8_t *prev, int bpp);
+static void UnfilterRow_C (int width, uint8_t *dest, uint8_t *stream, uint8_t *prev, int bpp);
 static void UnpackPixels (int width, int bytesPerRow, int bitdepth, const uint8_t *rowin, uint8_t *rowout, bool grayscale);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
@@ -115,9 +132,11 @@ CUSTOM_CVAR(Int, png_level, 5, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 		self = 9;
 }
 CVAR(Float, png_gamma, 0.f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+CVAR(Bool, png_simd, true, 0)	// only exists to compare against the plain C unfilter
 #else
 const int png_level = 5;
 const float png_gamma = 0;
+const bool png_simd = true;
 #endif
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
@@ -146,6 +165,11 @@ bool M_CreatePNG (FileWriter *file, const uint8_t *buffer, const PalEntry *palet
 	uint8_t *const plte = (uint8_t *)gama + 4 + 12;
 	size_t work_len;
 
+	if (auto deferred = dynamic_cast<FDeferredPNGWriter *>(file))
+	{
+		return deferred->Capture (buffer, palette, color_type, width, height, pitch, gamma);
+	}
+
 	sig[0] = MAKE_ID(137,'P','N','G');
 	sig[1] = MAKE_ID(13,10,26,10);
 
@@ -179,6 +203,46 @@ bool M_CreatePNG (FileWriter *file, const uint8_t *buffer, const PalEntry *palet
 	return M_SaveBitmap (buffer, color_type, width, height, pitch, file);
 }
 
+//==========================================================================
+//
+// FDeferredPNGWriter
+//
+//==========================================================================
+
+bool FDeferredPNGWriter::Capture(const uint8_t *buffer, const PalEntry *pal, ESSType color_type, int width, int height, int pitch, float gamma)
+{
+	const int bpp = color_type == SS_PAL ? 1 : color_type == SS_RGB ? 3 : 4;
+	const int rowSize = width * bpp;
+
+	// The pitch may be negative for upside down images, so copy row by row
+	Pixels.resize(size_t(rowSize) * height);
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(Pixels.data() + size_t(y) * rowSize, buffer + ptrdiff_t(y) * pitch, rowSize);
+	}
+	if (color_type == SS_PAL) memcpy(Palette, pal, sizeof(Palette));
+	ColorType = color_type;
+	Width = width;
+	Height = height;
+	Gamma = gamma;
+	return true;
+}
+
+std::vector<unsigned char> FDeferredPNGWriter::Encode()
+{
+	if (Pixels.empty()) return TakeBuffer();
+
+	BufferWriter png;
+	if (!M_CreatePNG (&png, Pixels.data(), Palette, ColorType, Width, Height, Width * (ColorType == SS_PAL ? 1 : ColorType == SS_RGB ? 3 : 4), Gamma))
+	{
+		return {};
+	}
+	auto out = png.TakeBuffer();
+	out.insert(out.end(), mBuffer.begin(), mBuffer.end());
+	Pixels.clear();
+	return out;
+}
+
 //==========================================================================
 //
 // M_CreateDummyPNG
@@ -477,6 +541,113 @@ void M_FreePNG (PNGHandle *png)
 //
 //==========================================================================
 
+//==========================================================================
+//
+// ReadIDATLinear
+//
+// Non-interlaced images get inflated a batch of rows at a time, which
+// keeps zlib in its fast loop instead of stopping after every row, and
+// the whole batch is then unfiltered in one go while it is still in cache.
+//
+//==========================================================================
+
+static bool ReadIDATLinear (FileReader &file, uint8_t *buffer, int width, int height, int pitch,
+	uint8_t bitdepth, int bytesPerPixel, bool grayscale, unsigned int chunklen)
+{
+	int bytesPerRowIn;
+	switch (bitdepth)
+	{
+	case 8:		bytesPerRowIn = width * bytesPerPixel;	break;
+	case 4:		bytesPerRowIn = (width+1)/2;			break;
+	case 2:		bytesPerRowIn = (width+3)/4;			break;
+	case 1:		bytesPerRowIn = (width+7)/8;			break;
+	default:	return false;
+	}
+
+	const int rowSize = bytesPerRowIn + 1;		// each row starts with its filter type
+	const int batchRows = std::clamp(65536 / rowSize, 1, height);
+	TArray<Byte> staging(rowSize * batchRows + bytesPerRowIn, true);
+	Byte *zeroRow = staging.data() + rowSize * batchRows;
+	memset (zeroRow, 0, bytesPerRowIn);
+
+	Byte chunkbuffer[4096];
+	z_stream stream;
+	stream.next_in = Z_NULL;
+	stream.avail_in = 0;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	int err = inflateInit (&stream);
+	if (err != Z_OK)
+	{
+		return false;
+	}
+
+	bool lastIDAT = false;
+	uint8_t *prev = zeroRow;
+	uint8_t *curr = buffer;
+	int row = 0;
+
+	while (row < height && err != Z_STREAM_END)
+	{
+		const int rows = std::min(batchRows, height - row);
+		stream.next_out = staging.data();
+		stream.avail_out = rows * rowSize;
+
+		while (stream.avail_out > 0 && err != Z_STREAM_END)
+		{
+			if (stream.avail_in == 0 && chunklen > 0)
+			{
+				stream.next_in = chunkbuffer;
+				stream.avail_in = (uInt)file.Read (chunkbuffer, min<uint32_t>(chunklen,sizeof(chunkbuffer)));
+				chunklen -= stream.avail_in;
+			}
+
+			err = inflate (&stream, Z_SYNC_FLUSH);
+			if (err != Z_OK && err != Z_STREAM_END)
+			{ // something unexpected happened
+				inflateEnd (&stream);
+				return false;
+			}
+
+			if (chunklen == 0 && !lastIDAT)
+			{
+				uint32_t x[3];
+
+				if (file.Read (x, 12) != 12 || x[2] != MAKE_ID('I','D','A','T'))
+				{
+					lastIDAT = true;
+				}
+				else
+				{
+					chunklen = BigLong((unsigned int)x[1]);
+				}
+			}
+		}
+
+		// A truncated stream still delivers every row that is complete.
+		const int done = int(rows * rowSize - stream.avail_out) / rowSize;
+		for (int i = 0; i < done; i++)
+		{
+			UnfilterRow (bytesPerRowIn, curr, staging.data() + i * rowSize, prev, bytesPerPixel);
+			prev = curr;
+			curr += pitch;
+		}
+		row += done;
+	}
+
+	inflateEnd (&stream);
+
+	if (bitdepth < 8)
+	{
+		curr = buffer;
+		for (int i = 0; i < row; i++, curr += pitch)
+		{
+			UnpackPixels (width, bytesPerRowIn, bitdepth, curr, curr, grayscale);
+		}
+	}
+	return true;
+}
+
 bool M_ReadIDAT (FileReader &file, uint8_t *buffer, int width, int height, int pitch,
 				 uint8_t bitdepth, uint8_t colortype, uint8_t interlace, unsigned int chunklen)
 {
@@ -504,6 +675,11 @@ bool M_ReadIDAT (FileReader &file, uint8_t *buffer, int width, int height, int p
 	default:	bytesPerPixel = 1;		break;
 	}
 
+	if (!interlace)
+	{
+		return ReadIDATLinear (file, buffer, width, height, pitch, bitdepth, bytesPerPixel, colortype == 0, chunklen);
+	}
+
 	bytesPerRowOut = width * bytesPerPixel;
 	i = 4 + bytesPerRowOut * 2;
 	if (interlace)
@@ -1077,6 +1253,130 @@ static bool WriteIDAT (FileWriter *file, const uint8_t *data, int len)
 	return true;
 }
 
+#ifdef PNG_USE_SSE2
+//==========================================================================
+//
+// SSE2 / AVX2 unfiltering
+//
+// Sub, Average and Paeth depend on the pixel to the left, so these work
+// on one whole pixel per step instead of one byte, which covers the RGB
+// and RGBA images that make up most of the data. Up has no such
+// dependency and is done 16 or 32 bytes at a time.
+//
+//==========================================================================
+
+static inline __m128i LoadPixel(const uint8_t *p, int bpp)
+{
+	int v = 0;
+	memcpy(&v, p, bpp);
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline void StorePixel(uint8_t *p, __m128i v, int bpp)
+{
+	int x = _mm_cvtsi128_si32(v);
+	memcpy(p, &x, bpp);
+}
+
+template<int bpp>
+static void UnfilterSub_SSE2(int width, uint8_t *dest, const uint8_t *row)
+{
+	__m128i a = _mm_setzero_si128();
+	for (int x = 0; x < width; x += bpp)
+	{
+		a = _mm_add_epi8(a, LoadPixel(row + x, bpp));
+		StorePixel(dest + x, a, bpp);
+	}
+}
+
+template<int bpp>
+static void UnfilterAverage_SSE2(int width, uint8_t *dest, const uint8_t *row, const uint8_t *prev)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	for (int x = 0; x < width; x += bpp)
+	{
+		__m128i b = LoadPixel(prev + x, bpp);
+		// _mm_avg_epu8 rounds up, PNG wants (a + b) >> 1
+		__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(LoadPixel(row + x, bpp), avg);
+		StorePixel(dest + x, a, bpp);
+	}
+}
+
+static inline __m128i Abs16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i Select(__m128i cond, __m128i t, __m128i f)
+{
+	return _mm_or_si128(_mm_and_si128(cond, t), _mm_andnot_si128(cond, f));
+}
+
+template<int bpp>
+static void UnfilterPaeth_SSE2(int width, uint8_t *dest, const uint8_t *row, const uint8_t *prev)
+{
+	const __m128i zero = _mm_setzero_si128();
+	// Predictor inputs are widened to 16 bit so the differences cannot overflow.
+	__m128i a = zero, c = zero;
+	for (int x = 0; x < width; x += bpp)
+	{
+		__m128i b = _mm_unpacklo_epi8(LoadPixel(prev + x, bpp), zero);
+		__m128i d = _mm_unpacklo_epi8(LoadPixel(row + x, bpp), zero);
+
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = Abs16(_mm_add_epi16(pa, pb));
+		pa = Abs16(pa);
+		pb = Abs16(pb);
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+		// Same tie breaking as the spec: a before b before c
+		__m128i nearest = Select(_mm_cmpeq_epi16(smallest, pa), a, Select(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		// Byte wise add keeps the result in the low byte of each lane
+		a = _mm_add_epi8(d, nearest);
+		StorePixel(dest + x, _mm_packus_epi16(a, a), bpp);
+		c = b;
+	}
+}
+
+static void UnfilterUp_SSE2(int width, uint8_t *dest, const uint8_t *row, const uint8_t *prev)
+{
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(row + x)), _mm_loadu_si128((const __m128i*)(prev + x)));
+		_mm_storeu_si128((__m128i*)(dest + x), v);
+	}
+	for (; x < width; x++) dest[x] = row[x] + prev[x];
+}
+
+PNG_TARGET_AVX2 static void UnfilterUp_AVX2(int width, uint8_t *dest, const uint8_t *row, const uint8_t *prev)
+{
+	int x = 0;
+	for (; x + 32 <= width; x += 32)
+	{
+		__m256i v = _mm256_add_epi8(_mm256_loadu_si256((const __m256i*)(row + x)), _mm256_loadu_si256((const __m256i*)(prev + x)));
+		_mm256_storeu_si256((__m256i*)(dest + x), v);
+	}
+	for (; x < width; x++) dest[x] = row[x] + prev[x];
+}
+
+template<int bpp>
+static bool UnfilterPixels_SSE2(int filter, int width, uint8_t *dest, const uint8_t *row, const uint8_t *prev)
+{
+	switch (filter)
+	{
+	case 1:		UnfilterSub_SSE2<bpp>(width, dest, row);				return true;
+	case 3:		UnfilterAverage_SSE2<bpp>(width, dest, row, prev);		return true;
+	case 4:		UnfilterPaeth_SSE2<bpp>(width, dest, row, prev);		return true;
+	default:	return false;
+	}
+}
+#endif
+
 //==========================================================================
 //
 // UnfilterRow
@@ -1087,7 +1387,28 @@ static bool WriteIDAT (FileWriter *file, const uint8_t *data, int len)
 //
 //==========================================================================
 
-void UnfilterRow (int width, uint8_t *dest, uint8_t *row, uint8_t *prev, int bpp)
+static void UnfilterRow (int width, uint8_t *dest, uint8_t *row, uint8_t *prev, int bpp)
+{
+#ifdef PNG_USE_SSE2
+	if (png_simd)
+	{
+		static const bool useAVX2 = CPU.bAVX2 && CPU.bAVX && CPU.bOSXSAVE;
+		int filter = row[0];
+
+		if (filter == 2)
+		{
+			if (useAVX2) UnfilterUp_AVX2(width, dest, row + 1, prev);
+			else UnfilterUp_SSE2(width, dest, row + 1, prev);
+			return;
+		}
+		if (bpp == 4 && UnfilterPixels_SSE2<4>(filter, width, dest, row + 1, prev)) return;
+		if (bpp == 3 && UnfilterPixels_SSE2<3>(filter, width, dest, row + 1, prev)) return;
+	}
+#endif
+	UnfilterRow_C (width, dest, row, prev, bpp);
+}
+
+static void UnfilterRow_C (int width, uint8_t *dest, uint8_t *row, uint8_t *prev, int bpp)
 {
 	int x;
 
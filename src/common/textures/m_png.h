@@ -69,6 +69,23 @@ bool M_FinishPNG (FileWriter *file);
 
 bool M_SaveBitmap(const uint8_t *from, ESSType color_type, int width, int height, int pitch, FileWriter *file);
 
+// A memory file M_CreatePNG only copies the image into instead of compressing
+// it. Encode does the compression later, on any thread, and returns the PNG
+// with everything else that was written to the file after the image.
+class FDeferredPNGWriter : public FileSys::BufferWriter
+{
+public:
+	bool Capture(const uint8_t *buffer, const PalEntry *pal, ESSType color_type, int width, int height, int pitch, float gamma);
+	std::vector<unsigned char> Encode();
+
+private:
+	std::vector<uint8_t> Pixels;
+	PalEntry Palette[256];
+	ESSType ColorType = SS_RGB;
+	int Width = 0, Height = 0;
+	float Gamma = 0;
+};
+
 // PNG Reading --------------------------------------------------------------
 
 struct PNGHandle
@@ -51,6 +51,21 @@
 #include "imagehelpers.h"
 #include "v_video.h"
 #include "v_font.h"
+#include "x86.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+#define TRIM_USE_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TRIM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TRIM_TARGET_AVX2
+#endif
+#endif
 
 // Wrappers to keep the definitions of these classes out of here.
 IHardwareTexture* CreateHardwareTexture(int numchannels);
@@ -475,6 +490,94 @@ bool FTexture::TrimBorders(uint16_t* rect)
 }
 
 
+//===========================================================================
+//
+// Alpha scanning for TrimBorders
+//
+// FirstOpaque / LastOpaque return the first or last pixel in [x0, x1) of
+// an RGBA row with a non-zero alpha, or -1. The vector versions test 4 or
+// 8 pixels per step and only look at single pixels once a block has a hit.
+//
+//===========================================================================
+
+static int FirstOpaque_C(const uint8_t* row, int x0, int x1)
+{
+	for (int x = x0; x < x1; x++)
+	{
+		if (row[x * 4 + 3] != 0) return x;
+	}
+	return -1;
+}
+
+static int LastOpaque_C(const uint8_t* row, int x0, int x1)
+{
+	for (int x = x1 - 1; x >= x0; x--)
+	{
+		if (row[x * 4 + 3] != 0) return x;
+	}
+	return -1;
+}
+
+#ifdef TRIM_USE_SSE2
+static inline bool AnyAlpha(const uint8_t* p)
+{
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)p), alpha);
+	return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xffff;
+}
+
+static int FirstOpaque_SSE2(const uint8_t* row, int x0, int x1)
+{
+	int x = x0;
+	for (; x + 4 <= x1; x += 4)
+	{
+		if (AnyAlpha(row + x * 4)) return FirstOpaque_C(row, x, x + 4);
+	}
+	return FirstOpaque_C(row, x, x1);
+}
+
+static int LastOpaque_SSE2(const uint8_t* row, int x0, int x1)
+{
+	int x = x1;
+	for (; x - 4 >= x0; x -= 4)
+	{
+		if (AnyAlpha(row + (x - 4) * 4)) return LastOpaque_C(row, x - 4, x);
+	}
+	return LastOpaque_C(row, x0, x);
+}
+
+TRIM_TARGET_AVX2 static int FirstOpaque_AVX2(const uint8_t* row, int x0, int x1)
+{
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	int x = x0;
+	for (; x + 8 <= x1; x += 8)
+	{
+		__m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(row + x * 4)), alpha);
+		if (!_mm256_testz_si256(v, v)) return FirstOpaque_C(row, x, x + 8);
+	}
+	return FirstOpaque_SSE2(row, x, x1);
+}
+#endif
+
+static int FirstOpaque(const uint8_t* row, int x0, int x1)
+{
+#ifdef TRIM_USE_SSE2
+	static const bool useAVX2 = CPU.bAVX2 && CPU.bAVX && CPU.bOSXSAVE;
+	return useAVX2 ? FirstOpaque_AVX2(row, x0, x1) : FirstOpaque_SSE2(row, x0, x1);
+#else
+	return FirstOpaque_C(row, x0, x1);
+#endif
+}
+
+static int LastOpaque(const uint8_t* row, int x0, int x1)
+{
+#ifdef TRIM_USE_SSE2
+	return LastOpaque_SSE2(row, x0, x1);
+#else
+	return LastOpaque_C(row, x0, x1);
+#endif
+}
+
 // @Cockatrice - Designed to be used in a background loader thread when we already have the texture data loaded
 bool FTexture::TrimBorders(uint16_t* rect, uint8_t *Buffer, int w, int h) {
 
@@ -483,8 +586,7 @@ bool FTexture::TrimBorders(uint16_t* rect, uint8_t *Buffer, int w, int h) {
 		return false;
 	}
 
-	int size = w * h;
-	if (size == 1)
+	if (w * h == 1)
 	{
 		// nothing to be done here.
 		rect[0] = 0;
@@ -493,13 +595,14 @@ bool FTexture::TrimBorders(uint16_t* rect, uint8_t *Buffer, int w, int h) {
 		rect[3] = 1;
 		return true;
 	}
-	int first, last;
 
-	for (first = 0; first < size; first++)
+	const int pitch = w * 4;
+	int top, bottom;
+	for (top = 0; top < h; top++)
 	{
-		if (Buffer[first * 4 + 3] != 0) break;
+		if (FirstOpaque(Buffer + top * pitch, 0, w) >= 0) break;
 	}
-	if (first >= size)
+	if (top >= h)
 	{
 		// completely empty
 		rect[0] = 0;
@@ -508,43 +611,27 @@ bool FTexture::TrimBorders(uint16_t* rect, uint8_t *Buffer, int w, int h) {
 		rect[3] = 1;
 		return true;
 	}
-
-	for (last = size - 1; last >= first; last--)
+	for (bottom = h - 1; bottom > top; bottom--)
 	{
-		if (Buffer[last * 4 + 3] != 0) break;
+		if (FirstOpaque(Buffer + bottom * pitch, 0, w) >= 0) break;
 	}
 
-	rect[1] = first / w;
-	rect[3] = 1 + last / w - rect[1];
-
-	rect[0] = 0;
-	rect[2] = w;
-
-	unsigned char* bufferoff = Buffer + (rect[1] * w * 4);
-	h = rect[3];
-
-	for (int x = 0; x < w; x++)
+	// Each row only needs to be checked outside of the bounds found so far,
+	// and once they cover the full width nothing can change anymore.
+	int left = w, right = -1;
+	for (int y = top; y <= bottom && (left > 0 || right < w - 1); y++)
 	{
-		for (int y = 0; y < h; y++)
-		{
-			if (bufferoff[(x + y * w) * 4 + 3] != 0) goto outl;
-		}
-		rect[0]++;
+		const uint8_t* row = Buffer + y * pitch;
+		int x = FirstOpaque(row, 0, left);
+		if (x >= 0) left = x;
+		x = LastOpaque(row, right + 1, w);
+		if (x >= 0) right = x;
 	}
-outl:
-	rect[2] -= rect[0];
 
-	for (int x = w - 1; rect[2] > 1; x--)
-	{
-		for (int y = 0; y < h; y++)
-		{
-			if (bufferoff[(x + y * w) * 4 + 3] != 0)
-			{
-				return true;
-			}
-		}
-		rect[2]--;
-	}
+	rect[0] = left;
+	rect[1] = top;
+	rect[2] = right - left + 1;
+	rect[3] = bottom - top + 1;
 	return true;
 }
 
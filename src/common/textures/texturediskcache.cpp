@@ -0,0 +1,494 @@
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+//--------------------------------------------------------------------------
+//
+/*
+** texturediskcache.cpp
+** On-disk cache of decoded images for the background texture loader
+**
+*/
+
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <typeinfo>
+#include "texturediskcache.h"
+#include "image.h"
+#include "textures.h"
+#include "filesystem.h"
+#include "files.h"
+#include "md5.h"
+#include "cmdlib.h"
+#include "i_specialpaths.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "printf.h"
+
+CVAR(Bool, r_texcache, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CVAR(Bool, r_trimcache, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CUSTOM_CVAR(Int, r_texcache_size, 2048, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)		// in megabytes
+{
+	if (self < 64) self = 64;
+}
+
+FTextureDiskCache TextureDiskCache;
+FSpriteTrimCache SpriteTrimCache;
+
+namespace fs = std::filesystem;
+
+static const char TexCacheMagic[4] = { 'Z', 'T', 'C', '1' };
+static const char TrimCacheMagic[4] = { 'Z', 'S', 'T', '1' };
+enum
+{
+	TEXCACHE_VERSION = 2,
+	TEXCACHE_HEADER_SIZE = 256,		// pixels start here
+	TRIMCACHE_VERSION = 1,			// bump whenever FTexture::TrimBorders changes its results
+	TRIMCACHE_MAX_RECORDS = 65536,	// older records get dropped beyond this
+};
+
+struct FTexCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t translucent;
+	uint32_t spiSize;
+	SpritePositioningInfo spi[2];
+};
+
+static_assert(sizeof(FTexCacheHeader) <= TEXCACHE_HEADER_SIZE, "texture cache header does not fit");
+
+static std::string DigestName(const FTexCacheKey &key)
+{
+	char hex[33];
+	for (int i = 0; i < 16; i++)
+	{
+		int v = key.digest[i] >> 4;
+		hex[i * 2] = v < 10 ? ('0' + v) : ('a' + v - 10);
+		v = key.digest[i] & 15;
+		hex[i * 2 + 1] = v < 10 ? ('0' + v) : ('a' + v - 10);
+	}
+	hex[32] = 0;
+	return hex;
+}
+
+static int64_t FileTimeNow()
+{
+	return fs::file_time_type::clock::now().time_since_epoch().count();
+}
+
+//==========================================================================
+//
+// The size, modification time and path of a lump's archive. Together with
+// the lump's position in it this identifies its contents without reading
+// them. Directories and nested archives have no stamp that covers their
+// contents, for those this returns false.
+// Stamps are looked up once per archive and kept until the file system gets
+// set up again.
+//
+//==========================================================================
+
+bool FTextureDiskCache::ContainerStamp(int lump, std::string &stamp)
+{
+	const char *path = fileSystem.GetResourceFileFullName(fileSystem.GetFileContainer(lump));
+	if (path == nullptr) return false;
+
+	std::lock_guard<std::mutex> guard(stampLock);
+	auto it = containerStamps.find(path);
+	if (it == containerStamps.end())
+	{
+		std::string newstamp;
+		std::error_code err;
+		if (fs::is_regular_file(path, err))
+		{
+			int64_t desc[] = { (int64_t)fs::file_size(path, err), (int64_t)fs::last_write_time(path, err).time_since_epoch().count() };
+			if (!err)
+			{
+				newstamp.assign((const char *)desc, sizeof(desc));
+				newstamp += path;
+			}
+		}
+		it = containerStamps.emplace(path, std::move(newstamp)).first;
+	}
+	stamp = it->second;
+	return !stamp.empty();
+}
+
+//==========================================================================
+//
+// Only images that come straight from a single lump are cached. Anything
+// with its own load params (multipatch and friends) composes other images
+// and translated loads depend on more than the lump data.
+//
+//==========================================================================
+
+bool FTextureDiskCache::MakeKey(FImageSource *src, FImageLoadParams *params, bool expand, bool notrimming, FTexCacheKey &key)
+{
+	if (!r_texcache || params == nullptr || params->lump < 0 || params->translation != 0 || params->remap != nullptr) return false;
+	if (typeid(*params) != typeid(FImageLoadParams) || src->IsGPUOnly()) return false;
+
+	std::string stamp;
+	if (!ContainerStamp(params->lump, stamp)) return false;
+
+	int lump = params->lump;
+	const int64_t desc[] = { TEXCACHE_VERSION, src->GetWidth(), src->GetHeight(), params->conversion, expand, notrimming,
+		lump - fileSystem.GetFirstEntry(fileSystem.GetFileContainer(lump)), (int64_t)fileSystem.FileLength(lump) };
+
+	MD5Context md5;
+	md5.Update((const uint8_t *)desc, sizeof(desc));
+	md5.Update((const uint8_t *)stamp.data(), (unsigned)stamp.size());
+	md5.Final(key.digest);
+	return true;
+}
+
+FString FTextureDiskCache::EntryPath(const std::string &name) const
+{
+	FString path = directory;
+	path << "/" << name.c_str() << ".ztc";
+	return path;
+}
+
+// Must be called with indexLock held
+void FTextureDiskCache::ScanDirectory()
+{
+	if (scanned) return;
+	scanned = true;
+
+	directory = M_GetCachePath(true);
+	directory << "/textures";
+	CreatePath(directory.GetChars());
+
+	std::error_code err;
+	for (auto &entry : fs::directory_iterator(directory.GetChars(), err))
+	{
+		if (!entry.is_regular_file(err) || entry.path().extension() != ".ztc") continue;
+
+		FEntry e = { (size_t)entry.file_size(err), entry.last_write_time(err).time_since_epoch().count() };
+		index[entry.path().stem().string()] = e;
+		totalSize += e.size;
+	}
+}
+
+// Move an entry to the front of the LRU order, on disk too so the order survives restarts.
+void FTextureDiskCache::Touch(const std::string &name)
+{
+	std::error_code err;
+	fs::last_write_time(EntryPath(name).GetChars(), fs::file_time_type::clock::now(), err);
+
+	std::lock_guard<std::mutex> lock(indexLock);
+	auto it = index.find(name);
+	if (it != index.end()) it->second.lastUse = FileTimeNow();
+}
+
+bool FTextureDiskCache::Load(const FTexCacheKey &key, int width, int height, unsigned char *&pixels, bool &translucent, SpritePositioningInfo *spi)
+{
+	std::string name = DigestName(key);
+	{
+		std::lock_guard<std::mutex> lock(indexLock);
+		ScanDirectory();
+		if (index.find(name) == index.end())
+		{
+			misses++;
+			return false;
+		}
+	}
+
+	FileReader fr;
+	FTexCacheHeader header;
+	const size_t pixelSize = 4u * (size_t)width * (size_t)height;
+
+	if (!fr.OpenFile(EntryPath(name).GetChars()) ||
+		fr.Read(&header, sizeof(header)) != (FileReader::Size)sizeof(header) ||
+		memcmp(header.magic, TexCacheMagic, 4) != 0 || header.version != TEXCACHE_VERSION ||
+		header.width != (uint32_t)width || header.height != (uint32_t)height || header.spiSize != sizeof(SpritePositioningInfo))
+	{
+		misses++;
+		return false;
+	}
+
+	unsigned char *buffer = (unsigned char *)malloc(pixelSize);
+	fr.Seek(TEXCACHE_HEADER_SIZE, FileReader::SeekSet);
+	if (fr.Read(buffer, pixelSize) != (FileReader::Size)pixelSize)
+	{
+		free(buffer);
+		misses++;
+		return false;
+	}
+
+	pixels = buffer;
+	translucent = header.translucent != 0;
+	if (spi) memcpy(spi, header.spi, sizeof(header.spi));
+
+	fr.Close();
+	Touch(name);
+	hits++;
+	return true;
+}
+
+//==========================================================================
+//
+// Entries are written under a temporary name and renamed into place, so a
+// reader on another thread or a crash never sees half an entry.
+//
+//==========================================================================
+
+void FTextureDiskCache::Store(const FTexCacheKey &key, int width, int height, const unsigned char *pixels, bool translucent, const SpritePositioningInfo *spi)
+{
+	std::string name = DigestName(key);
+	{
+		std::lock_guard<std::mutex> lock(indexLock);
+		ScanDirectory();
+		if (index.find(name) != index.end()) return;
+	}
+
+	uint8_t headerBlock[TEXCACHE_HEADER_SIZE] = {};
+	FTexCacheHeader header = {};
+	memcpy(header.magic, TexCacheMagic, 4);
+	header.version = TEXCACHE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.translucent = translucent;
+	header.spiSize = sizeof(SpritePositioningInfo);
+	memcpy(header.spi, spi, sizeof(header.spi));
+	memcpy(headerBlock, &header, sizeof(header));
+
+	const size_t pixelSize = 4u * (size_t)width * (size_t)height;
+	FString path = EntryPath(name);
+	FString temp = path;
+	temp.AppendFormat(".%p.tmp", (void *)&header);	// unique per writing thread
+
+	std::unique_ptr<FileWriter> fw(FileWriter::Open(temp.GetChars()));
+	if (!fw) return;
+
+	bool ok = fw->Write(headerBlock, sizeof(headerBlock)) == sizeof(headerBlock) && fw->Write(pixels, pixelSize) == pixelSize;
+	fw.reset();
+
+	std::error_code err;
+	if (ok) fs::rename(temp.GetChars(), path.GetChars(), err);
+	if (!ok || err)
+	{
+		fs::remove(temp.GetChars(), err);
+		return;
+	}
+
+	size_t limit;
+	{
+		std::lock_guard<std::mutex> lock(indexLock);
+		// Another thread may have stored the same image in the meantime, which must not be counted twice.
+		auto inserted = index.emplace(name, FEntry{ sizeof(headerBlock) + pixelSize, FileTimeNow() });
+		if (inserted.second) totalSize += inserted.first->second.size;
+		else inserted.first->second.lastUse = FileTimeNow();
+		limit = (size_t)r_texcache_size * 1024 * 1024;
+		if (totalSize <= limit) limit = 0;
+	}
+	stores++;
+
+	if (limit > 0) Trim(limit);
+}
+
+void FTextureDiskCache::Trim(size_t limit)
+{
+	std::vector<std::pair<int64_t, std::string>> order;
+	{
+		std::lock_guard<std::mutex> lock(indexLock);
+		ScanDirectory();
+		if (totalSize <= limit) return;
+
+		order.reserve(index.size());
+		for (auto &it : index) order.emplace_back(it.second.lastUse, it.first);
+	}
+
+	// Trim a bit further than necessary so not every new entry triggers another pass
+	std::sort(order.begin(), order.end());
+	const size_t target = limit - limit / 8;
+
+	for (auto &it : order)
+	{
+		size_t size;
+		{
+			std::lock_guard<std::mutex> lock(indexLock);
+			if (totalSize <= target) break;
+
+			auto entry = index.find(it.second);
+			if (entry == index.end()) continue;
+			size = entry->second.size;
+			index.erase(entry);
+			totalSize -= size;
+		}
+
+		std::error_code err;
+		fs::remove(EntryPath(it.second).GetChars(), err);
+		evictions++;
+	}
+}
+
+void FTextureDiskCache::Clear()
+{
+	Trim(0);
+}
+
+void FTextureDiskCache::ResetContainerStamps()
+{
+	std::lock_guard<std::mutex> guard(stampLock);
+	containerStamps.clear();
+}
+
+
+//==========================================================================
+//
+// FSpriteTrimCache
+//
+//==========================================================================
+
+int FSpriteTrimCache::LumpFor(FImageLoadParams *params)
+{
+	// Translations can change the alpha channel, so only plain loads qualify
+	if (!r_trimcache || params == nullptr || params->lump < 0 || params->translation != 0 || params->remap != nullptr) return -1;
+	if (typeid(*params) != typeid(FImageLoadParams)) return -1;
+	return params->lump;
+}
+
+bool FSpriteTrimCache::MakeKey(int lump, int width, int height, uint8_t *digest)
+{
+	std::string stamp;
+	if (!TextureDiskCache.ContainerStamp(lump, stamp)) return false;
+
+	const int64_t desc[] = { TRIMCACHE_VERSION, lump - fileSystem.GetFirstEntry(fileSystem.GetFileContainer(lump)), (int64_t)fileSystem.FileLength(lump), width, height };
+
+	MD5Context md5;
+	md5.Update((const uint8_t *)desc, sizeof(desc));
+	md5.Update((const uint8_t *)stamp.data(), (unsigned)stamp.size());
+	md5.Final(digest);
+	return true;
+}
+
+// Must be called with the lock held
+void FSpriteTrimCache::ReadFile()
+{
+	if (loaded) return;
+	loaded = true;
+
+	FString directory = M_GetCachePath(true);
+	CreatePath(directory.GetChars());
+	filename = directory + "/spritetrim.bin";
+
+	FileReader fr;
+	if (!fr.OpenFile(filename.GetChars())) return;
+	auto data = fr.Read();
+	fr.Close();
+
+	// An interrupted append can only leave a partial record at the end, which gets ignored.
+	uint32_t version = 0;
+	if (data.size() >= 8) memcpy(&version, data.bytes() + 4, 4);
+	if (data.size() < 8 || memcmp(data.data(), TrimCacheMagic, 4) != 0 || version != TRIMCACHE_VERSION)
+	{
+		// Start over, new records get appended to a fresh file
+		RemoveFile(filename.GetChars());
+		return;
+	}
+
+	// Records only ever get appended, so the newest one for a key is the last. Walking backward
+	// keeps that one and, once the limit is reached, drops the oldest records, which mostly
+	// belong to files that have changed or are no longer loaded.
+	size_t count = (data.size() - 8) / sizeof(FRecord);
+	TArray<FRecord> kept;
+	for (size_t i = count; i-- > 0 && records.size() < TRIMCACHE_MAX_RECORDS; )
+	{
+		FRecord rec;
+		memcpy(&rec, data.bytes() + 8 + i * sizeof(FRecord), sizeof(FRecord));
+		if (records.emplace(std::string((const char *)rec.digest, 16), rec).second) kept.Push(rec);
+	}
+	if (kept.Size() == count) return;
+
+	// Write the file anew with what is left, oldest first again.
+	FString tempname = filename + ".tmp";
+	FILE *f = fopen(tempname.GetChars(), "wb");
+	if (f == nullptr) return;
+	bool ok = fwrite(TrimCacheMagic, 1, 4, f) == 4 && fwrite(&version, 1, 4, f) == 4;
+	for (unsigned i = kept.Size(); ok && i-- > 0; )
+	{
+		ok = fwrite(&kept[i], 1, sizeof(FRecord), f) == sizeof(FRecord);
+	}
+	ok = fclose(f) == 0 && ok;
+	if (ok)
+	{
+		RemoveFile(filename.GetChars());
+		ok = rename(tempname.GetChars(), filename.GetChars()) == 0;
+	}
+	if (!ok) RemoveFile(tempname.GetChars());
+}
+
+bool FSpriteTrimCache::Load(int lump, int width, int height, uint16_t *trim, bool &result)
+{
+	uint8_t digest[16];
+	std::lock_guard<std::mutex> guard(lock);
+	ReadFile();
+	if (!MakeKey(lump, width, height, digest)) return false;
+
+	auto it = records.find(std::string((const char *)digest, 16));
+	if (it == records.end())
+	{
+		misses++;
+		return false;
+	}
+	memcpy(trim, it->second.trim, sizeof(it->second.trim));
+	result = it->second.result != 0;
+	hits++;
+	return true;
+}
+
+void FSpriteTrimCache::Store(int lump, int width, int height, const uint16_t *trim, bool result)
+{
+	FRecord rec = {};
+	std::lock_guard<std::mutex> guard(lock);
+	ReadFile();
+	if (!MakeKey(lump, width, height, rec.digest)) return;
+
+	memcpy(rec.trim, trim, sizeof(rec.trim));
+	rec.result = result;
+	records[std::string((const char *)rec.digest, 16)] = rec;
+
+	FILE *f = fopen(filename.GetChars(), "ab");
+	if (f == nullptr) return;
+	fseek(f, 0, SEEK_END);
+	if (ftell(f) == 0)
+	{
+		uint32_t version = TRIMCACHE_VERSION;
+		fwrite(TrimCacheMagic, 1, 4, f);
+		fwrite(&version, 1, 4, f);
+	}
+	fwrite(&rec, 1, sizeof(rec), f);
+	fclose(f);
+}
+
+
+ADD_STAT(texcache)
+{
+	FString out;
+	out.Format("%s: %d entries, %.1f MB, hits: %d, misses: %d, stores: %d, evicted: %d\nTrim cache %s: hits: %d, misses: %d",
+		r_texcache ? "On" : "Off", TextureDiskCache.NumEntries(), TextureDiskCache.TotalSize() / (1024. * 1024.),
+		TextureDiskCache.hits.load(), TextureDiskCache.misses.load(), TextureDiskCache.stores.load(), TextureDiskCache.evictions.load(),
+		r_trimcache ? "On" : "Off", SpriteTrimCache.hits.load(), SpriteTrimCache.misses.load());
+	return out;
+}
+
+CCMD(texcache_clear)
+{
+	TextureDiskCache.Clear();
+	Printf("Texture cache cleared\n");
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "zstring.h"
+
+class FImageSource;
+class FImageLoadParams;
+struct SpritePositioningInfo;
+
+//==========================================================================
+//
+// Decoded images of the background loader, kept on disk between runs.
+//
+// An entry is keyed by the lump's position in its archive together with the
+// archive's size and modification time, so a lookup never has to read the
+// lump, plus everything that changes the decoded result: size, conversion,
+// sprite expansion and trimming. Lumps that are not read from an archive
+// file on disk are never cached.
+// A fixed size header with the sprite positioning info is followed by the
+// RGBA pixels exactly as the loader hands them to the upload, so the pixel
+// block starts at an aligned offset and the file can be mapped directly.
+//
+// All functions are safe to call from any number of loader threads.
+//
+//==========================================================================
+
+struct FTexCacheKey
+{
+	uint8_t digest[16];
+};
+
+class FTextureDiskCache
+{
+public:
+	// Builds the key for a load. Returns false if the cache is off or the image cannot be cached.
+	bool MakeKey(FImageSource *src, FImageLoadParams *params, bool expand, bool notrimming, FTexCacheKey &key);
+
+	// On a hit, pixels is a malloc'd buffer of width * height * 4 bytes, owned by the caller.
+	bool Load(const FTexCacheKey &key, int width, int height, unsigned char *&pixels, bool &translucent, SpritePositioningInfo *spi);
+	void Store(const FTexCacheKey &key, int width, int height, const unsigned char *pixels, bool translucent, const SpritePositioningInfo *spi);
+
+	// Deletes least recently used entries until the cache fits its size limit.
+	void Trim(size_t limit);
+	void Clear();
+
+	// The archive stamp that keys are built from. The sprite trim cache uses it as well.
+	bool ContainerStamp(int lump, std::string &stamp);
+	// Must be called whenever the file system gets set up, since the archives may have changed on disk.
+	void ResetContainerStamps();
+
+	std::atomic<int> hits{ 0 }, misses{ 0 }, stores{ 0 }, evictions{ 0 };
+
+	size_t TotalSize()
+	{
+		std::lock_guard<std::mutex> lock(indexLock);
+		return totalSize;
+	}
+
+	int NumEntries()
+	{
+		std::lock_guard<std::mutex> lock(indexLock);
+		return (int)index.size();
+	}
+
+private:
+	struct FEntry
+	{
+		size_t size;
+		int64_t lastUse;
+	};
+
+	FString EntryPath(const std::string &name) const;
+	void ScanDirectory();
+	void Touch(const std::string &name);
+
+	std::mutex indexLock;
+	std::unordered_map<std::string, FEntry> index;
+	size_t totalSize = 0;
+	bool scanned = false;
+	FString directory;
+
+	std::mutex stampLock;
+	std::unordered_map<std::string, std::string> containerStamps;	// by archive path, empty if not cacheable
+};
+
+extern FTextureDiskCache TextureDiskCache;
+
+//==========================================================================
+//
+// Sprite trim bounds, kept on disk between runs.
+//
+// Finding the opaque area of a sprite means scanning every pixel, which is
+// wasted work for sprites that have not changed since the last run. The
+// key is the lump's position in its archive together with the archive's
+// size and modification time, so a lookup never has to touch the lump data.
+// Lumps that are not read from an archive file on disk are never cached.
+//
+// All records live in a single file that new results are appended to.
+// Loading it drops superseded and, past a fixed limit, the oldest records.
+//
+//==========================================================================
+
+class FSpriteTrimCache
+{
+public:
+	// Returns the lump to use as the key, or -1 if this load cannot be cached.
+	int LumpFor(FImageLoadParams *params);
+
+	bool Load(int lump, int width, int height, uint16_t *trim, bool &result);
+	void Store(int lump, int width, int height, const uint16_t *trim, bool result);
+
+	std::atomic<int> hits{ 0 }, misses{ 0 };
+
+private:
+	struct FRecord
+	{
+		uint8_t digest[16];
+		uint16_t trim[4];
+		uint8_t result;
+		uint8_t padding[3];
+	};
+
+	bool MakeKey(int lump, int width, int height, uint8_t *digest);
+	void ReadFile();
+
+	std::mutex lock;
+	std::unordered_map<std::string, FRecord> records;
+	bool loaded = false;
+	FString filename;
+};
+
+extern FSpriteTrimCache SpriteTrimCache;
@@ -32,4 +32,75 @@ void ResourceLoader<IP, OP>::bgproc() {
 			mWake.wait_for(lock, std::chrono::milliseconds(5));
 		}
 	}
-}*/
\ No newline at end of file
+}*/
+
+#include "c_dispatch.h"
+#include "printf.h"
+
+//==========================================================================
+//
+// Micro benchmark of TSQueue against TSRingQueue
+// Producers push increasing numbers, consumers pop until everything arrived.
+//
+// queuebench [producers] [consumers] [items]
+//
+//==========================================================================
+
+template <typename Q>
+static double BenchQueue(Q &queue, int producers, int consumers, int items, bool &valid) {
+	std::atomic<int> received{ 0 };
+	std::atomic<int64_t> sum{ 0 };
+	std::vector<std::thread> threads;
+	const int perProducer = items / producers;
+	const int total = perProducer * producers;
+
+	cycle_t time;
+	time.Reset();
+	time.Clock();
+
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&] {
+			for (int x = 0; x < perProducer; x++) {
+				int64_t v = x;
+				queue.queue(v);
+			}
+		});
+	}
+
+	for (int c = 0; c < consumers; c++) {
+		threads.emplace_back([&] {
+			int64_t v, local = 0;
+			while (received.load(std::memory_order_relaxed) < total) {
+				if (queue.dequeue(v)) {
+					local += v;
+					received++;
+				}
+				else std::this_thread::yield();
+			}
+			sum += local;
+		});
+	}
+
+	for (auto& t : threads) t.join();
+	time.Unclock();
+
+	valid = sum.load() == (int64_t)producers * ((int64_t)perProducer * (perProducer - 1) / 2);
+	return time.TimeMS();
+}
+
+CCMD(queuebench) {
+	int producers = argv.argc() > 1 ? std::max(atoi(argv[1]), 1) : 4;
+	int consumers = argv.argc() > 2 ? std::max(atoi(argv[2]), 1) : 2;
+	int items = argv.argc() > 3 ? std::max(atoi(argv[3]), producers) : 100000;
+
+	bool validLocked, validRing;
+	TSQueue<int64_t> locked;
+	TSRingQueue<int64_t> ring(1024);
+
+	double lockedTime = BenchQueue(locked, producers, consumers, items, validLocked);
+	double ringTime = BenchQueue(ring, producers, consumers, items, validRing);
+
+	Printf("%d producers, %d consumers, %d items\n", producers, consumers, items);
+	Printf("  TSQueue:     %8.2f ms %s\n", lockedTime, validLocked ? "" : TEXTCOLOR_RED "(lost items)");
+	Printf("  TSRingQueue: %8.2f ms %s\n", ringTime, validRing ? "" : TEXTCOLOR_RED "(lost items)");
+}
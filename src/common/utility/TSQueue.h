@@ -6,6 +6,7 @@
 #include <mutex>
 #include <atomic>
 #include <algorithm>
+#include <memory>
 
 #ifdef __linux__
 #include <condition_variable>
@@ -133,6 +134,183 @@ protected:
 
 
 
+// @Cockatrice - Lets threads sleep on a condition that is checked without a lock.
+// Notifying costs one atomic load unless somebody is actually waiting, so the
+// fast path of the queue below never touches the mutex.
+class TSEventCount {
+public:
+	// Call before re-checking the condition, then either wait() or cancelWait()
+	unsigned prepareWait() {
+		mWaiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return mEpoch.load();
+	}
+
+	void cancelWait() {
+		mWaiters.fetch_sub(1);
+	}
+
+	template <typename Rep, typename Period>
+	void wait(unsigned key, const std::chrono::duration<Rep, Period> &timeout) {
+		std::unique_lock lock(mLock);
+		mWake.wait_for(lock, timeout, [&] { return mEpoch.load() != key; });
+		mWaiters.fetch_sub(1);
+	}
+
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (mWaiters.load() == 0) return;
+		{
+			std::lock_guard lock(mLock);
+			mEpoch++;
+		}
+		mWake.notify_all();
+	}
+
+private:
+	std::atomic<int> mWaiters{ 0 };
+	std::atomic<unsigned> mEpoch{ 0 };
+	std::mutex mLock;
+	std::condition_variable mWake;
+};
+
+
+
+// @Cockatrice: Bounded lock-free multi producer/multi consumer queue
+// Same interface as TSQueue so either can be used, plus batch and blocking dequeues.
+// Every slot carries a sequence number that tells producers and consumers whose turn
+// it is, so the only shared writes are one CAS on the head or tail per item.
+// queue() waits while the queue is full, so never let the consumer thread fill it.
+template <typename T>
+class TSRingQueue {
+public:
+	explicit TSRingQueue(unsigned capacity = 1024) {
+		unsigned size = 2;
+		while (size < capacity) size <<= 1;
+
+		mMask = size - 1;
+		mCells.reset(new Cell[size]);
+		for (unsigned x = 0; x < size; x++) mCells[x].sequence.store(x, std::memory_order_relaxed);
+	}
+
+	~TSRingQueue() {
+		clear();
+	}
+
+	bool tryQueue(T &item) {
+		size_t pos = mTail.load(std::memory_order_relaxed);
+
+		while (true) {
+			Cell &cell = mCells[pos & mMask];
+			intptr_t diff = (intptr_t)cell.sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+
+			if (diff == 0) {
+				if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.data = std::move(item);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					mNotEmpty.notify();
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;	// full
+			}
+			else {
+				pos = mTail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void queue(T &item) {
+		while (!tryQueue(item)) {
+			unsigned key = mNotFull.prepareWait();
+			if (tryQueue(item)) {
+				mNotFull.cancelWait();
+				return;
+			}
+			mNotFull.wait(key, std::chrono::milliseconds(10));
+		}
+	}
+
+	bool dequeue(T &item) {
+		size_t pos = mHead.load(std::memory_order_relaxed);
+
+		while (true) {
+			Cell &cell = mCells[pos & mMask];
+			intptr_t diff = (intptr_t)cell.sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+
+			if (diff == 0) {
+				if (mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					item = std::move(cell.data);
+					cell.data = T();
+					cell.sequence.store(pos + mMask + 1, std::memory_order_release);
+					mNotFull.notify();
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;	// empty
+			}
+			else {
+				pos = mHead.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Dequeue up to maxItems, returns the number of items written
+	int dequeueBatch(T *items, int maxItems) {
+		int count = 0;
+		while (count < maxItems && dequeue(items[count])) count++;
+		return count;
+	}
+
+	// Sleeps until an item arrives or the timeout expires
+	template <typename Rep, typename Period>
+	bool waitDequeue(T &item, const std::chrono::duration<Rep, Period> &timeout) {
+		if (dequeue(item)) return true;
+
+		unsigned key = mNotEmpty.prepareWait();
+		if (dequeue(item)) {
+			mNotEmpty.cancelWait();
+			return true;
+		}
+		mNotEmpty.wait(key, timeout);
+		return dequeue(item);
+	}
+
+	void clear() {
+		T item;
+		while (dequeue(item)) {}
+	}
+
+	// Approximate while other threads are working on the queue
+	int size() {
+		size_t tail = mTail.load(std::memory_order_acquire);
+		size_t head = mHead.load(std::memory_order_acquire);
+		return tail > head ? (int)(tail - head) : 0;
+	}
+
+	int capacity() const {
+		return (int)mMask + 1;
+	}
+
+protected:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> mCells;
+	size_t mMask;
+
+	// Keep producers and consumers off each other's cache lines
+	alignas(64) std::atomic<size_t> mHead{ 0 };
+	alignas(64) std::atomic<size_t> mTail{ 0 };
+
+	TSEventCount mNotEmpty, mNotFull;
+};
+
+
 // ResourceLoader<InputType, OutputType>
 template <typename IP, typename OP>
 class ResourceLoader {
@@ -318,12 +496,13 @@ private:
 
 
 // @Cockatrice - Redesigning resource loader to work with an arbitrary set of queues
-template <typename IP, typename OP>
+// IQ is the input queue type, TSQueue or TSRingQueue
+template <typename IP, typename OP, typename IQ = TSQueue<IP>>
 class ResourceLoader2 {
 public:
 	ResourceLoader2() { }
 
-	ResourceLoader2(TSQueue<IP>* inputQueue, TSQueue<IP>* secondaryInputQueue, TSQueue<OP>* outputQueue) {
+	ResourceLoader2(IQ* inputQueue, IQ* secondaryInputQueue, TSQueue<OP>* outputQueue) {
 		mInputQ = inputQueue;
 		mInputQSecondary = secondaryInputQueue;
 		mOutputQ = outputQueue;
@@ -332,7 +511,7 @@ public:
 
 	void start() {
 		if (mThread.get_id() == std::thread::id()) {
-			mThread = std::thread(&ResourceLoader2<IP, OP>::bgproc, this);
+			mThread = std::thread(&ResourceLoader2::bgproc, this);
 		}
 	}
 
@@ -349,6 +528,11 @@ public:
 		return mRunning.load();//&& mActive.load();
 	}
 
+	// Wake the thread up early, instead of waiting for the next poll
+	void wake() {
+		mWake.notify_all();
+	}
+
 	void resetStats() {
 		// TODO: Block stat updates
 		mStatLoadTime = 0;
@@ -392,8 +576,8 @@ protected:
 	std::mutex mWakeLock, mStatsLock;
 	std::condition_variable mWake;
 
-	TSQueue<IP>* mInputQ = nullptr;
-	TSQueue<IP>* mInputQSecondary = nullptr;
+	IQ* mInputQ = nullptr;
+	IQ* mInputQSecondary = nullptr;
 	TSQueue<OP>* mOutputQ = nullptr;
 
 protected:
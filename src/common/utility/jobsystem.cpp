@@ -0,0 +1,500 @@
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+//--------------------------------------------------------------------------
+//
+/*
+** jobsystem.cpp
+** Prioritized, work stealing background job queue for resource loading
+**
+*/
+
+#include <algorithm>
+#include <stdlib.h>
+#include "jobsystem.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "printf.h"
+#include "version.h"
+
+CUSTOM_CVAR(Int, r_loader_threads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG | CVAR_NOINITCALL)
+{
+	if (self < 0) self = 0;
+	else if (self > 8) self = 8;
+
+	Printf("This won't take effect until " GAMENAME " is restarted.\n");
+}
+
+FJobSystem BackgroundJobs;
+
+static thread_local const FJobSystem *CurrentSystem = nullptr;
+static thread_local int CurrentIndex = -1;
+
+
+//==========================================================================
+//
+// FJobGroup
+//
+//==========================================================================
+
+int FJobGroup::QueuedTotal() const
+{
+	int total = 0;
+	for (auto &q : queued) total += q.load();
+	return total;
+}
+
+void FJobGroup::Wait()
+{
+	std::unique_lock<std::mutex> lock(waitLock);
+	waitCond.wait(lock, [this] { return pending.load() <= 0; });
+}
+
+void FJobGroup::Finished(int count, bool wasCancelled)
+{
+	if (count <= 0) return;
+
+	// All of this must happen under the lock. Wait may return as soon as it sees pending drop to 0
+	// and the group is often a local of the waiting function, so it must not be touched after that.
+	std::lock_guard<std::mutex> lock(waitLock);
+	(wasCancelled ? cancelled : completed) += count;
+	if ((pending -= count) <= 0)
+	{
+		waitCond.notify_all();
+	}
+}
+
+void FJobGroup::AddTime(double ms)
+{
+	std::lock_guard<std::mutex> lock(statLock);
+	minTime = timeCount == 0 ? ms : std::min(minTime, ms);
+	maxTime = std::max(maxTime, ms);
+	totalTime += ms;
+	timeCount++;
+}
+
+void FJobGroup::GetTimes(double &min, double &max, double &avg)
+{
+	std::lock_guard<std::mutex> lock(statLock);
+	min = minTime;
+	max = maxTime;
+	avg = timeCount > 0 ? totalTime / timeCount : 0;
+}
+
+void FJobGroup::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(statLock);
+	totalTime = minTime = maxTime = 0;
+	timeCount = 0;
+	completed = 0;
+	cancelled = 0;
+}
+
+
+//==========================================================================
+//
+// FJobSystem
+//
+//==========================================================================
+
+void FJobSystem::Start(int numWorkers)
+{
+	std::lock_guard<std::mutex> lock(StartLock);
+	if (Running) return;
+
+	if (numWorkers <= 0) numWorkers = r_loader_threads;
+	if (numWorkers <= 0) numWorkers = std::clamp<int>(std::thread::hardware_concurrency() / 2, 1, 4);
+
+	Stopping = false;
+	for (int i = 0; i < numWorkers; i++) Workers.push_back(std::make_unique<FWorker>());
+	for (int i = 0; i < numWorkers; i++) Workers[i]->Thread = std::thread(&FJobSystem::WorkerProc, this, i);
+	Running = true;
+}
+
+//==========================================================================
+//
+// Jobs still queued at this point are cancelled, not run
+//
+//==========================================================================
+
+void FJobSystem::Stop()
+{
+	std::lock_guard<std::mutex> lock(StartLock);
+	if (!Running) return;
+
+	{
+		std::lock_guard<std::mutex> sleepLock(SleepLock);
+		Stopping = true;
+	}
+	WakeUp.notify_all();
+
+	for (auto &w : Workers) w->Thread.join();
+	Cancel(nullptr);
+
+	Workers.clear();
+	Running = false;
+}
+
+int FJobSystem::CurrentWorker() const
+{
+	return CurrentSystem == this ? CurrentIndex : -1;
+}
+
+void FJobSystem::Submit(EJobPriority pri, FJobGroup *group, std::function<void()> run, std::function<void()> cancelled, const void *tag)
+{
+	assert(group != nullptr && pri >= 0 && pri < NUM_JOB_PRIORITIES);
+	if (!Running) Start();
+
+	int index = CurrentWorker();
+	if (index < 0) index = NextWorker++ % Workers.size();
+
+	group->pending++;
+	group->queued[pri]++;
+	{
+		auto &w = *Workers[index];
+		std::lock_guard<std::mutex> lock(w.Lock);
+		w.Queues[pri].push_back({ std::move(run), std::move(cancelled), group, tag });
+	}
+	NumQueued++;
+
+	// Taking the lock makes sure a worker cannot miss the wakeup between checking for work and going to sleep.
+	{
+		std::lock_guard<std::mutex> lock(SleepLock);
+	}
+	WakeUp.notify_one();
+}
+
+//==========================================================================
+//
+// A null group cancels everything
+//
+//==========================================================================
+
+int FJobSystem::Cancel(FJobGroup *group)
+{
+	std::vector<FJob> removed;
+
+	for (auto &w : Workers)
+	{
+		std::lock_guard<std::mutex> lock(w->Lock);
+		for (int pri = 0; pri < NUM_JOB_PRIORITIES; pri++)
+		{
+			auto &q = w->Queues[pri];
+			for (auto it = q.begin(); it != q.end();)
+			{
+				if (group == nullptr || it->Group == group)
+				{
+					it->Group->queued[pri]--;
+					NumQueued--;
+					removed.push_back(std::move(*it));
+					it = q.erase(it);
+				}
+				else ++it;
+			}
+		}
+	}
+
+	// Callbacks run outside of the locks, they are free to submit new work.
+	for (auto &job : removed)
+	{
+		if (job.Cancelled) job.Cancelled();
+		job.Group->Finished(1, true);
+	}
+	return (int)removed.size();
+}
+
+bool FJobSystem::Promote(const void *tag, EJobPriority pri)
+{
+	if (tag == nullptr) return false;
+
+	for (auto &w : Workers)
+	{
+		std::lock_guard<std::mutex> lock(w->Lock);
+		for (int p = 0; p < NUM_JOB_PRIORITIES; p++)
+		{
+			auto &q = w->Queues[p];
+			auto it = std::find_if(q.begin(), q.end(), [=](const FJob &job) { return job.Tag == tag; });
+			if (it == q.end()) continue;
+			if (p <= pri) return true;
+
+			it->Group->queued[p]--;
+			it->Group->queued[pri]++;
+			w->Queues[pri].push_back(std::move(*it));
+			q.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// Every job and the caller pull indices from a shared counter, so uneven
+// work sizes balance out and the caller never sits idle while it waits.
+//
+// Once the caller runs out of indices, helpers no worker has picked up yet
+// are removed instead of waited for. The caller therefore only ever waits
+// for jobs that are already running, so this is safe to use from a job,
+// even with every other worker busy.
+//
+//==========================================================================
+
+void FJobSystem::ParallelFor(int count, const std::function<void(int)> &work, EJobPriority pri)
+{
+	if (count <= 0) return;
+	bool onWorker = CurrentWorker() >= 0;
+	if (count > 1 && !onWorker) Start();
+	if (count == 1 || !Running || (onWorker && NumWorkers() < 2))
+	{
+		for (int i = 0; i < count; i++) work(i);
+		return;
+	}
+
+	std::atomic<int> next{ 0 };
+	auto loop = [&]()
+	{
+		for (int i = next++; i < count; i = next++) work(i);
+	};
+
+	FJobGroup group;
+	int jobs = std::min(count - 1, NumWorkers() - onWorker);
+	for (int i = 0; i < jobs; i++) Submit(pri, &group, loop);
+	loop();
+	Cancel(&group);
+	group.Wait();
+}
+
+//==========================================================================
+//
+// Own queue first, oldest job first, so requests are served in the order
+// they came in. Stealing takes the newest job from the back, away from
+// where the owner is working.
+//
+//==========================================================================
+
+bool FJobSystem::Take(int self, FJob &job)
+{
+	const int count = (int)Workers.size();
+
+	for (int pri = 0; pri < NUM_JOB_PRIORITIES; pri++)
+	{
+		{
+			auto &w = *Workers[self];
+			std::lock_guard<std::mutex> lock(w.Lock);
+			auto &q = w.Queues[pri];
+			if (!q.empty())
+			{
+				job = std::move(q.front());
+				q.pop_front();
+				job.Group->queued[pri]--;
+				NumQueued--;
+				return true;
+			}
+		}
+
+		for (int i = 1; i < count; i++)
+		{
+			auto &w = *Workers[(self + i) % count];
+			std::lock_guard<std::mutex> lock(w.Lock);
+			auto &q = w.Queues[pri];
+			if (!q.empty())
+			{
+				job = std::move(q.back());
+				q.pop_back();
+				job.Group->queued[pri]--;
+				NumQueued--;
+				Steals++;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void FJobSystem::WorkerProc(int index)
+{
+	CurrentSystem = this;
+	CurrentIndex = index;
+
+	while (true)
+	{
+		FJob job;
+		if (Take(index, job))
+		{
+			cycle_t time;
+			time.Reset();
+			time.Clock();
+			job.Run();
+			time.Unclock();
+
+			job.Group->AddTime(time.TimeMS());
+			job.Group->Finished(1, false);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(SleepLock);
+		WakeUp.wait(lock, [this] { return Stopping || NumQueued.load() > 0; });
+		if (Stopping) break;
+	}
+
+	CurrentSystem = nullptr;
+	CurrentIndex = -1;
+}
+
+
+ADD_STAT(jobs)
+{
+	FString out;
+	out.Format("%d workers, %d queued, %u steals", BackgroundJobs.NumWorkers(), BackgroundJobs.NumQueuedTotal(), BackgroundJobs.NumSteals());
+	return out;
+}
+
+
+//==========================================================================
+//
+// Drives a private job system with synthetic work and no renderer behind
+// it, then checks that every job either ran or was cancelled exactly once,
+// that promotions arrived and that urgent work was started first.
+//
+// jobtest [jobs] [workers]
+//
+//==========================================================================
+
+CCMD(jobtest)
+{
+	const int numJobs = argv.argc() > 1 ? std::max(atoi(argv[1]), 16) : 2000;
+	const int numWorkers = argv.argc() > 2 ? std::max(atoi(argv[2]), 1) : 4;
+
+	struct FTestJob
+	{
+		std::atomic<int> runs{ 0 }, cancels{ 0 };
+		int pri = 0;
+		int order = -1;
+		bool canceled = false;
+	};
+
+	std::vector<FTestJob> jobs(numJobs + numJobs / 4);
+	std::atomic<int> startOrder{ 0 };
+	std::atomic<uint32_t> sink{ 0 };
+	FJobGroup keep, drop;
+	FJobSystem system;
+
+	auto work = [&](int i)
+	{
+		jobs[i].order = startOrder++;
+		uint32_t h = i;
+		for (int n = 0; n < 2000; n++) h = h * 0x9E3779B1u + n;
+		sink += h;
+		jobs[i].runs++;
+	};
+
+	cycle_t time;
+	time.Reset();
+	time.Clock();
+
+	// Park every worker on a gate first so the whole queue is in place, promoted and
+	// partially cancelled before anything runs. That keeps the priority order checkable.
+	std::mutex gateLock;
+	std::condition_variable gate;
+	bool open = false;
+	std::atomic<int> parked{ 0 };
+
+	system.Start(numWorkers);
+	for (int i = 0; i < numWorkers; i++)
+	{
+		system.Submit(JOBPRI_Now, &keep, [&]
+		{
+			std::unique_lock<std::mutex> lock(gateLock);
+			parked++;
+			gate.wait(lock, [&] { return open; });
+		});
+	}
+	while (parked.load() < numWorkers) std::this_thread::yield();
+
+	for (int i = 0; i < numJobs; i++)
+	{
+		auto &j = jobs[i];
+		j.pri = i % NUM_JOB_PRIORITIES;
+		j.canceled = j.pri != JOBPRI_Now && (i % 5) == 0;
+
+		system.Submit((EJobPriority)j.pri, j.canceled ? &drop : &keep, [&, i]
+		{
+			work(i);
+
+			// Some jobs spawn follow-up work from inside a worker, which stays on that worker's queue.
+			if ((i % 8) == 0)
+			{
+				int child = numJobs + i / 4;
+				jobs[child].pri = JOBPRI_Speculative;
+				system.Submit(JOBPRI_Speculative, &keep, [&, child] { work(child); }, [&, child] { jobs[child].cancels++; });
+			}
+		}, [&, i] { jobs[i].cancels++; }, &jobs[i]);
+	}
+
+	int promoted = 0;
+	for (int i = JOBPRI_Speculative; i < numJobs; i += 9 * NUM_JOB_PRIORITIES)
+	{
+		if (!jobs[i].canceled && system.Promote(&jobs[i], JOBPRI_Now))
+		{
+			jobs[i].pri = JOBPRI_Now;
+			promoted++;
+		}
+	}
+	int cancelled = system.Cancel(&drop);
+	{
+		std::lock_guard<std::mutex> lock(gateLock);
+		open = true;
+	}
+	gate.notify_all();
+
+	keep.Wait();
+	drop.Wait();
+	time.Unclock();
+	system.Stop();
+
+	int errors = 0, ran = 0, cancels = 0;
+	double orderSum[NUM_JOB_PRIORITIES] = {}, orderCount[NUM_JOB_PRIORITIES] = {};
+	for (int i = 0; i < (int)jobs.size(); i++)
+	{
+		auto &j = jobs[i];
+		bool spawned = i >= numJobs;
+		if (spawned && (i - numJobs) * 4 >= numJobs) continue;
+		bool expected = spawned ? ((i - numJobs) * 4 % 8) == 0 && !jobs[(i - numJobs) * 4].canceled : true;
+		if (!expected) continue;
+
+		if (j.runs + j.cancels != 1 || (j.canceled && j.runs != 0)) errors++;
+		ran += j.runs;
+		cancels += j.cancels;
+		if (j.runs && !spawned)
+		{
+			orderSum[j.pri] += j.order;
+			orderCount[j.pri]++;
+		}
+	}
+
+	Printf("%d jobs on %d workers in %.2f ms: %d ran, %d cancelled (%d reported), %d promoted, %u steals\n",
+		startOrder.load(), numWorkers, time.TimeMS(), ran, cancels, cancelled, promoted, system.NumSteals());
+	for (int p = 0; p < NUM_JOB_PRIORITIES; p++)
+	{
+		Printf("  priority %d: average start %.1f\n", p, orderCount[p] > 0 ? orderSum[p] / orderCount[p] : 0.);
+	}
+	if (orderSum[JOBPRI_Now] / std::max(orderCount[JOBPRI_Now], 1.) > orderSum[JOBPRI_Speculative] / std::max(orderCount[JOBPRI_Speculative], 1.)) errors++;
+	if (keep.Pending() != 0 || drop.Pending() != 0 || drop.Completed() != 0) errors++;
+
+	if (errors) Printf(TEXTCOLOR_RED "jobtest: %d errors\n", errors);
+	else Printf(TEXTCOLOR_GREEN "jobtest: passed\n");
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+//==========================================================================
+//
+// Background job system shared by the resource loaders.
+//
+// Jobs are plain CPU work (file reads, image decoding, sprite positioning,
+// model parsing). Anything that has to talk to the GPU stays on the thread
+// owning the API context and consumes the results of these jobs.
+//
+// Every worker owns one queue per priority class. Jobs submitted from a
+// worker go to that worker's queue, everything else is spread round robin.
+// An idle worker first takes the oldest job of the most urgent class from
+// its own queue, then steals the newest job of that class from the others
+// before it looks at the next class.
+//
+//==========================================================================
+
+enum EJobPriority
+{
+	JOBPRI_Now,				// needed for something that is on screen
+	JOBPRI_Precache,		// will be needed for the current level
+	JOBPRI_Speculative,		// may be needed eventually
+
+	NUM_JOB_PRIORITIES
+};
+
+// Jobs belonging to one consumer, so they can be waited on or cancelled
+// together without touching anything else that is queued.
+class FJobGroup
+{
+public:
+	FJobGroup() = default;
+	FJobGroup(const FJobGroup &) = delete;
+	FJobGroup &operator=(const FJobGroup &) = delete;
+
+	int Pending() const { return pending.load(); }			// queued or running
+	int Queued(int pri) const { return queued[pri].load(); }
+	int QueuedTotal() const;
+	int Completed() const { return completed.load(); }
+	int Cancelled() const { return cancelled.load(); }
+
+	// Blocks until everything submitted to this group has run or was cancelled.
+	void Wait();
+
+	void GetTimes(double &min, double &max, double &avg);
+	void ResetStats();
+
+private:
+	friend class FJobSystem;
+
+	void Finished(int count, bool wasCancelled);
+	void AddTime(double ms);
+
+	std::atomic<int> pending{ 0 };
+	std::atomic<int> queued[NUM_JOB_PRIORITIES] = {};
+	std::atomic<int> completed{ 0 }, cancelled{ 0 };
+
+	std::mutex statLock;
+	double totalTime = 0, minTime = 0, maxTime = 0;
+	int timeCount = 0;
+
+	std::mutex waitLock;
+	std::condition_variable waitCond;
+};
+
+class FJobSystem
+{
+public:
+	~FJobSystem() { Stop(); }
+
+	void Start(int numWorkers = 0);
+	void Stop();
+	bool IsRunning() const { return Running.load(); }
+	int NumWorkers() const { return (int)Workers.size(); }
+	int NumQueuedTotal() const { return NumQueued.load(); }
+	unsigned NumSteals() const { return Steals.load(); }
+
+	// run executes on a worker. cancelled executes instead, on the thread calling
+	// Cancel or Stop, if the job gets removed before a worker picked it up.
+	// tag identifies the job for Promote, it is never dereferenced.
+	void Submit(EJobPriority pri, FJobGroup *group, std::function<void()> run, std::function<void()> cancelled = nullptr, const void *tag = nullptr);
+
+	// Removes all queued jobs of a group. Jobs that are already running are not interrupted.
+	int Cancel(FJobGroup *group);
+
+	// Moves a queued job to a more urgent class. Returns false if it was not queued anymore.
+	bool Promote(const void *tag, EJobPriority pri);
+
+	// Runs work(0) .. work(count - 1) spread over the workers and the calling thread and returns
+	// once all have finished. Safe to call from a worker, it never waits for jobs that have not started.
+	void ParallelFor(int count, const std::function<void(int)> &work, EJobPriority pri = JOBPRI_Now);
+
+	// Id of the calling worker thread or -1 if it is none of ours.
+	int CurrentWorker() const;
+
+private:
+	struct FJob
+	{
+		std::function<void()> Run;
+		std::function<void()> Cancelled;
+		FJobGroup *Group;
+		const void *Tag;
+	};
+
+	struct FWorker
+	{
+		std::thread Thread;
+		std::mutex Lock;
+		std::deque<FJob> Queues[NUM_JOB_PRIORITIES];
+	};
+
+	bool Take(int self, FJob &job);
+	void WorkerProc(int index);
+
+	std::vector<std::unique_ptr<FWorker>> Workers;
+	std::atomic<bool> Running{ false };
+	std::atomic<int> NumQueued{ 0 };
+	std::atomic<unsigned> NextWorker{ 0 }, Steals{ 0 };
+	std::mutex StartLock, SleepLock;
+	std::condition_variable WakeUp;
+	bool Stopping = false;
+};
+
+extern FJobSystem BackgroundJobs;
@@ -35,14 +35,30 @@
 
 #include <stdint.h>
 #include <algorithm>
+#include <miniz.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
 #include "tarray.h"
 #include "files.h"
 #include "m_swap.h"
 #include "w_zip.h"
 #include "fs_decompress.h"
+#include "fs_filesystem.h"
 #include "cmdlib.h"
+#include "c_dispatch.h"
+#include "printf.h"
+#include "v_text.h"
+#include "i_time.h"
+#include "i_specialpaths.h"
+#include "c_cvars.h"
+#include "jobsystem.h"
 
 using FileSys::FCompressedBuffer;
+using FileSys::FResourceFile;
 
 
 
@@ -69,6 +85,241 @@ static std::pair<uint16_t, uint16_t> time_to_dos(struct tm *time)
 	return val;
 }
 
+//==========================================================================
+//
+// Zstandard and LZ4 entries need a newer unzipper than the classic methods.
+//
+//==========================================================================
+
+static uint8_t VersionToExtract(int method)
+{
+	return (method == FileSys::METHOD_ZSTD || method == FileSys::METHOD_LZ4) ? 63 : 20;
+}
+
+//==========================================================================
+//
+// Parallel deflate
+//
+// The input gets cut into chunks that are compressed independently on the
+// job system's workers. Every chunk but the last ends with a sync flush so
+// it stops on a byte boundary without a final block, which lets the chunks
+// simply be appended into one valid raw deflate stream. The CRCs of the
+// chunks are calculated on the workers as well and merged afterward.
+//
+// miniz cannot preset a dictionary so matches never cross a chunk border.
+// The chunks are large enough to make the loss in ratio negligible.
+//
+//==========================================================================
+
+CUSTOM_CVAR(Int, zip_deflate_threads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// 0 uses every worker, 1 compresses in a single stream
+{
+	if (self < 0) self = 0;
+}
+
+enum
+{
+	DEFLATE_CHUNK = 256 * 1024,
+};
+
+static uint32_t GF2MatrixTimes(const uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+	for (; vec; vec >>= 1, mat++)
+	{
+		if (vec & 1) sum ^= *mat;
+	}
+	return sum;
+}
+
+static void GF2MatrixSquare(uint32_t *square, const uint32_t *mat)
+{
+	for (int n = 0; n < 32; n++) square[n] = GF2MatrixTimes(mat, mat[n]);
+}
+
+// Returns the CRC of two concatenated blocks from their individual CRCs, same as zlib's crc32_combine.
+static uint32_t CRC32Combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+	if (len2 == 0) return crc1;
+
+	uint32_t even[32], odd[32];
+	odd[0] = 0xedb88320;	// the CRC-32 polynomial
+	for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+
+	// put an operator for two and then four zero bits in even and odd
+	GF2MatrixSquare(even, odd);
+	GF2MatrixSquare(odd, even);
+
+	// apply len2 zero bytes to crc1, the first square puts the operator for one zero byte in even
+	do
+	{
+		GF2MatrixSquare(even, odd);
+		if (len2 & 1) crc1 = GF2MatrixTimes(even, crc1);
+		len2 >>= 1;
+		if (len2 == 0) break;
+
+		GF2MatrixSquare(odd, even);
+		if (len2 & 1) crc1 = GF2MatrixTimes(odd, crc1);
+		len2 >>= 1;
+	} while (len2 != 0);
+
+	return crc1 ^ crc2;
+}
+
+static size_t DeflateChunk(const uint8_t *data, size_t size, uint8_t *out, size_t outsize, int level, bool last)
+{
+	z_stream stream = {};
+	stream.next_in = data;
+	stream.avail_in = (unsigned)size;
+	stream.next_out = out;
+	stream.avail_out = (unsigned)outsize;
+
+	if (deflateInit2(&stream, level, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+	int err = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+	// a sync flush is only complete if there was output space left over
+	bool ok = last ? err == Z_STREAM_END : err == Z_OK && stream.avail_in == 0 && stream.avail_out > 0;
+	size_t result = ok ? (size_t)stream.total_out : 0;
+	deflateEnd(&stream);
+	return result;
+}
+
+//==========================================================================
+//
+// Compresses data into out, which must hold size bytes. Returns the size
+// of the raw deflate stream or 0 if it did not fit. crc is always set.
+//
+//==========================================================================
+
+static size_t DeflateParallel(const void *data, size_t size, int level, char *out, uint32_t &crc, int threads)
+{
+	auto src = (const uint8_t *)data;
+	int numchunks = int((size + DEFLATE_CHUNK - 1) / DEFLATE_CHUNK);
+	if (threads <= 0) threads = BackgroundJobs.NumWorkers() + 1;
+	threads = std::min(threads, numchunks);
+
+	if (threads <= 1)
+	{
+		crc = (uint32_t)crc32(0, src, size);
+		return DeflateChunk(src, size, (uint8_t *)out, size, level, true);
+	}
+
+	struct FChunk
+	{
+		TArray<uint8_t> packed;
+		size_t packedsize;
+		uint32_t crc;
+	};
+	TArray<FChunk> chunks(numchunks, true);
+	std::atomic<int> next{ 0 };
+
+	// Only as many loops as threads were requested, each of them pulls chunks until none are left.
+	BackgroundJobs.ParallelFor(threads, [&](int)
+	{
+		for (int i = next++; i < numchunks; i = next++)
+		{
+			size_t start = size_t(i) * DEFLATE_CHUNK;
+			size_t length = std::min<size_t>(DEFLATE_CHUNK, size - start);
+			auto &chunk = chunks[i];
+			chunk.crc = (uint32_t)crc32(0, src + start, length);
+			chunk.packed.Resize(unsigned(compressBound((mz_ulong)length) + 16));
+			chunk.packedsize = DeflateChunk(src + start, length, chunk.packed.Data(), chunk.packed.Size(), level, i == numchunks - 1);
+		}
+	});
+
+	// The CRC must cover all of the data even if the result does not fit, the caller stores the data then.
+	crc = 0;
+	for (int i = 0; i < numchunks; i++)
+	{
+		crc = CRC32Combine(crc, chunks[i].crc, std::min<size_t>(DEFLATE_CHUNK, size - size_t(i) * DEFLATE_CHUNK));
+	}
+
+	size_t total = 0;
+	for (auto &chunk : chunks)
+	{
+		if (chunk.packedsize == 0 || total + chunk.packedsize > size) return 0;
+		memcpy(out + total, chunk.packed.Data(), chunk.packedsize);
+		total += chunk.packedsize;
+	}
+	return total;
+}
+
+//==========================================================================
+//
+// CompressZipEntry
+//
+// Packs a block of data into a buffer WriteZip can store. Falls back to
+// storing the data if the method is not available in this build or does
+// not make the data any smaller.
+//
+//==========================================================================
+
+FCompressedBuffer CompressZipEntry(const char *filename, const void *data, size_t size, int method, int level)
+{
+	FCompressedBuffer buff = { size, size, FileSys::METHOD_STORED, 0, nullptr, filename };
+
+	char *out = nullptr;
+	size_t outsize = 0;
+
+	switch (method)
+	{
+	case FileSys::METHOD_DEFLATE:
+	{
+		// raw deflate stream, as required by FCompressedBuffer
+		uint32_t crc;
+		out = new char[size + 1];
+		outsize = DeflateParallel(data, size, level, out, crc, zip_deflate_threads);
+		buff.mCRC32 = crc;
+		break;
+	}
+
+#ifdef HAVE_ZSTD
+	case FileSys::METHOD_ZSTD:
+	{
+		size_t bound = ZSTD_compressBound(size);
+		out = new char[bound];
+		size_t result = ZSTD_compress(out, bound, data, size, level);
+		if (!ZSTD_isError(result)) outsize = result;
+		break;
+	}
+#endif
+
+#ifdef HAVE_LZ4
+	case FileSys::METHOD_LZ4:
+	{
+		LZ4F_preferences_t prefs = {};
+		prefs.compressionLevel = level;
+		prefs.frameInfo.contentSize = size;
+		size_t bound = LZ4F_compressFrameBound(size, &prefs);
+		out = new char[bound];
+		size_t result = LZ4F_compressFrame(out, bound, data, size, &prefs);
+		if (!LZ4F_isError(result)) outsize = result;
+		break;
+	}
+#endif
+
+	default:
+		break;
+	}
+
+	if (method != FileSys::METHOD_DEFLATE)
+	{
+		buff.mCRC32 = (unsigned)crc32(0, (const Bytef*)data, (unsigned)size);
+	}
+
+	if (outsize > 0 && outsize < size)
+	{
+		buff.mBuffer = out;
+		buff.mCompressedSize = outsize;
+		buff.mMethod = method;
+	}
+	else
+	{
+		delete[] out;
+		buff.mBuffer = new char[size + 1];
+		memcpy(buff.mBuffer, data, size);
+	}
+	return buff;
+}
+
 //==========================================================================
 //
 // append_to_zip
@@ -101,7 +352,7 @@ static int AppendToZip(FileWriter *zip_file, const FCompressedBuffer &content, s
 		return -1;
 
 	local.Magic = ZIP_LOCALFILE;
-	local.VersionToExtract[0] = 20;
+	local.VersionToExtract[0] = VersionToExtract(method);
 	local.VersionToExtract[1] = 0;
 	local.Flags = LittleShort((uint16_t)flags);
 	local.Method = LittleShort((uint16_t)method);
@@ -155,9 +406,9 @@ int AppendCentralDirectory(FileWriter *zip_file, const FCompressedBuffer &conten
 		return -1;
 
 	dir.Magic = ZIP_CENTRALFILE;
-	dir.VersionMadeBy[0] = 20;
+	dir.VersionMadeBy[0] = VersionToExtract(method);
 	dir.VersionMadeBy[1] = 0;
-	dir.VersionToExtract[0] = 20;
+	dir.VersionToExtract[0] = VersionToExtract(method);
 	dir.VersionToExtract[1] = 0;
 	dir.Flags = LittleShort((uint16_t)flags);
 	dir.Method = LittleShort((uint16_t)method);
@@ -239,3 +490,211 @@ bool WriteZip(const char* filename, const FCompressedBuffer* content, size_t con
 	}
 	return false;
 }
+
+//==========================================================================
+//
+// Repacking and comparing archive compression methods
+//
+//==========================================================================
+
+struct FZipMethodInfo
+{
+	const char *name;
+	int method;
+	int defaultlevel;
+};
+
+static const FZipMethodInfo ZipMethods[] =
+{
+	{ "store", FileSys::METHOD_STORED, 0 },
+	{ "deflate", FileSys::METHOD_DEFLATE, 9 },
+#ifdef HAVE_ZSTD
+	{ "zstd", FileSys::METHOD_ZSTD, 19 },
+#endif
+#ifdef HAVE_LZ4
+	{ "lz4", FileSys::METHOD_LZ4, 9 },
+#endif
+};
+
+// Compresses every entry of an archive. Returns the total compressed size or -1 on failure.
+static int64_t PackArchive(FResourceFile *source, const char *destname, int method, int level)
+{
+	TArray<FCompressedBuffer> buffers;
+	int64_t total = 0;
+
+	for (int i = 0; i < source->EntryCount(); i++)
+	{
+		auto data = source->Read(i);
+		buffers.Push(CompressZipEntry(source->getName(i), data.data(), data.size(), method, level));
+		total += buffers.Last().mCompressedSize;
+	}
+
+	bool ok = WriteZip(destname, buffers.Data(), buffers.Size());
+	for (auto &buff : buffers) buff.Clean();
+	return ok ? total : -1;
+}
+
+CCMD(zippack)
+{
+	if (argv.argc() < 3)
+	{
+		Printf("Usage: zippack <source> <destination> [store|deflate|zstd|lz4] [level]\n");
+		return;
+	}
+
+	const FZipMethodInfo *method = &ZipMethods[1];
+	if (argv.argc() > 3)
+	{
+		method = nullptr;
+		for (auto &m : ZipMethods) if (!stricmp(argv[3], m.name)) method = &m;
+		if (method == nullptr)
+		{
+			Printf("Compression method '%s' is not available in this build\n", argv[3]);
+			return;
+		}
+	}
+	int level = argv.argc() > 4 ? (int)strtol(argv[4], nullptr, 10) : method->defaultlevel;
+
+	std::unique_ptr<FResourceFile> source(FResourceFile::OpenResourceFile(argv[1]));
+	if (source == nullptr)
+	{
+		Printf("%s: unable to open\n", argv[1]);
+		return;
+	}
+	if (source->EntryCount() > 0xffff)
+	{
+		Printf("%s: too many entries for a zip without Zip64 support\n", argv[1]);
+		return;
+	}
+
+	auto start = I_msTimeF();
+	auto size = PackArchive(source.get(), argv[2], method->method, level);
+	if (size < 0) Printf("%s: unable to write\n", argv[2]);
+	else Printf("Packed %d entries with %s in %.1f ms, %.2f MB\n", source->EntryCount(), method->name, I_msTimeF() - start, size / (1024. * 1024.));
+}
+
+// Repacks an archive with every available method and measures what matters at runtime:
+// opening it and reading every entry back, which is what a full precache does.
+CCMD(zipbench)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: zipbench <archive>\n");
+		return;
+	}
+
+	std::unique_ptr<FResourceFile> source(FResourceFile::OpenResourceFile(argv[1]));
+	if (source == nullptr || source->EntryCount() > 0xffff)
+	{
+		Printf("%s: unable to open or too many entries\n", argv[1]);
+		return;
+	}
+
+	FString temppath = M_GetCachePath(true);
+	CreatePath(temppath.GetChars());
+
+	Printf("%-8s %10s %10s %10s %10s\n", "method", "size MB", "pack ms", "open ms", "read ms");
+	for (auto &m : ZipMethods)
+	{
+		// A separate file per method so nothing cached about one of them can be mistaken for another
+		FStringf tempname("%s/zipbench_%s.pk3", temppath.GetChars(), m.name);
+		auto start = I_msTimeF();
+		auto size = PackArchive(source.get(), tempname.GetChars(), m.method, m.defaultlevel);
+		auto packtime = I_msTimeF() - start;
+		if (size < 0)
+		{
+			Printf("%s: unable to write %s\n", m.name, tempname.GetChars());
+			continue;
+		}
+
+		start = I_msTimeF();
+		std::unique_ptr<FResourceFile> packed(FResourceFile::OpenResourceFile(tempname.GetChars()));
+		auto opentime = I_msTimeF() - start;
+		if (packed == nullptr)
+		{
+			RemoveFile(tempname.GetChars());
+			continue;
+		}
+
+		start = I_msTimeF();
+		for (int i = 0; i < packed->EntryCount(); i++)
+		{
+			auto data = packed->Read(i);
+		}
+		auto readtime = I_msTimeF() - start;
+
+		Printf("%-8s %10.2f %10.1f %10.1f %10.1f\n", m.name, size / (1024. * 1024.), packtime, opentime, readtime);
+		packed.reset();
+		RemoveFile(tempname.GetChars());
+	}
+}
+
+// Compresses a file with an increasing number of threads and checks that the result inflates back to the original.
+CCMD(deflatebench)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: deflatebench <file|-random> [level] [iterations]\n");
+		return;
+	}
+	int level = argv.argc() > 2 ? std::clamp((int)strtol(argv[2], nullptr, 10), 1, 9) : 8;
+	int iterations = argv.argc() > 3 ? std::max(1, (int)strtol(argv[3], nullptr, 10)) : 3;
+
+	FileSys::FileData data;
+	if (!stricmp(argv[1], "-random"))
+	{
+		// Incompressible input, which must end up stored with the correct CRC.
+		data.allocate(4 * 1024 * 1024 + 12345);
+		uint64_t state = 0x9E3779B97F4A7C15ull;
+		auto p = (uint8_t *)data.writable();
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			p[i] = uint8_t(state >> 24);
+		}
+	}
+	else
+	{
+		FileReader fr;
+		if (!fr.OpenFile(argv[1]))
+		{
+			Printf("%s: unable to open\n", argv[1]);
+			return;
+		}
+		data = fr.Read();
+		fr.Close();
+	}
+	double megabytes = data.size() / (1024. * 1024.);
+	uint32_t expectedcrc = (uint32_t)crc32(0, (const Bytef*)data.data(), data.size());
+
+	BackgroundJobs.Start();
+	TArray<char> out(data.size() + 1, true), check(data.size() + 1, true);
+
+	Printf("%.2f MB at level %d\n%-8s %10s %10s %10s\n", megabytes, level, "threads", "ms", "MB/s", "ratio");
+	for (int threads = 1; threads <= BackgroundJobs.NumWorkers() + 1; threads++)
+	{
+		size_t outsize = 0;
+		uint32_t crc = 0;
+		auto start = I_msTimeF();
+		for (int i = 0; i < iterations; i++) outsize = DeflateParallel(data.data(), data.size(), level, out.Data(), crc, threads);
+		auto time = (I_msTimeF() - start) / iterations;
+
+		if (outsize == 0)
+		{
+			Printf("%-8d %10.2f does not compress%s\n", threads, time, crc == expectedcrc ? "" : TEXTCOLOR_RED " wrong CRC");
+			continue;
+		}
+		FCompressedBuffer buff = { data.size(), outsize, FileSys::METHOD_DEFLATE, crc, out.Data(), nullptr };
+		buff.Decompress(check.Data());
+		bool ok = crc == expectedcrc && !memcmp(check.Data(), data.data(), data.size());
+		Printf("%-8d %10.2f %10.1f %10.3f%s\n", threads, time, megabytes / (time / 1000.), double(outsize) / data.size(), ok ? "" : TEXTCOLOR_RED " verification failed");
+	}
+
+	// The same through CompressZipEntry, which falls back to storing the data if it does not compress.
+	auto entry = CompressZipEntry(nullptr, data.data(), data.size(), FileSys::METHOD_DEFLATE, level);
+	Printf("Zip entry: %s, %zu bytes%s\n", entry.mMethod == FileSys::METHOD_STORED ? "stored" : "deflated", (size_t)entry.mCompressedSize,
+		entry.mCRC32 == expectedcrc ? "" : TEXTCOLOR_RED " wrong CRC");
+	entry.Clean();
+}
@@ -54,6 +54,7 @@
 #include "wipe.h"
 #include "m_argv.h"
 #include "m_misc.h"
+#include "i_specialpaths.h"
 #include "menu.h"
 #include "doommenu.h"
 #include "c_console.h"
@@ -119,7 +120,9 @@
 #include "startscreen.h"
 #include "shiftstate.h"
 #include "s_loader.h"
+#include "jobsystem.h"
 #include "fs_findfile.h"
+#include "texturediskcache.h"
 
 #include "statdb.h"
 
@@ -329,6 +332,13 @@ CVAR(Bool, disableautoload, false, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALC
 CVAR(Bool, autoloadbrightmaps, false, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALCONFIG)
 CVAR(Bool, autoloadlights, false, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALCONFIG)
 CVAR(Bool, autoloadwidescreen, true, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALCONFIG)
+CVAR(Bool, fs_mmap, true, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALCONFIG)	// map archives instead of reading through file handles, takes effect on restart
+CVAR(Bool, fs_indexcache, true, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALCONFIG)	// keep processed archive directories between runs
+CUSTOM_CVAR(Int, fs_prefetch_size, 256, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// in megabytes, 0 disables lump prefetching
+{
+	if (self < 0) self = 0;
+	else fileSystem.SetPrefetchLimit((size_t)self * 1024 * 1024);
+}
 CVAR(Bool, r_debug_disable_vis_filter, false, 0)
 CVAR(Int, vid_showpalette, 0, 0)
 
@@ -860,6 +870,14 @@ ADD_STAT(fps)
 	return FStringf("%2llu ms (%3llu fps)", (unsigned long long)LastMSCount , (unsigned long long)LastFPS);
 }
 
+ADD_STAT(prefetch)
+{
+	auto stats = fileSystem.GetPrefetchStats();
+	return FStringf("Prefetched %u lumps (%.1f MB), %u hits (%.0f%%), %u evicted, %u waiting (%.1f MB)",
+		stats.lumpsRead, stats.bytesRead / (1024. * 1024.), stats.hits, stats.lumpsRead ? 100. * stats.hits / stats.lumpsRead : 0.,
+		stats.evicted, stats.lumpsCached, stats.bytesCached / (1024. * 1024.));
+}
+
 static void DrawRateStuff()
 {
 	static uint64_t LastMS = 0, LastSec = 0, FrameCount = 0, LastTic = 0;
@@ -3423,10 +3441,21 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 
 	bool allowduplicates = Args->CheckParm("-allowduplicates");
 	auto hashfile = D_GetHashFile();
+	FileSys::SetMemoryMapping(fs_mmap);
+	if (fs_indexcache)
+	{
+		FString indexpath = M_GetCachePath(true);
+		indexpath << "/archives";
+		CreatePath(indexpath.GetChars());
+		FileSys::SetIndexCacheDirectory(indexpath.GetChars());
+	}
+	else FileSys::SetIndexCacheDirectory("");
+	fileSystem.ParallelFor = [](int count, const std::function<void(int)>& work) { BackgroundJobs.ParallelFor(count, work); };
 	if (!fileSystem.InitMultipleFiles(allwads, &lfi, FileSystemPrintf, allowduplicates, hashfile))
 	{
 		I_FatalError("FileSystem: no files found");
 	}
+	TextureDiskCache.ResetContainerStamps();
 	allwads.clear();
 	allwads.shrink_to_fit();
 	SetMapxxFlag();
@@ -4104,6 +4133,9 @@ int GameMain()
 
 void D_Cleanup()
 {
+	// A save that is still being written must not get lost
+	G_WaitForSave();
+
 	if (demorecording)
 	{
 		G_CheckDemoStatus();
@@ -4117,6 +4149,7 @@ void D_Cleanup()
 
 	// @Cockatrice - Stop any renderer threads
 	if(screen) screen->StopBackgroundCache();
+	BackgroundJobs.Stop();
 
 	M_ClearMenus();					// close menu if open
 	AM_ClearColorsets();
@@ -91,12 +91,14 @@
 #include "screenjob.h"
 #include "i_interface.h"
 #include "fs_findfile.h"
+#include "jobsystem.h"
 
 
 static FRandom pr_dmspawn ("DMSpawn");
 static FRandom pr_pspawn ("PlayerSpawn");
 
 bool WriteZip(const char* filename, const FileSys::FCompressedBuffer* content, size_t contentcount);
+FileSys::FCompressedBuffer CompressZipEntry(const char *filename, const void *data, size_t size, int method, int level);
 bool	G_CheckDemoStatus (void);
 void	G_ReadDemoTiccmd (ticcmd_t *cmd, int player);
 void	G_WriteDemoTiccmd (ticcmd_t *cmd, int player, int buf);
@@ -116,11 +118,13 @@ void STAT_Serialize(FSerializer &file);
 
 CVARD_NAMED(Int, gameskill, skill, 2, CVAR_SERVERINFO|CVAR_LATCH, "sets the skill for the next newly started game")
 CVAR(Bool, save_formatted, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// use formatted JSON for saves (more readable but a larger files and a bit slower.
+CVAR(Bool, save_binary, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// use the compact binary serializer format for game state. save_formatted overrides this.
 CVAR (Int, deathmatch, 0, CVAR_SERVERINFO|CVAR_LATCH);
 CVAR (Bool, chasedemo, false, 0);
 CVAR (Bool, storesavepic, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR (Bool, longsavemessages, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR (Bool, cl_waitforsave, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
+CVAR (Bool, save_background, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// compress and write savegames on a worker thread
 CVAR (Bool, enablescriptscreenshot, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 CVAR (Bool, cl_restartondeath, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 EXTERN_CVAR (Float, con_midtime);
@@ -1140,6 +1144,8 @@ void G_Ticker ()
 	int i;
 	gamestate_t	oldgamestate;
 
+	G_CheckPendingSave();
+
 	// do player reborns if needed
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
@@ -2032,6 +2038,9 @@ void G_DoLoadGame ()
 	hidecon = gameaction == ga_loadgamehidecon;
 	gameaction = ga_nothing;
 
+	// The file may be the one that is still being written
+	G_WaitForSave();
+
 	std::unique_ptr<FResourceFile> resfile(FResourceFile::OpenResourceFile(savename.GetChars(), true));
 	if (resfile == nullptr)
 	{
@@ -2309,6 +2318,9 @@ FString G_FindSaveFilename(const char* header, int count = 1) {
 	FString filename, file;
 	int i, firstValidIndex = -1;
 
+	// A save still being written would not be seen here yet
+	G_WaitForSave();
+
 	for (i = 0; i < 50; ++i)
 	{
 		FString savnam(header);
@@ -2524,11 +2536,120 @@ static void PutSavePic (FileWriter *file, int width, int height)
 	}
 }
 
-void G_DoSaveGame (bool okForQuicksave, bool forceQuicksave, FString filename, const char *description)
+//==========================================================================
+//
+// Background save writing
+//
+// The game thread only serializes the world into memory. Compressing the
+// JSON, encoding the savepic, building the zip and moving it into place
+// happen on a job system worker. The result gets reported on the game
+// thread by G_CheckPendingSave. Only one save can be in flight: starting
+// another save, loading a game or shutting down waits for it first.
+//
+//==========================================================================
+
+struct FPendingSave
+{
+	FString filename;
+	FString description;
+	int date;
+	bool okForQuicksave, forceQuicksave;
+
+	// All buffers are owned by this. Stored ones still need to be compressed.
+	TArray<FCompressedBuffer> content;
+	TArray<FString> names;
+	FDeferredPNGWriter savepic;
+	std::vector<unsigned char> savepicData;
+
+	std::atomic<bool> finished{ false };
+	bool succeeded = false;
+
+	~FPendingSave()
+	{
+		for (auto &buf : content) buf.Clean();
+	}
+};
+
+static std::unique_ptr<FPendingSave> PendingSave;
+static FJobGroup SaveJobs;
+
+static void WriteSaveFile(FPendingSave &save)
+{
+	for (auto &buf : save.content)
+	{
+		if (buf.mMethod == FileSys::METHOD_STORED && buf.mBuffer != nullptr)
+		{
+			auto packed = CompressZipEntry(nullptr, buf.mBuffer, buf.mSize, FileSys::METHOD_DEFLATE, 8);
+			buf.Clean();
+			buf = packed;
+		}
+	}
+
+	// The savepic is already compressed, so it is stored as is
+	save.savepicData = save.savepic.Encode();
+	auto &pic = save.savepicData;
+	FCompressedBuffer bufpng = { pic.size(), pic.size(), FileSys::METHOD_STORED, static_cast<unsigned int>(crc32(0, pic.data(), pic.size())), (char*)pic.data() };
+
+	TArray<FCompressedBuffer> zipContent;
+	zipContent.Push(bufpng);
+	zipContent.Append(save.content);
+	zipContent[0].filename = "savepic.png";
+	for (unsigned i = 0; i < save.names.Size(); i++)
+		zipContent[i + 1].filename = save.names[i].GetChars();
+
+	// Write under a temporary name so that a failed or interrupted save never destroys the previous one.
+	// The new file must be on disk before it replaces the old one, which happens in a single step.
+	FString tempname = save.filename + ".tmp";
+	if (!pic.empty() && WriteZip(tempname.GetChars(), zipContent.Data(), zipContent.Size()) && FileSys::FS_SyncFile(tempname.GetChars()))
+	{
+		// Check whether the file is ok by trying to open it.
+		FResourceFile *test = FResourceFile::OpenResourceFile(tempname.GetChars(), true);
+		if (test != nullptr)
+		{
+			delete test;
+			save.succeeded = FileSys::FS_RenameReplacing(tempname.GetChars(), save.filename.GetChars());
+		}
+	}
+	if (!save.succeeded) RemoveFile(tempname.GetChars());
+	save.finished = true;
+}
+
+//==========================================================================
+//
+// Reports a finished background save. Must be called on the game thread.
+//
+//==========================================================================
+
+void G_CheckPendingSave()
 {
-	TArray<FCompressedBuffer> savegame_content;
-	TArray<FString> savegame_filenames;
+	if (PendingSave == nullptr || !PendingSave->finished) return;
+
+	auto save = std::move(PendingSave);
+	SaveJobs.Wait();	// make sure the job has let go of it, too
 
+	if (save->succeeded)
+	{
+		savegameManager.NotifyNewSave(save->filename, save->description, save->date, save->okForQuicksave, save->forceQuicksave);
+		BackupSaveName = save->filename;
+
+		if (longsavemessages) Printf("%s (%s)\n", GStrings.GetString("GGSAVED"), save->filename.GetChars());
+		else Printf("%s\n", GStrings.GetString("GGSAVED"));
+	}
+	else
+	{
+		Printf(PRINT_HIGH, "%s\n", GStrings.GetString("TXT_SAVEFAILED"));
+	}
+}
+
+void G_WaitForSave()
+{
+	if (PendingSave == nullptr) return;
+	SaveJobs.Wait();
+	G_CheckPendingSave();
+}
+
+void G_DoSaveGame (bool okForQuicksave, bool forceQuicksave, FString filename, const char *description)
+{
 	char buf[100];
 
 	// Do not even try, if we're not in a level. (Can happen after
@@ -2538,6 +2659,9 @@ void G_DoSaveGame (bool okForQuicksave, bool forceQuicksave, FString filename, c
 		return;
 	}
 
+	// Never have two saves in flight, the second one might target the same file
+	G_WaitForSave();
+
 	if (demoplayback)
 	{
 		filename = G_BuildSaveName ("demosave");
@@ -2549,7 +2673,8 @@ void G_DoSaveGame (bool okForQuicksave, bool forceQuicksave, FString filename, c
 	insave = true;
 	try
 	{
-		level.SnapshotLevel();
+		// Compressing the snapshot is left to the background job
+		level.SnapshotLevel(false);
 	}
 	catch(CRecoverableError &err)
 	{
@@ -2571,21 +2696,21 @@ void G_DoSaveGame (bool okForQuicksave, bool forceQuicksave, FString filename, c
 		throw;
 	}
 
-	BufferWriter savepic;
+	auto save = std::make_unique<FPendingSave>();
 	FSerializer savegameinfo;		// this is for displayable info about the savegame
 	FSerializer savegameglobals;	// and this for non-level related info that must be saved.
 
 	savegameinfo.OpenWriter(true);
-	savegameglobals.OpenWriter(save_formatted);
+	savegameglobals.OpenWriter(save_formatted, save_binary && !save_formatted);
 
 	SaveVersion = SAVEVER;
-	PutSavePic(&savepic, SAVEPICWIDTH, SAVEPICHEIGHT);
+	PutSavePic(&save->savepic, SAVEPICWIDTH, SAVEPICHEIGHT);
 	mysnprintf(buf, countof(buf), GAMENAME " %s", GetVersionString());
 	// put some basic info into the PNG so that this isn't lost when the image gets extracted.
-	M_AppendPNGText(&savepic, "Software", buf);
-	M_AppendPNGText(&savepic, "Title", description);
-	M_AppendPNGText(&savepic, "Current Map", primaryLevel->MapName.GetChars());
-	M_FinishPNG(&savepic);
+	M_AppendPNGText(&save->savepic, "Software", buf);
+	M_AppendPNGText(&save->savepic, "Title", description);
+	M_AppendPNGText(&save->savepic, "Current Map", primaryLevel->MapName.GetChars());
+	M_FinishPNG(&save->savepic);
 
 	int ver = SAVEVER;
 	savegameinfo.AddString("Software", buf)
@@ -2627,59 +2752,55 @@ void G_DoSaveGame (bool okForQuicksave, bool forceQuicksave, FString filename, c
 		savegameglobals("nextskill", NextSkill);
 	}
 
-	auto picdata = savepic.GetBuffer();
-	FCompressedBuffer bufpng = { picdata->size(), picdata->size(), FileSys::METHOD_STORED, static_cast<unsigned int>(crc32(0, &(*picdata)[0], picdata->size())), (char*)&(*picdata)[0] };
+	save->content.Push(savegameinfo.GetUncompressedOutput());
+	save->names.Push("info.json");
+	save->content.Push(savegameglobals.GetUncompressedOutput());
+	save->names.Push("globals.json");
 
-	savegame_content.Push(bufpng);
-	savegame_filenames.Push("savepic.png");
-	savegame_content.Push(savegameinfo.GetCompressedOutput());
-	savegame_filenames.Push("info.json");
-	savegame_content.Push(savegameglobals.GetCompressedOutput());
-	savegame_filenames.Push("globals.json");
-	G_WriteSnapshots (savegame_filenames, savegame_content);
-	
-	for (unsigned i = 0; i < savegame_content.Size(); i++)
-		savegame_content[i].filename = savegame_filenames[i].GetChars();
-
-	bool succeeded = false;
-
-	if (WriteZip(filename.GetChars(), savegame_content.Data(), savegame_content.Size()))
+	TArray<FCompressedBuffer> snapshots;
+	G_WriteSnapshots (save->names, snapshots);
+	for (auto &snapshot : snapshots)
 	{
-		// Check whether the file is ok by trying to open it.
-		FResourceFile *test = FResourceFile::OpenResourceFile(filename.GetChars(), true);
-		if (test != nullptr)
+		if (snapshot.mBuffer == level.info->Snapshot.mBuffer)
 		{
-			delete test;
-			succeeded = true;
+			// We don't need the current level's snapshot any longer, so the job can have it.
+			save->content.Push(snapshot);
+			level.info->Snapshot.mBuffer = nullptr;
+			level.info->Snapshot.Clean();
+		}
+		else
+		{
+			// Snapshots of other hub levels stay in use, so the job gets its own copy.
+			auto copy = snapshot;
+			copy.mBuffer = new char[snapshot.mCompressedSize];
+			memcpy(copy.mBuffer, snapshot.mBuffer, snapshot.mCompressedSize);
+			save->content.Push(copy);
 		}
 	}
 
-	if (succeeded)
-	{
-		savegameManager.NotifyNewSave(filename, description, cdatei, okForQuicksave, forceQuicksave);
-		BackupSaveName = filename;
-
-		if (longsavemessages) Printf("%s (%s)\n", GStrings.GetString("GGSAVED"), filename.GetChars());
-		else Printf("%s\n", GStrings.GetString("GGSAVED"));
-	}
-	else
-	{
-		Printf(PRINT_HIGH, "%s\n", GStrings.GetString("TXT_SAVEFAILED"));
-	}
-
-
-	// delete the JSON buffers we created just above. Everything else will
-	// either still be needed or taken care of automatically.
-	savegame_content[1].Clean();
-	savegame_content[2].Clean();
+	save->filename = filename;
+	save->description = description;
+	save->date = cdatei;
+	save->okForQuicksave = okForQuicksave;
+	save->forceQuicksave = forceQuicksave;
 
-	// We don't need the snapshot any longer.
-	level.info->Snapshot.Clean();
-		
 	insave = false;
 
 	if (cl_waitforsave)
 		I_FreezeTime(false);
+
+	PendingSave = std::move(save);
+	if (save_background)
+	{
+		// A save must never get lost, so if the job system shuts down first it gets written right there.
+		FPendingSave *job = PendingSave.get();
+		BackgroundJobs.Submit(JOBPRI_Now, &SaveJobs, [job]() { WriteSaveFile(*job); }, [job]() { WriteSaveFile(*job); });
+	}
+	else
+	{
+		WriteSaveFile(*PendingSave);
+		G_CheckPendingSave();
+	}
 }
 
 
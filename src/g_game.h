@@ -67,6 +67,8 @@ void G_DoLoadGame (void);
 void G_SaveGame (const char *filename, const char *description);
 // Called by messagebox
 void G_DoQuickSave ();
+void G_CheckPendingSave ();
+void G_WaitForSave ();
 
 // Only called by startup code.
 void G_RecordDemo (const char* name);
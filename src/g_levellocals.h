@@ -173,7 +173,7 @@ private:
 	void PlayerSpawnPickClass (int playernum);
 
 public:
-	void SnapshotLevel();
+	void SnapshotLevel(bool compress = true);
 	void UnSnapshotLevel(bool hubLoad);
 
 	void FinalizePortals();
@@ -63,8 +63,11 @@
 #include "s_music.h"
 #include "model.h"
 #include "d_net.h"
+#include "i_time.h"
+#include "c_dispatch.h"
 
 EXTERN_CVAR(Bool, save_formatted)
+EXTERN_CVAR(Bool, save_binary)
 
 //==========================================================================
 //
@@ -943,6 +946,93 @@ void FLevelLocals::SpawnExtraPlayers()
 	}
 }
 
+//============================================================================
+//
+// Lines, sides and sectors only save what differs from the freshly loaded
+// map, but every untouched element still costs an empty object. The binary
+// format leaves those out: 'changes' holds pairs of the number of skipped
+// elements and the next changed one. Skipped elements are read from an
+// empty object so they end up exactly as with the full array.
+//
+//============================================================================
+
+template<class T>
+static void SerializeLevelArray(FSerializer &arc, const char *key, TArray<T> &value, TArray<T> &base)
+{
+	if (arc.isWriting() ? !arc.CanRewind() : !arc.HasObject(key))
+	{
+		arc(key, value, base);
+		return;
+	}
+	if (!arc.BeginObject(key)) return;
+
+	unsigned count = value.Size();
+	arc("count", count);
+	if (arc.BeginArray("changes"))
+	{
+		unsigned i = 0;
+		if (arc.isWriting())
+		{
+			unsigned skip = 0;
+			for (; i < value.Size(); i++)
+			{
+				auto mark = arc.WritePosition();
+				arc(nullptr, skip);
+				auto start = arc.WritePosition();
+				Serialize(arc, nullptr, value[i], &base[i]);
+				if (arc.WroteEmptyObject(start))
+				{
+					arc.Rewind(mark);
+					skip++;
+				}
+				else skip = 0;
+			}
+		}
+		else
+		{
+			auto skipTo = [&](unsigned end)
+			{
+				for (; i < end; i++)
+				{
+					arc.BeginEmptyElement();
+					Serialize(arc, nullptr, value[i], &base[i]);
+					arc.EndEmptyElement();
+				}
+			};
+			unsigned pairs = arc.ArraySize() / 2;
+			for (unsigned p = 0; p < pairs; p++)
+			{
+				unsigned skip = 0;
+				arc(nullptr, skip);
+				if (skip >= value.Size() - i)
+				{
+					Printf(TEXTCOLOR_RED "Bad element index in '%s'\n", key);
+					arc.mErrors++;
+					break;
+				}
+				skipTo(i + skip);
+				Serialize(arc, nullptr, value[i], &base[i]);
+				i++;
+			}
+			skipTo(value.Size());
+		}
+		arc.EndArray();
+	}
+	arc.EndObject();
+}
+
+static unsigned SavedLevelArraySize(FSerializer &arc, const char *key)
+{
+	unsigned count = 0;
+	if (!arc.HasObject(key)) return arc.GetSize(key);
+	if (arc.BeginObject(key))
+	{
+		arc("count", count);
+		arc.EndObject();
+	}
+	return count;
+}
+
 //============================================================================
 //
 //
@@ -964,9 +1054,9 @@ void FLevelLocals::Serialize(FSerializer &arc, bool hubload)
 		// deep down in the deserializer or just a crash if the few insufficient safeguards were not triggered.
 		uint8_t chk[16] = { 0 };
 		arc.Array("checksum", chk, 16);
-		if (arc.GetSize("linedefs") != lines.Size() ||
-			arc.GetSize("sidedefs") != sides.Size() ||
-			arc.GetSize("sectors") != sectors.Size() ||
+		if (SavedLevelArraySize(arc, "linedefs") != lines.Size() ||
+			SavedLevelArraySize(arc, "sidedefs") != sides.Size() ||
+			SavedLevelArraySize(arc, "sectors") != sectors.Size() ||
 			arc.GetSize("polyobjs") != Polyobjects.Size() ||
 			memcmp(chk, md5, 16))
 		{
@@ -1054,10 +1144,10 @@ void FLevelLocals::Serialize(FSerializer &arc, bool hubload)
 	Behaviors.SerializeModuleStates(arc);
 	// The order here is important: First world state, then portal state, then thinkers, and last polyobjects.
 	SetCompatLineOnSide(false);	// This flag should not be saved. It solely depends on current compatibility state.
-	arc("linedefs", lines, loadlines);
+	SerializeLevelArray(arc, "linedefs", lines, loadlines);
 	SetCompatLineOnSide(true);
-	arc("sidedefs", sides, loadsides);
-	arc("sectors", sectors, loadsectors);
+	SerializeLevelArray(arc, "sidedefs", sides, loadsides);
+	SerializeLevelArray(arc, "sectors", sectors, loadsectors);
 	arc("zones", Zones);
 	arc("lineportals", linePortals);
 	arc("sectorportals", sectorPortals);
@@ -1118,19 +1208,22 @@ void FLevelLocals::Serialize(FSerializer &arc, bool hubload)
 //
 //==========================================================================
 
-void FLevelLocals::SnapshotLevel()
+void FLevelLocals::SnapshotLevel(bool compress)
 {
 	info->Snapshot.Clean();
 
 	if (info->isValid())
 	{
 		FDoomSerializer arc(this);
+		auto start = I_msTimeF();
 
-		if (arc.OpenWriter(save_formatted))
+		if (arc.OpenWriter(save_formatted, save_binary && !save_formatted))
 		{
 			SaveVersion = SAVEVER;
 			Serialize(arc, false);
-			info->Snapshot = arc.GetCompressedOutput();
+			info->Snapshot = compress ? arc.GetCompressedOutput() : arc.GetUncompressedOutput();
+			DPrintf(DMSG_NOTIFY, "Snapshot of %s: %.1f KB (%.1f KB uncompressed), %.2f ms\n", MapName.GetChars(),
+				info->Snapshot.mCompressedSize / 1024., info->Snapshot.mSize / 1024., I_msTimeF() - start);
 		}
 	}
 }
@@ -1150,6 +1243,8 @@ void FLevelLocals::UnSnapshotLevel(bool hubLoad)
 	if (info->isValid())
 	{
 		FDoomSerializer arc(this);
+		auto start = I_msTimeF();
+		auto snapshotSize = info->Snapshot.mCompressedSize;
 		if (!arc.OpenReader(&info->Snapshot))
 		{
 			I_Error("Failed to load savegame");
@@ -1185,6 +1280,7 @@ void FLevelLocals::UnSnapshotLevel(bool hubLoad)
 			}
 		}
 		arc.Close();
+		DPrintf(DMSG_NOTIFY, "Restored %s from a %.1f KB snapshot in %.2f ms\n", MapName.GetChars(), snapshotSize / 1024., I_msTimeF() - start);
 	}
 	// No reason to keep the snapshot around once the level's been entered.
 	info->Snapshot.Clean();
@@ -1195,3 +1291,79 @@ void FLevelLocals::UnSnapshotLevel(bool hubLoad)
 	}
 }
 
+
+//==========================================================================
+//
+// Lists the memory held by the snapshots of all visited hub levels.
+//
+//==========================================================================
+
+CCMD(listsnapshots)
+{
+	size_t total = 0, totalRaw = 0;
+	int count = 0;
+	for (auto &info : wadlevelinfos)
+	{
+		if (info.Snapshot.mBuffer == nullptr) continue;
+		Printf("%-10s %10.1f KB %10.1f KB uncompressed\n", info.MapName.GetChars(), info.Snapshot.mCompressedSize / 1024., info.Snapshot.mSize / 1024.);
+		total += info.Snapshot.mCompressedSize;
+		totalRaw += info.Snapshot.mSize;
+		count++;
+	}
+	Printf("%d snapshots, %.1f KB (%.1f KB uncompressed)\n", count, total / 1024., totalRaw / 1024.);
+}
+
+//==========================================================================
+//
+// Compares both serializer formats on a snapshot of the current level.
+//
+//==========================================================================
+
+FileSys::FCompressedBuffer CompressZipEntry(const char *filename, const void *data, size_t size, int method, int level);
+
+CCMD(savebench)
+{
+	if (gamestate != GS_LEVEL || !primaryLevel->info->isValid())
+	{
+		Printf("savebench can only be used while in a level\n");
+		return;
+	}
+	int iterations = argv.argc() > 1 ? max(1, (int)strtol(argv[1], nullptr, 10)) : 5;
+
+	Printf("%-6s %10s %10s %10s %10s %10s\n", "format", "size", "deflated", "write ms", "deflate ms", "read ms");
+	for (int binary = 0; binary < 2; binary++)
+	{
+		double writeTime = 0, deflateTime = 0, readTime = 0;
+		unsigned size = 0, packedSize = 0;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto start = I_msTimeF();
+			FDoomSerializer writer(primaryLevel);
+			writer.OpenWriter(false, !!binary);
+			SaveVersion = SAVEVER;
+			primaryLevel->Serialize(writer, false);
+			auto output = writer.GetUncompressedOutput();
+			writer.Close();
+			auto written = I_msTimeF();
+
+			auto packed = CompressZipEntry(nullptr, output.mBuffer, output.mSize, FileSys::METHOD_DEFLATE, 8);
+			auto deflated = I_msTimeF();
+
+			{
+				FSerializer reader;
+				reader.OpenReader(output.mBuffer, output.mSize);
+			}
+			auto read = I_msTimeF();
+
+			writeTime += written - start;
+			deflateTime += deflated - written;
+			readTime += read - deflated;
+			size = output.mSize;
+			packedSize = packed.mCompressedSize;
+			output.Clean();
+			packed.Clean();
+		}
+		Printf("%-6s %10u %10u %10.2f %10.2f %10.2f\n", binary ? "binary" : "json", size, packedSize,
+			writeTime / iterations, deflateTime / iterations, readTime / iterations);
+	}
+}
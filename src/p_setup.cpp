@@ -601,8 +601,9 @@ void P_SetupLevel(FLevelLocals *Level, int position, bool newGame, int mapVersio
 	// [RH] Remove all particles
 	P_ClearParticles(Level);
 
-	// @Cockatrice - Flush any background texture loads
+	// @Cockatrice - Drop loads nobody started yet for the previous level, then flush the rest
 	if (screen->SupportsBackgroundCache()) {
+		screen->CancelBackgroundCache();
 		screen->FlushBackground();
 	}
 
@@ -64,9 +64,60 @@
 #include "a_dynlight.h"
 #include "actorinlines.h"
 #include "memarena.h"
+#include "parallel_for.h"
 
-static FMemArena DynLightArena(sizeof(FDynamicLight) * 200);
-static TArray<FDynamicLight*> FreeList;
+// Lights only relink once they moved this far from where they were last linked.
+// The links are made with a radius that is larger by the same amount so nothing in between gets cut off.
+static const float LIGHT_RELINK_TOLERANCE = 16.f;
+
+//==========================================================================
+//
+// Light descriptors come out of an arena and get recycled through an
+// intrusive free list, so creating and destroying lights never goes
+// through the general allocator.
+//
+//==========================================================================
+
+class FDynLightPool
+{
+	FMemArena Arena;
+	FDynamicLight *FreeHead = nullptr;
+	int NumAllocated = 0;
+	int NumFree = 0;
+
+public:
+	FDynLightPool() : Arena(sizeof(FDynamicLight) * 200) {}
+
+	FDynamicLight *Alloc()
+	{
+		FDynamicLight *ret = FreeHead;
+		if (ret != nullptr)
+		{
+			FreeHead = ret->next;
+			NumFree--;
+		}
+		else
+		{
+			ret = (FDynamicLight*)Arena.Alloc(sizeof(FDynamicLight));
+			NumAllocated++;
+		}
+		return ret;
+	}
+
+	void Release(FDynamicLight *light)
+	{
+		light->next = FreeHead;
+		FreeHead = light;
+		NumFree++;
+	}
+
+	int Allocated() const { return NumAllocated; }
+	int Free() const { return NumFree; }
+};
+
+static FDynLightPool LightPool;
+static TArray<FLightLinkRequest> PendingLinks;
+static int LightRelinks, LightRelinksSkipped, LightRelinksThreaded;
 static FRandom randLight;
 
 extern TArray<FLightDefaults *> StateLights;
@@ -80,12 +131,7 @@ extern TArray<FLightDefaults *> StateLights;
 
 static FDynamicLight *GetLight(FLevelLocals *Level)
 {
-	FDynamicLight *ret;
-	if (FreeList.Size())
-	{
-		FreeList.Pop(ret);
-	}
-	else ret = (FDynamicLight*)DynLightArena.Alloc(sizeof(FDynamicLight));
+	FDynamicLight *ret = LightPool.Alloc();
 	memset(ret, 0, sizeof(*ret));
 	ret->m_cycler.m_increment = true;
 	ret->next = Level->lights;
@@ -228,7 +274,12 @@ void FDynamicLight::ReleaseLight()
 	else Level->lights = next;
 	if (next != nullptr) next->prev = prev;
 	next = prev = nullptr;
-	FreeList.Push(this);
+	if (linkQueued)
+	{
+		for (auto &req : PendingLinks) if (req.light == this) req.light = nullptr;
+		linkQueued = false;
+	}
+	LightPool.Release(this);
 }
 
 
@@ -268,6 +319,7 @@ void FDynamicLight::Tick()
 	if (!target)
 	{
 		// How did we get here? :?
+		UnlinkLight();
 		ReleaseLight();
 		return;
 	}
@@ -447,11 +499,18 @@ void FDynamicLight::UpdateLocation()
 		radius = intensity * 2.0f;
 		if (radius < m_currentRadius * 2) radius = m_currentRadius * 2;
 
-		if (X() != oldx || Y() != oldy || radius != oldradius || angleChanged)
+		// Update the light lists once the light has left the area covered by the last link or its size changed.
+		float linkRadius;
+		DVector3 center = Pos + GetSpotDir(linkRadius);
+		const float tolerance = LIGHT_RELINK_TOLERANCE * LIGHT_RELINK_TOLERANCE;
+		if (linkRadius != LinkRadius || (center - LinkCenter).LengthSquared() > tolerance || (Pos - LinkPos).LengthSquared() > tolerance)
 		{
-			//Update the light lists
 			LinkLight();
 		}
+		else if (X() != oldx || Y() != oldy || radius != oldradius || angleChanged)
+		{
+			LightRelinksSkipped++;
+		}
 	}
 }
 
@@ -565,277 +624,269 @@ double FDynamicLight::DistToSeg(const DVector3 &pos, vertex_t *start, vertex_t *
 
 //==========================================================================
 //
-// Collect all touched sidedefs and subsectors
-// to sidedefs and sector parts.
+// Collect all touched sidedefs and sections
+//
+// This only reads level data and writes to the passed scratch space,
+// so several lights can be processed on worker threads at once.
+// Sections and lines are marked with a per-scratch stamp instead of
+// validcount for the same reason.
 //
 //==========================================================================
+
 struct LightLinkEntry
 {
 	FSection *sect;
 	DVector3 pos;
 };
-static TArray<LightLinkEntry> collected_ss;
 
-void FDynamicLight::CollectWithinRadius(const DVector3 &opos, FSection *section, float radius)
+struct FLightLinkScratch
 {
-	if (!section) return;
-	collected_ss.Clear();
-	collected_ss.Push({ section, opos });
-	section->validcount = dl_validcount;
+	TArray<int> sectionStamps;
+	TArray<int> lineStamps;
+	int stamp = 0;
+	TArray<LightLinkEntry> collected;
 
-	bool hitonesidedback = false;
-	for (unsigned i = 0; i < collected_ss.Size(); i++)
+	// The results of all lights processed with this scratch since the last ClearResults.
+	TArray<FSection *> sections;
+	TArray<side_t *> sides;
+
+	void NewStamp(FLevelLocals *Level)
 	{
-		auto pos = collected_ss[i].pos;
-		section = collected_ss[i].sect;
+		if (sectionStamps.Size() != Level->sections.allSections.Size() || lineStamps.Size() != Level->lines.Size() || stamp == INT_MAX)
+		{
+			sectionStamps.Resize(Level->sections.allSections.Size());
+			lineStamps.Resize(Level->lines.Size());
+			if (sectionStamps.Size() > 0) memset(sectionStamps.Data(), 0, sectionStamps.Size() * sizeof(int));
+			if (lineStamps.Size() > 0) memset(lineStamps.Data(), 0, lineStamps.Size() * sizeof(int));
+			stamp = 0;
+		}
+		stamp++;
+	}
 
-		touching_sector = AddLightNode(&section->lighthead, section, this, touching_sector);
+	bool MarkSection(FLevelLocals *Level, FSection *sect)
+	{
+		int &s = sectionStamps[Level->sections.SectionIndex(sect)];
+		if (s == stamp) return false;
+		s = stamp;
+		return true;
+	}
 
+	bool IsLineMarked(const line_t *line) const
+	{
+		return lineStamps[line->Index()] == stamp;
+	}
 
-		auto processSide = [&](side_t *sidedef, const vertex_t *v1, const vertex_t *v2)
-		{
-			auto linedef = sidedef->linedef;
-			if (linedef && linedef->validcount != ::validcount)
-			{
-				// light is in front of the seg
-				if ((pos.Y - v1->fY()) * (v2->fX() - v1->fX()) + (v1->fX() - pos.X) * (v2->fY() - v1->fY()) <= 0)
-				{
-					linedef->validcount = ::validcount;
-					touching_sides = AddLightNode(&sidedef->lighthead, sidedef, this, touching_sides);
-				}
-				else if (linedef->sidedef[0] == sidedef && linedef->sidedef[1] == nullptr)
-				{
-					hitonesidedback = true;
-				}
-			}
-			if (linedef)
-			{
-				FLinePortal *port = linedef->getPortal();
-				if (port && port->mType == PORTT_LINKED)
-				{
-					line_t *other = port->mDestination;
-					if (other->validcount != ::validcount)
-					{
-						subsector_t *othersub = Level->PointInRenderSubsector(other->v1->fPos() + other->Delta() / 2);
-						FSection *othersect = othersub->section;
-						if (othersect->validcount != ::validcount)
-						{
-							othersect->validcount = ::validcount;
-							collected_ss.Push({ othersect, PosRelative(other->frontsector->PortalGroup) });
-						}
-					}
-				}
-			}
-		};
+	void MarkLine(const line_t *line)
+	{
+		lineStamps[line->Index()] = stamp;
+	}
 
-		for (auto &segment : section->segments)
-		{
-			// check distance from x/y to seg and if within radius add this seg and, if present the opposing subsector (lather/rinse/repeat)
-			// If out of range we do not need to bother with this seg.
-			if (DistToSeg(pos, segment.start, segment.end) <= radius)
-			{
-				auto sidedef = segment.sidedef;
-				if (sidedef)
-				{
-					processSide(sidedef, segment.start, segment.end);
-				}
+	void ClearResults()
+	{
+		sections.Clear();
+		sides.Clear();
+	}
+};
 
-				auto partner = segment.partner;
-				if (partner)
-				{
-					FSection *sect = partner->section;
-					if (sect != nullptr && sect->validcount != dl_validcount)
-					{
-						sect->validcount = dl_validcount;
-						collected_ss.Push({ sect, pos });
-					}
-				}
-			}
-		}
-		for (auto side : section->sides)
-		{
-			auto v1 = side->V1(), v2 = side->V2();
-			if (DistToSeg(pos, v1, v2) <= radius)
-			{
-				processSide(side, v1, v2);
-			}
-		}
-		sector_t *sec = section->sector;
-		if (!sec->PortalBlocksSight(sector_t::ceiling))
-		{
-			line_t *other = section->segments[0].sidedef->linedef;
-			if (sec->GetPortalPlaneZ(sector_t::ceiling) < Z() + radius)
-			{
-				DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::ceiling);
-				subsector_t *othersub = Level->PointInRenderSubsector(refpos);
-				FSection *othersect = othersub->section;
-				if (othersect->validcount != dl_validcount)
-				{
-					othersect->validcount = dl_validcount;
-					collected_ss.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
-				}
-			}
-		}
-		if (!sec->PortalBlocksSight(sector_t::floor))
-		{
-			line_t *other = section->segments[0].sidedef->linedef;
-			if (sec->GetPortalPlaneZ(sector_t::floor) > Z() - radius)
-			{
-				DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::floor);
-				subsector_t *othersub = Level->PointInRenderSubsector(refpos);
-				FSection *othersect = othersub->section;
-				if (othersect->validcount != dl_validcount)
-				{
-					othersect->validcount = dl_validcount;
-					collected_ss.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
-				}
-			}
-		}
+enum
+{
+	LIGHTLINK_CHUNK = 8,		// minimum number of lights handed to one worker
+	LIGHTLINK_MAXSLOTS = 16,	// upper bound on worker scratch spaces (each holds a stamp per line)
+};
+
+static FLightLinkScratch MainLinkScratch;
+static TArray<FLightLinkScratch> WorkerLinkScratch;
+static bool DeferLightLinks;
+
+// @Cockatrice - Spotlights collect only within a radius from the center of the spot, we don't care about stuff that is behind the spot light.
+// The distance checks use spotDir + pos. This is not accurate but it's good enough and the fastest way to do it without wasting
+// a lot of time culling what is behind the spotlight
+DVector3 FDynamicLight::GetSpotDir(float &linkRadius)
+{
+	DVector3 spotDir(0, 0, 0);
+
+	if (radius <= 0)
+	{
+		linkRadius = 0;
+	}
+	else if (IsSpot())
+	{
+		// Determine center point in the direction of the light, reduce radius by half
+		// This may not work as we may have extended outside of our sector
+		float rad = radius * 0.5f;
+		AActor *target = this->target;
+		DAngle pitch = *pPitch == target->Angles.Pitch ? target->Angles.Pitch : *pPitch;
+		DAngle angle = target->Angles.Yaw;
+		double cospitch = pitch.Cos();
+		spotDir.X = rad * cospitch * angle.Cos();
+		spotDir.Y = rad * cospitch * angle.Sin();
+		spotDir.Z = rad * -pitch.Sin();
+		linkRadius = rad + LIGHT_RELINK_TOLERANCE;
+	}
+	else
+	{
+		linkRadius = radius + LIGHT_RELINK_TOLERANCE;
 	}
-	shadowmapped = hitonesidedback && !DontShadowmap();
+	return spotDir;
 }
 
-// @Cockatrice - Spotlight version, we use spotDir + pos to calculate the distance to segment
-// This is not accurate but it's good enough and the fastest way to do it without wasting a lot of time culling
-// what is behind the spotlight
-void FDynamicLight::CollectWithinRadiusSP(const DVector3 &opos, const DVector3 &spotDir, FSection *section, float radius)
+void FDynamicLight::PrepareLink(FLightLinkRequest &req)
 {
-	if (!section) return;
-	collected_ss.Clear();
-	collected_ss.Push({ section, opos });
-	section->validcount = dl_validcount;
+	req.light = this;
+	req.spotDir = GetSpotDir(req.linkRadius);
+	req.firstSection = req.numSections = 0;
+	req.firstSide = req.numSides = 0;
+	req.hitonesidedback = false;
+}
 
-	bool hitonesidedback = false;
-	for (unsigned i = 0; i < collected_ss.Size(); i++)
-	{
-		auto pos = collected_ss[i].pos;
-		auto spotPos = pos + spotDir;
-		section = collected_ss[i].sect;
+void FDynamicLight::CollectLinks(FLightLinkScratch &scratch, FLightLinkRequest &req) const
+{
+	req.firstSection = scratch.sections.Size();
+	req.firstSide = scratch.sides.Size();
+	req.hitonesidedback = false;
 
-		touching_sector = AddLightNode(&section->lighthead, section, this, touching_sector);
+	FSection *section = req.linkRadius > 0 ? Level->PointInRenderSubsector(Pos)->section : nullptr;
+	if (section != nullptr)
+	{
+		// passing in radius*radius allows us to do a distance check without any calls to sqrt
+		float radius = req.linkRadius * req.linkRadius;
+		auto &collected = scratch.collected;
 
+		scratch.NewStamp(Level);
+		collected.Clear();
+		collected.Push({ section, Pos });
+		scratch.MarkSection(Level, section);
 
-		auto processSide = [&](side_t *sidedef, const vertex_t *v1, const vertex_t *v2)
+		for (unsigned i = 0; i < collected.Size(); i++)
 		{
-			auto linedef = sidedef->linedef;
-			if (linedef && linedef->validcount != ::validcount)
+			auto pos = collected[i].pos;
+			auto spotPos = pos + req.spotDir;
+			section = collected[i].sect;
+
+			scratch.sections.Push(section);
+
+			auto processSide = [&](side_t *sidedef, const vertex_t *v1, const vertex_t *v2)
 			{
-				// light is in front of the seg
-				if ((pos.Y - v1->fY()) * (v2->fX() - v1->fX()) + (v1->fX() - pos.X) * (v2->fY() - v1->fY()) <= 0)
+				auto linedef = sidedef->linedef;
+				if (linedef && !scratch.IsLineMarked(linedef))
 				{
-					linedef->validcount = ::validcount;
-					touching_sides = AddLightNode(&sidedef->lighthead, sidedef, this, touching_sides);
-				}
-				else if (linedef->sidedef[0] == sidedef && linedef->sidedef[1] == nullptr)
-				{
-					hitonesidedback = true;
+					// light is in front of the seg. Two-sided lines are also taken from behind while the light is
+					// within the relink tolerance, because it may cross them before the next relink.
+					double dx = v2->fX() - v1->fX(), dy = v2->fY() - v1->fY();
+					double behind = (pos.Y - v1->fY()) * dx + (v1->fX() - pos.X) * dy;
+					if (behind <= 0 || (linedef->sidedef[1] != nullptr && behind * behind <= LIGHT_RELINK_TOLERANCE * LIGHT_RELINK_TOLERANCE * (dx * dx + dy * dy)))
+					{
+						scratch.MarkLine(linedef);
+						scratch.sides.Push(sidedef);
+					}
+					else if (linedef->sidedef[0] == sidedef && linedef->sidedef[1] == nullptr)
+					{
+						req.hitonesidedback = true;
+					}
 				}
-			}
-			if (linedef)
-			{
-				FLinePortal *port = linedef->getPortal();
-				if (port && port->mType == PORTT_LINKED)
+				if (linedef)
 				{
-					line_t *other = port->mDestination;
-					if (other->validcount != ::validcount)
+					FLinePortal *port = linedef->getPortal();
+					if (port && port->mType == PORTT_LINKED)
 					{
-						subsector_t *othersub = Level->PointInRenderSubsector(other->v1->fPos() + other->Delta() / 2);
-						FSection *othersect = othersub->section;
-						if (othersect->validcount != ::validcount)
+						line_t *other = port->mDestination;
+						if (!scratch.IsLineMarked(other))
 						{
-							othersect->validcount = ::validcount;
-							collected_ss.Push({ othersect, PosRelative(other->frontsector->PortalGroup) });
+							subsector_t *othersub = Level->PointInRenderSubsector(other->v1->fPos() + other->Delta() / 2);
+							FSection *othersect = othersub->section;
+							if (scratch.MarkSection(Level, othersect))
+							{
+								collected.Push({ othersect, PosRelative(other->frontsector->PortalGroup) });
+							}
 						}
 					}
 				}
-			}
-		};
+			};
 
-		for (auto &segment : section->segments)
-		{
-			// check distance from x/y to seg and if within radius add this seg and, if present the opposing subsector (lather/rinse/repeat)
-			// If out of range we do not need to bother with this seg.
-			if (DistToSeg(spotPos, segment.start, segment.end) <= radius)
+			for (auto &segment : section->segments)
 			{
-				auto sidedef = segment.sidedef;
-				if (sidedef)
+				// check distance from x/y to seg and if within radius add this seg and, if present the opposing subsector (lather/rinse/repeat)
+				// If out of range we do not need to bother with this seg.
+				if (DistToSeg(spotPos, segment.start, segment.end) <= radius)
 				{
-					processSide(sidedef, segment.start, segment.end);
-				}
+					auto sidedef = segment.sidedef;
+					if (sidedef)
+					{
+						processSide(sidedef, segment.start, segment.end);
+					}
 
-				auto partner = segment.partner;
-				if (partner)
-				{
-					FSection *sect = partner->section;
-					if (sect != nullptr && sect->validcount != dl_validcount)
+					auto partner = segment.partner;
+					if (partner)
 					{
-						sect->validcount = dl_validcount;
-						collected_ss.Push({ sect, pos });
+						FSection *sect = partner->section;
+						if (sect != nullptr && scratch.MarkSection(Level, sect))
+						{
+							collected.Push({ sect, pos });
+						}
 					}
 				}
 			}
-		}
-		for (auto side : section->sides)
-		{
-			auto v1 = side->V1(), v2 = side->V2();
-			if (DistToSeg(spotPos, v1, v2) <= radius)
+			for (auto side : section->sides)
 			{
-				processSide(side, v1, v2);
+				auto v1 = side->V1(), v2 = side->V2();
+				if (DistToSeg(spotPos, v1, v2) <= radius)
+				{
+					processSide(side, v1, v2);
+				}
 			}
-		}
-		sector_t *sec = section->sector;
-		if (!sec->PortalBlocksSight(sector_t::ceiling))
-		{
-			line_t *other = section->segments[0].sidedef->linedef;
-			if (sec->GetPortalPlaneZ(sector_t::ceiling) < Z() + radius)
+			sector_t *sec = section->sector;
+			if (!sec->PortalBlocksSight(sector_t::ceiling))
 			{
-				DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::ceiling);
-				subsector_t *othersub = Level->PointInRenderSubsector(refpos);
-				FSection *othersect = othersub->section;
-				if (othersect->validcount != dl_validcount)
+				line_t *other = section->segments[0].sidedef->linedef;
+				if (sec->GetPortalPlaneZ(sector_t::ceiling) < Z() + radius)
 				{
-					othersect->validcount = dl_validcount;
-					collected_ss.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
+					DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::ceiling);
+					subsector_t *othersub = Level->PointInRenderSubsector(refpos);
+					FSection *othersect = othersub->section;
+					if (scratch.MarkSection(Level, othersect))
+					{
+						collected.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
+					}
 				}
 			}
-		}
-		if (!sec->PortalBlocksSight(sector_t::floor))
-		{
-			line_t *other = section->segments[0].sidedef->linedef;
-			if (sec->GetPortalPlaneZ(sector_t::floor) > Z() - radius)
+			if (!sec->PortalBlocksSight(sector_t::floor))
 			{
-				DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::floor);
-				subsector_t *othersub = Level->PointInRenderSubsector(refpos);
-				FSection *othersect = othersub->section;
-				if (othersect->validcount != dl_validcount)
+				line_t *other = section->segments[0].sidedef->linedef;
+				if (sec->GetPortalPlaneZ(sector_t::floor) > Z() - radius)
 				{
-					othersect->validcount = dl_validcount;
-					collected_ss.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
+					DVector2 refpos = other->v1->fPos() + other->Delta() / 2 + sec->GetPortalDisplacement(sector_t::floor);
+					subsector_t *othersub = Level->PointInRenderSubsector(refpos);
+					FSection *othersect = othersub->section;
+					if (scratch.MarkSection(Level, othersect))
+					{
+						collected.Push({ othersect, PosRelative(othersub->sector->PortalGroup) });
+					}
 				}
 			}
 		}
 	}
-	shadowmapped = hitonesidedback && !DontShadowmap();
+	req.numSections = scratch.sections.Size() - req.firstSection;
+	req.numSides = scratch.sides.Size() - req.firstSide;
 }
 
-
 //==========================================================================
 //
-// Link the light into the world
+// Replaces the light's touching lists with the collected ones.
+// Nodes that are still in use are kept.
 //
 //==========================================================================
 
-void FDynamicLight::LinkLight()
+void FDynamicLight::ApplyLinks(const FLightLinkScratch &scratch, const FLightLinkRequest &req)
 {
 	// mark the old light nodes
 	FLightNode * node;
 	
 	node = touching_sides;
 	while (node)
-    {
+	{
 		node->lightsource = nullptr;
 		node = node->nextTarget;
-    }
+	}
 	node = touching_sector;
 	while (node)
 	{
@@ -843,40 +894,21 @@ void FDynamicLight::LinkLight()
 		node = node->nextTarget;
 	}
 
-	if (radius>0)
+	for (unsigned i = 0; i < req.numSections; i++)
 	{
-		// passing in radius*radius allows us to do a distance check without any calls to sqrt
-		
-
-		// @Cockatrice - If this is a spot light, collect only within a radius from the center of the spot, we don't care about stuff that is behind the spot light
-		if (IsSpot()) {
-			dl_validcount++;
-			::validcount++;
-
-			// Determine center point in the direction of the light, reduce radius by half
-			// This may not work as we may have extended outside of our sector
-			float rad = radius * 0.5f;
-			DAngle pitch = *pPitch == target->Angles.Pitch ? target->Angles.Pitch : *pPitch;
-			DAngle angle = target->Angles.Yaw;
-			double cospitch = pitch.Cos();
-			DVector3 pPos;
-			pPos.X = rad * cospitch * angle.Cos();
-			pPos.Y = rad * cospitch * angle.Sin();
-			pPos.Z = rad * -pitch.Sin();
-
-			FSection *sect = Level->PointInRenderSubsector(Pos)->section;
-			CollectWithinRadiusSP(Pos, pPos, sect, rad * rad);
-		}
-		else {
-			FSection *sect = Level->PointInRenderSubsector(Pos)->section;
-
-			dl_validcount++;
-			::validcount++;
-
-			CollectWithinRadius(Pos, sect, float(radius*radius));
-		}
+		auto section = scratch.sections[req.firstSection + i];
+		touching_sector = AddLightNode(&section->lighthead, section, this, touching_sector);
 	}
-		
+	for (unsigned i = 0; i < req.numSides; i++)
+	{
+		auto sidedef = scratch.sides[req.firstSide + i];
+		touching_sides = AddLightNode(&sidedef->lighthead, sidedef, this, touching_sides);
+	}
+	if (req.numSections > 0)
+	{
+		shadowmapped = req.hitonesidedback && !DontShadowmap();
+	}
+
 	// Now delete any nodes that won't be used. These are the ones where
 	// m_thing is still nullptr.
 	
@@ -901,6 +933,113 @@ void FDynamicLight::LinkLight()
 		else
 			node = node->nextTarget;
 	}
+
+	LinkCenter = Pos + req.spotDir;
+	LinkPos = Pos;
+	LinkRadius = req.linkRadius;
+	linkQueued = false;
+	LightRelinks++;
+}
+
+
+//==========================================================================
+//
+// Link the light into the world
+//
+// While P_TickDynamicLights runs this only queues the light so that the
+// section floods of all moving lights can be done in parallel.
+//
+//==========================================================================
+
+void FDynamicLight::LinkLight()
+{
+	FLightLinkRequest req;
+	PrepareLink(req);
+
+	if (DeferLightLinks)
+	{
+		if (!linkQueued)
+		{
+			linkQueued = true;
+			PendingLinks.Push(req);
+		}
+		return;
+	}
+
+	MainLinkScratch.ClearResults();
+	CollectLinks(MainLinkScratch, req);
+	ApplyLinks(MainLinkScratch, req);
+}
+
+//==========================================================================
+//
+// Ticks all lights of a level and relinks the ones that moved.
+// Returns the number of lights that were ticked.
+//
+//==========================================================================
+
+int P_TickDynamicLights(FLevelLocals *Level)
+{
+	int count = 0;
+
+	LightRelinks = LightRelinksSkipped = LightRelinksThreaded = 0;
+	PendingLinks.Clear();
+	DeferLightLinks = true;
+	for (auto light = Level->lights; light;)
+	{
+		auto next = light->next;
+		light->Tick();
+		light = next;
+		count++;
+	}
+	DeferLightLinks = false;
+
+	unsigned numpending = PendingLinks.Size();
+	if (numpending < 2 * LIGHTLINK_CHUNK)
+	{
+		for (auto &req : PendingLinks)
+		{
+			if (req.light == nullptr) continue;
+			MainLinkScratch.ClearResults();
+			req.light->CollectLinks(MainLinkScratch, req);
+			req.light->ApplyLinks(MainLinkScratch, req);
+		}
+	}
+	else
+	{
+		unsigned chunk = max<unsigned>(LIGHTLINK_CHUNK, (numpending + LIGHTLINK_MAXSLOTS - 1) / LIGHTLINK_MAXSLOTS);
+		unsigned numslots = (numpending + chunk - 1) / chunk;
+		if (WorkerLinkScratch.Size() < numslots) WorkerLinkScratch.Resize(numslots);
+
+		parallel_for(0u, numpending, chunk, [&](unsigned start)
+		{
+			if (start >= numpending) return;
+			auto &scratch = WorkerLinkScratch[start / chunk];
+			unsigned end = min(start + chunk, numpending);
+			scratch.ClearResults();
+			for (unsigned p = start; p < end; p++)
+			{
+				if (PendingLinks[p].light != nullptr) PendingLinks[p].light->CollectLinks(scratch, PendingLinks[p]);
+			}
+		});
+
+		// The node lists are shared between lights so they must be updated in order on this thread.
+		for (unsigned p = 0; p < numpending; p++)
+		{
+			if (PendingLinks[p].light != nullptr) PendingLinks[p].light->ApplyLinks(WorkerLinkScratch[p / chunk], PendingLinks[p]);
+		}
+		LightRelinksThreaded = numpending;
+	}
+	PendingLinks.Clear();
+	return count;
+}
+
+ADD_STAT(lightlinks)
+{
+	FString out;
+	out.Format("Relinked: %d (%d on workers), within tolerance: %d, pool: %d allocated, %d free",
+		LightRelinks, LightRelinksThreaded, LightRelinksSkipped, LightPool.Allocated(), LightPool.Free());
+	return out;
 }
 
 
@@ -914,6 +1053,7 @@ void FDynamicLight::UnlinkLight ()
 	while (touching_sides) touching_sides = DeleteLightNode(touching_sides);
 	while (touching_sector) touching_sector = DeleteLightNode(touching_sector);
 	shadowmapped = false;
+	LinkRadius = -1;
 }
 
 //==========================================================================
@@ -195,6 +195,20 @@ struct FLightNode
 	};
 };
 
+struct FLightLinkScratch;
+
+// One pending relink. Filled in on the game thread, the section flood
+// can then run anywhere since it does not touch the light's target.
+struct FLightLinkRequest
+{
+	FDynamicLight *light;
+	DVector3 spotDir;		// offset from the light to the point used for distance checks (zero for point lights)
+	float linkRadius;		// the radius the flood actually uses, including the relink tolerance
+	unsigned firstSection, numSections;
+	unsigned firstSide, numSides;
+	bool hitonesidedback;
+};
+
 struct FDynamicLight
 {
 	friend class FLightDefaults;
@@ -259,10 +273,13 @@ struct FDynamicLight
 	void UnlinkLight();
 	void ReleaseLight();
 
+	void PrepareLink(FLightLinkRequest &req);
+	void CollectLinks(FLightLinkScratch &scratch, FLightLinkRequest &req) const;
+	void ApplyLinks(const FLightLinkScratch &scratch, const FLightLinkRequest &req);
+
 private:
-	double DistToSeg(const DVector3 &pos, vertex_t *start, vertex_t *end);
-	void CollectWithinRadius(const DVector3 &pos, FSection *section, float radius);
-	void CollectWithinRadiusSP(const DVector3 &opos, const DVector3 &spotDir, FSection *section, float radius);
+	static double DistToSeg(const DVector3 &pos, vertex_t *start, vertex_t *end);
+	DVector3 GetSpotDir(float &linkRadius);
 
 public:
 	FCycler m_cycler;
@@ -288,6 +305,9 @@ public:
 	TObjPtr<AActor *> target;
 	FLightNode * touching_sides;
 	FLightNode * touching_sector;
+	DVector3 LinkCenter;	// where the touching lists were last built for
+	DVector3 LinkPos;		// from where, sides are linked from both faces within the tolerance of that
+	float LinkRadius;		// and with which radius. -1 forces a relink.
 	float radius;			// The maximum size the light can be with its current settings.
 	float m_currentRadius;	// The current light size.
 	int m_tickCount;
@@ -300,7 +320,10 @@ public:
 	bool owned;
 	bool swapped;
 	bool explicitpitch;
+	bool linkQueued;
 
 };
 
+int P_TickDynamicLights(FLevelLocals *Level);
+
 
@@ -89,6 +89,11 @@ void FThinkerCollection::Link(DThinker *thinker, int statnum)
 	}
 
 	list->AddTail(thinker);
+
+	if (statnum == STAT_SLEEP)
+	{
+		SleepWheel.Schedule(thinker, thinker->sleepTimer);
+	}
 }
 
 // Insert the sleeper at the head of the list
@@ -96,6 +101,43 @@ void FThinkerCollection::LinkSleeper(DThinker* thinker, int statnum)
 {
 	Thinkers[statnum].AddHead(thinker);
 	//if (statnum != STAT_TRAVELLING) thinker->ObjectFlags &= ~OF_JustSpawned;
+
+	if (statnum == STAT_SLEEP)
+	{
+		SleepWheel.Schedule(thinker, thinker->sleepTimer);
+	}
+}
+
+//==========================================================================
+//
+// Run the wake checks for every sleeper that is due this tic
+//
+//==========================================================================
+
+void FThinkerCollection::CheckSleepingThinkers()
+{
+	SleepWheel.Advance(dueSleepers);
+
+	for (auto sleeper : dueSleepers)
+	{
+		// Only check thinkers not scheduled for destruction
+		if (sleeper->ObjectFlags & OF_EuthanizeMe)
+		{
+			continue;
+		}
+
+		if (sleeper->sleepInterval <= 0 || sleeper->CallShouldWake())
+		{
+			sleeper->CallWake();
+		}
+		else if (sleeper->sleepSlot < 0 && sleeper->sleepInterval > 0)
+		{
+			// Not ready yet and nobody woke it, put it back to sleep or moved it elsewhere, check again after another interval
+			SleepWheel.Schedule(sleeper, sleeper->sleepInterval);
+		}
+	}
+
+	dueSleepers.Clear();
 }
 
 //==========================================================================
@@ -118,8 +160,7 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 
 	// Handle sleeping thinkers, allow them to slip back into the regular pool when unnecessary
 	inSleepCycle = true;
-	Thinkers[STAT_SLEEP].CheckSleepingThinkers(1);
-	FreshThinkers[STAT_SLEEP].CheckSleepingThinkers(1);
+	CheckSleepingThinkers();
 
 	// Wake the waiting dreamers
 	for (auto dreamer : tempWakers) {
@@ -185,12 +226,7 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 		recreateLights();
 		if (dolights)
 		{
-			for (auto light = Level->lights; light;)
-			{
-				auto next = light->next;
-				light->Tick();
-				light = next;
-			}
+			P_TickDynamicLights(Level);
 		}
 	}
 	else
@@ -220,13 +256,7 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 			// Also profile the internal dynamic lights, even though they are not implemented as thinkers.
 			auto &prof = Profiles[NAME_InternalDynamicLight];
 			prof.timer.Clock();
-			for (auto light = Level->lights; light;)
-			{
-				prof.numcalls++;
-				auto next = light->next;
-				light->Tick();
-				light = next;
-			}
+			prof.numcalls += P_TickDynamicLights(Level);
 			prof.timer.Unclock();
 		}
 
@@ -303,6 +333,9 @@ void FThinkerCollection::DestroyAllThinkers(bool fullgc)
 	int i;
 	bool error = false;
 
+	// Drop the whole schedule up front instead of unlinking the sleepers one at a time
+	SleepWheel.Clear();
+
 	for (i = 0; i <= MAX_STATNUM; i++)
 	{
 		if (i != STAT_TRAVELLING && i != STAT_STATIC)
@@ -387,6 +420,12 @@ void FThinkerCollection::SerializeThinkers(FSerializer &arc, bool hubLoad)
 									Thinkers[i].AddTail(thinker);
 									thinker->PostSerialize();
 								}
+
+								if (i == STAT_SLEEP && !(thinker->ObjectFlags & OF_EuthanizeMe))
+								{
+									// sleepTimer was saved as the tics remaining, so this picks up where the save left off
+									SleepWheel.Schedule(thinker, thinker->sleepTimer);
+								}
 							}
 						}
 					}
@@ -729,39 +768,112 @@ void FThinkerList::SaveList(FSerializer &arc)
 }
 
 
-int FThinkerList::CheckSleepingThinkers(int ticsElapsed) {
-	int count = 0;
-	DThinker *node = GetHead();
-	DThinker *nextNode = nullptr;
+//==========================================================================
+//
+// FSleepWheel
+//
+//==========================================================================
 
-	if (node == nullptr) {
-		//sleepCount = 0;
-		return 0;
+void FSleepWheel::Schedule(DThinker *thinker, int tics)
+{
+	Unschedule(thinker);
+
+	thinker->sleepWakeTic = CurrentTic + clamp(tics, 1, (1 << (SLOT_BITS * LEVELS)) - 1);
+	Place(thinker);
+	Count++;
+}
+
+void FSleepWheel::Place(DThinker *thinker)
+{
+	int delta = thinker->sleepWakeTic - CurrentTic;
+	int level = 0;
+
+	while (level < LEVELS - 1 && delta >= (1 << (SLOT_BITS * (level + 1))))
+	{
+		level++;
 	}
 
-	while (node != Sentinel)
+	int slot = (thinker->sleepWakeTic >> (SLOT_BITS * level)) & SLOT_MASK;
+	thinker->sleepSlot = level * SLOTS + slot;
+	Slots[level][slot].Push(thinker);
+}
+
+void FSleepWheel::Unschedule(DThinker *thinker)
+{
+	if (thinker->sleepSlot < 0)
 	{
-		nextNode = node->NextThinker;
+		return;
+	}
 
-		if (!(node->ObjectFlags & OF_EuthanizeMe))
-		{ // Only check thinkers not scheduled for destruction
-			node->sleepTimer -= ticsElapsed;
-			if (node->sleepTimer  <= 0) {
-				if (node->sleepInterval <= 0 || node->CallShouldWake()) {
-					++count;
-					node->CallWake();
-				}
-			}
+	auto &slot = Slots[thinker->sleepSlot / SLOTS][thinker->sleepSlot % SLOTS];
+	for (unsigned i = slot.Size(); i-- > 0; )
+	{
+		if (slot[i] == thinker)
+		{
+			slot[i] = slot.Last();
+			slot.Pop();
+			Count--;
+			break;
 		}
+	}
 
-		node = nextNode;
+	thinker->sleepSlot = -1;
+}
+
+// Redistributes an outer slot once the inner levels have caught up with it
+void FSleepWheel::Cascade(int level, int slot)
+{
+	TArray<DThinker *> moving;
+	moving.Swap(Slots[level][slot]);
+
+	for (auto thinker : moving)
+	{
+		Place(thinker);
 	}
+}
 
-	// TODO: Might have to perform some maintenance on sleepCount to prevent it from getting too big
+void FSleepWheel::Advance(TArray<DThinker *> &due)
+{
+	CurrentTic++;
 
-	return count;
+	for (int level = LEVELS - 1; level > 0; level--)
+	{
+		if ((CurrentTic & ((1 << (SLOT_BITS * level)) - 1)) == 0)
+		{
+			Cascade(level, (CurrentTic >> (SLOT_BITS * level)) & SLOT_MASK);
+		}
+	}
+
+	due.Clear();
+	due.Swap(Slots[0][CurrentTic & SLOT_MASK]);
+
+	for (auto thinker : due)
+	{
+		thinker->sleepSlot = -1;
+	}
+	Count -= due.Size();
 }
 
+void FSleepWheel::Clear()
+{
+	for (auto &level : Slots)
+	{
+		for (auto &slot : level)
+		{
+			for (auto thinker : slot)
+			{
+				thinker->sleepSlot = -1;
+			}
+			slot.Clear();
+		}
+	}
+	Count = 0;
+}
+
+int FSleepWheel::GetRemaining(const DThinker *thinker) const
+{
+	return thinker->sleepSlot >= 0 ? thinker->sleepWakeTic - CurrentTic : thinker->sleepTimer;
+}
 
 //==========================================================================
 //
@@ -887,6 +999,10 @@ void DThinker::Serialize(FSerializer &arc)
 {
 	Super::Serialize(arc);
 	arc("level", Level);
+	if (arc.isWriting() && sleepSlot >= 0)
+	{
+		sleepTimer = Level->Thinkers.GetSleepWheel().GetRemaining(this);
+	}
 	arc("sleepInterval", sleepInterval);
 	arc("sleepTimer", sleepTimer);
 }
@@ -907,6 +1023,11 @@ void DThinker::Remove()
 	DThinker *next = NextThinker;
 	if (prev == nullptr && next == nullptr) return;	// This was already removed earlier.
 
+	if (sleepSlot >= 0)
+	{
+		Level->Thinkers.GetSleepWheel().Unschedule(this);
+	}
+
 	assert((ObjectFlags & OF_Sentinel) || (prev != this && next != this));
 	assert(prev->NextThinker == this);
 	assert(next->PrevThinker == this);
@@ -1100,6 +1221,11 @@ void DThinker::ChangeStatNum (int statnum)
 		statnum = MAX_STATNUM;
 	}
 	Remove();
+	// Leaving the sleep list ends the sleep, otherwise the wake check would put it back on the sleep wheel.
+	if (statnum != STAT_SLEEP && sleepInterval > 0)
+	{
+		sleepInterval = sleepTimer = 0;
+	}
 	Level->Thinkers.Link(this, statnum);
 }
 
@@ -67,7 +67,6 @@ struct FThinkerList
 	bool IsEmpty() const;
 	void DestroyThinkers();
 	bool DoDestroyThinkers();
-	int CheckSleepingThinkers(int ticsElapsed = 1);			// Check and unsleep thinkers periodically
 	int TickThinkers(FThinkerList *dest);					// Returns: # of thinkers ticked
 	int ProfileThinkers(FThinkerList *dest);
 	void SaveList(FSerializer &arc);
@@ -78,6 +77,35 @@ private:
 	friend struct FThinkerCollection;
 };
 
+// Hierarchical timing wheel over the STAT_SLEEP thinkers, bucketed by the tic they are due to
+// wake on. The sleepers stay linked in their regular thinker list for iteration, saving and GC;
+// the wheel only decides who needs to be looked at, so each tic only touches the due sleepers.
+struct FSleepWheel
+{
+	enum
+	{
+		SLOT_BITS = 8,
+		SLOTS = 1 << SLOT_BITS,
+		SLOT_MASK = SLOTS - 1,
+		LEVELS = 3,		// Covers 2^24 tics, longer sleeps are clamped
+	};
+
+	void Schedule(DThinker *thinker, int tics);
+	void Unschedule(DThinker *thinker);
+	void Advance(TArray<DThinker *> &due);		// Steps one tic and collects every sleeper due on it
+	void Clear();
+	int GetRemaining(const DThinker *thinker) const;
+	unsigned Size() const { return Count; }
+
+private:
+	void Place(DThinker *thinker);
+	void Cascade(int level, int slot);
+
+	TArray<DThinker *> Slots[LEVELS][SLOTS];
+	int CurrentTic = 0;
+	unsigned Count = 0;
+};
+
 struct FThinkerCollection
 {
 	void DestroyThinkersInList(int statnum)
@@ -96,6 +124,7 @@ struct FThinkerCollection
 
 	bool IsSleepCycle() const { return inSleepCycle; }
 	void AddWaker(DThinker* einstein) { tempWakers.Push(einstein); }
+	FSleepWheel &GetSleepWheel() { return SleepWheel; }
 
 private:
 	FThinkerList Thinkers[MAX_STATNUM + 2];
@@ -103,6 +132,10 @@ private:
 
 	bool inSleepCycle = false;							// Set when running through sleepers.  If in sleep cycle, we put new sleeping thinkers into FreshThinkers and new wakes into the wake list
 	TArray<DThinker*> tempWakers;
+	TArray<DThinker*> dueSleepers;
+	FSleepWheel SleepWheel;
+
+	void CheckSleepingThinkers();
 
 	friend class FThinkerIterator;
 };
@@ -127,6 +160,7 @@ public:
 	virtual void CallSleep(int tics = 10);
 	virtual bool CallShouldWake();
 	virtual void CallWake();
+	bool IsSleeping() const { return sleepInterval != 0; }
 
 	void Serialize(FSerializer &arc) override;
 	size_t PropagateMark();
@@ -141,12 +175,15 @@ private:
 	friend class FThinkerIterator;
 	friend class DObject;
 	friend class FDoomSerializer;
+	friend struct FSleepWheel;
 
 	DThinker *NextThinker = nullptr, *PrevThinker = nullptr;
 
 	// Sleep info
 	int sleepInterval = 0;	// How many tics to sleep before checking for wake
-	int sleepTimer = 0;		// Timer data
+	int sleepTimer = 0;		// Tics left until the next wake check. Only kept up to date for saving, the sleep wheel has the live value
+	int sleepWakeTic = 0;	// Sleep wheel tic this thinker is due on
+	int sleepSlot = -1;		// Sleep wheel slot this thinker is queued in, or -1 if not scheduled
 
 public:
 	FLevelLocals *Level;
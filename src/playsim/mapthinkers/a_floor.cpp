@@ -1216,6 +1216,7 @@ void DWaggleBase::DoWaggle (bool ceiling)
 			dist = (m_OriginalDist - plane->fD()) / plane->fC();
 			m_Sector->ChangePlaneTexZ(pos, -plane->HeightDiff (m_OriginalDist));
 			plane->setD(m_OriginalDist);
+			P_InvalidateSightCache();
 			P_ChangeSector (m_Sector, true, dist, ceiling, false);
 			if (ceiling)
 			{
@@ -1242,6 +1243,7 @@ void DWaggleBase::DoWaggle (bool ceiling)
 	}
 	m_Accumulator += m_AccDelta;
 
+	P_InvalidateSightCache();
 	dist = plane->fD();
 	plane->setD(m_OriginalDist + plane->PointToDist (DVector2(0, 0), BobSin(m_Accumulator) *m_Scale));
 	m_Sector->ChangePlaneTexZ(pos, plane->HeightDiff (dist));
@@ -52,6 +52,7 @@
 #include "a_ceiling.h"
 #include "shadowinlines.h"
 #include "i_time.h"
+#include "c_dispatch.h"
 
 #include "gi.h"
 
@@ -274,6 +275,68 @@ void P_NoiseAlert (AActor *emitter, AActor *target, bool splash, double maxdist)
 	AlertCycles.Unclock();
 }
 
+//----------------------------------------------------------------------------
+//
+// PROC P_WakeSleepers
+//
+// Wakes every sleeping actor within radius of the emitter, so noises and
+// other events can rouse sleepers without waiting on their ShouldWake checks.
+//
+//----------------------------------------------------------------------------
+
+int P_WakeSleepers(AActor *emitter, double radius)
+{
+	if (emitter == nullptr || radius <= 0)
+		return 0;
+
+	int count = 0;
+	FPortalGroupArray grouplist;
+	FMultiBlockThingsIterator it(grouplist, emitter->Level, emitter->X(), emitter->Y(), emitter->Z() - radius, radius * 2, radius, false, emitter->Sector);
+	FMultiBlockThingsIterator::CheckResult cres;
+
+	while (it.Next(&cres))
+	{
+		AActor *thing = cres.thing;
+
+		if (thing == emitter || !thing->IsSleeping() || (thing->ObjectFlags & OF_EuthanizeMe))
+			continue;
+
+		// The iterator puts the check radius into cres.Position.Z, so the height comes from the emitter itself.
+		DVector3 diff(thing->Pos().XY() - cres.Position.XY(), thing->Z() - emitter->Z());
+		if (diff.LengthSquared() > radius * radius)
+			continue;
+
+		thing->CallWake();
+		count++;
+	}
+
+	return count;
+}
+
+// Debug CCMD for checking P_WakeSleepers away from the floor: a sleeper right next to the emitter must always be woken.
+CCMD(checkwakesleepers)
+{
+	if (netgame || players[consoleplayer].mo == nullptr) return;
+
+	auto mo = players[consoleplayer].mo;
+	DVector3 pos = mo->Pos() + DVector3(0, 0, 512);
+	AActor *emitter = Spawn(mo->Level, NAME_MapSpot, pos, NO_REPLACE);
+	AActor *sleeper = Spawn(mo->Level, NAME_MapSpot, pos + DVector3(8, 0, 0), NO_REPLACE);
+	if (emitter == nullptr || sleeper == nullptr) return;
+
+	// Map spots are not in the blockmap, so the iterator would never find the sleeper.
+	FLinkContext ctx;
+	sleeper->UnlinkFromWorld(&ctx);
+	sleeper->flags &= ~MF_NOBLOCKMAP;
+	sleeper->LinkToWorld(&ctx);
+
+	sleeper->Sleep(35);
+	int woken = P_WakeSleepers(emitter, 64);
+	Printf("%s: woke %d sleeper(s) at height %.1f\n", sleeper->IsSleeping() ? TEXTCOLOR_RED "FAILED" TEXTCOLOR_NORMAL : "ok", woken, pos.Z);
+	emitter->Destroy();
+	sleeper->Destroy();
+}
+
 //----------------------------------------------------------------------------
 //
 // AActor :: CheckMeleeRange
@@ -48,6 +48,7 @@ struct FLookExParams
 
 int P_HitFriend (AActor *self);
 void P_NoiseAlert (AActor *emitter, AActor *target, bool splash=false, double maxdist=0);
+int P_WakeSleepers(AActor *emitter, double radius);
 int P_CheckMeleeRange(AActor* actor, double range = -1);
 
 bool P_CheckMeleeRange2 (AActor *actor);
@@ -283,7 +283,20 @@ enum ESightFlags
 	SF_IGNOREWATERBOUNDARY=8
 };
 
+// One looker/target pair for P_CheckSightBatch. Result is filled in by the call.
+struct FSightQuery
+{
+	AActor *Looker;
+	AActor *Target;
+	int Flags;
+	bool Result;
+};
+
+void	P_CheckSightBatch (FSightQuery *queries, unsigned count);
+void	P_CheckSightBatch (TArray<FSightQuery> &queries);
+
 void	P_ResetSightCounters (bool full);
+void	P_InvalidateSightCache ();
 bool	P_TalkFacing (AActor *player);
 void	P_UseLines (player_t* player);
 int	P_UsePuzzleItem (AActor *actor, int itemType);
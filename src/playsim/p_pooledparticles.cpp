@@ -9,6 +9,11 @@
 #include "texturemanager.h"
 #include "d_player.h"
 #include "actorinlines.h"
+#include "parallel_for.h"
+
+#ifndef NO_SSE
+#include <xmmintrin.h>
+#endif
 
 // NL: This is a helper to make sure that the particles are all linked correctly.
 //     If something breaks the chain, it can cause particles to stop updating and spawning
@@ -24,6 +29,10 @@ static int PARTICLE_COUNT = 0;
 // Taken from p_mobj.cpp
 #define WATER_SINK_SPEED		0.5
 
+// Below this many particles the integration pass isn't worth handing to other threads
+#define PARALLEL_INTEGRATE_MIN	1024
+#define PARALLEL_INTEGRATE_CHUNK	256
+
 const float DParticleDefinition::INVALID = -99999;
 const float DParticleDefinition::BOUNCE_SOUND_ATTENUATION = 1.5f;
 
@@ -322,6 +331,56 @@ DEFINE_ACTION_FUNCTION(DParticleDefinition, EmitNative)
 	return 0;
 }
 
+DEFINE_ACTION_FUNCTION(DParticleDefinition, EmitBatchNative)
+{
+	PARAM_PROLOGUE;
+	PARAM_CLASS(definitionClass, DParticleDefinition);
+	PARAM_POINTER(master, AActor);
+	PARAM_FLOAT(chance);
+	PARAM_FLOAT(angle);
+	PARAM_FLOAT(pitch);
+	PARAM_FLOAT(speed);
+	PARAM_POINTER(offsets, TArray<double>);
+	PARAM_POINTER(velocities, TArray<double>);
+	PARAM_INT(flags);
+	PARAM_FLOAT(scaleBoost);
+	PARAM_FLOAT(additionalAngleScale);
+	PARAM_FLOAT(additionalAngleChance);
+
+	if (!currentVMLevel || !definitionClass || !offsets)
+	{
+		return 0;
+	}
+
+	int count = offsets->Size() / 3;
+	bool hasVelocities = velocities && velocities->Size() > 0;
+
+	if (hasVelocities && velocities->Size() / 3 != (unsigned)count)
+	{
+		ThrowAbortException(X_OTHER, "EmitBatch: %u velocities for %d offsets", velocities->Size() / 3, count);
+	}
+
+	if (DParticleDefinition* definition = *currentVMLevel->ParticleDefinitionsByType.CheckKey(definitionClass->TypeName.GetIndex()))
+	{
+		// Not static: OnCreateParticle may run script code that emits another batch.
+		TArray<DVector3> batchOffsets(count, true), batchVelocities(hasVelocities ? count : 0, true);
+
+		for (int i = 0; i < count; i++)
+		{
+			batchOffsets[i] = DVector3((*offsets)[i * 3], (*offsets)[i * 3 + 1], (*offsets)[i * 3 + 2]);
+
+			if (hasVelocities)
+			{
+				batchVelocities[i] = DVector3((*velocities)[i * 3], (*velocities)[i * 3 + 1], (*velocities)[i * 3 + 2]);
+			}
+		}
+
+		definition->EmitBatch(master, chance, angle, pitch, speed, batchOffsets.Data(), hasVelocities ? batchVelocities.Data() : nullptr, count, flags, (float)scaleBoost, (float)additionalAngleScale, (float)additionalAngleChance);
+	}
+
+	return 0;
+}
+
 static int DParticleDefinition_AddAnimationSequence(DParticleDefinition* self)
 {
 	if (self->AnimationSequences.Size() >= 255)
@@ -697,15 +756,12 @@ float SpreadRandomizer3::NewRandom(float min /*= 0.0f*/, float max /*= 1.0f*/, f
 	return rnd;
 }
 
-void particledata_t::Init(FLevelLocals* Level, DVector3 initialPos)
+// Everything Init sets that does not depend on the particle's position. Saved particles only store what differs from this.
+void particledata_t::InitDefaults()
 {
-	subsector = Level->PointInRenderSubsector(initialPos);
-	sector_t* s = subsector->sector;
-
 	master = nullptr;
 	renderStyle = definition->DefaultRenderStyle;
 	startLife = life = 35;
-	pos = prevpos = initialPos;
 	vel = DVector3();
 	gravity = 0;
 	alpha = 1;
@@ -723,17 +779,26 @@ void particledata_t::Init(FLevelLocals* Level, DVector3 initialPos)
 	rollStep = 0;
 	bounces = 0;
 	maxBounces = -1;
-	floorz = GetFloorHeight();
-	ceilingz = (float)s->ceilingplane.ZatPoint(initialPos);
 	restplane = nullptr;
 	color = 0xffffff;
 	animFrame = 0;
 	animTick = 0;
 	invalidateTicks = 0;
 	sleepFor = 0;
-	flags = flags | definition->DefaultParticleFlags | DPF_FIRSTUPDATE;
 	user1 = user2 = user3 = user4 = 0;
 	lastTexture = {};
+}
+
+void particledata_t::Init(FLevelLocals* Level, DVector3 initialPos)
+{
+	subsector = Level->PointInRenderSubsector(initialPos);
+	sector_t* s = subsector->sector;
+
+	InitDefaults();
+	pos = prevpos = initialPos;
+	floorz = GetFloorHeight();
+	ceilingz = (float)s->ceilingplane.ZatPoint(initialPos);
+	flags = flags | definition->DefaultParticleFlags | DPF_FIRSTUPDATE;
 
 	if ((definition->HasFlag(PDF_CHECKWATERSPAWN) || definition->HasFlag(PDF_CHECKWATER) || definition->HasFlag(PDF_NOSPAWNUNDERWATER)) && CheckWater(nullptr))
 	{
@@ -890,9 +955,9 @@ DParticleDefinition::~DParticleDefinition()
 
 }
 
-void DParticleDefinition::Emit(AActor* master, double chance, int numTries, double angle, double pitch, double speed, DVector3 offset, DVector3 velocity, int flags, float scaleBoost, int particleSpawnOffsets, float particleLifetimeModifier, float additionalAngleScale, float additionalAngleChance)
+// Scales the emit chance by the particle quality settings and the distance to the player
+double DParticleDefinition::GetEmitChance(AActor* master, double chance, int& numTries, int flags)
 {
-	// Multiply the emit chance based on particle settings
 	if (!(flags & PE_IGNORE_CHANCE))
 	{
 		int spawnSetting = (((flags & PE_ISBLOOD) || (Flags & PDF_ISBLOOD)) ? cvarBloodQuality : cvarParticleIntensity)->ToInt();
@@ -931,196 +996,247 @@ void DParticleDefinition::Emit(AActor* master, double chance, int numTries, doub
 		}
 	}
 
-	if (master)
+	return chance;
+}
+
+int DParticleDefinition::GetLifespanSetting()
+{
+	return cvarParticleLifespan ? cvarParticleLifespan->ToInt() : 3;
+}
+
+// Spawns and sets up a single particle. Everything that is the same for the whole
+// burst (chance, orientation, cvars) has already been resolved by the caller.
+// Returns false if the pool is full and nothing more can be spawned.
+bool DParticleDefinition::EmitParticle(AActor* master, double angle, double pitch, double speed, const DVector3& offset, const DVector3& velocity, int flags, float scaleBoost, int particleSpawnOffsets, float particleLifetimeModifier, float additionalAngleScale, float additionalAngleChance, int lifespanSetting)
+{
+	SpreadRandomizer3 angleRandomizer = {};
+	SpreadRandomizer3 speedRandomizer = {};
+
+	DVector3 pos;
+
+	// Find position+offset
+	if (flags & PE_ABSOLUTE_POSITION) 
 	{
-		if ((flags & PE_ABSOLUTE_ANGLE) == 0) angle += master->Angles.Yaw.Degrees();
-		if ((flags & PE_ABSOLUTE_PITCH) == 0) pitch += master->Angles.Pitch.Degrees();
+		pos = offset;
 	}
+	else 
+	{
+		pos = master ? master->Pos() : offset;
 
-	int numCreated = 0;
+		if (master && flags & PE_ABSOLUTE_OFFSET) 
+		{
+			pos += offset;
+		}
+		else if (master) 
+		{
+			pos += RotVec(offset, angle, pitch);
+		}
+	}
 
-	for (int x = 0; x < numTries; x++)
+	// Move around if particle offset is set
+	if (particleSpawnOffsets > 0)
 	{
-		SpreadRandomizer3 angleRandomizer;
-		SpreadRandomizer3 speedRandomizer;
+		pos.X += ParticleRandom(-(double)particleSpawnOffsets, (double)particleSpawnOffsets);
+		pos.Y += ParticleRandom(-(double)particleSpawnOffsets, (double)particleSpawnOffsets);
+		pos.Z += ParticleRandom(0.0, (double)particleSpawnOffsets);
+	}
 
-		if (flags & PE_IGNORE_CHANCE || randomEmit() / 256.0 <= chance)
+	particledata_t* p = NewDefinedParticle(Level, this, true);
+
+	if (!p)
+	{
+		return false;
+	}
+
+	p->master = master;
+	p->Init(Level, pos);
+
+	double angleDelta = MaxAng - MinAng;
+	double pitchDelta = MaxPitch - MinPitch;
+
+	if (additionalAngleScale != 0 && additionalAngleChance > 0)
+	{
+		if (additionalAngleChance >= ParticleRandom(0.0, 1.0))
 		{
-			DVector3 pos;
+			angleDelta += MaxAng * additionalAngleScale;
+			pitchDelta += MaxPitch * additionalAngleScale;
+		}
+	}
+
+	// Configure orientation, used both for angling flatsprites and for fire-direction
+	double pAngle = angle + (angleRandomizer.NewRandom(0.0, 1.0) * angleDelta) + MinAng;
+	double pPitch = pitch + (angleRandomizer.NewRandom(0.0, 1.0) * pitchDelta) + MinPitch;
+	p->angle = (float)pAngle;
+	p->roll = (ParticleRandom(0.0f, 1.0f) * (MaxRoll - MinRoll)) + MinRoll;
+	p->rollStep = (ParticleRandom(0.0f, 1.0f) * (MaxRollSpeed - MinRollSpeed)) + MinRollSpeed;
+	
+	if (MinScale.X >= 0)
+	{
+		p->scale.X *= (ParticleRandom(0.0f, 1.0f) * (MaxScale.X - MinScale.X)) + MinScale.X;
+	}
+	
+	if (!HasFlag(PDF_SQUAREDSCALE) && MinScale.Y >= 0)
+	{
+		p->scale.Y *= (ParticleRandom(0.0f, 1.0f) * (MaxScale.Y - MinScale.Y)) + MinScale.Y;
+	}
+	else if (MinScale.X >= 0 && HasFlag(PDF_SQUAREDSCALE))
+	{
+		p->scale.Y = p->scale.X;
+	}
+
+	if (scaleBoost)
+	{
+		p->scale *= scaleBoost;
+	}
 
-			// Find position+offset
-			if (flags & PE_ABSOLUTE_POSITION) 
+	p->startScale = p->scale;
+	p->gravity = ParticleRandom(MinGravity, MaxGravity);
+
+	// Set speed
+	double pSpeed = Speed;
+	if (!(flags & PE_FORCE_VELOCITY)) 
+	{
+		if (flags & PE_ABSOLUTE_SPEED) 
+		{
+			pSpeed = speed;
+		}
+		else 
+		{
+			// Use the default.speed arg if the random args are invalid (which they are by default)
+			if (MinSpeed == INVALID || MaxSpeed == INVALID) 
 			{
-				pos = offset;
+				pSpeed = flags & PE_SPEED_IS_MULTIPLIER ? pSpeed * speed : pSpeed + speed;
 			}
 			else 
 			{
-				pos = master ? master->Pos() : offset;
-
-				if (master && flags & PE_ABSOLUTE_OFFSET) 
-				{
-					pos += offset;
-				}
-				else if (master) 
-				{
-					pos += RotVec(offset, angle, pitch);
-				}
+				pSpeed = (speedRandomizer.NewRandom(0.0, 1.0) * (MaxSpeed - MinSpeed)) + MinSpeed;
+				pSpeed = flags & PE_SPEED_IS_MULTIPLIER ? pSpeed * speed : pSpeed + speed;
 			}
+		}
 
-			// Move around if particle offset is set
-			if (particleSpawnOffsets > 0)
-			{
-				pos.X += ParticleRandom(-(double)particleSpawnOffsets, (double)particleSpawnOffsets);
-				pos.Y += ParticleRandom(-(double)particleSpawnOffsets, (double)particleSpawnOffsets);
-				pos.Z += ParticleRandom(0.0, (double)particleSpawnOffsets);
-			}
+		p->vel = VecFromAngle(pAngle, pPitch, pSpeed);
+		if (master) 
+		{
+			p->vel += master->Vel * InheritVelocity;
+		}
+		
+		p->vel += flags & PE_ABSOLUTE_VELOCITY ? velocity : (ApproxZero(velocity) ? DVector3() : RotVec(velocity, pAngle, pPitch));
+	}
+	else 
+	{
+		if (flags & PE_ABSOLUTE_VELOCITY) 
+		{
+			p->vel = velocity;
+		}
+		else 
+		{
+			p->vel = ApproxZero(velocity) ? DVector3() : RotVec(velocity, pAngle, pPitch);
+		}
+	}
 
-			particledata_t* p = NewDefinedParticle(Level, this, true);
+	// Set life
+	if (MinLife > 0 || MaxLife > 0) 
+	{
+		int minLife = std::max(0, MinLife);
+		p->life = ParticleRandom(randomLife, minLife, std::max(minLife, MaxLife));
 
-			if (!p)
-			{
-				return;
-			}
+		switch (lifespanSetting)
+		{
+			case 1:
+				p->life = (int16_t)roundf(p->life * LifeMultLow);
+				break;
+			case 2:
+				p->life = (int16_t)roundf(p->life * LifeMultMed);
+				break;
+			case 3:
+				p->life = (int16_t)roundf(p->life * LifeMultHigh);
+				break;
+			case 4:
+				p->life = (int16_t)roundf(p->life * LifeMultUlt) * 2;
+				break;
+			case 5:
+				p->life = (int16_t)roundf(p->life * LifeMultInsane);
+				break;
+			default:
+				p->life = (int16_t)roundf(p->life * LifeMultHigh);
+				break;
+		}
 
-			p->master = master;
-			p->Init(Level, pos);
+		if (particleLifetimeModifier > 0) p->life = (int16_t)(p->life * particleLifetimeModifier);
+	}
+	else 
+	{
+		p->life = -1;
+	}
 
-			double angleDelta = MaxAng - MinAng;
-			double pitchDelta = MaxPitch - MinPitch;
+	p->startLife = p->life;
 
-			if (additionalAngleScale != 0 && additionalAngleChance > 0)
-			{
-				if (additionalAngleChance >= ParticleRandom(0.0, 1.0))
-				{
-					angleDelta += MaxAng * additionalAngleScale;
-					pitchDelta += MaxPitch * additionalAngleScale;
-				}
-			}
+	// Set bounces
+	if (MinRandomBounces >= MaxRandomBounces) 
+	{
+		p->maxBounces = ParticleRandom(randomBounce, MinRandomBounces, MaxRandomBounces);
+	}
+	else 
+	{
+		p->maxBounces = -1;
+	}
 
-			// Configure orientation, used both for angling flatsprites and for fire-direction
-			double pAngle = angle + (angleRandomizer.NewRandom(0.0, 1.0) * angleDelta) + MinAng;
-			double pPitch = pitch + (angleRandomizer.NewRandom(0.0, 1.0) * pitchDelta) + MinPitch;
-			p->angle = (float)pAngle;
-			p->roll = (ParticleRandom(0.0f, 1.0f) * (MaxRoll - MinRoll)) + MinRoll;
-			p->rollStep = (ParticleRandom(0.0f, 1.0f) * (MaxRollSpeed - MinRollSpeed)) + MinRollSpeed;
-			
-			if (MinScale.X >= 0)
-			{
-				p->scale.X *= (ParticleRandom(0.0f, 1.0f) * (MaxScale.X - MinScale.X)) + MinScale.X;
-			}
-			
-			if (!HasFlag(PDF_SQUAREDSCALE) && MinScale.Y >= 0)
-			{
-				p->scale.Y *= (ParticleRandom(0.0f, 1.0f) * (MaxScale.Y - MinScale.Y)) + MinScale.Y;
-			}
-			else if (MinScale.X >= 0 && HasFlag(PDF_SQUAREDSCALE))
-			{
-				p->scale.Y = p->scale.X;
-			}
+	CallOnCreateParticle(p);
 
-			if (scaleBoost)
-			{
-				p->scale *= scaleBoost;
-			}
+	return true;
+}
 
-			p->startScale = p->scale;
-			p->gravity = ParticleRandom(MinGravity, MaxGravity);
+void DParticleDefinition::Emit(AActor* master, double chance, int numTries, double angle, double pitch, double speed, DVector3 offset, DVector3 velocity, int flags, float scaleBoost, int particleSpawnOffsets, float particleLifetimeModifier, float additionalAngleScale, float additionalAngleChance)
+{
+	// Multiply the emit chance based on particle settings
+	chance = GetEmitChance(master, chance, numTries, flags);
 
-			// Set speed
-			double pSpeed = Speed;
-			if (!(flags & PE_FORCE_VELOCITY)) 
-			{
-				if (flags & PE_ABSOLUTE_SPEED) 
-				{
-					pSpeed = speed;
-				}
-				else 
-				{
-					// Use the default.speed arg if the random args are invalid (which they are by default)
-					if (MinSpeed == INVALID || MaxSpeed == INVALID) 
-					{
-						pSpeed = flags & PE_SPEED_IS_MULTIPLIER ? pSpeed * speed : pSpeed + speed;
-					}
-					else 
-					{
-						pSpeed = (speedRandomizer.NewRandom(0.0, 1.0) * (MaxSpeed - MinSpeed)) + MinSpeed;
-						pSpeed = flags & PE_SPEED_IS_MULTIPLIER ? pSpeed * speed : pSpeed + speed;
-					}
-				}
+	if (master)
+	{
+		if ((flags & PE_ABSOLUTE_ANGLE) == 0) angle += master->Angles.Yaw.Degrees();
+		if ((flags & PE_ABSOLUTE_PITCH) == 0) pitch += master->Angles.Pitch.Degrees();
+	}
 
-				p->vel = VecFromAngle(pAngle, pPitch, pSpeed);
-				if (master) 
-				{
-					p->vel += master->Vel * InheritVelocity;
-				}
-				
-				p->vel += flags & PE_ABSOLUTE_VELOCITY ? velocity : (ApproxZero(velocity) ? DVector3() : RotVec(velocity, pAngle, pPitch));
-			}
-			else 
+	int lifespanSetting = GetLifespanSetting();
+
+	for (int x = 0; x < numTries; x++)
+	{
+		if (flags & PE_IGNORE_CHANCE || randomEmit() / 256.0 <= chance)
+		{
+			if (!EmitParticle(master, angle, pitch, speed, offset, velocity, flags, scaleBoost, particleSpawnOffsets, particleLifetimeModifier, additionalAngleScale, additionalAngleChance, lifespanSetting))
 			{
-				if (flags & PE_ABSOLUTE_VELOCITY) 
-				{
-					p->vel = velocity;
-				}
-				else 
-				{
-					p->vel = ApproxZero(velocity) ? DVector3() : RotVec(velocity, pAngle, pPitch);
-				}
+				return;
 			}
+		}
+	}
+}
 
-			// Set life
-			if (MinLife > 0 || MaxLife > 0) 
-			{
-				int minLife = std::max(0, MinLife);
-				p->life = ParticleRandom(randomLife, minLife, std::max(minLife, MaxLife));
+// Emits one particle per offset/velocity pair in a single native loop, so a burst
+// only pays for the chance, orientation and cvar lookups once.
+void DParticleDefinition::EmitBatch(AActor* master, double chance, double angle, double pitch, double speed, const DVector3* offsets, const DVector3* velocities, int count, int flags, float scaleBoost, float additionalAngleScale, float additionalAngleChance)
+{
+	// The batch size is fixed by the caller, so the extra INSANE tries don't apply here
+	int numTries = count;
+	chance = GetEmitChance(master, chance, numTries, flags);
 
-				switch (cvarParticleLifespan->ToInt())
-				{
-					case 1:
-						p->life = (int16_t)roundf(p->life * LifeMultLow);
-						break;
-					case 2:
-						p->life = (int16_t)roundf(p->life * LifeMultMed);
-						break;
-					case 3:
-						p->life = (int16_t)roundf(p->life * LifeMultHigh);
-						break;
-					case 4:
-						p->life = (int16_t)roundf(p->life * LifeMultUlt) * 2;
-						break;
-					case 5:
-						p->life = (int16_t)roundf(p->life * LifeMultInsane);
-						break;
-					default:
-						p->life = (int16_t)roundf(p->life * LifeMultHigh);
-						break;
-				}
+	if (master)
+	{
+		if ((flags & PE_ABSOLUTE_ANGLE) == 0) angle += master->Angles.Yaw.Degrees();
+		if ((flags & PE_ABSOLUTE_PITCH) == 0) pitch += master->Angles.Pitch.Degrees();
+	}
 
-				if (particleLifetimeModifier > 0) p->life = (int16_t)(p->life * particleLifetimeModifier);
-			}
-			else 
-			{
-				p->life = -1;
-			}
+	int lifespanSetting = GetLifespanSetting();
 
-			p->startLife = p->life;
+	for (int x = 0; x < count; x++)
+	{
+		if (flags & PE_IGNORE_CHANCE || randomEmit() / 256.0 <= chance)
+		{
+			DVector3 velocity = velocities ? velocities[x] : DVector3(0, 0, 0);
 
-			// Set bounces
-			if (MinRandomBounces >= MaxRandomBounces) 
+			if (!EmitParticle(master, angle, pitch, speed, offsets[x], velocity, flags, scaleBoost, 0, 0, additionalAngleScale, additionalAngleChance, lifespanSetting))
 			{
-				p->maxBounces = ParticleRandom(randomBounce, MinRandomBounces, MaxRandomBounces);
-			}
-			else 
-			{
-				p->maxBounces = -1;
+				return;
 			}
-
-			//if (returnAr) 
-			//{
-			//	returnAr.push(p);
-			//}
-
-			CallOnCreateParticle(p);
 		}
 	}
 }
@@ -1134,11 +1250,53 @@ void DParticleDefinition::CallInit()
 	}
 }
 
+// Checks which of the particle virtuals this definition overrides, so the
+// ones that are left at their defaults can skip the VM entirely.
+void DParticleDefinition::CacheScriptHooks()
+{
+	static const struct { const char* name; uint32_t hook; } hooks[] =
+	{
+		{ "OnCreateParticle", PSH_CREATE },
+		{ "ThinkParticle", PSH_THINK },
+		{ "OnParticleBounce", PSH_BOUNCE },
+		{ "OnParticleDeath", PSH_DEATH },
+		{ "OnParticleSleep", PSH_SLEEP },
+		{ "OnParticleCollideWithPlayer", PSH_COLLIDEWITHPLAYER },
+		{ "OnParticleEnterWater", PSH_ENTERWATER },
+		{ "OnParticleExitWater", PSH_EXITWATER },
+	};
+
+	PClass* base = RUNTIME_CLASS(DParticleDefinition);
+	PClass* cls = GetClass();
+
+	ScriptHooks = 0;
+	for (auto& hook : hooks)
+	{
+		unsigned index = GetVirtualIndex(base, hook.name);
+		if (index == ~0u)
+		{
+			continue;
+		}
+
+		VMFunction* orig = index < base->Virtuals.Size() ? base->Virtuals[index] : nullptr;
+		VMFunction* func = index < cls->Virtuals.Size() ? cls->Virtuals[index] : nullptr;
+		if (func != nullptr && func != orig)
+		{
+			ScriptHooks |= hook.hook;
+		}
+	}
+}
+
 void DParticleDefinition::CallOnCreateParticle(particledata_t* particle)
 {
+	if (!HasScriptHook(PSH_CREATE))
+	{
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnCreateParticle)
 	{
-		VMValue params[] = { this, particle };
+		VMValue params[] = { this, particle, particle->master };
 		VMCall(func, params, 3, nullptr, 0);
 	}
 }
@@ -1147,6 +1305,11 @@ bool DParticleDefinition::CallOnParticleDeath(particledata_t* particle)
 {
 	int result = true;
 
+	if (!HasScriptHook(PSH_DEATH))
+	{
+		return result;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnParticleDeath)
 	{
 		VMValue params[] = { this, particle };
@@ -1160,6 +1323,11 @@ bool DParticleDefinition::CallOnParticleDeath(particledata_t* particle)
 
 void DParticleDefinition::CallThinkParticle(particledata_t* particle)
 {
+	if (!NeedsScriptThink())
+	{
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, ThinkParticle)
 	{
 		VMValue params[] = { this, particle };
@@ -1169,6 +1337,12 @@ void DParticleDefinition::CallThinkParticle(particledata_t* particle)
 
 void DParticleDefinition::CallOnParticleBounce(particledata_t* particle)
 {
+	if (!HasScriptHook(PSH_BOUNCE))
+	{
+		OnParticleBounce(particle);
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnParticleBounce)
 	{
 		VMValue params[] = { this, particle };
@@ -1182,6 +1356,11 @@ void DParticleDefinition::CallOnParticleBounce(particledata_t* particle)
 
 void DParticleDefinition::CallOnParticleSleep(particledata_t* particle)
 {
+	if (!HasScriptHook(PSH_SLEEP))
+	{
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnParticleSleep)
 	{
 		VMValue params[] = { this, particle };
@@ -1191,6 +1370,11 @@ void DParticleDefinition::CallOnParticleSleep(particledata_t* particle)
 
 void DParticleDefinition::CallOnParticleCollideWithPlayer(particledata_t* particle, AActor* player)
 {
+	if (!HasScriptHook(PSH_COLLIDEWITHPLAYER))
+	{
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnParticleCollideWithPlayer)
 	{
 		VMValue params[] = { this, particle, player };
@@ -1200,6 +1384,11 @@ void DParticleDefinition::CallOnParticleCollideWithPlayer(particledata_t* partic
 
 void DParticleDefinition::CallOnParticleEnterWater(particledata_t* particle, double surfaceHeight)
 {
+	if (!HasScriptHook(PSH_ENTERWATER))
+	{
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnParticleEnterWater)
 	{
 		VMValue params[] = { this, particle, surfaceHeight };
@@ -1209,6 +1398,11 @@ void DParticleDefinition::CallOnParticleEnterWater(particledata_t* particle, dou
 
 void DParticleDefinition::CallOnParticleExitWater(particledata_t* particle, double surfaceHeight)
 {
+	if (!HasScriptHook(PSH_EXITWATER))
+	{
+		return;
+	}
+
 	IFVIRTUAL(DParticleDefinition, OnParticleExitWater)
 	{
 		VMValue params[] = { this, particle, surfaceHeight };
@@ -1543,6 +1737,7 @@ void P_InitParticleDefinitions(FLevelLocals* Level)
 			definition->cvarParticleLifespan = FindCVar("r_particlelifespan", nullptr);
 			definition->cvarBloodQuality = FindCVar("r_bloodquality", nullptr);
 			definition->CallInit();
+			definition->CacheScriptHooks();
 
 			Level->ParticleDefinitionsByType.Insert(cls->TypeName.GetIndex(), definition);
 		}
@@ -1713,6 +1908,79 @@ bool P_DestroyDefinedParticle(FLevelLocals* Level, int particleIndex)
 	return true;
 }
 
+static void P_IntegrateDefinedParticleRange(particledata_t* particles, const uint16_t* indices, unsigned count)
+{
+	for (unsigned n = 0; n < count; n++)
+	{
+		particledata_t& particle = particles[indices[n]];
+
+		particle.prevpos = particle.pos;
+#ifndef NO_SSE
+		_mm_storeu_ps(&particle.alpha, _mm_add_ps(_mm_loadu_ps(&particle.alpha), _mm_loadu_ps(&particle.alphaStep)));
+#else
+		particle.alpha += particle.alphaStep;
+		particle.angle += particle.angleStep;
+		particle.pitch += particle.pitchStep;
+		particle.roll += particle.rollStep;
+#endif
+		particle.scale = FVector2(particle.scale.X * particle.scaleStep.X, particle.scale.Y * particle.scaleStep.Y);
+		particle.preintegrated = true;
+	}
+}
+
+// Applies the per-tic alpha, scale and rotation steps up front for every particle that
+// doesn't have to go through ThinkParticle first. These don't depend on the world or on
+// any other particle, so they can be spread across threads, leaving only the collision
+// and script work for the serial loop in P_ThinkDefinedParticles.
+static void P_IntegrateDefinedParticles(FLevelLocals* Level, particlelevelpool_t* pool)
+{
+	TArray<uint16_t>& list = pool->IntegrateList;
+	bool frozen = Level->isFrozen();
+
+	list.Clear();
+	for (int i = pool->ActiveParticles; i != NO_PARTICLE; i = pool->Particles[i].tnext)
+	{
+		particledata_t& particle = pool->Particles[i];
+		DParticleDefinition* definition = particle.definition;
+
+		if (frozen && !(particle.flags & DPF_NOTIMEFREEZE))
+		{
+			continue;
+		}
+
+		if (particle.sleepFor > 0 || !definition || definition->NeedsScriptThink())
+		{
+			continue;
+		}
+
+		// OnParticleDeath gets to see the particle before this tic's steps are applied
+		if (((particle.life >= 0 && particle.life <= 1) || particle.HasFlag(DPF_DESTROYED)) && definition->HasScriptHook(PSH_DEATH))
+		{
+			continue;
+		}
+
+		list.Push(i);
+	}
+
+	unsigned count = list.Size();
+	particledata_t* particles = pool->Particles.Data();
+	const uint16_t* indices = list.Data();
+
+	if (count < PARALLEL_INTEGRATE_MIN)
+	{
+		P_IntegrateDefinedParticleRange(particles, indices, count);
+		return;
+	}
+
+	parallel_for((int)count, PARALLEL_INTEGRATE_CHUNK, [=](int start)
+	{
+		if ((unsigned)start < count)
+		{
+			P_IntegrateDefinedParticleRange(particles, indices + start, min<unsigned>(PARALLEL_INTEGRATE_CHUNK, count - start));
+		}
+	});
+}
+
 void P_ThinkDefinedParticles(FLevelLocals* Level)
 {
 	particlelevelpool_t* pool = &Level->DefinedParticlePool;
@@ -1726,6 +1994,8 @@ void P_ThinkDefinedParticles(FLevelLocals* Level)
 		P_ResizeDefinedParticlePool(Level, particleLimit);
 	}
 
+	P_IntegrateDefinedParticles(Level, pool);
+
 	int i = pool->ActiveParticles;
 	particledata_t* particle = nullptr;
 	while (i != NO_PARTICLE)
@@ -1740,7 +2010,13 @@ void P_ThinkDefinedParticles(FLevelLocals* Level)
 			continue;
 		}
 
-		particle->prevpos = particle->pos;
+		bool preintegrated = particle->preintegrated;
+		particle->preintegrated = false;
+
+		if (!preintegrated)
+		{
+			particle->prevpos = particle->pos;
+		}
 		float prevFloorZ = particle->floorz;
 
 		if (particle->sleepFor > 0)
@@ -1819,11 +2095,14 @@ void P_ThinkDefinedParticles(FLevelLocals* Level)
 			}
 		}
 
-		particle->alpha += particle->alphaStep;
-		particle->scale = FVector2(particle->scale.X * particle->scaleStep.X, particle->scale.Y * particle->scaleStep.Y);
-		particle->angle += particle->angleStep;
-		particle->pitch += particle->pitchStep;
-		particle->roll += particle->rollStep;
+		if (!preintegrated)
+		{
+			particle->alpha += particle->alphaStep;
+			particle->scale = FVector2(particle->scale.X * particle->scaleStep.X, particle->scale.Y * particle->scaleStep.Y);
+			particle->angle += particle->angleStep;
+			particle->pitch += particle->pitchStep;
+			particle->roll += particle->rollStep;
+		}
 
 		// Handle crossing a line portal
 		double movex = (particle->pos.X - particle->prevpos.X) + particle->vel.X;
@@ -2117,6 +2396,11 @@ particledata_t* P_SpawnDefinedParticle(FLevelLocals* Level, DParticleDefinition*
 
 static FLevelLocals* ParticleDefinitionLoadingLevel = nullptr;
 
+// 0: every field is written and the angle is stored under the first of two "pitch" keys
+// 1: only fields that differ from the spawn state are written, the angle has its own key
+enum { PARTICLE_SAVE_VERSION = 1 };
+static int ParticleLoadingVersion = PARTICLE_SAVE_VERSION;
+
 void P_LoadDefinedParticles(FSerializer& arc, FLevelLocals* Level, const char* key)
 {
 	assert(arc.isReading());
@@ -2157,6 +2441,10 @@ FSerializer& Serialize(FSerializer& arc, const char* key, particlelevelpool_t& l
 {
 	if (arc.BeginObject(key))
 	{
+		int version = arc.isWriting() ? PARTICLE_SAVE_VERSION : 0;
+		arc("version", version);
+		ParticleLoadingVersion = version;
+
 		if (arc.BeginArray("particles"))
 		{
 			if (arc.isWriting())
@@ -2202,16 +2490,32 @@ FSerializer& Serialize(FSerializer& arc, const char* key, particlelevelpool_t& l
 	return arc;
 }
 
+//==========================================================================
+//
+// Only what differs from a freshly spawned particle of the same definition
+// gets written, which leaves out most fields of a typical particle. When
+// reading, the particle is reset to those values first.
+//
+//==========================================================================
+
 FSerializer& Serialize(FSerializer& arc, const char* key, particledata_t& p, particledata_t* def)
 {
 	if (arc.BeginObject(key))
 	{
+		particledata_t base = {};
+		particledata_t* d = nullptr;
+
 		if (arc.isWriting())
 		{
 			FName definitionName;
 			if (p.definition)
 			{
 				definitionName = p.definition->GetClass()->TypeName;
+				base.definition = p.definition;
+				base.InitDefaults();
+				base.prevpos = p.pos;
+				base.startScale = p.scale;
+				d = &base;
 			}
 
 			arc("definition", definitionName);
@@ -2224,6 +2528,7 @@ FSerializer& Serialize(FSerializer& arc, const char* key, particledata_t& p, par
 			if (DParticleDefinition** definition = ParticleDefinitionLoadingLevel->ParticleDefinitionsByType.CheckKey(definitionName.GetIndex()))
 			{
 				p.definition = *definition;
+				p.InitDefaults();
 			}
 			else
 			{
@@ -2232,37 +2537,55 @@ FSerializer& Serialize(FSerializer& arc, const char* key, particledata_t& p, par
 		}
 
 		arc ("master", p.master)
-			("renderStyle", p.renderStyle)
-		    ("life", p.life)
-			("startLife", p.startLife)
-			("prevpos", p.prevpos)
+			("renderStyle", p.renderStyle, d ? &d->renderStyle : nullptr)
+			("life", p.life, d ? &d->life : nullptr)
+			("startLife", p.startLife, d ? &d->startLife : nullptr)
 			("pos", p.pos)
-			("vel", p.vel)
-			("alpha", p.alpha)
-			("alphastep", p.alphaStep)
-			("scale", p.scale)
-			("scalestep", p.scaleStep)
-			("startScale", p.startScale)
-			("pitch", p.angle)
-			("pitchstep", p.angleStep)
-			("pitch", p.pitch)
-			("pitchstep", p.pitchStep)
-			("roll", p.roll)
-			("rollstep", p.rollStep)
-			("bounces", p.bounces)
-			("maxbounces", p.maxBounces)
+			("vel", p.vel, d ? &d->vel : nullptr)
+			("alpha", p.alpha, d ? &d->alpha : nullptr)
+			("alphastep", p.alphaStep, d ? &d->alphaStep : nullptr)
+			("scale", p.scale, d ? &d->scale : nullptr);
+
+		// These default to the values just read.
+		if (arc.isReading())
+		{
+			p.prevpos = p.pos;
+			p.startScale = p.scale;
+		}
+
+		if (arc.isReading() && ParticleLoadingVersion < 1)
+		{
+			// The first "pitch" key is the one that gets found, and it holds the angle. The pitch itself is lost.
+			arc("pitch", p.angle)
+				("pitchstep", p.angleStep);
+		}
+		else
+		{
+			arc("angle", p.angle, d ? &d->angle : nullptr)
+				("anglestep", p.angleStep, d ? &d->angleStep : nullptr)
+				("pitch", p.pitch, d ? &d->pitch : nullptr)
+				("pitchstep", p.pitchStep, d ? &d->pitchStep : nullptr);
+		}
+
+		arc ("prevpos", p.prevpos, d ? &d->prevpos : nullptr)
+			("scalestep", p.scaleStep, d ? &d->scaleStep : nullptr)
+			("startScale", p.startScale, d ? &d->startScale : nullptr)
+			("roll", p.roll, d ? &d->roll : nullptr)
+			("rollstep", p.rollStep, d ? &d->rollStep : nullptr)
+			("bounces", p.bounces, d ? &d->bounces : nullptr)
+			("maxbounces", p.maxBounces, d ? &d->maxBounces : nullptr)
 			("floorz", p.floorz)
 			("ceilingz", p.ceilingz)
-			("color", p.color)
+			("color", p.color, d ? &d->color : nullptr)
 			("texture", p.texture)
-			("animframe", p.animFrame)
-			("animTick", p.animTick)
-			("invalidateTicks", p.invalidateTicks)
+			("animframe", p.animFrame, d ? &d->animFrame : nullptr)
+			("animTick", p.animTick, d ? &d->animTick : nullptr)
+			("invalidateTicks", p.invalidateTicks, d ? &d->invalidateTicks : nullptr)
 			("flags", p.flags)
-			("user1", p.user1)
-			("user2", p.user2)
-			("user3", p.user3)
-			("user4", p.user4)
+			("user1", p.user1, d ? &d->user1 : nullptr)
+			("user2", p.user2, d ? &d->user2 : nullptr)
+			("user3", p.user3, d ? &d->user3 : nullptr)
+			("user4", p.user4, d ? &d->user4 : nullptr)
 			// Deliberately not saving tprev or tnext, since they're calculated during load
 			// Deliberately not saving subsector or snext, since they're calculated every frame.
 			.EndObject();
@@ -91,13 +91,12 @@ struct particledata_t
 	DVector3 pos;								// +24
 	DVector3 vel;								// +24
 	float gravity;								// +4
-	float alpha, alphaStep;						// +8 
+	// alpha/angle/pitch/roll and their steps are kept contiguous so they can be integrated as one vector
+	float alpha, angle, pitch, roll;			// +16
+	float alphaStep, angleStep, pitchStep, rollStep;	// +16
 	float fadeAlpha;							// +4
 	FVector2 scale, scaleStep, startScale;		// +24
 	FVector2 fadeScale;							// +8
-	float angle, angleStep;						// +8
-	float pitch, pitchStep;						// +8
-	float roll, rollStep;						// +8 
 	int16_t bounces, maxBounces;				// +4
 	float floorz, ceilingz;						// +8
 	secplane_t* restplane;						// +8
@@ -109,10 +108,12 @@ struct particledata_t
 	uint32_t flags;								// +4 
 	int user1, user2, user3, user4;				// +16
 	uint16_t tnext, tprev;						// +4 
+	bool preintegrated;							// +1 Set by the parallel integration pass, consumed by the serial think
 
 	subsector_t* subsector;						// +8 
 	uint16_t snext;								// +2 
 
+	void InitDefaults();
 	void Init(FLevelLocals* Level, DVector3 initialPos);
 
 	bool CheckWater(double* outSurfaceHeight);
@@ -128,6 +129,20 @@ struct particledata_t
 	void ClearFlag(int flag) { flags &= ~flag; }
 };
 
+// Script virtuals a definition actually overrides. Anything not in this mask is handled natively
+// without a VM round trip, and particles whose definition has no PSH_THINK can be integrated in parallel.
+enum EParticleScriptHooks
+{
+	PSH_CREATE					= 1 << 0,
+	PSH_THINK					= 1 << 1,
+	PSH_BOUNCE					= 1 << 2,
+	PSH_DEATH					= 1 << 3,
+	PSH_SLEEP					= 1 << 4,
+	PSH_COLLIDEWITHPLAYER		= 1 << 5,
+	PSH_ENTERWATER				= 1 << 6,
+	PSH_EXITWATER				= 1 << 7,
+};
+
 struct particleanimsequence_t
 {
 	uint8_t startFrame;
@@ -209,8 +224,13 @@ public:
 	TArray<particleanimframe_t> AnimationFrames;
 
 	void Emit(AActor* master, double chance, int numTries, double angle, double pitch, double speed, DVector3 offset, DVector3 velocity, int flags, float scaleBoost, int particleSpawnOffsets, float particleLifetimeModifier, float additionalAngleScale, float additionalAngleChance);
+	void EmitBatch(AActor* master, double chance, double angle, double pitch, double speed, const DVector3* offsets, const DVector3* velocities, int count, int flags, float scaleBoost, float additionalAngleScale, float additionalAngleChance);
+	bool EmitParticle(AActor* master, double angle, double pitch, double speed, const DVector3& offset, const DVector3& velocity, int flags, float scaleBoost, int particleSpawnOffsets, float particleLifetimeModifier, float additionalAngleScale, float additionalAngleChance, int lifespanSetting);
+	double GetEmitChance(AActor* master, double chance, int& numTries, int flags);
+	int GetLifespanSetting();
 
 	void CallInit();
+	void CacheScriptHooks();
 	void CallOnCreateParticle(particledata_t* particle);
 	bool CallOnParticleDeath(particledata_t* particle);
 	void CallThinkParticle(particledata_t* particle);
@@ -236,7 +256,11 @@ public:
 	void SetFlag(EParticleDefinitionFlags flag) { Flags |= flag; }
 	void ClearFlag(EParticleDefinitionFlags flag) { Flags &= ~flag; }
 
+	bool HasScriptHook(EParticleScriptHooks hook) const { return ScriptHooks & hook; }
+	bool NeedsScriptThink() const { return HasScriptHook(PSH_THINK) && !HasFlag(PDF_NOTHINK); }
+
 	FLevelLocals* Level;
+	uint32_t ScriptHooks = ~0u;		// Filled in by CacheScriptHooks, assume everything is overridden until then
 	FBaseCVar* cvarParticleIntensity;
 	FBaseCVar* cvarParticleLifespan;
 	FBaseCVar* cvarBloodQuality;
@@ -252,6 +276,7 @@ struct particlelevelpool_t
 	uint32_t					ActiveParticles;
 	uint32_t					InactiveParticles;
 	TArray<particledata_t>		Particles;
+	TArray<uint16_t>			IntegrateList;	// Scratch list for the parallel integration pass, rebuilt every tic
 };
 
 inline particledata_t* NewDefinedParticle(FLevelLocals* Level, DParticleDefinition* definition, bool replace = false);
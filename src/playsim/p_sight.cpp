@@ -36,6 +36,7 @@
 
 #include "g_levellocals.h"
 #include "actorinlines.h"
+#include "parallel_for.h"
 
 static FRandom pr_botchecksight ("BotCheckSight");
 static FRandom pr_checksight ("CheckSight");
@@ -51,7 +52,6 @@ This uses specialized forms of the maputils routines for optimized performance
 */
 
 // Performance meters
-static int sightcounts[6];
 static cycle_t SightCycles;
 static cycle_t MaxSightCycles;
 
@@ -87,12 +87,113 @@ struct SightTask
 };
 
 
-static TArray<intercept_t> intercepts (128);
-static TArray<SightTask> portals(32);
+//==========================================================================
+//
+// SightContext
+//
+// Scratch state for one thread's sight checks. Lines and polyobjects are
+// marked with a per-context stamp instead of the global validcount so that
+// several traversals can run against the same level at once.
+//
+//==========================================================================
+
+struct SightContext
+{
+	TArray<intercept_t> intercepts;
+	TArray<SightTask> portals;
+	TArray<int> lineStamps;
+	TArray<int> polyStamps;
+	int stamp = 0;
+	int counts[6] = {};
+
+	SightContext() : intercepts(128), portals(32) {}
+
+	void NewStamp(FLevelLocals *Level)
+	{
+		if (lineStamps.Size() != Level->lines.Size() || polyStamps.Size() != Level->Polyobjects.Size() || stamp == INT_MAX)
+		{
+			lineStamps.Resize(Level->lines.Size());
+			polyStamps.Resize(Level->Polyobjects.Size());
+			if (lineStamps.Size() > 0) memset(lineStamps.Data(), 0, lineStamps.Size() * sizeof(int));
+			if (polyStamps.Size() > 0) memset(polyStamps.Data(), 0, polyStamps.Size() * sizeof(int));
+			stamp = 0;
+		}
+		stamp++;
+	}
+};
+
+// Used by P_CheckSight and by batches too small to be worth splitting.
+static SightContext MainSight;
+static TArray<SightContext> BatchSight;
+
+enum
+{
+	SIGHT_BATCH_CHUNK = 16,		// minimum number of traces handed to one worker
+	SIGHT_BATCH_MAXSLOTS = 16,	// upper bound on worker contexts (each holds a stamp per line)
+};
+
+//==========================================================================
+//
+// Sight cache
+//
+// Remembers traversal results for the current tic. A trace only depends
+// on the level geometry and on the positions and heights of both actors,
+// so those form the key and a recycled actor pointer cannot produce a
+// stale hit. Moving planes and polyobjects invalidate the whole cache,
+// and P_ResetSightCounters empties it at the start of every tic.
+//
+// Only the traversal is cached. The precheck still runs every time
+// because the stealth check consumes a random number.
+//
+//==========================================================================
+
+struct SightCacheEntry
+{
+	FLevelLocals *Level;
+	AActor *t1, *t2;
+	DVector3 pos1, pos2;
+	double height1, height2;
+	int flags;
+	int stamp;
+	bool result;
+};
+
+enum
+{
+	SIGHT_CACHE_SIZE = 256,		// must be a power of 2
+};
+
+static SightCacheEntry SightCache[SIGHT_CACHE_SIZE];
+static int SightCacheStamp = 1;
+static int sightcachehits, sightcachemisses;
+
+static SightCacheEntry &P_SightCacheSlot(AActor *t1, AActor *t2, int flags)
+{
+	size_t hash = (size_t(uintptr_t(t1)) >> 4) * 31 + (size_t(uintptr_t(t2)) >> 4) + size_t(flags);
+	hash ^= hash >> 8;
+	return SightCache[hash & (SIGHT_CACHE_SIZE - 1)];
+}
+
+static bool P_SightCacheMatches(const SightCacheEntry &entry, AActor *t1, AActor *t2, int flags)
+{
+	return entry.stamp == SightCacheStamp && entry.t1 == t1 && entry.t2 == t2 && entry.flags == flags &&
+		entry.Level == t1->Level && entry.pos1 == t1->Pos() && entry.pos2 == t2->Pos() &&
+		entry.height1 == t1->Height && entry.height2 == t2->Height;
+}
+
+void P_InvalidateSightCache()
+{
+	if (++SightCacheStamp == INT_MAX)
+	{
+		memset(SightCache, 0, sizeof(SightCache));
+		SightCacheStamp = 1;
+	}
+}
 
 class SightCheck
 {
 	FLevelLocals *Level;
+	SightContext &ctx;
 	DVector3 sightstart;
 	DVector2 sightend;
 	double Startfrac;
@@ -117,7 +218,7 @@ class SightCheck
 	bool LineBlocksSight(line_t *ld);
 
 public:
-	SightCheck(FLevelLocals *l)
+	SightCheck(FLevelLocals *l, SightContext &c) : ctx(c)
 	{
 		Level = l;
 	}
@@ -279,16 +380,16 @@ bool SightCheck::PTR_SightTraverse (intercept_t *in)
 
 		if (portaldir != sector_t::floor && (open.portalflags & SO_TOPBACK) && !(open.portalflags & SO_TOPFRONT))
 		{
-			portals.Push({ in->frac, topslope, bottomslope, sector_t::ceiling, backsec->GetOppositePortalGroup(sector_t::ceiling) });
+			ctx.portals.Push({ in->frac, topslope, bottomslope, sector_t::ceiling, backsec->GetOppositePortalGroup(sector_t::ceiling) });
 		}
 		if (portaldir != sector_t::ceiling && (open.portalflags & SO_BOTTOMBACK) && !(open.portalflags & SO_BOTTOMFRONT))
 		{
-			portals.Push({ in->frac, topslope, bottomslope, sector_t::floor, backsec->GetOppositePortalGroup(sector_t::floor) });
+			ctx.portals.Push({ in->frac, topslope, bottomslope, sector_t::floor, backsec->GetOppositePortalGroup(sector_t::floor) });
 		}
 	}
 	if (lport != nullptr && lport->mDestination != nullptr)
 	{
-		portals.Push({ in->frac, topslope, bottomslope, portaldir, lport->mDestination->frontsector->PortalGroup });
+		ctx.portals.Push({ in->frac, topslope, bottomslope, portaldir, lport->mDestination->frontsector->PortalGroup });
 		return false;
 	}
 
@@ -441,11 +542,12 @@ bool SightCheck::P_SightCheckLine (line_t *ld)
 {
 	divline_t dl;
 
-	if (ld->validcount == validcount)
+	int &linestamp = ctx.lineStamps[ld->Index()];
+	if (linestamp == ctx.stamp)
 	{
 		return true;
 	}
-	ld->validcount = validcount;
+	linestamp = ctx.stamp;
 	if (P_PointOnDivlineSide (ld->v1->fPos(), &Trace) ==
 		P_PointOnDivlineSide (ld->v2->fPos(), &Trace))
 	{
@@ -463,12 +565,12 @@ bool SightCheck::P_SightCheckLine (line_t *ld)
 		if (LineBlocksSight(ld)) return false;
 	}
 
-	sightcounts[3]++;
+	ctx.counts[3]++;
 	// store the line for later intersection testing
 	intercept_t newintercept;
 	newintercept.isaline = true;
 	newintercept.d.line = ld;
-	intercepts.Push (newintercept);
+	ctx.intercepts.Push (newintercept);
 
 	return true;
 }
@@ -502,9 +604,10 @@ int SightCheck::P_SightBlockLinesIterator (int x, int y)
 	{
 		if (polyLink->polyobj)
 		{ // only check non-empty links
-			if (polyLink->polyobj->validcount != validcount)
+			int &polystamp = ctx.polyStamps[unsigned(polyLink->polyobj - &Level->Polyobjects[0])];
+			if (polystamp != ctx.stamp)
 			{
-				polyLink->polyobj->validcount = validcount;
+				polystamp = ctx.stamp;
 				for (i = 0; i < polyLink->polyobj->Linedefs.Size(); i++)
 				{
 					if (!P_SightCheckLine(polyLink->polyobj->Linedefs[i]))
@@ -547,6 +650,7 @@ bool SightCheck::P_SightTraverseIntercepts ()
 	unsigned scanpos;
 	divline_t dl;
 
+	auto &intercepts = ctx.intercepts;
 	count = intercepts.Size ();
 //
 // calculate intercept distance
@@ -634,8 +738,8 @@ bool SightCheck::P_SightPathTraverse ()
 	int mapx, mapy, mapxstep, mapystep;
 	int count;
 
-	validcount++;
-	intercepts.Clear ();
+	ctx.NewStamp(Level);
+	ctx.intercepts.Clear ();
 	x1 = sightstart.X + Startfrac * Trace.dx;
 	y1 = sightstart.Y + Startfrac * Trace.dy;
 	x2 = sightend.X;
@@ -667,11 +771,11 @@ bool SightCheck::P_SightPathTraverse ()
 	// We also must check if the starting sector contains  portals, and start sight checks in those as well.
 	if (portaldir != sector_t::floor && checkceiling && !lastsector->PortalBlocksSight(sector_t::ceiling))
 	{
-		portals.Push({ 0, topslope, bottomslope, sector_t::ceiling, lastsector->GetOppositePortalGroup(sector_t::ceiling) });
+		ctx.portals.Push({ 0, topslope, bottomslope, sector_t::ceiling, lastsector->GetOppositePortalGroup(sector_t::ceiling) });
 	}
 	if (portaldir != sector_t::ceiling && checkfloor && !lastsector->PortalBlocksSight(sector_t::floor))
 	{
-		portals.Push({ 0, topslope, bottomslope, sector_t::floor, lastsector->GetOppositePortalGroup(sector_t::floor) });
+		ctx.portals.Push({ 0, topslope, bottomslope, sector_t::floor, lastsector->GetOppositePortalGroup(sector_t::floor) });
 	}
 
 	x1 -= Level->blockmap.bmaporgx;
@@ -767,7 +871,7 @@ bool SightCheck::P_SightPathTraverse ()
 		itres = P_SightBlockLinesIterator(mapx, mapy);
 		if (itres == 0)
 		{
-			sightcounts[1]++;
+			ctx.counts[1]++;
 			return false;	// early out
 		}
 
@@ -778,7 +882,7 @@ bool SightCheck::P_SightPathTraverse ()
 		switch (((xs_FloorToInt(yintercept) == mapy) << 1) | (xs_FloorToInt(xintercept) == mapx))
 		{
 		case 0:		// neither xintercept nor yintercept match!
-sightcounts[5]++;
+ctx.counts[5]++;
 			// Continuing won't make things any better, so we might as well stop right here
 			return false;
 
@@ -797,7 +901,7 @@ sightcounts[5]++;
 			break;
 
 		case 3:		// xintercept and yintercept both match
-			sightcounts[4]++;
+			ctx.counts[4]++;
 			// The trace is exiting a block through its corner. Not only does the block
 			// being entered need to be checked (which will happen when this loop
 			// continues), but the other two blocks adjacent to the corner also need to
@@ -805,7 +909,7 @@ sightcounts[5]++;
 			if (!P_SightBlockLinesIterator (mapx + mapxstep, mapy) ||
 				!P_SightBlockLinesIterator (mapx, mapy + mapystep))
 			{
-sightcounts[1]++;
+ctx.counts[1]++;
 				return false;
 			}
 			xintercept += xstep;
@@ -824,7 +928,7 @@ sightcounts[1]++;
 //
 // couldn't early out, so go through the sorted list
 //
-sightcounts[2]++;
+ctx.counts[2]++;
 
 	bool traverseres = P_SightTraverseIntercepts ( );
 	if (itres == -1) return false;	// if the iterator had an early out there was no line of sight. The traverser was only called to collect more portals.
@@ -835,27 +939,17 @@ sightcounts[2]++;
 /*
 =====================
 =
-= P_CheckSight
+= P_SightPrecheck
 =
-= Returns true if a straight line between t1 and t2 is unobstructed
-= look from eyes of t1 to any part of t2
-=
-= killough 4/20/98: cleaned up, made to use new LOS struct
+= The cheap rejections of P_CheckSight. This consumes random numbers
+= so it always runs on the calling thread, in query order.
+= Returns false if t1 certainly cannot see t2.
 =
 =====================
 */
 
-int P_CheckSight (AActor *t1, AActor *t2, int flags)
+static bool P_SightPrecheck (SightContext &ctx, AActor *t1, AActor *t2, int flags)
 {
-	SightCycles.Clock();
-
-	bool res;
-
-	if (t1 == nullptr || t2 == nullptr)
-	{
-		return false;
-	}
-
 	if ((t2->flags9 & MF9_MVISBLOCKED) && !(flags & SF_IGNOREVISIBILITY))
 	{
 		return false;
@@ -868,9 +962,8 @@ int P_CheckSight (AActor *t1, AActor *t2, int flags)
 	//
 	if (!t1->Level->CheckReject(s1, s2))
 	{
-sightcounts[0]++;
-		res = false;			// can't possibly be connected
-		goto done;
+ctx.counts[0]++;
+		return false;			// can't possibly be connected
 	}
 
 //
@@ -885,8 +978,7 @@ sightcounts[0]++;
 	{ // small chance of an attack being made anyway
 		if ((t1->Level->BotInfo.m_Thinking ? pr_botchecksight() : pr_checksight()) > 50)
 		{
-			res = false;
-			goto done;
+			return false;
 		}
 	}
 
@@ -906,56 +998,177 @@ sightcounts[0]++;
 			  (t2->Z() >= s2->heightsec->ceilingplane.ZatPoint(t2) &&
 			   t1->Top() <= s2->heightsec->ceilingplane.ZatPoint(t1)))))
 		{
-			res = false;
-			goto done;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+=====================
+=
+= P_SightTrace
+=
+= Looks from the eyes of t1 to any part of t2. Only reads level data
+= and writes to the passed context, so it may run on a worker thread.
+=
+=====================
+*/
+
+static bool P_SightTrace (SightContext &ctx, AActor *t1, AActor *t2, int flags)
+{
+	sector_t *sec;
+	double lookheight = t1->Z() + t1->Height*0.75;
+	t1->GetPortalTransition(lookheight, &sec);
+
+	double bottomslope = t2->Z() - lookheight;
+	double topslope = bottomslope + t2->Height;
+	SightTask task = { 0, topslope, bottomslope, -1, sec->PortalGroup };
+
+	ctx.portals.Clear();
+	SightCheck s(t1->Level, ctx);
+	s.init(t1, t2, sec, &task, flags);
+	if (s.P_SightPathTraverse ())
+	{
+		return true;
+	}
+
+	double dist = t1->Distance2D(t2);
+	for (unsigned i = 0; i < ctx.portals.Size(); i++)
+	{
+		ctx.portals[i].Frac += 1 / dist;
+		s.init(t1, t2, NULL, &ctx.portals[i], flags);
+		if (s.P_SightPathTraverse())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+=====================
+=
+= P_CheckSight
+=
+= Returns true if a straight line between t1 and t2 is unobstructed
+= look from eyes of t1 to any part of t2
+=
+= killough 4/20/98: cleaned up, made to use new LOS struct
+=
+=====================
+*/
+
+int P_CheckSight (AActor *t1, AActor *t2, int flags)
+{
+	if (t1 == nullptr || t2 == nullptr)
+	{
+		return false;
+	}
+
+	SightCycles.Clock();
+	bool res = P_SightPrecheck(MainSight, t1, t2, flags);
+	if (res)
+	{
+		auto &entry = P_SightCacheSlot(t1, t2, flags);
+		if (P_SightCacheMatches(entry, t1, t2, flags))
+		{
+			sightcachehits++;
+			res = entry.result;
+		}
+		else
+		{
+			sightcachemisses++;
+			res = P_SightTrace(MainSight, t1, t2, flags);
+			entry = { t1->Level, t1, t2, t1->Pos(), t2->Pos(), t1->Height, t2->Height, flags, SightCacheStamp, res };
 		}
 	}
+	SightCycles.Unclock();
+	return res;
+}
+
+/*
+=====================
+=
+= P_CheckSightBatch
+=
+= Resolves a list of sight queries in one go. The rejection checks run
+= in query order on the calling thread because they may consume random
+= numbers; the remaining traversals are spread over worker threads.
+= Nothing may modify the level while this runs, which holds as long as
+= it is called from the game or render thread.
+=
+= Results are identical to calling P_CheckSight for each query in turn.
+= This bypasses the sight cache since the renderer calls it while
+= sector planes are interpolated.
+=
+=====================
+*/
 
-	// An unobstructed LOS is possible.
-	// Now look from eyes of t1 to any part of t2.
+void P_CheckSightBatch (FSightQuery *queries, unsigned count)
+{
+	SightCycles.Clock();
 
-	validcount++;
-	portals.Clear();
+	TArray<unsigned> pending(count);
+	for (unsigned i = 0; i < count; i++)
 	{
-		sector_t *sec;
-		double lookheight = t1->Z() + t1->Height*0.75;
-		t1->GetPortalTransition(lookheight, &sec);
+		auto &q = queries[i];
+		q.Result = q.Looker != nullptr && q.Target != nullptr && P_SightPrecheck(MainSight, q.Looker, q.Target, q.Flags);
+		if (q.Result) pending.Push(i);
+	}
 
-		double bottomslope = t2->Z() - lookheight;
-		double topslope = bottomslope + t2->Height;
-		SightTask task = { 0, topslope, bottomslope, -1, sec->PortalGroup };
+	unsigned numpending = pending.Size();
+	if (numpending < 2 * SIGHT_BATCH_CHUNK)
+	{
+		for (auto i : pending)
+		{
+			queries[i].Result = P_SightTrace(MainSight, queries[i].Looker, queries[i].Target, queries[i].Flags);
+		}
+	}
+	else
+	{
+		unsigned chunk = max<unsigned>(SIGHT_BATCH_CHUNK, (numpending + SIGHT_BATCH_MAXSLOTS - 1) / SIGHT_BATCH_MAXSLOTS);
+		unsigned numslots = (numpending + chunk - 1) / chunk;
+		if (BatchSight.Size() < numslots) BatchSight.Resize(numslots);
 
+		parallel_for(0u, numpending, chunk, [&](unsigned start)
+		{
+			if (start >= numpending) return;
+			auto &ctx = BatchSight[start / chunk];
+			unsigned end = min(start + chunk, numpending);
+			for (unsigned p = start; p < end; p++)
+			{
+				auto &q = queries[pending[p]];
+				q.Result = P_SightTrace(ctx, q.Looker, q.Target, q.Flags);
+			}
+		});
 
-		SightCheck s(t1->Level);
-		s.init(t1, t2, sec, &task, flags);
-		res = s.P_SightPathTraverse ();
-		if (!res)
+		for (unsigned i = 0; i < numslots; i++)
 		{
-			double dist = t1->Distance2D(t2);
-			for (unsigned i = 0; i < portals.Size(); i++)
+			for (int c = 0; c < 6; c++)
 			{
-				portals[i].Frac += 1 / dist;
-				s.init(t1, t2, NULL, &portals[i], flags);
-				if (s.P_SightPathTraverse())
-				{
-					res = true;
-					break;
-				}
+				MainSight.counts[c] += BatchSight[i].counts[c];
+				BatchSight[i].counts[c] = 0;
 			}
 		}
 	}
 
-done:
 	SightCycles.Unclock();
-	return res;
+}
+
+void P_CheckSightBatch (TArray<FSightQuery> &queries)
+{
+	P_CheckSightBatch(queries.Data(), queries.Size());
 }
 
 ADD_STAT (sight)
 {
 	FString out;
-	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d\n",
+	int lookups = sightcachehits + sightcachemisses;
+	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d, cache %d hit %d miss (%.0f%%)\n",
 		SightCycles.TimeMS(), MaxSightCycles.TimeMS(),
-		sightcounts[3], sightcounts[0], sightcounts[1], sightcounts[2], sightcounts[4], sightcounts[5]);
+		MainSight.counts[3], MainSight.counts[0], MainSight.counts[1], MainSight.counts[2], MainSight.counts[4], MainSight.counts[5],
+		sightcachehits, sightcachemisses, lookups > 0 ? sightcachehits * 100. / lookups : 0.);
 	return out;
 }
 
@@ -970,5 +1183,7 @@ void P_ResetSightCounters (bool full)
 		MaxSightCycles = SightCycles;
 	}
 	SightCycles.Reset();
-	memset (sightcounts, 0, sizeof(sightcounts));
+	memset (MainSight.counts, 0, sizeof(MainSight.counts));
+	sightcachehits = sightcachemisses = 0;
+	P_InvalidateSightCache();
 }
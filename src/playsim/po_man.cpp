@@ -861,6 +861,7 @@ void FPolyObj::CalcCenter()
 bool FPolyObj::MovePolyobj (const DVector2 &pos, bool force)
 {
 	FBoundingBox oldbounds = Bounds;
+	P_InvalidateSightCache();
 	UnLinkPolyobj ();
 	DoMovePolyobj (pos);
 
@@ -941,6 +942,7 @@ bool FPolyObj::RotatePolyobj (DAngle angle, bool fromsave)
 	bool blocked;
 	FBoundingBox oldbounds = Bounds;
 
+	P_InvalidateSightCache();
 	an = Angle + angle;
 
 	UnLinkPolyobj();
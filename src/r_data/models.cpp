@@ -395,7 +395,8 @@ void RenderFrameModels(FModelRenderer *renderer, FLevelLocals *Level, const FSpr
 
 	TArray<FTextureID> surfaceskinids;
 
-	TArray<VSMatrix> boneData;
+	static const TArray<VSMatrix> noBones;
+	const TArray<VSMatrix> *boneData = &noBones;	// points into the model's pose cache
 	int boneStartingPosition = 0;
 	bool evaluatedSingle = false;
 
@@ -542,14 +543,14 @@ void RenderFrameModels(FModelRenderer *renderer, FLevelLocals *Level, const FSpr
 					{
 						if(decoupled_main_frame != -1)
 						{
-							boneData = animation->CalculateBones(decoupled_main_frame, decoupled_next_frame, inter, decoupled_main_prev_frame, inter_main, decoupled_next_prev_frame, inter_next, animationData, actor->boneComponentData, i);
+							boneData = &animation->CalculateBones(decoupled_main_frame, decoupled_next_frame, inter, decoupled_main_prev_frame, inter_main, decoupled_next_prev_frame, inter_next, animationData, actor->boneComponentData, i);
 						}
 					}
 					else
 					{
-						boneData = animation->CalculateBones(modelframe, modelframenext, nextFrame ? inter : -1.f, 0, -1.f, 0, -1.f, animationData, actor->boneComponentData, i);
+						boneData = &animation->CalculateBones(modelframe, modelframenext, nextFrame ? inter : -1.f, 0, -1.f, 0, -1.f, animationData, actor->boneComponentData, i);
 					}
-					boneStartingPosition = renderer->SetupFrame(animation, 0, 0, 0, boneData, -1);
+					boneStartingPosition = renderer->SetupFrame(animation, 0, 0, 0, *boneData, -1);
 					evaluatedSingle = true;
 				}
 				else
@@ -558,19 +559,19 @@ void RenderFrameModels(FModelRenderer *renderer, FLevelLocals *Level, const FSpr
 					{
 						if(decoupled_main_frame != -1)
 						{
-							boneData = mdl->CalculateBones(decoupled_main_frame, decoupled_next_frame, inter, decoupled_main_prev_frame, inter_main, decoupled_next_prev_frame, inter_next, nullptr, actor->boneComponentData, i);
+							boneData = &mdl->CalculateBones(decoupled_main_frame, decoupled_next_frame, inter, decoupled_main_prev_frame, inter_main, decoupled_next_prev_frame, inter_next, nullptr, actor->boneComponentData, i);
 						}
 					}
 					else
 					{
-						boneData = mdl->CalculateBones(modelframe, modelframenext, nextFrame ? inter : -1.f, 0, -1.f, 0, -1.f, nullptr, actor->boneComponentData, i);
+						boneData = &mdl->CalculateBones(modelframe, modelframenext, nextFrame ? inter : -1.f, 0, -1.f, 0, -1.f, nullptr, actor->boneComponentData, i);
 					}
-					boneStartingPosition = renderer->SetupFrame(mdl, 0, 0, 0, boneData, -1);
+					boneStartingPosition = renderer->SetupFrame(mdl, 0, 0, 0, *boneData, -1);
 					evaluatedSingle = true;
 				}
 			}
 
-			mdl->RenderFrame(renderer, tex, modelframe, nextFrame ? modelframenext : modelframe, nextFrame ? inter : -1.f, translation, ssidp, boneData, boneStartingPosition);
+			mdl->RenderFrame(renderer, tex, modelframe, nextFrame ? modelframenext : modelframe, nextFrame ? inter : -1.f, translation, ssidp, *boneData, boneStartingPosition);
 		}
 	}
 }
@@ -416,6 +416,9 @@ void hw_PrecacheTexture(uint8_t *texhitlist, TMap<PClassActor*, bool> &actorhitl
 
 		FImageSource::BeginPrecaching();
 
+		// @Cockatrice - Lumps of everything that gets uploaded, so their reads and decompression can be done in one parallel batch
+		TArray<int> prefetchLumps;
+
 		// cache all used images
 		for (int i = cnt - 1; i >= 0; i--)
 		{
@@ -429,6 +432,7 @@ void hw_PrecacheTexture(uint8_t *texhitlist, TMap<PClassActor*, bool> &actorhitl
 					if (tex->GetImage() && tex->GetHardwareTexture(0, flags) == nullptr)
 					{
 						FImageSource::RegisterForPrecache(tex->GetImage(), V_IsTrueColor());
+						if (tex->GetImage()->LumpNum() >= 0) prefetchLumps.Push(tex->GetImage()->LumpNum());
 					}
 				}
 
@@ -436,9 +440,11 @@ void hw_PrecacheTexture(uint8_t *texhitlist, TMap<PClassActor*, bool> &actorhitl
 				if (spritehitlist[i] != nullptr && (*spritehitlist[i]).CheckKey(0))
 				{
 					FImageSource::RegisterForPrecache(tex->GetImage(), V_IsTrueColor());
+					if (tex->GetImage()->LumpNum() >= 0) prefetchLumps.Push(tex->GetImage()->LumpNum());
 				}
 			}
 		}
+		fileSystem.PrefetchLumps(prefetchLumps.Data(), prefetchLumps.Size());
 
 		// cache all used textures
 		for (int i = cnt - 1; i >= 0; i--)
@@ -460,6 +466,14 @@ void hw_PrecacheTexture(uint8_t *texhitlist, TMap<PClassActor*, bool> &actorhitl
 
 		// cache all used models
 		FModelRenderer* renderer = new FHWModelRenderer(nullptr, *screen->RenderState(), -1);
+		prefetchLumps.Clear();
+		for (unsigned i = 0; i < Models.Size(); i++)
+		{
+			if (modellist[i] && Models[i]->GetVertexBuffer(renderer->GetType()) == nullptr && Models[i]->GetLumpNum() >= 0)
+				prefetchLumps.Push(Models[i]->GetLumpNum());
+		}
+		fileSystem.PrefetchLumps(prefetchLumps.Data(), prefetchLumps.Size());
+
 		for (unsigned i = 0; i < Models.Size(); i++)
 		{
 			if (modellist[i]) 
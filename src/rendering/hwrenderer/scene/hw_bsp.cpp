@@ -49,12 +49,18 @@
 #endif // ARCH_IA32
 
 CVAR(Bool, gl_multithread, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CUSTOM_CVAR(Int, gl_multithread_workers, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)	// 0 = pick from the number of cores
+{
+	if (self < 0) self = 0;
+	else if (self > MAX_RENDER_WORKERS) self = MAX_RENDER_WORKERS;
+}
 
 EXTERN_CVAR(Float, r_actorspriteshadowdist)
 EXTERN_CVAR(Bool, r_radarclipper)
 EXTERN_CVAR(Bool, r_dithertransparency)
 
 thread_local bool isWorkerThread;
+thread_local int RenderWorkerLane;
 ctpl::thread_pool renderPool(4);
 bool inited = false;
 
@@ -85,13 +91,31 @@ struct RenderJob
 	int type;
 	subsector_t *sub;
 	seg_t *seg;
+
+	// Walls, sprites and portals always stay on the first worker because they share
+	// the portal list and line portal processing moves actors around temporarily.
+	// Flats and particles only write to their own draw lists so they can be split off.
+	static int Lane(int type, int numlanes)
+	{
+		if (numlanes == 1) return 0;
+		switch (type)
+		{
+		case FlatJob:
+			return 1;
+		case ParticleJob:
+		case ParticlePoolJob:
+			return numlanes - 1;
+		default:
+			return 0;
+		}
+	}
 };
 
 
 class RenderJobQueue
 {
 	RenderJob pool[300000];	// Way more than ever needed. The largest ever seen on a single viewpoint is around 40000.
-	std::atomic<int> readindex{};
+	std::atomic<int> readindex[MAX_RENDER_WORKERS] = {};	// every worker reads the whole stream and picks out its own jobs.
 	std::atomic<int> writeindex{};
 public:
 	void AddJob(int type, subsector_t *sub, seg_t *seg = nullptr)
@@ -102,31 +126,33 @@ public:
 		writeindex++;	// update index only after the value has been written.
 	}
 
-	RenderJob *GetJob()
+	RenderJob *GetJob(int lane)
 	{
-		if (readindex < writeindex) return &pool[readindex++];
+		if (readindex[lane] < writeindex) return &pool[readindex[lane]++];
 		return nullptr;
 	}
 	
 	void ReleaseAll()
 	{
-		readindex = 0;
+		for (auto &index : readindex) index = 0;
 		writeindex = 0;
 	}
 };
 
 static RenderJobQueue jobQueue;	// One static queue is sufficient here. This code will never be called recursively.
 
-void HWDrawInfo::WorkerThread()
+void HWDrawInfo::WorkerThread(int lane, int numlanes)
 {
 	sector_t *front, *back;
 	HWWallDispatcher disp(this);
 
-	WTTotal.Clock();
+	if (lane == 0) WTTotal.Clock();
+	WTWorkerTotal[lane].Clock();
 	isWorkerThread = true;	// for adding asserts in GL API code. The worker thread may never call any GL API.
+	RenderWorkerLane = lane;
 	while (true)
 	{
-		auto job = jobQueue.GetJob();
+		auto job = jobQueue.GetJob(lane);
 		if (job == nullptr)
 		{
 #ifdef ARCH_IA32
@@ -143,15 +169,25 @@ void HWDrawInfo::WorkerThread()
 			_mm_pause();
 			_mm_pause();
 #endif // ARCH_IA32
+			continue;
 		}
-		// Note that the main thread MUST have prepared the fake sectors that get used below!
-		// This worker thread cannot prepare them itself without costly synchronization.
-		else switch (job->type)
+		if (job->type == RenderJob::TerminateJob)
 		{
-		case RenderJob::TerminateJob:
-			WTTotal.Unclock();
+			RenderWorkerLane = 0;
+			WTWorkerTotal[lane].Unclock();
+			if (lane == 0) WTTotal.Unclock();
 			return;
+		}
+		if (RenderJob::Lane(job->type, numlanes) != lane)
+		{
+			continue;
+		}
 
+		// Note that the main thread MUST have prepared the fake sectors that get used below!
+		// This worker thread cannot prepare them itself without costly synchronization.
+		WTWorkerBusy[lane].Clock();
+		switch (job->type)
+		{
 		case RenderJob::WallJob:
 		{
 			HWWall wall;
@@ -210,22 +246,46 @@ void HWDrawInfo::WorkerThread()
 			break;
 
 		case RenderJob::ParticleJob:
-			SetupSprite.Clock();
+			// SetupSprite belongs to the first worker. A separate particle worker is only timed by its own clocks.
+			if (lane == 0) SetupSprite.Clock();
 			front = hw_FakeFlat(job->sub->sector, in_area, false);
 			RenderParticles(job->sub, front);
-			SetupSprite.Unclock();
+			if (lane == 0) SetupSprite.Unclock();
 			break;
 
 		case RenderJob::ParticlePoolJob:
+			if (lane == 0) SetupSprite.Clock();
 			front = hw_FakeFlat(job->sub->sector, in_area, false);
 			RenderDefinedParticles(job->sub, front);
+			if (lane == 0) SetupSprite.Unclock();
 			break;
 
 		case RenderJob::PortalJob:
 			AddSubsectorToPortal((FSectorPortalGroup *)job->seg, job->sub);
 			break;
 		}
+		WTWorkerBusy[lane].Unclock();
+	}
+}
 
+//==========================================================================
+//
+// Appends the draw lists of the additional workers to the main lists.
+// This always happens in worker order so the result does not depend on
+// thread timing.
+//
+//==========================================================================
+
+void HWDrawInfo::MergeWorkerLists(int numlanes)
+{
+	for (int lane = 1; lane < numlanes; lane++)
+	{
+		for (int i = 0; i < GLDL_TYPES; i++)
+		{
+			drawlists[i].Append(workerlists[lane - 1][i]);
+		}
+		rendered_sprites += workersprites[lane - 1];
+		workersprites[lane - 1] = 0;
 	}
 }
 
@@ -662,7 +722,6 @@ void HWDrawInfo::RenderThings(subsector_t * sub, sector_t * sector)
 
 void HWDrawInfo::RenderParticles(subsector_t *sub, sector_t *front)
 {
-	SetupSprite.Clock();
 	for (uint32_t i = 0; i < sub->sprites.Size(); i++)
 	{
 		DVisualThinker *sp = sub->sprites[i];
@@ -689,14 +748,10 @@ void HWDrawInfo::RenderParticles(subsector_t *sub, sector_t *front)
 		HWSprite sprite;
 		sprite.ProcessParticle(this, &Level->Particles[i], front, nullptr);
 	}
-	
-	SetupSprite.Unclock();
 }
 
 void HWDrawInfo::RenderDefinedParticles(subsector_t* sub, sector_t* front)
 {
-	SetupSprite.Clock();
-
 	for (int i = Level->DefinedParticlesInSubsec[sub->Index()]; i != NO_PARTICLE; i = Level->DefinedParticlePool.Particles[i].snext)
 	{
 		particledata_t& particle = Level->DefinedParticlePool.Particles[i];
@@ -710,8 +765,6 @@ void HWDrawInfo::RenderDefinedParticles(subsector_t* sub, sector_t* front)
 		HWSprite sprite;
 		sprite.ProcessDefinedParticle(this, &particle, front);
 	}
-
-	SetupSprite.Unclock();
 }
 
 
@@ -1072,18 +1125,30 @@ void HWDrawInfo::RenderBSP(void *node, bool drawpsprites)
 	multithread = gl_multithread;
 	if (multithread)
 	{
+		int numlanes = gl_multithread_workers;
+		if (numlanes == 0) numlanes = clamp<int>(std::thread::hardware_concurrency() - 1, 1, MAX_RENDER_WORKERS);
+		WTWorkerCount = numlanes;
+
 		jobQueue.ReleaseAll();
-		auto future = renderPool.push([&](int id) {
-			WorkerThread();
-		});
+		std::future<void> futures[MAX_RENDER_WORKERS];
+		for (int lane = 0; lane < numlanes; lane++)
+		{
+			futures[lane] = renderPool.push([=](int id) {
+				WorkerThread(lane, numlanes);
+			});
+		}
 		if (Viewpoint.IsOrtho() && ((Level->flags3 & LEVEL3_NOFOGOFWAR) || !r_radarclipper)) RenderOrthoNoFog();
 		else RenderBSPNode(node);
 
 		jobQueue.AddJob(RenderJob::TerminateJob, nullptr, nullptr);
 		Bsp.Unclock();
 		MTWait.Clock();
-		future.wait();
+		for (int lane = 0; lane < numlanes; lane++)
+		{
+			futures[lane].wait();
+		}
 		MTWait.Unclock();
+		MergeWorkerLists(numlanes);
 	}
 	else
 	{
@@ -1093,12 +1158,22 @@ void HWDrawInfo::RenderBSP(void *node, bool drawpsprites)
 	}
 
 	// Make rendered targets set dither transparency flags on level geometry for next pass
-	// Can't do this inside DoSubsector() because both Trace() and P_CheckSight() affect 'validcount' global variable
+	// Can't do this inside DoSubsector() because Trace() affects the 'validcount' global variable
+	FSightQuery ditherQueries[MAXDITHERACTORS];
+	int numDitherQueries = 0;
 	for (int ii = 0; ii < MAXDITHERACTORS; ii++)
 	{
-		if ( RenderedTargets[ii] && P_CheckSight(players[consoleplayer].mo, RenderedTargets[ii], 0) )
+		if (RenderedTargets[ii])
+		{
+			ditherQueries[numDitherQueries++] = { players[consoleplayer].mo, RenderedTargets[ii], 0, false };
+		}
+	}
+	P_CheckSightBatch(ditherQueries, numDitherQueries);
+	for (int ii = 0; ii < numDitherQueries; ii++)
+	{
+		if (ditherQueries[ii].Result)
 		{
-			SetDitherTransFlags(RenderedTargets[ii]);
+			SetDitherTransFlags(ditherQueries[ii].Target);
 		}
 	}
 
@@ -44,6 +44,7 @@
 #include "hw_bonebuffer.h"
 #include "hw_vrmodes.h"
 #include "hw_clipper.h"
+#include "hw_lightclusters.h"
 #include "v_draw.h"
 #include "a_corona.h"
 #include "texturemanager.h"
@@ -182,6 +183,7 @@ void HWDrawInfo::StartScene(FRenderViewpoint &parentvp, HWViewpointUniforms *uni
 	ClearBuffers();
 
 	for (int i = 0; i < GLDL_TYPES; i++) drawlists[i].Reset();
+	for (auto &lists : workerlists) for (auto &list : lists) list.Reset();
 	hudsprites.Clear();
 //	Coronas.Clear();
 	vpIndex = 0;
@@ -471,6 +473,12 @@ void HWDrawInfo::CreateScene(bool drawpsprites)
 
 	ProcessAll.Clock();
 
+	// Portals are rendered in the same frame so they can use the main view's light clusters.
+	if (outer == nullptr)
+	{
+		LightClusters.Build(Level, Viewpoint.TicFrac, !isFullbrightScene());
+	}
+
 	// clip the scene and fill the drawlists
 	screen->mVertexData->Map();
 	screen->mLights->Map();
@@ -514,11 +522,11 @@ void HWDrawInfo::RenderScene(FRenderState &state)
 
 	if (gl_sort_textures)
 	{
-		drawlists[GLDL_PLAINWALLS].SortWalls();
+		drawlists[GLDL_PLAINWALLS].SortWalls(this);
 		drawlists[GLDL_PLAINFLATS].SortFlats();
-		drawlists[GLDL_MASKEDWALLS].SortWalls();
+		drawlists[GLDL_MASKEDWALLS].SortWalls(this);
 		drawlists[GLDL_MASKEDFLATS].SortFlats();
-		drawlists[GLDL_MASKEDWALLSOFS].SortWalls();
+		drawlists[GLDL_MASKEDWALLSOFS].SortWalls(this);
 	}
 
 	// Part 1: solid geometry. This is set up so that there are no transparent parts
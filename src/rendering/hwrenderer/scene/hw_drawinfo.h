@@ -134,8 +134,11 @@ struct HWDrawInfo
 	bool isFullbrightScene() const { return !!(FullbrightFlags & Fullbright); }
 	bool isNightvision() const { return !!(FullbrightFlags & Nightvision); }
 	bool isStealthVision() const { return !!(FullbrightFlags & StealthVision); }
+	void CountSprite();
     
 	HWDrawList drawlists[GLDL_TYPES];
+	HWDrawList workerlists[MAX_RENDER_WORKERS - 1][GLDL_TYPES];	// filled by the flat and particle workers, merged into drawlists after the BSP walk.
+	int workersprites[MAX_RENDER_WORKERS - 1] = {};				// rendered_sprites of those workers, added to it along with the lists.
 	int vpIndex;
 	ELightMode lightmode;
 
@@ -194,7 +197,9 @@ private:
 	subsector_t *currentsubsector;	// used by the line processing code.
 	sector_t *currentsector;
 
-	void WorkerThread();
+	void WorkerThread(int lane, int numlanes);
+	void MergeWorkerLists(int numlanes);
+	HWDrawList *CurrentDrawLists() { return RenderWorkerLane > 0 ? workerlists[RenderWorkerLane - 1] : drawlists; }
 
 	void UnclipSubsector(subsector_t *sub);
 	
@@ -291,7 +296,7 @@ public:
 	void AddOtherFloorPlane(int sector, gl_subsectorrendernode * node);
 	void AddOtherCeilingPlane(int sector, gl_subsectorrendernode * node);
 
-	void GetDynSpriteLight(AActor *self, float x, float y, float z, FLightNode *node, int portalgroup, float *out);
+	void GetDynSpriteLight(AActor *self, float x, float y, float z, FSection *section, int portalgroup, float *out);
 	void GetDynSpriteLight(AActor *thing, HWSprite* particleSprite, float *out);
 
 	void PreparePlayerSprites(sector_t * viewsector, area_t in_area);
@@ -40,10 +40,17 @@
 #include "hw_walldispatcher.h"
 
 FMemArena RenderDataAllocator(1024*1024);	// Use large blocks to reduce allocation time.
+static FMemArena WorkerDataAllocator[MAX_RENDER_WORKERS - 1] = { 1024*1024, 1024*1024 };
+
+FMemArena &CurrentRenderDataAllocator()
+{
+	return RenderWorkerLane > 0 ? WorkerDataAllocator[RenderWorkerLane - 1] : RenderDataAllocator;
+}
 
 void ResetRenderDataAllocator()
 {
 	RenderDataAllocator.FreeAll();
+	for (auto &arena : WorkerDataAllocator) arena.FreeAll();
 }
 
 //==========================================================================
@@ -721,23 +728,93 @@ void HWDrawList::Sort(HWDrawInfo *di)
 
 //==========================================================================
 //
-// Sorting the drawitems first by texture and then by light level
+// Sorting the opaque lists
+//
+// Only state changes matter here, not the drawing order, so every item
+// gets a packed 64 bit key and the list is put in order with an LSD
+// radix sort. Bytes that are the same for all keys are skipped.
+//
+// Key layout, from most to least significant:
+// texture index (24 bits), render flags/style (8 bits),
+// light level (8 bits), unused (8 bits), depth bucket (16 bits).
 //
 //==========================================================================
 
-void HWDrawList::SortWalls()
+struct HWSortKey
+{
+	uint64_t key;
+	HWDrawItem item;
+};
+
+static TArray<HWSortKey> SortKeys, SortKeysTemp;	// only used by the main thread
+
+static uint64_t TextureSortKey(FGameTexture *tex)
+{
+	return tex == nullptr ? 0 : uint64_t((tex->GetID().GetIndex() + 1) & 0xffffff) << 40;
+}
+
+static uint64_t LightSortKey(int lightlevel)
+{
+	return uint64_t(clamp(lightlevel, 0, 255)) << 24;
+}
+
+static void RadixSortKeys(TArray<HWSortKey> &keys, TArray<HWSortKey> &temp)
+{
+	unsigned count = keys.Size();
+	unsigned histogram[8][256] = {};
+
+	for (auto &k : keys)
+	{
+		for (int b = 0; b < 8; b++) histogram[b][(k.key >> (b * 8)) & 255]++;
+	}
+
+	temp.Resize(count);
+	HWSortKey *src = keys.Data(), *dst = temp.Data();
+	for (int b = 0; b < 8; b++)
+	{
+		int shift = b * 8;
+		unsigned *h = histogram[b];
+		if (h[(src[0].key >> shift) & 255] == count) continue;
+
+		unsigned sum = 0;
+		for (int i = 0; i < 256; i++)
+		{
+			unsigned c = h[i];
+			h[i] = sum;
+			sum += c;
+		}
+		for (unsigned i = 0; i < count; i++)
+		{
+			dst[h[(src[i].key >> shift) & 255]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+	if (src != keys.Data()) memcpy(keys.Data(), src, count * sizeof(HWSortKey));
+}
+
+void HWDrawList::SortWalls(HWDrawInfo *di)
 {
 	if (drawitems.Size() > 1)
 	{
-		std::sort(drawitems.begin(), drawitems.end(), [=](const HWDrawItem &a, const HWDrawItem &b) -> bool
+		float vx = (float)di->Viewpoint.Pos.X, vy = (float)di->Viewpoint.Pos.Y;
+
+		SortKeys.Resize(drawitems.Size());
+		for (unsigned i = 0; i < drawitems.Size(); i++)
 		{
-			HWWall * w1 = walls[a.index];
-			HWWall * w2 = walls[b.index];
+			HWWall *w = walls[drawitems[i].index];
 
-			if (w1->texture != w2->texture) return w1->texture < w2->texture;
-			return (w1->flags & 3) < (w2->flags & 3);
+			// The bit pattern of a positive float orders the same as its value, so the top 16 bits make a logarithmic depth bucket.
+			float dx = (w->glseg.x1 + w->glseg.x2) * 0.5f - vx;
+			float dy = (w->glseg.y1 + w->glseg.y2) * 0.5f - vy;
+			float dist = dx * dx + dy * dy;
+			uint32_t distbits;
+			memcpy(&distbits, &dist, sizeof(distbits));
 
-		});
+			SortKeys[i].key = TextureSortKey(w->texture) | (uint64_t(w->flags & 3) << 32) | LightSortKey(w->lightlevel) | (distbits >> 16);
+			SortKeys[i].item = drawitems[i];
+		}
+		RadixSortKeys(SortKeys, SortKeysTemp);
+		for (unsigned i = 0; i < drawitems.Size(); i++) drawitems[i] = SortKeys[i].item;
 	}
 }
 
@@ -745,12 +822,15 @@ void HWDrawList::SortFlats()
 {
 	if (drawitems.Size() > 1)
 	{
-		std::sort(drawitems.begin(), drawitems.end(), [=](const HWDrawItem &a, const HWDrawItem &b)
+		SortKeys.Resize(drawitems.Size());
+		for (unsigned i = 0; i < drawitems.Size(); i++)
 		{
-			HWFlat * w1 = flats[a.index];
-			HWFlat* w2 = flats[b.index];
-			return w1->texture < w2->texture;
-		});
+			HWFlat *f = flats[drawitems[i].index];
+			SortKeys[i].key = TextureSortKey(f->texture) | (uint64_t(f->renderstyle & 255) << 32) | LightSortKey(f->lightlevel);
+			SortKeys[i].item = drawitems[i];
+		}
+		RadixSortKeys(SortKeys, SortKeysTemp);
+		for (unsigned i = 0; i < drawitems.Size(); i++) drawitems[i] = SortKeys[i].item;
 	}
 }
 
@@ -763,7 +843,7 @@ void HWDrawList::SortFlats()
 
 HWWall *HWDrawList::NewWall()
 {
-	auto wall = (HWWall*)RenderDataAllocator.Alloc(sizeof(HWWall));
+	auto wall = (HWWall*)CurrentRenderDataAllocator().Alloc(sizeof(HWWall));
 	drawitems.Push(HWDrawItem(DrawType_WALL, walls.Push(wall)));
 	return wall;
 }
@@ -775,7 +855,7 @@ HWWall *HWDrawList::NewWall()
 //==========================================================================
 HWFlat *HWDrawList::NewFlat()
 {
-	auto flat = (HWFlat*)RenderDataAllocator.Alloc(sizeof(HWFlat));
+	auto flat = (HWFlat*)CurrentRenderDataAllocator().Alloc(sizeof(HWFlat));
 	drawitems.Push(HWDrawItem(DrawType_FLAT,flats.Push(flat)));
 	return flat;
 }
@@ -787,11 +867,35 @@ HWFlat *HWDrawList::NewFlat()
 //==========================================================================
 HWSprite *HWDrawList::NewSprite()
 {	
-	auto sprite = (HWSprite*)RenderDataAllocator.Alloc(sizeof(HWSprite));
+	auto sprite = (HWSprite*)CurrentRenderDataAllocator().Alloc(sizeof(HWSprite));
 	drawitems.Push(HWDrawItem(DrawType_SPRITE, sprites.Push(sprite)));
 	return sprite;
 }
 
+//==========================================================================
+//
+// Moves all items of another list to the end of this one.
+// Used to merge the lists of the render workers after the BSP walk.
+//
+//==========================================================================
+void HWDrawList::Append(HWDrawList &other)
+{
+	int wallbase = walls.Size();
+	int flatbase = flats.Size();
+	int spritebase = sprites.Size();
+
+	walls.Append(other.walls);
+	flats.Append(other.flats);
+	sprites.Append(other.sprites);
+	drawitems.Grow(other.drawitems.Size());
+	for (auto &item : other.drawitems)
+	{
+		int base = item.rendertype == DrawType_WALL ? wallbase : item.rendertype == DrawType_FLAT ? flatbase : spritebase;
+		drawitems.Push(HWDrawItem(item.rendertype, item.index + base));
+	}
+	other.Reset();
+}
+
 //==========================================================================
 //
 //
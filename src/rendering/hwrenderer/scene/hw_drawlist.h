@@ -1,8 +1,11 @@
 #pragma once
 
 #include "memarena.h"
+#include "hw_clock.h"
 
 extern FMemArena RenderDataAllocator;
+extern thread_local int RenderWorkerLane;	// 0 on the main thread and the first render worker
+FMemArena &CurrentRenderDataAllocator();
 void ResetRenderDataAllocator();
 struct HWDrawInfo;
 class HWWall;
@@ -91,8 +94,9 @@ public:
 	HWWall *NewWall();
 	HWFlat *NewFlat();
 	HWSprite *NewSprite();
+	void Append(HWDrawList &other);
 	void Reset();
-	void SortWalls();
+	void SortWalls(HWDrawInfo *di);
 	void SortFlats();
 	
 	
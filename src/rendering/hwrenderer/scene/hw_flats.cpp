@@ -42,6 +42,7 @@
 #include "hw_lighting.h"
 #include "hw_material.h"
 #include "hwrenderer/scene/hw_drawinfo.h"
+#include "hwrenderer/scene/hw_lightclusters.h"
 #include "flatvertices.h"
 #include "hw_lightbuffer.h"
 #include "hw_drawstructs.h"
@@ -157,6 +158,12 @@ void HWFlat::SetupLights(HWDrawInfo *di, FLightNode * node, FDynLightData &light
 		dynlightindex = -1;
 		return;	// no lights on additively blended surfaces.
 	}
+	if (LightClusters.IsValid())
+	{
+		draw_dlightf += LightClusters.AddPlaneLights(lightdata, section, plane.plane, ceiling);
+		dynlightindex = screen->mLights->UploadLights(lightdata);
+		return;
+	}
 	while (node)
 	{
 		FDynamicLight * light = node->lightsource;
@@ -0,0 +1,418 @@
+//
+//---------------------------------------------------------------------------
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+//--------------------------------------------------------------------------
+//
+/*
+** hw_lightclusters.cpp
+** Clustered assignment of dynamic lights to walls, flats and sprites
+**
+*/
+
+#include "c_dispatch.h"
+#include "c_cvars.h"
+#include "stats.h"
+#include "printf.h"
+#include "a_dynlight.h"
+#include "g_levellocals.h"
+#include "actorinlines.h"
+#include "hw_lightclusters.h"
+#include "hw_drawstructs.h"
+
+CVAR(Bool, gl_light_clusters, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+
+HWLightClusters LightClusters;
+
+
+// Each thread needs its own stamps to avoid returning the same light twice when a box spans multiple clusters.
+static thread_local TArray<unsigned> CollectStamps;
+static thread_local unsigned CollectStamp;
+static thread_local unsigned CollectGeneration;
+static thread_local TArray<const HWClusterLight *> PlaneLights;
+
+//==========================================================================
+//
+// Surface links of the frame's lights
+//
+//==========================================================================
+
+void HWLightClusters::AddLink(const void *targ, unsigned light)
+{
+	unsigned mask = Links.Size() - 1;
+	for (unsigned i = HashLink(targ, light) & mask; ; i = (i + 1) & mask)
+	{
+		auto &entry = Links[i];
+		if (entry.targ == nullptr)
+		{
+			entry.targ = targ;
+			entry.light = light;
+			return;
+		}
+		if (entry.targ == targ && entry.light == light) return;
+	}
+}
+
+bool HWLightClusters::IsLinked(const void *targ, unsigned light) const
+{
+	unsigned mask = Links.Size() - 1;
+	for (unsigned i = HashLink(targ, light) & mask; ; i = (i + 1) & mask)
+	{
+		auto &entry = Links[i];
+		if (entry.targ == nullptr) return false;
+		if (entry.targ == targ && entry.light == light) return true;
+	}
+}
+
+//==========================================================================
+//
+// Builds the light table and the cluster grid for the current frame
+//
+//==========================================================================
+
+void HWLightClusters::Build(FLevelLocals *Level, double ticFrac, bool enable)
+{
+	valid = false;
+	numlights = 0;
+	queries = candidates = accepted = 0;
+
+	// Lights are looked up by their actual position so this cannot work with displaced portal groups.
+	if (!enable || !gl_light_clusters || !Level->HasDynamicLights || Level->Displacements.size > 0) return;
+
+	cycle_t ClusterBuildTime;
+	ClusterBuildTime.Reset();
+	ClusterBuildTime.Clock();
+
+	generation++;
+	Lights.Clear();
+
+	FDynLightData record;
+	FVector3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	unsigned numlinks = 0;
+
+	for (auto light = Level->lights; light; light = light->next)
+	{
+		float radius = light->GetRadius();
+		if (!light->IsActive() || radius <= 0.f || (light->touching_sector == nullptr && light->touching_sides == nullptr)) continue;
+
+		record.Clear();
+		AddLightToList(record, 0, light, false, ticFrac);
+
+		auto &cl = Lights[Lights.Reserve(1)];
+		cl.light = light;
+		cl.pos = FVector3(light->Pos);
+		cl.radius = radius;
+		cl.lightsurfaces = !light->DontLightMap();
+		cl.list = record.arrays[1].Size() > 0 ? 1 : record.arrays[2].Size() > 0 ? 2 : 0;
+		memcpy(cl.data, record.arrays[cl.list].Data(), sizeof(cl.data));
+
+		for (int i = 0; i < 3; i++)
+		{
+			mins[i] = min(mins[i], cl.pos[i] - radius);
+			maxs[i] = max(maxs[i], cl.pos[i] + radius);
+		}
+		for (auto node = light->touching_sector; node; node = node->nextTarget) numlinks++;
+		for (auto node = light->touching_sides; node; node = node->nextTarget) numlinks++;
+	}
+
+	numlights = Lights.Size();
+	if (numlights == 0)
+	{
+		ClusterBuildTime.Unclock();
+		buildtime = ClusterBuildTime.TimeMS();
+		return;
+	}
+
+	// Size the grid to the lights' bounds, growing the clusters if the level is too large for the maximum count.
+	origin = mins;
+	for (int i = 0; i < 3; i++)
+	{
+		float extent = max(maxs[i] - mins[i], 1.f);
+		int maxdim = i == 2 ? MAX_CLUSTERS_Z : MAX_CLUSTERS_XY;
+		float cellsize = max<float>(CLUSTER_SIZE, extent / maxdim);
+		dims[i] = clamp(int(ceilf(extent / cellsize)), 1, maxdim);
+		invCellSize[i] = 1.f / cellsize;
+	}
+
+	unsigned numcells = dims[0] * dims[1] * dims[2];
+	CellStart.Resize(numcells + 1);
+	memset(CellStart.Data(), 0, CellStart.Size() * sizeof(unsigned));
+
+	// Count the lights per cell first so that the cell lists can be packed into one array.
+	int lo[3], hi[3];
+	for (auto &cl : Lights)
+	{
+		CellRange(cl.pos - cl.radius, cl.pos + cl.radius, lo, hi);
+		for (int z = lo[2]; z <= hi[2]; z++)
+			for (int y = lo[1]; y <= hi[1]; y++)
+				for (int x = lo[0]; x <= hi[0]; x++)
+					CellStart[(z * dims[1] + y) * dims[0] + x + 1]++;
+	}
+	for (unsigned i = 0; i < numcells; i++)
+	{
+		CellStart[i + 1] += CellStart[i];
+	}
+	CellLights.Resize(CellStart[numcells]);
+	for (unsigned l = 0; l < Lights.Size(); l++)
+	{
+		auto &cl = Lights[l];
+		CellRange(cl.pos - cl.radius, cl.pos + cl.radius, lo, hi);
+		for (int z = lo[2]; z <= hi[2]; z++)
+			for (int y = lo[1]; y <= hi[1]; y++)
+				for (int x = lo[0]; x <= hi[0]; x++)
+					CellLights[CellStart[(z * dims[1] + y) * dims[0] + x]++] = l;
+	}
+	// The fill pass advanced every start to the next cell's start, so shift them back.
+	for (unsigned i = numcells; i > 0; i--)
+	{
+		CellStart[i] = CellStart[i - 1];
+	}
+	CellStart[0] = 0;
+
+	// Hash all section and sidedef links so that queries can reject lights whose flood did not reach the surface.
+	unsigned linksize = 16;
+	while (linksize < numlinks * 2) linksize <<= 1;
+	Links.Resize(linksize);
+	memset(Links.Data(), 0, Links.Size() * sizeof(LinkEntry));
+	for (unsigned l = 0; l < Lights.Size(); l++)
+	{
+		auto light = Lights[l].light;
+		for (auto node = light->touching_sector; node; node = node->nextTarget) AddLink(node->targ, l);
+		for (auto node = light->touching_sides; node; node = node->nextTarget) AddLink(node->targ, l);
+	}
+
+	valid = true;
+	ClusterBuildTime.Unclock();
+	buildtime = ClusterBuildTime.TimeMS();
+}
+
+//==========================================================================
+//
+// Returns false if the box does not touch the grid at all
+//
+//==========================================================================
+
+bool HWLightClusters::CellRange(const FVector3 &mins, const FVector3 &maxs, int *lo, int *hi) const
+{
+	for (int i = 0; i < 3; i++)
+	{
+		int l = int(floorf((mins[i] - origin[i]) * invCellSize[i]));
+		int h = int(floorf((maxs[i] - origin[i]) * invCellSize[i]));
+		if (h < 0 || l >= dims[i]) return false;
+		lo[i] = max(l, 0);
+		hi[i] = min(h, dims[i] - 1);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// Appends all lights linked to targ whose sphere touches the given box.
+// If 'surfaces' is set, lights that do not affect map geometry are skipped.
+//
+//==========================================================================
+
+void HWLightClusters::Collect(const void *targ, const FVector3 &mins, const FVector3 &maxs, TArray<const HWClusterLight *> &out, bool surfaces) const
+{
+	int lo[3], hi[3];
+
+	queries.fetch_add(1, std::memory_order_relaxed);
+	if (!valid || !CellRange(mins, maxs, lo, hi)) return;
+
+	auto &stamps = CollectStamps;
+	if (CollectGeneration != generation || stamps.Size() < Lights.Size() || ++CollectStamp == 0)
+	{
+		stamps.Resize(Lights.Size());
+		memset(stamps.Data(), 0, stamps.Size() * sizeof(unsigned));
+		CollectGeneration = generation;
+		CollectStamp = 1;
+	}
+	unsigned stamp = CollectStamp;
+	int numcandidates = 0, numaccepted = 0;
+
+	for (int z = lo[2]; z <= hi[2]; z++)
+	{
+		for (int y = lo[1]; y <= hi[1]; y++)
+		{
+			for (int x = lo[0]; x <= hi[0]; x++)
+			{
+				unsigned cell = (z * dims[1] + y) * dims[0] + x;
+				for (unsigned i = CellStart[cell]; i < CellStart[cell + 1]; i++)
+				{
+					unsigned l = CellLights[i];
+					if (stamps[l] == stamp) continue;
+					stamps[l] = stamp;
+
+					auto &cl = Lights[l];
+					if (surfaces && !cl.lightsurfaces) continue;
+					numcandidates++;
+
+					// sphere/box overlap
+					float dist = 0;
+					for (int a = 0; a < 3; a++)
+					{
+						float d = cl.pos[a] < mins[a] ? mins[a] - cl.pos[a] : cl.pos[a] > maxs[a] ? cl.pos[a] - maxs[a] : 0.f;
+						dist += d * d;
+					}
+					if (dist > cl.radius * cl.radius || !IsLinked(targ, l)) continue;
+
+					out.Push(&cl);
+					numaccepted++;
+				}
+			}
+		}
+	}
+	candidates.fetch_add(numcandidates, std::memory_order_relaxed);
+	accepted.fetch_add(numaccepted, std::memory_order_relaxed);
+}
+
+//==========================================================================
+//
+// Sets up the light list for a section's floor or ceiling.
+// This performs the same checks as HWFlat::SetupLights.
+//
+//==========================================================================
+
+int HWLightClusters::AddPlaneLights(FDynLightData &dld, FSection *section, const secplane_t &plane, bool ceiling) const
+{
+	auto &b = section->bounds;
+	float z1 = (float)plane.ZatPoint(b.left, b.top);
+	float z2 = (float)plane.ZatPoint(b.right, b.top);
+	float z3 = (float)plane.ZatPoint(b.left, b.bottom);
+	float z4 = (float)plane.ZatPoint(b.right, b.bottom);
+	FVector3 mins((float)b.left, (float)b.top, min(min(z1, z2), min(z3, z4)));
+	FVector3 maxs((float)b.right, (float)b.bottom, max(max(z1, z2), max(z3, z4)));
+
+	auto &found = PlaneLights;
+	found.Clear();
+	Collect(section, mins, maxs, found, true);
+
+	Plane p;
+	p.Set(plane.Normal(), plane.fD());
+
+	int added = 0;
+	for (auto cl : found)
+	{
+		// the light must be on the visible side of the plane
+		double planeh = plane.ZatPoint(cl->pos);
+		if ((planeh < cl->pos.Z && ceiling) || (planeh > cl->pos.Z && !ceiling)) continue;
+		if (fabsf(p.DistToPoint(cl->pos.X, cl->pos.Z, cl->pos.Y)) > cl->radius) continue;
+
+		AddToList(dld, *cl);
+		added++;
+	}
+	return added;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+ADD_STAT(lightclusters)
+{
+	FString out;
+	auto &lc = LightClusters;
+	if (!lc.IsValid())
+	{
+		out = "Light clusters inactive";
+	}
+	else
+	{
+		out.Format("Lights: %d, clusters: %dx%dx%d, build: %2.3f ms\nQueries: %d, candidates: %d, accepted: %d",
+			lc.numlights, lc.dims[0], lc.dims[1], lc.dims[2], lc.buildtime, lc.queries.load(), lc.candidates.load(), lc.accepted.load());
+	}
+	return out;
+}
+
+//==========================================================================
+//
+// Builds the light lists of all floors and ceilings in the level, once
+// by walking the sections' light nodes as HWFlat::SetupLights does without
+// clusters and once through the cluster grid, and reports the times.
+//
+//==========================================================================
+
+CCMD(benchlightlists)
+{
+	auto Level = primaryLevel;
+	int count = argv.argc() > 1 ? max(1, atoi(argv[1])) : 100;
+
+	if (Level == nullptr || !Level->HasDynamicLights)
+	{
+		Printf("No dynamic lights in the current level\n");
+		return;
+	}
+
+	HWLightClusters clusters;	// not the live grid, which the renderer uses for the current frame.
+	FDynLightData dld;
+	cycle_t buildTime, nodeTime, clusterTime;
+	int nodeLights = 0, clusterLights = 0;
+
+	buildTime.Reset();
+	nodeTime.Reset();
+	clusterTime.Reset();
+
+	for (int n = 0; n < count; n++)
+	{
+		buildTime.Clock();
+		clusters.Build(Level, 1., true);
+		buildTime.Unclock();
+
+		if (!clusters.IsValid())
+		{
+			Printf("Light clusters are not available for this level\n");
+			return;
+		}
+
+		nodeTime.Clock();
+		for (auto &section : Level->sections.allSections)
+		{
+			for (int ceiling = 0; ceiling < 2; ceiling++)
+			{
+				auto &plane = ceiling ? section.sector->ceilingplane : section.sector->floorplane;
+				Plane p;
+				p.Set(plane.Normal(), plane.fD());
+				dld.Clear();
+				for (auto node = section.lighthead; node; node = node->nextLight)
+				{
+					auto light = node->lightsource;
+					if (!light->IsActive() || light->DontLightMap()) continue;
+					double planeh = plane.ZatPoint(light->Pos);
+					if ((planeh < light->Z() && ceiling) || (planeh > light->Z() && !ceiling)) continue;
+					nodeLights += GetLight(dld, section.sector->PortalGroup, p, light, false, 1.);
+				}
+			}
+		}
+		nodeTime.Unclock();
+
+		clusterTime.Clock();
+		for (auto &section : Level->sections.allSections)
+		{
+			for (int ceiling = 0; ceiling < 2; ceiling++)
+			{
+				dld.Clear();
+				clusterLights += clusters.AddPlaneLights(dld, &section, ceiling ? section.sector->ceilingplane : section.sector->floorplane, !!ceiling);
+			}
+		}
+		clusterTime.Unclock();
+	}
+
+	Printf("%d passes over %u sections with %d lights\n", count, Level->sections.allSections.Size(), clusters.numlights);
+	Printf("Cluster build: %2.3f ms per pass\n", buildTime.TimeMS() / count);
+	Printf("Light nodes:   %2.3f ms per pass, %d lights assigned\n", nodeTime.TimeMS() / count, nodeLights / count);
+	Printf("Clusters:      %2.3f ms per pass, %d lights assigned\n", clusterTime.TimeMS() / count, clusterLights / count);
+}
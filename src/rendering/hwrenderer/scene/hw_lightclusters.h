@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include "tarray.h"
+#include "vectors.h"
+#include "hw_dynlightdata.h"
+
+struct FLevelLocals;
+struct FSection;
+struct secplane_t;
+class FDynamicLight;
+
+//==========================================================================
+//
+// Per-frame light data for one light that can be assigned to surfaces.
+// The buffer entry is computed once per frame instead of once per surface.
+//
+//==========================================================================
+
+struct HWClusterLight
+{
+	FDynamicLight *light;
+	FVector3 pos;			// current position, used for all range checks
+	float radius;
+	int list;				// which of FDynLightData's arrays this light goes into
+	bool lightsurfaces;		// false for lights that only affect actors
+	float data[16];			// the light's buffer entry, interpolated for the current frame
+};
+
+//==========================================================================
+//
+// World aligned 3D grid of all lights that are active in the current frame.
+//
+// Surfaces look up their lights in the clusters their bounding box touches
+// instead of testing everything that is linked to their section or sidedef.
+// A light is only returned for a surface if it is also linked to it, so
+// lights still cannot leak through walls their section flood did not pass.
+//
+// The grid is built on the main thread before the BSP is processed and is
+// read only afterward so render workers can query it without locking.
+//
+//==========================================================================
+
+class HWLightClusters
+{
+public:
+	enum
+	{
+		CLUSTER_SIZE = 256,
+		MAX_CLUSTERS_XY = 64,
+		MAX_CLUSTERS_Z = 16,
+	};
+
+	void Build(FLevelLocals *Level, double ticFrac, bool enable);
+	bool IsValid() const { return valid; }
+
+	void Collect(const void *targ, const FVector3 &mins, const FVector3 &maxs, TArray<const HWClusterLight *> &out, bool surfaces) const;
+	int AddPlaneLights(FDynLightData &dld, FSection *section, const secplane_t &plane, bool ceiling) const;
+
+	static void AddToList(FDynLightData &dld, const HWClusterLight &cl)
+	{
+		auto &array = dld.arrays[cl.list];
+		memcpy(&array[array.Reserve(16)], cl.data, sizeof(cl.data));
+	}
+
+	// statistics, collected from all render threads.
+	mutable std::atomic<int> queries, candidates, accepted;
+	int numlights = 0;
+	int dims[3] = {};
+	double buildtime = 0;
+
+private:
+	struct LinkEntry
+	{
+		const void *targ;
+		unsigned light;
+	};
+
+	bool valid = false;
+	unsigned generation = 0;
+	FVector3 origin;
+	FVector3 invCellSize;
+	TArray<HWClusterLight> Lights;
+	TArray<unsigned> CellStart;
+	TArray<unsigned> CellLights;
+	TArray<LinkEntry> Links;
+
+	static unsigned HashLink(const void *targ, unsigned light)
+	{
+		uint64_t h = (uint64_t(uintptr_t(targ)) >> 3) * 0x9E3779B97F4A7C15ull;
+		return unsigned(h >> 32) ^ (light * 0x85EBCA6Bu);
+	}
+
+	void AddLink(const void *targ, unsigned light);
+	bool IsLinked(const void *targ, unsigned light) const;
+	bool CellRange(const FVector3 &mins, const FVector3 &maxs, int *lo, int *hi) const;
+};
+
+extern HWLightClusters LightClusters;
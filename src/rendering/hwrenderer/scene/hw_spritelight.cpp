@@ -36,6 +36,7 @@
 #include "hw_shadowmap.h"
 #include "hwrenderer/scene/hw_drawinfo.h"
 #include "hwrenderer/scene/hw_drawstructs.h"
+#include "hwrenderer/scene/hw_lightclusters.h"
 #include "models.h"
 #include <cmath>	// needed for std::floor on mac
 
@@ -103,95 +104,120 @@ LightProbe* FindLightProbe(FLevelLocals* level, float x, float y, float z)
 
 //==========================================================================
 //
-// Sets a single light value from all dynamic lights affecting the specified location
+// Adds one dynamic light's contribution to a sprite's light value
 //
 //==========================================================================
 
-void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FLightNode *node, int portalgroup, float *out)
+static inline void AddDynSpriteLight(FLevelLocals *Level, FDynamicLight *light, float x, float y, float z, int portalgroup, float *out)
 {
-	FDynamicLight *light;
 	float frac, lr, lg, lb;
 	float radius;
-	
-	out[0] = out[1] = out[2] = 0.f;
+	float dist;
+	FVector3 L;
 
-	LightProbe* probe = FindLightProbe(Level, x, y, z);
-	if (probe)
+	// This is a performance critical section of code where we cannot afford to let the compiler decide whether to inline the function or not.
+	// This will do the calculations explicitly rather than calling one of AActor's utility functions.
+	if (Level->Displacements.size > 0)
 	{
-		out[0] = probe->Red;
-		out[1] = probe->Green;
-		out[2] = probe->Blue;
+		int fromgroup = light->Sector->PortalGroup;
+		int togroup = portalgroup;
+		if (fromgroup == togroup || fromgroup == 0 || togroup == 0) goto direct;
+
+		DVector2 offset = Level->Displacements.getOffset(fromgroup, togroup);
+		L = FVector3(x - (float)(light->X() + offset.X), y - (float)(light->Y() + offset.Y), z - (float)light->Z());
+	}
+	else
+	{
+	direct:
+		L = FVector3(x - (float)light->X(), y - (float)light->Y(), z - (float)light->Z());
 	}
 
-	// Go through both light lists
-	while (node)
+	dist = (float)L.LengthSquared();
+	radius = light->GetRadius();
+
+	if (dist < radius * radius)
 	{
-		light=node->lightsource;
-		if (light->ShouldLightActor(self))
-		{
-			float dist;
-			FVector3 L;
+		dist = sqrtf(dist);	// only calculate the square root if we really need it.
 
-			// This is a performance critical section of code where we cannot afford to let the compiler decide whether to inline the function or not.
-			// This will do the calculations explicitly rather than calling one of AActor's utility functions.
-			if (Level->Displacements.size > 0)
-			{
-				int fromgroup = light->Sector->PortalGroup;
-				int togroup = portalgroup;
-				if (fromgroup == togroup || fromgroup == 0 || togroup == 0) goto direct;
+		frac = 1.0f - (dist / radius);
 
-				DVector2 offset = Level->Displacements.getOffset(fromgroup, togroup);
-				L = FVector3(x - (float)(light->X() + offset.X), y - (float)(light->Y() + offset.Y), z - (float)light->Z());
-			}
-			else
+		if (light->IsSpot())
+		{
+			L *= -1.0f / dist;
+			DAngle negPitch = -*light->pPitch;
+			DAngle Angle = light->target->Angles.Yaw;
+			double xyLen = negPitch.Cos();
+			double spotDirX = -Angle.Cos() * xyLen;
+			double spotDirY = -Angle.Sin() * xyLen;
+			double spotDirZ = -negPitch.Sin();
+			double cosDir = L.X * spotDirX + L.Y * spotDirY + L.Z * spotDirZ;
+			frac *= (float)smoothstep(light->pSpotOuterAngle->Cos(), light->pSpotInnerAngle->Cos(), cosDir);
+		}
+
+		if (frac > 0 && (!light->shadowmapped || (light->GetRadius() > 0 && screen->mShadowMap.ShadowTest(light->Pos, { x, y, z }))))
+		{
+			lr = light->GetRed() / 255.0f;
+			lg = light->GetGreen() / 255.0f;
+			lb = light->GetBlue() / 255.0f;
+			if (light->IsSubtractive())
 			{
-			direct:
-				L = FVector3(x - (float)light->X(), y - (float)light->Y(), z - (float)light->Z());
+				float bright = (float)FVector3(lr, lg, lb).Length();
+				FVector3 lightColor(lr, lg, lb);
+				lr = (bright - lr) * -1;
+				lg = (bright - lg) * -1;
+				lb = (bright - lb) * -1;
 			}
 
-			dist = (float)L.LengthSquared();
-			radius = light->GetRadius();
-
-			if (dist < radius * radius)
-			{
-				dist = sqrtf(dist);	// only calculate the square root if we really need it.
+			out[0] += lr * frac;
+			out[1] += lg * frac;
+			out[2] += lb * frac;
+		}
+	}
+}
 
-				frac = 1.0f - (dist / radius);
+//==========================================================================
+//
+// Sets a single light value from all dynamic lights affecting the specified location
+//
+//==========================================================================
 
-				if (light->IsSpot())
-				{
-					L *= -1.0f / dist;
-					DAngle negPitch = -*light->pPitch;
-					DAngle Angle = light->target->Angles.Yaw;
-					double xyLen = negPitch.Cos();
-					double spotDirX = -Angle.Cos() * xyLen;
-					double spotDirY = -Angle.Sin() * xyLen;
-					double spotDirZ = -negPitch.Sin();
-					double cosDir = L.X * spotDirX + L.Y * spotDirY + L.Z * spotDirZ;
-					frac *= (float)smoothstep(light->pSpotOuterAngle->Cos(), light->pSpotInnerAngle->Cos(), cosDir);
-				}
+void HWDrawInfo::GetDynSpriteLight(AActor *self, float x, float y, float z, FSection *section, int portalgroup, float *out)
+{
+	out[0] = out[1] = out[2] = 0.f;
 
-				if (frac > 0 && (!light->shadowmapped || (light->GetRadius() > 0 && screen->mShadowMap.ShadowTest(light->Pos, { x, y, z }))))
-				{
-					lr = light->GetRed() / 255.0f;
-					lg = light->GetGreen() / 255.0f;
-					lb = light->GetBlue() / 255.0f;
-					if (light->IsSubtractive())
-					{
-						float bright = (float)FVector3(lr, lg, lb).Length();
-						FVector3 lightColor(lr, lg, lb);
-						lr = (bright - lr) * -1;
-						lg = (bright - lg) * -1;
-						lb = (bright - lb) * -1;
-					}
+	LightProbe* probe = FindLightProbe(Level, x, y, z);
+	if (probe)
+	{
+		out[0] = probe->Red;
+		out[1] = probe->Green;
+		out[2] = probe->Blue;
+	}
 
-					out[0] += lr * frac;
-					out[1] += lg * frac;
-					out[2] += lb * frac;
-				}
+	if (LightClusters.IsValid())
+	{
+		// Only the cluster containing the sprite needs to be checked.
+		static thread_local TArray<const HWClusterLight *> spriteLights;
+		FVector3 pos(x, y, z);
+		spriteLights.Clear();
+		LightClusters.Collect(section, pos, pos, spriteLights, false);
+		for (auto cl : spriteLights)
+		{
+			if (cl->light->ShouldLightActor(self))
+			{
+				AddDynSpriteLight(Level, cl->light, x, y, z, portalgroup, out);
 			}
 		}
-		node = node->nextLight;
+		return;
+	}
+
+	// Go through both light lists
+	for (FLightNode *node = section->lighthead; node; node = node->nextLight)
+	{
+		FDynamicLight *light = node->lightsource;
+		if (light->ShouldLightActor(self))
+		{
+			AddDynSpriteLight(Level, light, x, y, z, portalgroup, out);
+		}
 	}
 }
 
@@ -199,11 +225,11 @@ void HWDrawInfo::GetDynSpriteLight(AActor *thing, HWSprite *particleSprite, floa
 {
 	if (thing != NULL)
 	{
-		GetDynSpriteLight(thing, (float)thing->X(), (float)thing->Y(), (float)thing->Center(), thing->section->lighthead, thing->Sector->PortalGroup, out);
+		GetDynSpriteLight(thing, (float)thing->X(), (float)thing->Y(), (float)thing->Center(), thing->section, thing->Sector->PortalGroup, out);
 	}
 	else if (particleSprite != NULL)
 	{
-		GetDynSpriteLight(NULL, particleSprite->x, particleSprite->y, particleSprite->z, particleSprite->particlesubsector->section->lighthead, particleSprite->particlesubsector->sector->PortalGroup, out);
+		GetDynSpriteLight(NULL, particleSprite->x, particleSprite->y, particleSprite->z, particleSprite->particlesubsector->section, particleSprite->particlesubsector->sector->PortalGroup, out);
 	}
 }
 
@@ -559,6 +559,18 @@ bool HWSprite::CalculateVertices(HWDrawInfo* di, FVector3* v, DVector3* vp)
 	return false;
 }
 
+//==========================================================================
+//
+// The extra render workers count into their own slot, see MergeWorkerLists
+//
+//==========================================================================
+
+void HWDrawInfo::CountSprite()
+{
+	if (RenderWorkerLane > 0) workersprites[RenderWorkerLane - 1]++;
+	else rendered_sprites++;
+}
+
 //==========================================================================
 //
 // 
@@ -1501,7 +1513,7 @@ void HWSprite::Process(HWDrawInfo *di, AActor* thing, sector_t * sector, area_t
 		lightlist = nullptr;
 	}
 	PutSprite(di, hw_styleflags != STYLEHW_Solid, vp.TicFrac);
-	rendered_sprites++;
+	di->CountSprite();
 }
 
 
@@ -1690,7 +1702,7 @@ void HWSprite::ProcessParticle(HWDrawInfo *di, particle_t *particle, sector_t *s
 		lightlist = nullptr;
 
 	PutSprite(di, hw_styleflags != STYLEHW_Solid, vp.TicFrac);
-	rendered_sprites++;
+	di->CountSprite();
 }
 
 void HWSprite::ProcessDefinedParticle(HWDrawInfo* di, particledata_t* particle, sector_t* sector)
@@ -1938,7 +1950,7 @@ void HWSprite::ProcessDefinedParticle(HWDrawInfo* di, particledata_t* particle,
 		lightlist = nullptr;
 
 	PutSprite(di, hw_styleflags != STYLEHW_Solid, vp.TicFrac);
-	rendered_sprites++;
+	di->CountSprite();
 }
 
 // [MC] VisualThinkers are to be rendered akin to actor sprites. The reason this whole system
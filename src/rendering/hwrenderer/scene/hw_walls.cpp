@@ -40,6 +40,7 @@
 #include "hwrenderer/scene/hw_drawinfo.h"
 #include "hwrenderer/scene/hw_drawstructs.h"
 #include "hwrenderer/scene/hw_portal.h"
+#include "hwrenderer/scene/hw_lightclusters.h"
 #include "hw_lightbuffer.h"
 #include "hw_renderstate.h"
 #include "hw_skydome.h"
@@ -380,6 +381,53 @@ void HWWall::DrawWall(HWWallDispatcher*di, FRenderState &state, bool translucent
 	}
 }
 
+//==========================================================================
+//
+// Quick check whether a light touches the wall polygon
+//
+//==========================================================================
+
+static bool LightTouchesWall(Plane &p, float *vtx, float x, float y, float z, float radius)
+{
+	float dist = fabsf(p.DistToPoint(x, z, y));
+	float scale = 1.0f / ((2.f * radius) - dist);
+	FVector3 fn, pos;
+
+	if (radius > 0.f && dist < radius)
+	{
+		FVector3 nearPt, up, right;
+
+		pos = { x, z, y };
+		fn = p.Normal();
+
+		fn.GetRightUp(right, up);
+
+		FVector3 tmpVec = fn * dist;
+		nearPt = pos + tmpVec;
+
+		FVector3 t1;
+		int outcnt[4]={0,0,0,0};
+		texcoord tcs[4];
+
+		// do a quick check whether the light touches this polygon
+		for(int i=0;i<4;i++)
+		{
+			t1 = FVector3(&vtx[i*3]);
+			FVector3 nearToVert = t1 - nearPt;
+			tcs[i].u = ((nearToVert | right) * scale) + 0.5f;
+			tcs[i].v = ((nearToVert | up) * scale) + 0.5f;
+
+			if (tcs[i].u<0) outcnt[0]++;
+			if (tcs[i].u>1) outcnt[1]++;
+			if (tcs[i].v<0) outcnt[2]++;
+			if (tcs[i].v>1) outcnt[3]++;
+
+		}
+		return outcnt[0]!=4 && outcnt[1]!=4 && outcnt[2]!=4 && outcnt[3]!=4;
+	}
+	return false;
+}
+
 //==========================================================================
 //
 // Collect lights for shader
@@ -409,20 +457,52 @@ void HWWall::SetupLights(HWDrawInfo*di, FDynLightData &lightdata)
 	p.Set(normal, -normal.X * glseg.x1 - normal.Z * glseg.y1);
 
 	FLightNode *node;
+	void *targ;
 	if (seg->sidedef == NULL)
 	{
 		node = NULL;
+		targ = NULL;
 	}
 	else if (!(seg->sidedef->Flags & WALLF_POLYOBJ))
 	{
 		node = seg->sidedef->lighthead;
+		targ = seg->sidedef;
 	}
 	else if (sub)
 	{
 		// Polobject segs cannot be checked per sidedef so use the subsector instead.
 		node = sub->section->lighthead;
+		targ = sub->section;
+	}
+	else
+	{
+		node = NULL;
+		targ = NULL;
+	}
+
+	if (LightClusters.IsValid())
+	{
+		// Only look at the lights in the clusters the wall touches.
+		static thread_local TArray<const HWClusterLight *> wallLights;
+		wallLights.Clear();
+		if (node != NULL)
+		{
+			FVector3 mins(min(glseg.x1, glseg.x2), min(glseg.y1, glseg.y2), min(zbottom[0], zbottom[1]));
+			FVector3 maxs(max(glseg.x1, glseg.x2), max(glseg.y1, glseg.y2), max(ztop[0], ztop[1]));
+			LightClusters.Collect(targ, mins, maxs, wallLights, true);
+		}
+		for (auto cl : wallLights)
+		{
+			iter_dlight++;
+			if (LightTouchesWall(p, vtx, cl->pos.X, cl->pos.Y, cl->pos.Z, cl->radius) && !p.PointOnSide(cl->pos.X, cl->pos.Z, cl->pos.Y))
+			{
+				LightClusters.AddToList(lightdata, *cl);
+				draw_dlight++;
+			}
+		}
+		dynlightindex = screen->mLights->UploadLights(lightdata);
+		return;
 	}
-	else node = NULL;
 
 	// Iterate through all dynamic lights which touch this wall and render them
 	while (node)
@@ -432,48 +512,9 @@ void HWWall::SetupLights(HWDrawInfo*di, FDynLightData &lightdata)
 			iter_dlight++;
 
 			DVector3 posrel = node->lightsource->PosRelative(seg->frontsector->PortalGroup);
-			float x = posrel.X;
-			float y = posrel.Y;
-			float z = posrel.Z;
-			float dist = fabsf(p.DistToPoint(x, z, y));
-			float radius = node->lightsource->GetRadius();
-			float scale = 1.0f / ((2.f * radius) - dist);
-			FVector3 fn, pos;
-
-			if (radius > 0.f && dist < radius)
+			if (LightTouchesWall(p, vtx, posrel.X, posrel.Y, posrel.Z, node->lightsource->GetRadius()))
 			{
-				FVector3 nearPt, up, right;
-
-				pos = { x, z, y };
-				fn = p.Normal();
-
-				fn.GetRightUp(right, up);
-
-				FVector3 tmpVec = fn * dist;
-				nearPt = pos + tmpVec;
-
-				FVector3 t1;
-				int outcnt[4]={0,0,0,0};
-				texcoord tcs[4];
-
-				// do a quick check whether the light touches this polygon
-				for(int i=0;i<4;i++)
-				{
-					t1 = FVector3(&vtx[i*3]);
-					FVector3 nearToVert = t1 - nearPt;
-					tcs[i].u = ((nearToVert | right) * scale) + 0.5f;
-					tcs[i].v = ((nearToVert | up) * scale) + 0.5f;
-
-					if (tcs[i].u<0) outcnt[0]++;
-					if (tcs[i].u>1) outcnt[1]++;
-					if (tcs[i].v<0) outcnt[2]++;
-					if (tcs[i].v>1) outcnt[3]++;
-
-				}
-				if (outcnt[0]!=4 && outcnt[1]!=4 && outcnt[2]!=4 && outcnt[3]!=4) 
-				{
-					draw_dlight += GetLight(lightdata, seg->frontsector->PortalGroup, p, node->lightsource, true, di->Viewpoint.TicFrac);
-				}
+				draw_dlight += GetLight(lightdata, seg->frontsector->PortalGroup, p, node->lightsource, true, di->Viewpoint.TicFrac);
 			}
 		}
 		node = node->nextLight;
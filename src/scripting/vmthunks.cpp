@@ -1809,13 +1809,14 @@ DEFINE_ACTION_FUNCTION_NATIVE(_Secplane, isEqual, isPlaneEqual)
 static void ChangeHeight(secplane_t *self, double hdiff)
 {
 	self->ChangeHeight(hdiff);
+	P_InvalidateSightCache();
 }
 
 DEFINE_ACTION_FUNCTION_NATIVE(_Secplane, ChangeHeight, ChangeHeight)
 {
 	PARAM_SELF_STRUCT_PROLOGUE(secplane_t);
 	PARAM_FLOAT(hdiff);
-	self->ChangeHeight(hdiff);
+	ChangeHeight(self, hdiff);
 	return 0;
 }
 
@@ -1507,6 +1507,13 @@ DEFINE_ACTION_FUNCTION_NATIVE(AActor, SoundAlert, P_NoiseAlert)
 	return 0;
 }
 
+DEFINE_ACTION_FUNCTION_NATIVE(AActor, WakeSleepers, P_WakeSleepers)
+{
+	PARAM_SELF_PROLOGUE(AActor);
+	PARAM_FLOAT(radius);
+	ACTION_RETURN_INT(P_WakeSleepers(self, radius));
+}
+
 DEFINE_ACTION_FUNCTION_NATIVE(AActor, HitFriend, P_HitFriend)
 {
 	PARAM_SELF_PROLOGUE(AActor);
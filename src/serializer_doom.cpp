@@ -127,7 +127,7 @@ FSerializer &SerializeArgs(FSerializer& arc, const char *key, int *args, int *de
 					}
 					else if (i == 0 && aval.IsString())
 					{
-						args[i] = -FName(UnicodeToString(aval.GetString())).GetIndex();
+						args[i] = -FName(arc.r->GetString(aval)).GetIndex();
 					}
 					else
 					{
@@ -190,7 +190,7 @@ FSerializer &FDoomSerializer::Sprite(const char *key, int32_t &spritenum, int32_
 		{
 			if (val->IsString())
 			{
-				uint32_t name = *reinterpret_cast<const uint32_t*>(UnicodeToString(val->GetString()));
+				uint32_t name = *reinterpret_cast<const uint32_t*>(r->GetString(*val));
 				for (auto hint = NumStdSprites; hint-- != 0; )
 				{
 					if (sprites[hint].dwName == name)
@@ -298,7 +298,7 @@ template<> FSerializer &Serialize(FSerializer &arc, const char *key, PClassActor
 			assert(val->IsString() || val->IsNull());
 			if (val->IsString())
 			{
-				clst = PClass::FindActor(UnicodeToString(val->GetString()));
+				clst = PClass::FindActor(arc.r->GetString(*val));
 			}
 			else if (val->IsNull())
 			{
@@ -380,7 +380,7 @@ FSerializer &Serialize(FSerializer &arc, const char *key, FState *&state, FState
 				assert(cls.IsString() && ndx.IsUint());
 				if (cls.IsString() && ndx.IsUint())
 				{
-					auto str = UnicodeToString(cls.GetString());
+					auto str = arc.r->GetString(cls);
 					PClassActor *clas = PClass::FindActor(str);
 					if (clas && ndx.GetUint() < (unsigned)clas->GetStateCount())
 					{
@@ -510,7 +510,7 @@ template<> FSerializer &Serialize(FSerializer &arc, const char *key, FString *&p
 			}
 			else if (val->IsString())
 			{
-				pstr = AActor::mStringPropertyData.Alloc(UnicodeToString(val->GetString()));
+				pstr = AActor::mStringPropertyData.Alloc(arc.r->GetString(*val));
 			}
 			else
 			{
@@ -559,7 +559,7 @@ template<> FSerializer &Serialize(FSerializer &arc, const char *key, char *&pstr
 			}
 			else if (val->IsString())
 			{
-				pstr = copystring(UnicodeToString(val->GetString()));
+				pstr = copystring(arc.r->GetString(*val));
 			}
 			else
 			{